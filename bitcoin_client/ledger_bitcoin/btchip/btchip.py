@@ -57,6 +57,15 @@ class btchip:
 	BTCHIP_INS_COMPOSE_MOFN_ADDRESS = 0xc6
 	BTCHIP_INS_GET_POS_SEED = 0xca
 
+	GET_TRUSTED_INPUT_P2_SINGLE = 0x00
+	GET_TRUSTED_INPUT_P2_MULTIPLE = 0x01
+	MAX_TRUSTED_INPUT_TARGETS = 4
+	TRUSTED_INPUT_TOTAL_SIZE = 56
+
+	SW_INCORRECT_P1_P2 = 0x6b00
+
+	INPUT_FLAG_SESSION = 0x03
+
 	BTCHIP_INS_EXT_GET_HALF_PUBLIC_KEY = 0x20
 	BTCHIP_INS_EXT_CACHE_PUT_PUBLIC_KEY = 0x22
 	BTCHIP_INS_EXT_CACHE_HAS_PUBLIC_KEY = 0x24
@@ -79,6 +88,8 @@ class btchip:
 	def __init__(self, dongle):
 		self.dongle = dongle
 		self.needKeyCache = False
+		self.multipleTrustedInputsSupported = True
+		self.sessionInputsSupported = True
 		try:
 			firmware = self.getFirmwareVersion()['version']
 			self.multiOutputSupported = tuple(map(int, (firmware.split(".")))) >= (1, 1, 4)
@@ -107,9 +118,48 @@ class btchip:
 
 	def getTrustedInput(self, transaction, index):
 		result = {}
+		response = self._streamTrustedInputTransaction(transaction, self.GET_TRUSTED_INPUT_P2_SINGLE, bytearray.fromhex("%.8x" % (index)))
+		result['trustedInput'] = True
+		result['value'] = response
+		return result
+
+	def getTrustedInputs(self, requests):
+		"""
+		Returns the trusted inputs for a list of (transaction, index) pairs, in the same order. Each distinct
+		previous transaction is streamed once for up to MAX_TRUSTED_INPUT_TARGETS of its outputs, rather than
+		once per output; apps that do not support it get one request per output.
+		"""
+		trustedInputs = {}
+		indexesByTransaction = {}
+		for transaction, index in requests:
+			key = bytes(transaction.serialize())
+			indexesByTransaction.setdefault(key, (transaction, set()))[1].add(index)
+		for key, (transaction, indexes) in indexesByTransaction.items():
+			indexes = sorted(indexes)
+			for offset in range(0, len(indexes), self.MAX_TRUSTED_INPUT_TARGETS):
+				chunk = indexes[offset : offset + self.MAX_TRUSTED_INPUT_TARGETS]
+				for index, value in zip(chunk, self._getTrustedInputsForOutputs(transaction, chunk)):
+					trustedInputs[(key, index)] = { 'trustedInput': True, 'value': value }
+		return [ dict(trustedInputs[(bytes(transaction.serialize()), index)]) for transaction, index in requests ]
+
+	def _getTrustedInputsForOutputs(self, transaction, indexes):
+		if self.multipleTrustedInputsSupported:
+			params = bytearray([ len(indexes) ])
+			for index in indexes:
+				params.extend(bytearray.fromhex("%.8x" % (index)))
+			try:
+				response = self._streamTrustedInputTransaction(transaction, self.GET_TRUSTED_INPUT_P2_MULTIPLE, params)
+				return [ response[i * self.TRUSTED_INPUT_TOTAL_SIZE : (i + 1) * self.TRUSTED_INPUT_TOTAL_SIZE] for i in range(len(indexes)) ]
+			except Exception as e:
+				if getattr(e, 'sw', None) != self.SW_INCORRECT_P1_P2:
+					raise
+				self.multipleTrustedInputsSupported = False
+		return [ self.getTrustedInput(transaction, index)['value'] for index in indexes ]
+
+	def _streamTrustedInputTransaction(self, transaction, p2, header):
 		# Header
-		apdu = [ self.BTCHIP_CLA, self.BTCHIP_INS_GET_TRUSTED_INPUT, 0x00, 0x00 ]
-		params = bytearray.fromhex("%.8x" % (index))
+		apdu = [ self.BTCHIP_CLA, self.BTCHIP_INS_GET_TRUSTED_INPUT, 0x00, p2 ]
+		params = bytearray(header)
 		params.extend(transaction.version)
 		writeVarint(len(transaction.inputs), params)
 		apdu.append(len(params))
@@ -117,7 +167,7 @@ class btchip:
 		self.dongle.exchange(bytearray(apdu))
 		# Each input
 		for trinput in transaction.inputs:
-			apdu = [ self.BTCHIP_CLA, self.BTCHIP_INS_GET_TRUSTED_INPUT, 0x80, 0x00 ]
+			apdu = [ self.BTCHIP_CLA, self.BTCHIP_INS_GET_TRUSTED_INPUT, 0x80, p2 ]
 			params = bytearray(trinput.prevOut)
 			writeVarint(len(trinput.script), params)
 			apdu.append(len(params))
@@ -133,14 +183,14 @@ class btchip:
 				params = bytearray(trinput.script[offset : offset + dataLength])
 				if ((offset + dataLength) == len(trinput.script)):
 					params.extend(trinput.sequence)
-				apdu = [ self.BTCHIP_CLA, self.BTCHIP_INS_GET_TRUSTED_INPUT, 0x80, 0x00, len(params) ]
+				apdu = [ self.BTCHIP_CLA, self.BTCHIP_INS_GET_TRUSTED_INPUT, 0x80, p2, len(params) ]
 				apdu.extend(params)
 				self.dongle.exchange(bytearray(apdu))
 				offset += dataLength
 				if (offset >= len(trinput.script)):
 					break
 		# Number of outputs
-		apdu = [ self.BTCHIP_CLA, self.BTCHIP_INS_GET_TRUSTED_INPUT, 0x80, 0x00 ]
+		apdu = [ self.BTCHIP_CLA, self.BTCHIP_INS_GET_TRUSTED_INPUT, 0x80, p2 ]
 		params = []
 		writeVarint(len(transaction.outputs), params)
 		apdu.append(len(params))
@@ -149,7 +199,7 @@ class btchip:
 		# Each output
 		indexOutput = 0
 		for troutput in transaction.outputs:
-			apdu = [ self.BTCHIP_CLA, self.BTCHIP_INS_GET_TRUSTED_INPUT, 0x80, 0x00 ]
+			apdu = [ self.BTCHIP_CLA, self.BTCHIP_INS_GET_TRUSTED_INPUT, 0x80, p2 ]
 			params = bytearray(troutput.amount)
 			writeVarint(len(troutput.script), params)
 			apdu.append(len(params))
@@ -162,17 +212,14 @@ class btchip:
 					dataLength = blockLength
 				else:
 					dataLength = len(troutput.script) - offset
-				apdu = [ self.BTCHIP_CLA, self.BTCHIP_INS_GET_TRUSTED_INPUT, 0x80, 0x00, dataLength ]
+				apdu = [ self.BTCHIP_CLA, self.BTCHIP_INS_GET_TRUSTED_INPUT, 0x80, p2, dataLength ]
 				apdu.extend(troutput.script[offset : offset + dataLength])
 				self.dongle.exchange(bytearray(apdu))
 				offset += dataLength
 		# Locktime
-		apdu = [ self.BTCHIP_CLA, self.BTCHIP_INS_GET_TRUSTED_INPUT, 0x80, 0x00, len(transaction.lockTime) ]
+		apdu = [ self.BTCHIP_CLA, self.BTCHIP_INS_GET_TRUSTED_INPUT, 0x80, p2, len(transaction.lockTime) ]
 		apdu.extend(transaction.lockTime)
-		response = self.dongle.exchange(bytearray(apdu))
-		result['trustedInput'] = True
-		result['value'] = response
-		return result
+		return self.dongle.exchange(bytearray(apdu))
 
 	def startUntrustedTransaction(self, newTransaction, inputIndex, outputList, redeemScript, version=0x01, cashAddr=False, continueSegwit=False):
 		# Start building a fake transaction with the passed inputs
@@ -197,15 +244,34 @@ class btchip:
 		self.dongle.exchange(bytearray(apdu))
 		# Loop for each input
 		currentIndex = 0
+		packedInputs = bytearray()
 		for passedOutput in outputList:
 			if ('sequence' in passedOutput) and passedOutput['sequence']:
 				sequence = bytearray(unhexlify(passedOutput['sequence']))
 			else:
 				sequence = bytearray([0xFF, 0xFF, 0xFF, 0xFF]) # default sequence
+			sessionInput = ('sessionInput' in passedOutput) and passedOutput['sessionInput']
+			if sessionInput and currentIndex != inputIndex:
+				# Session inputs without a script are packed in as few APDUs as possible
+				params = bytearray([ self.INPUT_FLAG_SESSION ])
+				params.extend(passedOutput['value'])
+				writeVarint(0, params)
+				params.extend(sequence)
+				if len(packedInputs) + len(params) > 255:
+					self._sendPackedInputs(packedInputs)
+					packedInputs = bytearray()
+				packedInputs.extend(params)
+				currentIndex += 1
+				continue
+			if len(packedInputs) > 0:
+				self._sendPackedInputs(packedInputs)
+				packedInputs = bytearray()
 			apdu = [ self.BTCHIP_CLA, self.BTCHIP_INS_HASH_INPUT_START, 0x80, 0x00 ]
 			params = []
 			script = bytearray(redeemScript)
-			if ('trustedInput' in passedOutput) and passedOutput['trustedInput']:
+			if sessionInput:
+				params.append(self.INPUT_FLAG_SESSION)
+			elif ('trustedInput' in passedOutput) and passedOutput['trustedInput']:
 				params.append(0x01)
 			elif ('witness' in passedOutput) and passedOutput['witness']:
 				params.append(0x02)
@@ -239,6 +305,13 @@ class btchip:
 				apdu.extend(sequence)
 				self.dongle.exchange(bytearray(apdu))				
 			currentIndex += 1
+		if len(packedInputs) > 0:
+			self._sendPackedInputs(packedInputs)
+
+	def _sendPackedInputs(self, packedInputs):
+		apdu = [ self.BTCHIP_CLA, self.BTCHIP_INS_HASH_INPUT_START, 0x80, 0x00, len(packedInputs) ]
+		apdu.extend(packedInputs)
+		self.dongle.exchange(bytearray(apdu))
 
 	def finalizeInput(self, outputAddress, amount, fees, changePath, rawTx=None):
 		alternateEncoding = False
@@ -10,8 +10,8 @@ from .client_legacy import LegacyClient
 from .exception import DeviceException
 from .merkle import get_merkleized_map_commitment
 from .wallet import Wallet, WalletType, PolicyMapWallet
-from .psbt import PSBT
-from ._serialize import deser_string
+from .psbt import PSBT, PartiallySignedInput, PartiallySignedOutput
+from ._serialize import deser_string, ser_string
 
 
 def parse_stream_to_map(f: BufferedReader) -> Mapping[bytes, bytes]:
@@ -65,6 +65,35 @@ class NewClient(Client):
 
         return response.decode()
 
+    def get_extended_pubkeys(self, paths: List[str]) -> List[str]:
+        if len(paths) < 1 or len(paths) > 255:
+            raise ValueError("Invalid number of paths")
+
+        client_intepreter = ClientCommandInterpreter()
+
+        sw, _ = self._make_request(self.builder.get_extended_pubkeys(paths), client_intepreter)
+
+        if sw != 0x9000:
+            raise DeviceException(error_code=sw, ins=BitcoinInsType.GET_EXTENDED_PUBKEYS)
+
+        # each yielded value contains one or more pubkeys, each prefixed by its length
+        pubkeys: List[str] = []
+        for res in client_intepreter.yielded:
+            res_buffer = BytesIO(res)
+            while True:
+                pubkey_len = res_buffer.read(1)
+                if len(pubkey_len) == 0:
+                    break
+                pubkey = res_buffer.read(pubkey_len[0])
+                if len(pubkey) != pubkey_len[0]:
+                    raise RuntimeError("Invalid response")
+                pubkeys.append(pubkey.decode())
+
+        if len(pubkeys) != len(paths):
+            raise RuntimeError("Invalid response")
+
+        return pubkeys
+
     def register_wallet(self, wallet: Wallet) -> Tuple[bytes, bytes]:
         if wallet.type != WalletType.POLICYMAP:
             raise ValueError("wallet type must be POLICYMAP")
@@ -121,6 +150,58 @@ class NewClient(Client):
 
         return response.decode()
 
+    def get_wallet_addresses(
+        self,
+        wallet: Wallet,
+        wallet_hmac: Optional[bytes],
+        change: int,
+        start_index: int,
+        count: int,
+    ) -> List[str]:
+
+        if wallet.type != WalletType.POLICYMAP or not isinstance(
+            wallet, PolicyMapWallet
+        ):
+            raise ValueError("wallet type must be POLICYMAP")
+
+        if change != 0 and change != 1:
+            raise ValueError("Invalid change")
+
+        if count < 1 or start_index < 0 or start_index + count > 2**32:
+            raise ValueError("Invalid range of address indexes")
+
+        client_intepreter = ClientCommandInterpreter()
+        client_intepreter.add_known_list([k.encode() for k in wallet.keys_info])
+        client_intepreter.add_known_preimage(wallet.serialize())
+
+        sw, _ = self._make_request(
+            self.builder.get_wallet_addresses(
+                wallet, wallet_hmac, change, start_index, count
+            ),
+            client_intepreter,
+        )
+
+        if sw != 0x9000:
+            raise DeviceException(error_code=sw, ins=BitcoinInsType.GET_WALLET_ADDRESSES)
+
+        # each yielded value contains one or more addresses, each prefixed by its length
+        addresses: List[str] = []
+        for res in client_intepreter.yielded:
+            res_buffer = BytesIO(res)
+            while True:
+                address_len = res_buffer.read(1)
+                if len(address_len) == 0:
+                    break
+                address = res_buffer.read(address_len[0])
+                if len(address) != address_len[0]:
+                    raise RuntimeError("Invalid response")
+                addresses.append(address.decode())
+
+        if len(addresses) != count:
+            raise RuntimeError("Invalid response")
+
+        return addresses
+
     def sign_psbt(self, psbt: PSBT, wallet: Wallet, wallet_hmac: Optional[bytes]) -> Mapping[int, bytes]:
         """Signs a PSBT using a registered wallet (or a standard wallet that does not need registration).
 
@@ -178,12 +259,27 @@ class NewClient(Client):
         for m in input_maps:
             client_intepreter.add_known_mapping(m)
 
+        # The outpoint and nSequence of all the inputs are also requested as a single preimage
+        client_intepreter.add_known_preimage(b"\x00" + b"".join(
+            m[bytes([PartiallySignedInput.PSBT_IN_PREVIOUS_TXID])]
+            + m[bytes([PartiallySignedInput.PSBT_IN_OUTPUT_INDEX])]
+            + m.get(bytes([PartiallySignedInput.PSBT_IN_SEQUENCE]), b"\xff" * 4)
+            for m in input_maps
+        ))
+
         output_maps: List[Mapping[bytes, bytes]] = []
         for _ in range(len(psbt_v2.outputs)):
             output_maps.append(parse_stream_to_map(f))
         for m in output_maps:
             client_intepreter.add_known_mapping(m)
 
+        # The network serialization of all the outputs is also requested as a single preimage
+        client_intepreter.add_known_preimage(b"\x00" + b"".join(
+            m[bytes([PartiallySignedOutput.PSBT_OUT_AMOUNT])]
+            + ser_string(m[bytes([PartiallySignedOutput.PSBT_OUT_SCRIPT])])
+            for m in output_maps
+        ))
+
         # We also add the Merkle tree of the input (resp. output) map commitments as a known tree
         input_commitments = [get_merkleized_map_commitment(m_in) for m_in in input_maps]
         output_commitments = [get_merkleized_map_commitment(m_out) for m_out in output_maps]
@@ -234,10 +330,8 @@ class NewClient(Client):
         else:
             message_bytes = message
 
-        chunks = [message_bytes[64 * i: 64 * i + 64] for i in range((len(message_bytes) + 63) // 64)]
-
         client_intepreter = ClientCommandInterpreter()
-        client_intepreter.add_known_list(chunks)
+        client_intepreter.add_known_preimage(b'\x00' + message_bytes)
 
         sw, response = self._make_request(self.builder.sign_message(message_bytes, bip32_path), client_intepreter)
 
@@ -1,4 +1,4 @@
-from typing import Tuple, Mapping, Optional, Union, Literal
+from typing import List, Tuple, Mapping, Optional, Union, Literal
 from io import BytesIO
 
 from ledgercomm import Transport
@@ -146,6 +146,26 @@ class Client:
 
         raise NotImplementedError
 
+    def get_extended_pubkeys(self, paths: List[str]) -> List[str]:
+        """Gets the serialized extended public keys for a list of BIP32 paths, without showing them on the device.
+
+        All the paths must be standard paths that can be exported without user confirmation. This is much faster than
+        calling `get_extended_pubkey` for each path, especially if consecutive paths have the same parent (like several
+        accounts for the same purpose and coin type).
+
+        Parameters
+        ----------
+        paths : List[str]
+            The BIP32 paths of the public keys you want.
+
+        Returns
+        -------
+        List[str]
+            The requested serialized extended public keys, in the same order as `paths`.
+        """
+
+        raise NotImplementedError
+
     def register_wallet(self, wallet: Wallet) -> Tuple[bytes, bytes]:
         """Registers a wallet policy with the user. After approval returns the wallet id and hmac to be stored on the client.
 
@@ -199,6 +219,45 @@ class Client:
 
         raise NotImplementedError
 
+    def get_wallet_addresses(
+        self,
+        wallet: Wallet,
+        wallet_hmac: Optional[bytes],
+        change: int,
+        start_index: int,
+        count: int,
+    ) -> List[str]:
+        """For a given wallet that was already registered on the device (or a standard wallet that does not need registration),
+        returns the addresses for `count` consecutive address indexes, starting from `start_index`.
+
+        The addresses are not shown on the device. This is much faster than calling `get_wallet_address` for each
+        address index.
+
+        Parameters
+        ----------
+        wallet : Wallet
+            The registered wallet policy, or a standard wallet policy.
+
+        wallet_hmac: Optional[bytes]
+            For a registered wallet, the hmac obtained at wallet registration. `None` for a standard wallet policy.
+
+        change: int
+            0 for standard receive addresses, 1 for change addresses. Other values are invalid.
+
+        start_index: int
+            The address index of the first address.
+
+        count: int
+            The number of addresses, at least 1.
+
+        Returns
+        -------
+        List[str]
+            The requested addresses, in order.
+        """
+
+        raise NotImplementedError
+
     def sign_psbt(self, psbt: PSBT, wallet: Wallet, wallet_hmac: Optional[bytes]) -> Mapping[int, bytes]:
         """Signs a PSBT using a registered wallet (or a standard wallet that does not need registration).
 
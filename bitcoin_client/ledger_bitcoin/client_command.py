@@ -1,6 +1,5 @@
 from enum import IntEnum
-from typing import List, Mapping
-from collections import deque
+from typing import Iterable, List, Mapping, Optional
 from hashlib import sha256
 
 from .common import ByteStreamParser, sha256, write_varint
@@ -12,9 +11,85 @@ class ClientCommandCode(IntEnum):
     GET_PREIMAGE = 0x40
     GET_MERKLE_LEAF_PROOF = 0x41
     GET_MERKLE_LEAF_INDEX = 0x42
+    GET_MERKLE_TREE_LEAVES = 0x43
+    GET_MERKLE_LEAF_ELEMENT = 0x44
+    STORE_RECORD = 0x50
+    GET_RECORD = 0x51
     GET_MORE_ELEMENTS = 0xA0
 
 
+# Maximum total length of the elements returned in a single response to GET_MORE_ELEMENTS: the 255
+# bytes of the APDU data, minus 1 byte for the number of elements and 1 byte for their length.
+GET_MORE_ELEMENTS_MAX_PAYLOAD = 253
+
+
+class ElementsQueue:
+    """Queue of byte strings of the same length, returned to the hardware wallet in successive
+    GET_MORE_ELEMENTS commands.
+
+    The elements are stored contiguously in a single buffer, so that the continuation of a long
+    preimage (a sequence of 1-byte elements) is enqueued and returned in chunks of
+    GET_MORE_ELEMENTS_MAX_PAYLOAD bytes, rather than one byte at a time.
+    """
+
+    def __init__(self):
+        self.element_len = 0
+        self.data = bytearray()
+        self.offset = 0  # position of the first element in self.data
+
+    def __len__(self) -> int:
+        if self.element_len == 0:
+            return 0
+        return (len(self.data) - self.offset) // self.element_len
+
+    def extend_bytes(self, data: bytes, element_len: int) -> None:
+        """Enqueues the concatenation of elements of length element_len."""
+
+        if element_len == 0 or len(data) % element_len != 0:
+            raise ValueError("Invalid element length.")
+
+        if len(self) > 0 and element_len != self.element_len:
+            raise ValueError(
+                "The queue contains elements of different byte length, which is not expected."
+            )
+
+        self.element_len = element_len
+        self.data.extend(data)
+
+    def extend(self, elements: Iterable[bytes]) -> None:
+        for el in elements:
+            self.extend_bytes(el, len(el))
+
+    def pop_bytes(self, max_len: int) -> bytes:
+        """Removes and returns as many elements as fit in max_len bytes, concatenated."""
+
+        n_bytes = min(max_len // self.element_len, len(self)) * self.element_len
+        result = bytes(self.data[self.offset:self.offset + n_bytes])
+        self.offset += n_bytes
+
+        if self.offset == len(self.data):
+            self.data = bytearray()
+            self.offset = 0
+            self.element_len = 0
+
+        return result
+
+
+def get_requested_proof(mt: MerkleTree, leaf_index: int, proof_len: Optional[int]) -> List[bytes]:
+    """Returns the Merkle proof for a leaf, starting from the sibling of the leaf.
+
+    If the hardware wallet already verified a node on the path from the root to the leaf, it only
+    requests the first proof_len hashes of the proof, up to that node.
+    """
+    proof = mt.prove_leaf(leaf_index)
+    if proof_len is None:
+        return proof
+
+    if proof_len > len(proof):
+        raise ValueError("Invalid proof length.")
+    return proof[:proof_len]
+
+
 class ClientCommand:
     def execute(self, request: bytes) -> bytes:
         raise NotImplementedError("Subclasses should implement this method.")
@@ -38,7 +113,7 @@ class YieldCommand(ClientCommand):
 
 
 class GetPreimageCommand(ClientCommand):
-    def __init__(self, known_preimages: Mapping[bytes, bytes], queue: "deque[bytes]"):
+    def __init__(self, known_preimages: Mapping[bytes, bytes], queue: ElementsQueue):
         self.queue = queue
         self.known_preimages = known_preimages
 
@@ -68,13 +143,8 @@ class GetPreimageCommand(ClientCommand):
             payload_size = min(max_payload_size, len(known_preimage))
 
             if payload_size < len(known_preimage):
-                # split into list of length-1 bytes elements
-                extra_elements = [
-                    known_preimage[i: i + 1]
-                    for i in range(payload_size, len(known_preimage))
-                ]
-                # add to the queue any remaining extra bytes
-                self.queue.extend(extra_elements)
+                # add to the queue any remaining extra bytes, as length-1 elements
+                self.queue.extend_bytes(known_preimage[payload_size:], 1)
 
             return (
                 preimage_len_out
@@ -87,7 +157,7 @@ class GetPreimageCommand(ClientCommand):
 
 
 class GetMerkleLeafProofCommand(ClientCommand):
-    def __init__(self, known_trees: Mapping[bytes, MerkleTree], queue: "deque[bytes]"):
+    def __init__(self, known_trees: Mapping[bytes, MerkleTree], queue: ElementsQueue):
         self.queue = queue
         self.known_trees = known_trees
 
@@ -101,6 +171,7 @@ class GetMerkleLeafProofCommand(ClientCommand):
         root = req.read_bytes(32)
         tree_size = req.read_varint()
         leaf_index = req.read_varint()
+        proof_len = None if req.is_empty() else req.read_uint(1)
         req.assert_empty()
 
         if not root in self.known_trees:
@@ -116,7 +187,7 @@ class GetMerkleLeafProofCommand(ClientCommand):
                 "This command should not execute when the queue is not empty."
             )
 
-        proof = mt.prove_leaf(leaf_index)
+        proof = get_requested_proof(mt, leaf_index, proof_len)
 
         # Compute how many elements we can fit in 255 - 32 - 1 - 1 = 221 bytes
         n_response_elements = min((255 - 32 - 1 - 1) // 32, len(proof))
@@ -164,8 +235,175 @@ class GetMerkleLeafIndexCommand(ClientCommand):
         return found.to_bytes(1, byteorder="big") + write_varint(leaf_index)
 
 
+class GetMerkleTreeLeavesCommand(ClientCommand):
+    def __init__(self, known_preimages: Mapping[bytes, bytes], known_trees: Mapping[bytes, MerkleTree]):
+        self.known_preimages = known_preimages
+        self.known_trees = known_trees
+
+    @property
+    def code(self) -> int:
+        return ClientCommandCode.GET_MERKLE_TREE_LEAVES
+
+    def execute(self, request: bytes) -> bytes:
+        req = ByteStreamParser(request[1:])
+
+        root = req.read_bytes(32)
+        tree_size = req.read_varint()
+        start_index = req.read_varint()
+        req.assert_empty()
+
+        if not root in self.known_trees:
+            raise ValueError(f"Unknown Merkle root: {root.hex()}.")
+
+        mt: MerkleTree = self.known_trees[root]
+
+        if start_index >= tree_size or len(mt) != tree_size:
+            raise ValueError(f"Invalid index or tree size.")
+
+        # Pack as many consecutive leaves as possible in 255 bytes, each prefixed by its length;
+        # the hardware wallet will ask for the remaining ones with a new request.
+        response_leaves = bytearray()
+        n_leaves = 0
+        for leaf_index in range(start_index, tree_size):
+            leaf_hash = mt.get(leaf_index)
+            if leaf_hash not in self.known_preimages:
+                raise RuntimeError(f"Requested unknown preimage for: {leaf_hash.hex()}")
+
+            leaf = self.known_preimages[leaf_hash][1:]  # skip the b'\0' prefix
+
+            if 1 + len(response_leaves) + 1 + len(leaf) > 255:
+                break
+
+            response_leaves.extend(len(leaf).to_bytes(1, byteorder="big"))
+            response_leaves.extend(leaf)
+            n_leaves += 1
+
+        if n_leaves == 0:
+            raise RuntimeError("The leaf is too long to fit in a single response.")
+
+        return n_leaves.to_bytes(1, byteorder="big") + bytes(response_leaves)
+
+
+class GetMerkleLeafElementCommand(ClientCommand):
+    def __init__(self, known_preimages: Mapping[bytes, bytes], known_trees: Mapping[bytes, MerkleTree],
+                 queue: ElementsQueue):
+        self.queue = queue
+        self.known_preimages = known_preimages
+        self.known_trees = known_trees
+
+    @property
+    def code(self) -> int:
+        return ClientCommandCode.GET_MERKLE_LEAF_ELEMENT
+
+    def execute(self, request: bytes) -> bytes:
+        req = ByteStreamParser(request[1:])
+
+        root = req.read_bytes(32)
+        tree_size = req.read_varint()
+        leaf_index = req.read_varint()
+        proof_len = None if req.is_empty() else req.read_uint(1)
+        req.assert_empty()
+
+        if not root in self.known_trees:
+            raise ValueError(f"Unknown Merkle root: {root.hex()}.")
+
+        mt: MerkleTree = self.known_trees[root]
+
+        if leaf_index >= tree_size or len(mt) != tree_size:
+            raise ValueError(f"Invalid index or tree size.")
+
+        if len(self.queue) != 0:
+            raise RuntimeError(
+                "This command should not execute when the queue is not empty."
+            )
+
+        leaf_hash = mt.get(leaf_index)
+        if leaf_hash not in self.known_preimages:
+            raise RuntimeError(f"Requested unknown preimage for: {leaf_hash.hex()}")
+
+        preimage = self.known_preimages[leaf_hash]
+        preimage_len_out = write_varint(len(preimage))
+
+        proof = get_requested_proof(mt, leaf_index, proof_len)
+
+        # Bytes of the preimage that fit after the leaf hash, the whole proof and the preimage length
+        max_payload_size = 255 - 32 - 1 - 1 - 32 * len(proof) - len(preimage_len_out) - 1
+
+        if max_payload_size <= 0:
+            # The proof is too long: the response is the same as for GET_MERKLE_LEAF_PROOF, and the
+            # hardware wallet will ask for the preimage with GET_PREIMAGE.
+            n_response_elements = min((255 - 32 - 1 - 1) // 32, len(proof))
+            self.queue.extend(proof[n_response_elements:])
+
+            return b"".join(
+                [
+                    leaf_hash,
+                    len(proof).to_bytes(1, byteorder="big"),
+                    n_response_elements.to_bytes(1, byteorder="big"),
+                    *proof[:n_response_elements],
+                ]
+            )
+
+        payload_size = min(max_payload_size, len(preimage))
+
+        if payload_size < len(preimage):
+            # add to the queue any remaining extra bytes, as length-1 elements
+            self.queue.extend_bytes(preimage[payload_size:], 1)
+
+        return b"".join(
+            [
+                leaf_hash,
+                len(proof).to_bytes(1, byteorder="big"),
+                len(proof).to_bytes(1, byteorder="big"),
+                *proof,
+                preimage_len_out,
+                payload_size.to_bytes(1, byteorder="big"),
+                preimage[:payload_size],
+            ]
+        )
+
+
+class StoreRecordCommand(ClientCommand):
+    def __init__(self, records: Mapping[bytes, bytes]):
+        self.records = records
+
+    @property
+    def code(self) -> int:
+        return ClientCommandCode.STORE_RECORD
+
+    def execute(self, request: bytes) -> bytes:
+        req = ByteStreamParser(request[1:])
+
+        key = req.read_bytes(32)
+        record_len = req.read_uint(1)
+        record = req.read_bytes(record_len)
+        req.assert_empty()
+
+        self.records[key] = record
+        return b""
+
+
+class GetRecordCommand(ClientCommand):
+    def __init__(self, records: Mapping[bytes, bytes]):
+        self.records = records
+
+    @property
+    def code(self) -> int:
+        return ClientCommandCode.GET_RECORD
+
+    def execute(self, request: bytes) -> bytes:
+        req = ByteStreamParser(request[1:])
+
+        key = req.read_bytes(32)
+        req.assert_empty()
+
+        # an unknown record is not an error: the hardware wallet falls back to the original data
+        record = self.records.get(key, b"")
+        return len(record).to_bytes(1, byteorder="big") + record
+
+
 class GetMoreElementsCommand(ClientCommand):
-    def __init__(self, queue: "deque[bytes]"):
+    def __init__(self, queue: ElementsQueue):
         self.queue = queue
 
     @property
@@ -179,26 +417,16 @@ class GetMoreElementsCommand(ClientCommand):
         if len(self.queue) == 0:
             raise ValueError("No elements to get.")
 
-        element_len = len(self.queue[0])
-        if any(len(el) != element_len for el in self.queue):
-            raise ValueError(
-                "The queue contains elements of different byte length, which is not expected."
-            )
+        element_len = self.queue.element_len
 
         # pop from the queue, keeping the total response length at most 255
-
-        response_elements = bytearray()
-
-        n_added_elements = 0
-        while len(self.queue) > 0 and len(response_elements) + element_len <= 253:
-            response_elements.extend(self.queue.popleft())
-            n_added_elements += 1
+        response_elements = self.queue.pop_bytes(GET_MORE_ELEMENTS_MAX_PAYLOAD)
 
         return b"".join(
             [
-                n_added_elements.to_bytes(1, byteorder="big"),
+                (len(response_elements) // element_len).to_bytes(1, byteorder="big"),
                 element_len.to_bytes(1, byteorder="big"),
-                bytes(response_elements),
+                response_elements,
             ]
         )
 
@@ -217,6 +445,9 @@ class ClientCommandInterpreter:
       in a single message). The data in the queue is returned in one (or more) successive
       GET_MORE_ELEMENTS commands from the hardware wallet.
 
+    It also stores the records that the hardware wallet sends with STORE_RECORD, and gives them back
+    with GET_RECORD; the records are authenticated by the hardware wallet, and opaque to the client.
+
     Finally, it keeps track of the yielded values (that is, the values sent from the hardware
     wallet with a YIELD client command).
 
@@ -233,13 +464,19 @@ class ClientCommandInterpreter:
 
         self.yielded: List[bytes] = []
 
-        queue = deque()
+        records: Mapping[bytes, bytes] = {}
+
+        queue = ElementsQueue()
 
         commands = [
             YieldCommand(self.yielded),
             GetPreimageCommand(self.known_preimages, queue),
             GetMerkleLeafIndexCommand(self.known_trees),
             GetMerkleLeafProofCommand(self.known_trees, queue),
+            GetMerkleTreeLeavesCommand(self.known_preimages, self.known_trees),
+            GetMerkleLeafElementCommand(self.known_preimages, self.known_trees, queue),
+            StoreRecordCommand(records),
+            GetRecordCommand(records),
             GetMoreElementsCommand(queue),
         ]
 
@@ -297,8 +534,8 @@ class ClientCommandInterpreter:
 
         If `el` is one of `elements`, the client must respond with b'\0' + `el` when a GET_PREIMAGE
         client command is sent with `sha256(b'\0' + el)`.
-        Moreover, the commands GET_MERKLE_LEAF_INDEX and GET_MERKLE_LEAF_PROOF must correctly answer
-        queries relative to the Merkle whose root is `mt_root`.
+        Moreover, the commands GET_MERKLE_LEAF_INDEX, GET_MERKLE_LEAF_PROOF and GET_MERKLE_TREE_LEAVES
+        must correctly answer queries relative to the Merkle whose root is `mt_root`.
 
         Parameters
         ----------
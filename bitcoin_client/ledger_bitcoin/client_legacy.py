@@ -194,6 +194,10 @@ class LegacyClient(Client):
 
         script_codes: List[bytes] = [b""] * len(c_tx.vin)
 
+        # Trusted inputs are requested once all the inputs are known, so that each previous transaction is only
+        # streamed once even if several of its outputs are spent
+        trusted_input_requests: List[Tuple[bitcoinTransaction, int, dict]] = []
+
         # Detect changepath, (p2sh-)p2(w)pkh only
         change_path = ''
         for txout, i_num in zip(c_tx.vout, range(len(c_tx.vout))):
@@ -249,13 +253,13 @@ class LegacyClient(Client):
                 # later
                 assert psbt_in.non_witness_utxo is not None
                 ledger_prevtx = bitcoinTransaction(psbt_in.non_witness_utxo.serialize())
-                legacy_inputs.append(self.app.getTrustedInput(ledger_prevtx, txin.prevout.n))
-                legacy_inputs[-1]["sequence"] = seq_hex
+                legacy_inputs.append({"sequence": seq_hex})
+                trusted_input_requests.append((ledger_prevtx, txin.prevout.n, legacy_inputs[-1]))
                 has_legacy = True
 
             if psbt_in.non_witness_utxo and use_trusted_segwit:
                 ledger_prevtx = bitcoinTransaction(psbt_in.non_witness_utxo.serialize())
-                segwit_inputs[-1].update(self.app.getTrustedInput(ledger_prevtx, txin.prevout.n))
+                trusted_input_requests.append((ledger_prevtx, txin.prevout.n, segwit_inputs[-1]))
 
             pubkeys = []
             signature_attempts = []
@@ -278,6 +282,10 @@ class LegacyClient(Client):
 
             all_signature_attempts[i_num] = signature_attempts
 
+        trusted_inputs = self.app.getTrustedInputs([(prevtx, n) for prevtx, n, _ in trusted_input_requests])
+        for (_, _, signing_input), trusted_input in zip(trusted_input_requests, trusted_inputs):
+            signing_input.update(trusted_input)
+
         result = {}
 
         # Sign any segwit inputs
@@ -299,11 +307,25 @@ class LegacyClient(Client):
                     result[i] = self.app.untrustedHashSign(signature_attempt[0], "", c_tx.nLockTime, 0x01)
         elif has_legacy:
             first_input = True
+            # Once the transaction is approved, the following passes send the bare prevouts rather than the trusted
+            # inputs, as the device already validated them
+            session_inputs = [{"sessionInput": True, "value": legacy_input["value"][4:40],
+                               "sequence": legacy_input["sequence"]} for legacy_input in legacy_inputs]
             # Legacy signing if all inputs are legacy
             for i in range(len(legacy_inputs)):
                 for signature_attempt in all_signature_attempts[i]:
                     assert(tx.inputs[i].non_witness_utxo is not None)
-                    self.app.startUntrustedTransaction(first_input, i, legacy_inputs, script_codes[i], c_tx.nVersion)
+                    if first_input or not self.app.sessionInputsSupported:
+                        self.app.startUntrustedTransaction(first_input, i, legacy_inputs, script_codes[i], c_tx.nVersion)
+                    else:
+                        try:
+                            self.app.startUntrustedTransaction(False, i, session_inputs, script_codes[i], c_tx.nVersion)
+                        except Exception as e:
+                            if getattr(e, "sw", None) is None:
+                                raise
+                            # older apps reject the session inputs; resend this pass with the trusted inputs
+                            self.app.sessionInputsSupported = False
+                            self.app.startUntrustedTransaction(False, i, legacy_inputs, script_codes[i], c_tx.nVersion)
                     self.app.finalizeInput(b"DUMMY", -1, -1, change_path, tx_bytes)
 
                     #tx.inputs[i].partial_sigs[signature_attempt[1]] = self.app.untrustedHashSign(signature_attempt[0], "", c_tx.nLockTime, 0x01)
@@ -6,6 +6,15 @@ from .merkle import get_merkleized_map_commitment, MerkleTree, element_hash
 from .wallet import Wallet
 
 
+# version of the protocol sent in the P2 field of the commands. Version 1 adds:
+# - the GET_MERKLE_LEAF_ELEMENT and GET_MERKLE_TREE_LEAVES client commands;
+# - the STORE_RECORD and GET_RECORD client commands;
+# - the length of the requested proof (proof_size) in GET_MERKLE_LEAF_PROOF, for truncated proofs;
+# - the preimages of the serialized inputs and outputs in SIGN_PSBT.
+# See doc/apdu.md for the details.
+CURRENT_PROTOCOL_VERSION = 1
+
+
 def chunkify(data: bytes, chunk_len: int) -> Iterator[Tuple[bool, bytes]]:
     size: int = len(data)
 
@@ -34,10 +43,17 @@ class BitcoinInsType(enum.IntEnum):
     GET_WALLET_ADDRESS = 0x03
     SIGN_PSBT = 0x04
     GET_MASTER_FINGERPRINT = 0x05
+    GET_WALLET_ADDRESSES = 0x06
+    GET_EXTENDED_PUBKEYS = 0x07
     SIGN_MESSAGE = 0x10
 
+class MessageCommitmentType(enum.IntEnum):
+    MERKLE_ROOT = 0x00
+    PREIMAGE = 0x01
+
 class FrameworkInsType(enum.IntEnum):
     CONTINUE_INTERRUPTED = 0x01
+    GET_COMMAND_STATS = 0x02
 
 
 class BitcoinCommandBuilder:
@@ -52,7 +68,7 @@ class BitcoinCommandBuilder:
         cla: int,
         ins: Union[int, enum.IntEnum],
         p1: int = 0,
-        p2: int = 0,
+        p2: int = CURRENT_PROTOCOL_VERSION,
         cdata: bytes = b"",
     ) -> dict:
         """Serialize the whole APDU command (header + data).
@@ -66,7 +82,7 @@ class BitcoinCommandBuilder:
         p1 : int
             Instruction parameter 1: P1 (1 byte).
         p2 : int
-            Instruction parameter 2: P2 (1 byte).
+            Instruction parameter 2: P2 (1 byte). The protocol version for the app commands.
         cdata : bytes
             Bytes of command data.
 
@@ -94,6 +110,19 @@ class BitcoinCommandBuilder:
             cdata=cdata,
         )
 
+    def get_extended_pubkeys(self, bip32_paths: List[str]):
+        cdata_parts: List[bytes] = [len(bip32_paths).to_bytes(1, byteorder="big")]
+        for path in bip32_paths:
+            bip32_path: List[bytes] = bip32_path_from_string(path)
+            cdata_parts.append(len(bip32_path).to_bytes(1, byteorder="big"))
+            cdata_parts.extend(bip32_path)
+
+        return self.serialize(
+            cla=self.CLA_BITCOIN,
+            ins=BitcoinInsType.GET_EXTENDED_PUBKEYS,
+            cdata=b"".join(cdata_parts),
+        )
+
     def register_wallet(self, wallet: Wallet):
         wallet_bytes = wallet.serialize()
 
@@ -127,6 +156,30 @@ class BitcoinCommandBuilder:
             cdata=cdata,
         )
 
+    def get_wallet_addresses(
+        self,
+        wallet: Wallet,
+        wallet_hmac: Optional[bytes],
+        change: bool,
+        start_index: int,
+        count: int,
+    ):
+        cdata: bytes = b"".join(
+            [
+                wallet.id,                                              # 32 bytes
+                wallet_hmac if wallet_hmac is not None else b'\0' * 32, # 32 bytes
+                b"\1" if change else b"\0",                             # 1 byte
+                start_index.to_bytes(4, byteorder="big"),               # 4 bytes
+                count.to_bytes(4, byteorder="big"),                     # 4 bytes
+            ]
+        )
+
+        return self.serialize(
+            cla=self.CLA_BITCOIN,
+            ins=BitcoinInsType.GET_WALLET_ADDRESSES,
+            cdata=cdata,
+        )
+
     def sign_psbt(
         self,
         global_mapping: Mapping[bytes, bytes],
@@ -173,16 +226,14 @@ class BitcoinCommandBuilder:
 
         bip32_path: List[bytes] = bip32_path_from_string(bip32_path)
 
-        # split message in 64-byte chunks (last chunk can be smaller)
-        n_chunks = (len(message) + 63) // 64
-        chunks = [message[64 * i: 64 * i + 64] for i in range(n_chunks)]
-
         cdata += len(bip32_path).to_bytes(1, byteorder="big")
         cdata += b''.join(bip32_path)
 
         cdata += write_varint(len(message))
 
-        cdata += MerkleTree(element_hash(c) for c in chunks).root
+        # the message is streamed with GET_PREIMAGE, rather than in 64-byte chunks of a Merkle tree
+        cdata += element_hash(message)
+        cdata += MessageCommitmentType.PREIMAGE.to_bytes(1, byteorder="big")
 
         return self.serialize(
             cla=self.CLA_BITCOIN,
@@ -202,5 +253,23 @@ class BitcoinCommandBuilder:
         return self.serialize(
             cla=self.CLA_FRAMEWORK,
             ins=FrameworkInsType.CONTINUE_INTERRUPTED,
+            p2=0,
             cdata=cdata,
         )
+
+    def get_command_stats(self):
+        """Command builder for GET_COMMAND_STATS.
+
+        Only supported if the app is compiled with HAVE_APDU_STATS.
+
+        Returns
+        -------
+        bytes
+            APDU command for GET_COMMAND_STATS.
+
+        """
+        return self.serialize(
+            cla=self.CLA_FRAMEWORK,
+            ins=FrameworkInsType.GET_COMMAND_STATS,
+            p2=0
+        )
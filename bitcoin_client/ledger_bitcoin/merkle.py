@@ -1,4 +1,4 @@
-from typing import List, Iterable, Mapping
+from typing import Dict, List, Iterable, Mapping, Set
 
 from .common import write_varint, sha256
 
@@ -63,53 +63,6 @@ def combine_hashes(left: bytes, right: bytes) -> bytes:
     return sha256(b'\x01' + left + right)
 
 
-# root is the only node with parent == None
-# leaves have left == right == None
-class Node:
-    def __init__(self, left, right, parent, value: bytes):
-        self.left = left
-        self.right = right
-        self.parent = parent
-        self.value = value
-
-    def recompute_value(self):
-        assert self.left is not None
-        assert self.right is not None
-        self.value = combine_hashes(self.left.value, self.right.value)
-
-    def sibling(self):
-        if self.parent is None:
-            raise IndexError("The root does not have a sibling.")
-
-        if self.parent.left == self:
-            return self.parent.right
-        elif self.parent.right == self:
-            return self.parent.left
-        else:
-            raise IndexError("Invalid state: not a child of his parent.")
-
-
-def make_tree(leaves: List[Node], begin: int, size: int) -> Node:
-    """Given a list of nodes, builds the left-complete Merkle tree on top of it.
-    The nodes in `leaves` are modified by setting their `parent` field appropriately.
-    It returns the root of the newly built tree.
-    """
-
-    if size == 0:
-        return []
-    if size == 1:
-        return leaves[begin]
-
-    lchild_size = largest_power_of_2_less_than(size)
-
-    lchild = make_tree(leaves, begin, lchild_size)
-    rchild = make_tree(leaves, begin + lchild_size, size - lchild_size)
-    root = Node(lchild, rchild, None, None)
-    root.recompute_value()
-    lchild.parent = rchild.parent = root
-    return root
-
-
 class MerkleTree:
     """
     Maintains a dynamic vector of values and the Merkle tree built on top of it. The elements of the vector are stored
@@ -125,30 +78,83 @@ class MerkleTree:
     - There are always n - 1 internal nodes; all the internal nodes have exactly two children.
     - If a subtree has n > 1 leaves, then the left subchild is a complete subtree with p leaves, where p is the largest
       power of 2 smaller than n.
+
+    It follows that each complete subtree with 2^k leaves starts at a multiple of 2^k. The tree is stored in flat
+    arrays: `levels[k][j]` is the value of the complete subtree with the leaves from j * 2^k to (j + 1) * 2^k - 1
+    (in particular, `levels[0]` are the leaves). The only other nodes are the O(log n) nodes on the rightmost path,
+    whose values are stored in `spine`, indexed by the position of their first leaf.
+
+    The index of each leaf is stored in a dictionary, and proofs are cached until the tree is modified.
     """
 
     def __init__(self, elements: Iterable[bytes] = []):
-        self.leaves = [Node(None, None, None, el) for el in elements]
-        n_elements = len(self.leaves)
-        if n_elements > 0:
-            self.root_node = make_tree(self.leaves, 0, n_elements)
-            self.depth = ceil_lg(n_elements)
-        else:
-            self.root_node = None
-            self.depth = None
+        self.levels: List[List[bytes]] = [[]]
+        self.spine: Dict[int, bytes] = {}
+        self.leaf_indexes: Dict[bytes, Set[int]] = {}
+        self.proofs: Dict[int, List[bytes]] = {}
+
+        for el in elements:
+            self._append_leaf(el)
+        self._recompute_spine()
 
     def __len__(self) -> int:
         """Return the total number of leaves in the tree."""
-        return len(self.leaves)
+        return len(self.levels[0])
 
     @property
     def root(self) -> bytes:
-        """Return the Merkle root, or None if the tree is empty."""
-        return NIL if self.root_node is None else self.root_node.value
+        """Return the Merkle root, or NIL if the tree is empty."""
+        return NIL if len(self) == 0 else self._subtree_value(0, len(self))
 
     def copy(self):
         """Return an identical copy of this Merkle tree."""
-        return MerkleTree([leaf.value for leaf in self.leaves])
+        return MerkleTree(self.levels[0])
+
+    def _subtree_value(self, begin: int, size: int) -> bytes:
+        """Return the value of the subtree with `size` leaves starting from the leaf with index `begin`."""
+        if is_power_of_2(size):
+            k = size.bit_length() - 1
+            return self.levels[k][begin >> k]
+        else:
+            return self.spine[begin]
+
+    def _append_leaf(self, x: bytes) -> None:
+        """Append a leaf, and compute the values of the complete subtrees that it completes; the spine is not updated."""
+        self.levels[0].append(x)
+        self.leaf_indexes.setdefault(x, set()).add(len(self) - 1)
+
+        n = len(self)
+        k = 1
+        while n % (1 << k) == 0:
+            if len(self.levels) == k:
+                self.levels.append([])
+            lower = self.levels[k - 1]
+            self.levels[k].append(combine_hashes(lower[-2], lower[-1]))
+            k += 1
+
+    def _recompute_spine(self) -> None:
+        """Recompute the values of the nodes on the rightmost path that are not complete subtrees. Cost O(log n)."""
+        n = len(self)
+        self.spine = {}
+
+        # the rightmost path splits the leaves in complete subtrees, one for each bit of n, from the largest
+        blocks = []
+        begin = 0
+        for k in reversed(range(n.bit_length())):
+            if n & (1 << k):
+                blocks.append((begin, 1 << k))
+                begin += 1 << k
+
+        value = None
+        for begin, size in reversed(blocks):
+            block_value = self._subtree_value(begin, size)
+            if value is None:
+                value = block_value
+            else:
+                value = combine_hashes(block_value, value)
+                self.spine[begin] = value
+
+        self.proofs = {}
 
     def add(self, x: bytes) -> None:
         """Add an element as new leaf, and recompute the tree accordingly. Cost O(log n)."""
@@ -156,41 +162,8 @@ class MerkleTree:
         if len(x) != 32:
             raise ValueError("Inserted elements must be exactly 32 bytes long")
 
-        new_leaf = Node(None, None, None, x)
-        self.leaves.append(new_leaf)
-        if len(self.leaves) == 1:
-            self.root_node = new_leaf
-            self.depth = 0
-            return
-
-        # add a new leaf
-        if self.depth == 0:
-            ltree_size = 0
-        else:
-            # number of leaves of the left subtree of cur_root
-            ltree_size = 1 << (self.depth - 1)
-
-        cur_root = self.root_node
-        cur_root_size = len(self.leaves) - 1
-
-        while not is_power_of_2(cur_root_size):
-            cur_root = cur_root.right
-            cur_root_size -= ltree_size
-            ltree_size /= 2
-
-        # node value will be computed later
-        new_node = Node(cur_root, new_leaf, cur_root.parent, None)
-        if cur_root.parent is None:
-            # replacing the root
-            self.depth += 1
-            self.root_node = new_node
-        else:
-            assert cur_root.parent.right == cur_root
-            cur_root.parent.right = new_node
-        cur_root.parent = new_node
-        new_leaf.parent = new_node
-
-        self.fix_up(new_node)
+        self._append_leaf(x)
+        self._recompute_spine()
 
     def set(self, index: int, x: bytes) -> None:
         """
@@ -199,52 +172,68 @@ class MerkleTree:
 
         Cost: Worst case O(log n).
         """
-        assert 0 <= index <= len(self.leaves)
+        assert 0 <= index <= len(self)
 
-        if not (0 <= index <= len(self.leaves)):
+        if not (0 <= index <= len(self)):
             raise ValueError(
                 "The index must be at least 0, and at most the current number of leaves.")
 
         if len(x) != 32:
             raise ValueError("Inserted elements must be exactly 32 bytes long.")
 
-        if index == len(self.leaves):
+        if index == len(self):
             self.add(x)
-        else:
-            self.leaves[index].value = x
-            self.fix_up(self.leaves[index].parent)
+            return
+
+        old_value = self.levels[0][index]
+        self.leaf_indexes[old_value].discard(index)
+        if len(self.leaf_indexes[old_value]) == 0:
+            del self.leaf_indexes[old_value]
+        self.leaf_indexes.setdefault(x, set()).add(index)
+
+        # recompute the complete subtrees containing the leaf
+        self.levels[0][index] = x
+        k = 1
+        j = index >> 1
+        while k < len(self.levels) and j < len(self.levels[k]):
+            lower = self.levels[k - 1]
+            self.levels[k][j] = combine_hashes(lower[2 * j], lower[2 * j + 1])
+            k += 1
+            j >>= 1
 
-    def fix_up(self, node: Node):
-        while node is not None:
-            node.recompute_value()
-            node = node.parent
+        self._recompute_spine()
 
     def get(self, i: int) -> bytes:
         """Return the value of the leaf with index `i`, where 0 <= i < len(self)."""
-        return self.leaves[i].value
+        return self.levels[0][i]
 
     def leaf_index(self, x: bytes) -> int:
         """Return the index of the leaf with hash `x`. Raises `ValueError` if not found."""
-        idx = 0
-        while idx < len(self):
-            if self.leaves[idx].value == x:
-                return idx
-            idx += 1
-        raise ValueError("Leaf not found")
+        if x not in self.leaf_indexes:
+            raise ValueError("Leaf not found")
+        return min(self.leaf_indexes[x])
 
     def prove_leaf(self, index: int) -> List[bytes]:
         """Produce the Merkle proof of membership for the leaf with the given index where 0 <= index < len(self)."""
-        node = self.leaves[index]
-        proof = []
-        while node.parent is not None:
-            sibling = node.sibling()
-            assert sibling is not None
-
-            proof.append(sibling.value)
-
-            node = node.parent
-
-        return proof
+        if not 0 <= index < len(self):
+            raise IndexError("Leaf index out of range")
+
+        if index not in self.proofs:
+            # walk down from the root, collecting the siblings; the proof lists them from the leaf up
+            proof = []
+            begin, size = 0, len(self)
+            while size > 1:
+                lchild_size = largest_power_of_2_less_than(size)
+                if index < begin + lchild_size:
+                    proof.append(self._subtree_value(begin + lchild_size, size - lchild_size))
+                    size = lchild_size
+                else:
+                    proof.append(self._subtree_value(begin, lchild_size))
+                    begin, size = begin + lchild_size, size - lchild_size
+            proof.reverse()
+            self.proofs[index] = proof
+
+        return list(self.proofs[index])
 
 
 def get_merkleized_map_commitment(mapping: Mapping[bytes, bytes]) -> bytes:
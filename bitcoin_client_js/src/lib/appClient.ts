@@ -11,15 +11,31 @@ import { createVarint } from './varint';
 const CLA_BTC = 0xe1;
 const CLA_FRAMEWORK = 0xf8;
 
+// version of the protocol sent in the P2 field of the commands. Version 1 adds:
+// - the GET_MERKLE_LEAF_ELEMENT and GET_MERKLE_TREE_LEAVES client commands;
+// - the STORE_RECORD and GET_RECORD client commands;
+// - the length of the requested proof (proof_size) in GET_MERKLE_LEAF_PROOF,
+//   for truncated proofs;
+// - the preimages of the serialized inputs and outputs in SIGN_PSBT.
+// See doc/apdu.md for the details.
+const CURRENT_PROTOCOL_VERSION = 1;
+
 enum BitcoinIns {
   GET_PUBKEY = 0x00,
   REGISTER_WALLET = 0x02,
   GET_WALLET_ADDRESS = 0x03,
   SIGN_PSBT = 0x04,
   GET_MASTER_FINGERPRINT = 0x05,
+  GET_WALLET_ADDRESSES = 0x06,
+  GET_EXTENDED_PUBKEYS = 0x07,
   SIGN_MESSAGE = 0x10,
 }
 
+enum MessageCommitmentType {
+  MERKLE_ROOT = 0x00,
+  PREIMAGE = 0x01,
+}
+
 enum FrameworkIns {
   CONTINUE_INTERRUPTED = 0x01,
 }
@@ -44,7 +60,7 @@ export class AppClient {
       CLA_BTC,
       ins,
       0,
-      0,
+      CURRENT_PROTOCOL_VERSION,
       data,
       [0x9000, 0xe000]
     );
@@ -97,6 +113,56 @@ export class AppClient {
     return response.toString('ascii');
   }
 
+  /**
+   * Requests the serialized extended pubkeys for a list of BIP32 paths, without showing them on the device.
+   * All the paths must be standard paths that can be exported without user confirmation. This is much faster than
+   * calling `getExtendedPubkey` for each path, especially if consecutive paths have the same parent.
+   *
+   * @param paths the BIP32 paths, e.g. `["m/44'/175'/0'", "m/44'/175'/1'"]`
+   * @returns the base58-encoded serialized extended pubkeys (xpubs), in the same order as `paths`
+   */
+  async getExtendedPubkeys(paths: string[]): Promise<string[]> {
+    if (paths.length < 1 || paths.length > 255) {
+      throw new Error('Invalid number of paths');
+    }
+    const pathBuffers = paths.map((path) => {
+      const pathElements = pathStringToArray(path);
+      if (pathElements.length > 6) {
+        throw new Error('Path too long. At most 6 levels allowed.');
+      }
+      return pathElementsToBuffer(pathElements);
+    });
+
+    const clientInterpreter = new ClientCommandInterpreter();
+
+    await this.makeRequest(
+      BitcoinIns.GET_EXTENDED_PUBKEYS,
+      Buffer.concat([Buffer.from([paths.length]), ...pathBuffers]),
+      clientInterpreter
+    );
+
+    // each yielded value contains one or more pubkeys, each prefixed by its length
+    const pubkeys: string[] = [];
+    for (const res of clientInterpreter.getYielded()) {
+      let offset = 0;
+      while (offset < res.length) {
+        const pubkeyLen = res[offset];
+        if (offset + 1 + pubkeyLen > res.length) {
+          throw new Error('Invalid response');
+        }
+        pubkeys.push(
+          res.toString('ascii', offset + 1, offset + 1 + pubkeyLen)
+        );
+        offset += 1 + pubkeyLen;
+      }
+    }
+
+    if (pubkeys.length !== paths.length) {
+      throw new Error('Invalid response');
+    }
+    return pubkeys;
+  }
+
   /**
    * Registers a `WalletPolicy`, after interactive verification from the user.
    * On success, after user's approval, this function returns the id (which is the same that can be computed with
@@ -186,6 +252,84 @@ export class AppClient {
     return response.toString('ascii');
   }
 
+  /**
+   * Returns the addresses of `walletPolicy` for the given `change` and `count` consecutive address
+   * indexes, starting from `startIndex`. The addresses are not shown on the device; this is much
+   * faster than calling `getWalletAddress` for each address index.
+   *
+   * @param walletPolicy the `WalletPolicy` to use
+   * @param walletHMAC the 32-byte hmac returned during wallet registration for a registered policy; otherwise
+   * `null` for a standard policy
+   * @param change `0` for normal receive addresses, `1` for change addresses
+   * @param startIndex the address index of the first address
+   * @param count the number of addresses, at least 1
+   * @returns the addresses, as ascii strings, in order.
+   */
+  async getWalletAddresses(
+    walletPolicy: WalletPolicy,
+    walletHMAC: Buffer | null,
+    change: number,
+    startIndex: number,
+    count: number
+  ): Promise<string[]> {
+    if (change !== 0 && change !== 1)
+      throw new Error('Change can only be 0 or 1');
+    if (
+      startIndex < 0 ||
+      !Number.isInteger(startIndex) ||
+      count < 1 ||
+      !Number.isInteger(count) ||
+      startIndex + count > 0x100000000
+    )
+      throw new Error('Invalid range of address indexes');
+
+    if (walletHMAC != null && walletHMAC.length != 32) {
+      throw new Error('Invalid HMAC length');
+    }
+
+    const clientInterpreter = new ClientCommandInterpreter();
+    clientInterpreter.addKnownList(
+      walletPolicy.keys.map((k) => Buffer.from(k, 'ascii'))
+    );
+    clientInterpreter.addKnownPreimage(walletPolicy.serialize());
+
+    const rangeBuffer = Buffer.alloc(8);
+    rangeBuffer.writeUInt32BE(startIndex, 0);
+    rangeBuffer.writeUInt32BE(count, 4);
+
+    await this.makeRequest(
+      BitcoinIns.GET_WALLET_ADDRESSES,
+      Buffer.concat([
+        walletPolicy.getId(),
+        walletHMAC || Buffer.alloc(32, 0),
+        Buffer.from([change]),
+        rangeBuffer,
+      ]),
+      clientInterpreter
+    );
+
+    // each yielded value contains one or more addresses, each prefixed by its length
+    const addresses: string[] = [];
+    for (const res of clientInterpreter.getYielded()) {
+      let offset = 0;
+      while (offset < res.length) {
+        const addressLen = res[offset];
+        if (offset + 1 + addressLen > res.length) {
+          throw new Error('Invalid response');
+        }
+        addresses.push(
+          res.toString('ascii', offset + 1, offset + 1 + addressLen)
+        );
+        offset += 1 + addressLen;
+      }
+    }
+
+    if (addresses.length !== count) {
+      throw new Error('Invalid response');
+    }
+    return addresses;
+  }
+
   /**
    * Signs a psbt using a (standard or registered) `WalletPolicy`. This is an interactive command, as user validation
    * is necessary using the device's secure screen.
@@ -222,10 +366,35 @@ export class AppClient {
     for (const map of merkelizedPsbt.inputMerkleMaps) {
       clientInterpreter.addKnownMapping(map);
     }
+
+    // The outpoint and nSequence of all the inputs are also requested as a single preimage
+    const serializedInputs: Buffer[] = [Buffer.from([0])];
+    for (let i = 0; i < merkelizedPsbt.getGlobalInputCount(); i++) {
+      const outpointIndexAndSequence = Buffer.alloc(8);
+      outpointIndexAndSequence.writeUInt32LE(merkelizedPsbt.getInputOutputIndex(i), 0);
+      outpointIndexAndSequence.writeUInt32LE(merkelizedPsbt.getInputSequence(i), 4);
+      serializedInputs.push(
+        merkelizedPsbt.getInputPreviousTxid(i),
+        outpointIndexAndSequence
+      );
+    }
+    clientInterpreter.addKnownPreimage(Buffer.concat(serializedInputs));
     for (const map of merkelizedPsbt.outputMerkleMaps) {
       clientInterpreter.addKnownMapping(map);
     }
 
+    // The network serialization of all the outputs is also requested as a single preimage
+    const serializedOutputs: Buffer[] = [Buffer.from([0])];
+    for (let i = 0; i < merkelizedPsbt.getGlobalOutputCount(); i++) {
+      const script = merkelizedPsbt.getOutputScript(i);
+      serializedOutputs.push(
+        merkelizedPsbt.getOutputAmountBytes(i),
+        createVarint(script.length),
+        script
+      );
+    }
+    clientInterpreter.addKnownPreimage(Buffer.concat(serializedOutputs));
+
     clientInterpreter.addKnownList(merkelizedPsbt.inputMapCommitments);
     const inputMapsRoot = new Merkle(
       merkelizedPsbt.inputMapCommitments.map((m) => hashLeaf(m))
@@ -286,22 +455,18 @@ export class AppClient {
 
     const clientInterpreter = new ClientCommandInterpreter();
 
-    // prepare ClientCommandInterpreter
-    const nChunks = Math.ceil(message.length / 64);
-    const chunks: Buffer[] = [];
-    for (let i = 0; i < nChunks; i++) {
-      chunks.push(message.subarray(64 * i, 64 * i + 64));
-    }
-
-    clientInterpreter.addKnownList(chunks);
-    const chunksRoot = new Merkle(chunks.map((m) => hashLeaf(m))).getRoot();
+    // the message is streamed with GET_PREIMAGE, rather than in 64-byte chunks of a Merkle tree
+    clientInterpreter.addKnownPreimage(
+      Buffer.concat([Buffer.from([0]), message])
+    );
 
     const result = await this.makeRequest(
       BitcoinIns.SIGN_MESSAGE,
       Buffer.concat([
         pathElementsToBuffer(pathElements),
         createVarint(message.length),
-        chunksRoot,
+        hashLeaf(message),
+        Buffer.from([MessageCommitmentType.PREIMAGE]),
       ]),
       clientInterpreter
     );
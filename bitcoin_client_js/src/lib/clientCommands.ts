@@ -10,9 +10,103 @@ enum ClientCommandCode {
   GET_PREIMAGE = 0x40,
   GET_MERKLE_LEAF_PROOF = 0x41,
   GET_MERKLE_LEAF_INDEX = 0x42,
+  GET_MERKLE_TREE_LEAVES = 0x43,
+  GET_MERKLE_LEAF_ELEMENT = 0x44,
+  STORE_RECORD = 0x50,
+  GET_RECORD = 0x51,
   GET_MORE_ELEMENTS = 0xa0,
 }
 
+// Maximum total length of the elements returned in a single response to
+// GET_MORE_ELEMENTS: the 255 bytes of the APDU data, minus 1 byte for the
+// number of elements and 1 byte for their length.
+const GET_MORE_ELEMENTS_MAX_PAYLOAD = 253;
+
+/**
+ * Queue of byte strings of the same length, returned to the hardware device in
+ * successive GET_MORE_ELEMENTS commands.
+ *
+ * The elements are stored contiguously in a single buffer, so that the
+ * continuation of a long preimage (a sequence of 1-byte elements) is enqueued
+ * and returned in chunks, rather than one byte at a time.
+ */
+export class ElementsQueue {
+  private elementLen = 0;
+  private data: Buffer = Buffer.alloc(0);
+  private offset = 0; // position of the first element in this.data
+
+  get length(): number {
+    if (this.elementLen === 0) {
+      return 0;
+    }
+    return (this.data.length - this.offset) / this.elementLen;
+  }
+
+  get elementLength(): number {
+    return this.elementLen;
+  }
+
+  // Enqueues the concatenation of elements of length elementLen.
+  pushBytes(data: Buffer, elementLen: number): void {
+    if (elementLen === 0 || data.length % elementLen != 0) {
+      throw new Error('Invalid element length');
+    }
+    if (this.length > 0 && elementLen != this.elementLen) {
+      throw new Error(
+        'The queue contains elements with different byte length, which is not expected'
+      );
+    }
+    this.elementLen = elementLen;
+    this.data = Buffer.concat([this.data.subarray(this.offset), data]);
+    this.offset = 0;
+  }
+
+  push(...elements: Buffer[]): void {
+    for (const el of elements) {
+      this.pushBytes(el, el.length);
+    }
+  }
+
+  // Removes and returns as many elements as fit in maxLen bytes, concatenated.
+  popBytes(maxLen: number): Buffer {
+    const n_bytes =
+      Math.min(Math.floor(maxLen / this.elementLen), this.length) *
+      this.elementLen;
+    const result = Buffer.from(
+      this.data.subarray(this.offset, this.offset + n_bytes)
+    );
+    this.offset += n_bytes;
+    if (this.offset === this.data.length) {
+      this.data = Buffer.alloc(0);
+      this.offset = 0;
+      this.elementLen = 0;
+    }
+    return result;
+  }
+}
+
+/**
+ * Returns the Merkle proof for a leaf, starting from the sibling of the leaf.
+ *
+ * If the hardware device already verified a node on the path from the root to
+ * the leaf, it only requests the first proof_len hashes of the proof, up to
+ * that node.
+ */
+function getRequestedProof(
+  mt: Merkle,
+  leaf_index: number,
+  proof_len?: number
+): Buffer[] {
+  const proof = mt.getProof(leaf_index);
+  if (proof_len === undefined) {
+    return proof;
+  }
+  if (proof_len > proof.length) {
+    throw new Error('Invalid proof length');
+  }
+  return proof.slice(0, proof_len);
+}
+
 abstract class ClientCommand {
   abstract code: ClientCommandCode;
   abstract execute(request: Buffer): Buffer;
@@ -42,11 +136,14 @@ export class YieldCommand extends ClientCommand {
 
 export class GetPreimageCommand extends ClientCommand {
   private readonly known_preimages: ReadonlyMap<string, Buffer>;
-  private queue: Buffer[];
+  private queue: ElementsQueue;
 
   readonly code = ClientCommandCode.GET_PREIMAGE;
 
-  constructor(known_preimages: ReadonlyMap<string, Buffer>, queue: Buffer[]) {
+  constructor(
+    known_preimages: ReadonlyMap<string, Buffer>,
+    queue: ElementsQueue
+  ) {
     super();
     this.known_preimages = known_preimages;
     this.queue = queue;
@@ -82,9 +179,8 @@ export class GetPreimageCommand extends ClientCommand {
       const payload_size = Math.min(max_payload_size, known_preimage.length);
 
       if (payload_size < known_preimage.length) {
-        for (let i = payload_size; i < known_preimage.length; i++) {
-          this.queue.push(Buffer.from([known_preimage[i]]));
-        }
+        // the remaining bytes are enqueued as length-1 elements
+        this.queue.pushBytes(known_preimage.subarray(payload_size), 1);
       }
 
       return Buffer.concat([
@@ -100,11 +196,11 @@ export class GetPreimageCommand extends ClientCommand {
 
 export class GetMerkleLeafProofCommand extends ClientCommand {
   private readonly known_trees: ReadonlyMap<string, Merkle>;
-  private queue: Buffer[];
+  private queue: ElementsQueue;
 
   readonly code = ClientCommandCode.GET_MERKLE_LEAF_PROOF;
 
-  constructor(known_trees: ReadonlyMap<string, Merkle>, queue: Buffer[]) {
+  constructor(known_trees: ReadonlyMap<string, Merkle>, queue: ElementsQueue) {
     super();
     this.known_trees = known_trees;
     this.queue = queue;
@@ -131,6 +227,7 @@ export class GetMerkleLeafProofCommand extends ClientCommand {
         "Invalid request, couldn't parse tree_size or leaf_index"
       );
     }
+    const proof_len = reqBuf.available() > 0 ? reqBuf.readUInt8() : undefined;
 
     const mt = this.known_trees.get(hash_hex);
     if (!mt) {
@@ -147,7 +244,7 @@ export class GetMerkleLeafProofCommand extends ClientCommand {
       );
     }
 
-    const proof = mt.getProof(leaf_index);
+    const proof = getRequestedProof(mt, leaf_index, proof_len);
 
     const n_response_elements = Math.min(
       Math.floor((255 - 32 - 1 - 1) / 32),
@@ -220,12 +317,245 @@ export class GetMerkleLeafIndexCommand extends ClientCommand {
   }
 }
 
+export class GetMerkleTreeLeavesCommand extends ClientCommand {
+  private readonly known_preimages: ReadonlyMap<string, Buffer>;
+  private readonly known_trees: ReadonlyMap<string, Merkle>;
+
+  readonly code = ClientCommandCode.GET_MERKLE_TREE_LEAVES;
+
+  constructor(
+    known_preimages: ReadonlyMap<string, Buffer>,
+    known_trees: ReadonlyMap<string, Merkle>
+  ) {
+    super();
+    this.known_preimages = known_preimages;
+    this.known_trees = known_trees;
+  }
+
+  execute(request: Buffer): Buffer {
+    const req = Buffer.from(request.subarray(1));
+
+    if (req.length < 32 + 1 + 1) {
+      throw new Error('Invalid request, expected at least 34 bytes');
+    }
+
+    const reqBuf = new BufferReader(req);
+    const hash = reqBuf.readSlice(32);
+    const hash_hex = hash.toString('hex');
+
+    let tree_size: number;
+    let start_index: number;
+    try {
+      tree_size = sanitizeBigintToNumber(reqBuf.readVarInt());
+      start_index = sanitizeBigintToNumber(reqBuf.readVarInt());
+    } catch (e) {
+      throw new Error(
+        "Invalid request, couldn't parse tree_size or start_index"
+      );
+    }
+
+    const mt = this.known_trees.get(hash_hex);
+    if (!mt) {
+      throw Error(`Requested Merkle tree leaves for unknown tree: ${hash_hex}`);
+    }
+
+    if (start_index >= tree_size || mt.size() != tree_size) {
+      throw Error('Invalid index or tree size.');
+    }
+
+    // Pack as many consecutive leaves as possible in 255 bytes, each prefixed
+    // by its length; the device will ask for the remaining ones with a new request.
+    const response_leaves: Buffer[] = [];
+    let response_len = 1;
+    for (let i = start_index; i < tree_size; i++) {
+      const leaf_hash_hex = mt.getLeafHash(i).toString('hex');
+      const preimage = this.known_preimages.get(leaf_hash_hex);
+      if (preimage == undefined) {
+        throw Error(`Requested unknown preimage for: ${leaf_hash_hex}`);
+      }
+
+      const leaf = preimage.subarray(1); // skip the 0x00 prefix
+      if (response_len + 1 + leaf.length > 255) {
+        break;
+      }
+      response_leaves.push(Buffer.from([leaf.length]), Buffer.from(leaf));
+      response_len += 1 + leaf.length;
+    }
+
+    if (response_leaves.length == 0) {
+      throw Error('The leaf is too long to fit in a single response');
+    }
+
+    return Buffer.concat([
+      Buffer.from([response_leaves.length / 2]),
+      ...response_leaves,
+    ]);
+  }
+}
+
+export class GetMerkleLeafElementCommand extends ClientCommand {
+  private readonly known_preimages: ReadonlyMap<string, Buffer>;
+  private readonly known_trees: ReadonlyMap<string, Merkle>;
+  private queue: ElementsQueue;
+
+  readonly code = ClientCommandCode.GET_MERKLE_LEAF_ELEMENT;
+
+  constructor(
+    known_preimages: ReadonlyMap<string, Buffer>,
+    known_trees: ReadonlyMap<string, Merkle>,
+    queue: ElementsQueue
+  ) {
+    super();
+    this.known_preimages = known_preimages;
+    this.known_trees = known_trees;
+    this.queue = queue;
+  }
+
+  execute(request: Buffer): Buffer {
+    const req = Buffer.from(request.subarray(1));
+
+    if (req.length < 32 + 1 + 1) {
+      throw new Error('Invalid request, expected at least 34 bytes');
+    }
+
+    const reqBuf = new BufferReader(req);
+    const hash = reqBuf.readSlice(32);
+    const hash_hex = hash.toString('hex');
+
+    let tree_size: number;
+    let leaf_index: number;
+    try {
+      tree_size = sanitizeBigintToNumber(reqBuf.readVarInt());
+      leaf_index = sanitizeBigintToNumber(reqBuf.readVarInt());
+    } catch (e) {
+      throw new Error(
+        "Invalid request, couldn't parse tree_size or leaf_index"
+      );
+    }
+    const proof_len = reqBuf.available() > 0 ? reqBuf.readUInt8() : undefined;
+
+    const mt = this.known_trees.get(hash_hex);
+    if (!mt) {
+      throw Error(
+        `Requested Merkle leaf element for unknown tree: ${hash_hex}`
+      );
+    }
+
+    if (leaf_index >= tree_size || mt.size() != tree_size) {
+      throw Error('Invalid index or tree size.');
+    }
+
+    if (this.queue.length != 0) {
+      throw Error(
+        'This command should not execute when the queue is not empty.'
+      );
+    }
+
+    const leaf_hash = mt.getLeafHash(leaf_index);
+    const preimage = this.known_preimages.get(leaf_hash.toString('hex'));
+    if (!preimage) {
+      throw Error(
+        `Requested unknown preimage for: ${leaf_hash.toString('hex')}`
+      );
+    }
+    const preimage_len_varint = createVarint(preimage.length);
+
+    const proof = getRequestedProof(mt, leaf_index, proof_len);
+
+    // Bytes of the preimage that fit after the leaf hash, the whole proof and
+    // the preimage length
+    const max_payload_size =
+      255 - 32 - 1 - 1 - 32 * proof.length - preimage_len_varint.length - 1;
+
+    if (max_payload_size <= 0) {
+      // The proof is too long: the response is the same as for
+      // GET_MERKLE_LEAF_PROOF, and the hardware device will ask for the
+      // preimage with GET_PREIMAGE.
+      const n_response_elements = Math.min(
+        Math.floor((255 - 32 - 1 - 1) / 32),
+        proof.length
+      );
+      this.queue.push(...proof.slice(n_response_elements));
+
+      return Buffer.concat([
+        leaf_hash,
+        Buffer.from([proof.length]),
+        Buffer.from([n_response_elements]),
+        ...proof.slice(0, n_response_elements),
+      ]);
+    }
+
+    const payload_size = Math.min(max_payload_size, preimage.length);
+
+    if (payload_size < preimage.length) {
+      // the remaining bytes are enqueued as length-1 elements
+      this.queue.pushBytes(preimage.subarray(payload_size), 1);
+    }
+
+    return Buffer.concat([
+      leaf_hash,
+      Buffer.from([proof.length]),
+      Buffer.from([proof.length]),
+      ...proof,
+      preimage_len_varint,
+      Buffer.from([payload_size]),
+      Buffer.from(preimage.subarray(0, payload_size)),
+    ]);
+  }
+}
+
+export class StoreRecordCommand extends ClientCommand {
+  private readonly records: Map<string, Buffer>;
+
+  readonly code = ClientCommandCode.STORE_RECORD;
+
+  constructor(records: Map<string, Buffer>) {
+    super();
+    this.records = records;
+  }
+
+  execute(request: Buffer): Buffer {
+    const req = request.subarray(1);
+
+    if (req.length < 32 + 1 || req.length != 32 + 1 + req[32]) {
+      throw new Error('Invalid request, unexpected length');
+    }
+
+    const key_hex = req.subarray(0, 32).toString('hex');
+    this.records.set(key_hex, Buffer.from(req.subarray(32 + 1)));
+    return Buffer.from('');
+  }
+}
+
+export class GetRecordCommand extends ClientCommand {
+  private readonly records: ReadonlyMap<string, Buffer>;
+
+  readonly code = ClientCommandCode.GET_RECORD;
+
+  constructor(records: ReadonlyMap<string, Buffer>) {
+    super();
+    this.records = records;
+  }
+
+  execute(request: Buffer): Buffer {
+    const req = request.subarray(1);
+
+    if (req.length != 32) {
+      throw new Error('Invalid request, unexpected trailing data');
+    }
+
+    // an unknown record is not an error: the device falls back to the original data
+    const record = this.records.get(req.toString('hex')) ?? Buffer.from('');
+    return Buffer.concat([Buffer.from([record.length]), record]);
+  }
+}
+
 export class GetMoreElementsCommand extends ClientCommand {
-  queue: Buffer[];
+  queue: ElementsQueue;
 
   readonly code = ClientCommandCode.GET_MORE_ELEMENTS;
 
-  constructor(queue: Buffer[]) {
+  constructor(queue: ElementsQueue) {
     super();
     this.queue = queue;
   }
@@ -239,23 +569,17 @@ export class GetMoreElementsCommand extends ClientCommand {
       throw new Error('No elements to get');
     }
 
-    // all elements should have the same length
-    const element_len = this.queue[0].length;
-    if (this.queue.some((el) => el.length != element_len)) {
-      throw new Error(
-        'The queue contains elements with different byte length, which is not expected'
-      );
-    }
-
-    const max_elements = Math.floor(253 / element_len);
-    const n_returned_elements = Math.min(max_elements, this.queue.length);
+    // all elements have the same length, as enforced by the queue
+    const element_len = this.queue.elementLength;
 
-    const returned_elements = this.queue.splice(0, n_returned_elements);
+    const returned_elements = this.queue.popBytes(
+      GET_MORE_ELEMENTS_MAX_PAYLOAD
+    );
 
     return Buffer.concat([
-      Buffer.from([n_returned_elements]),
+      Buffer.from([returned_elements.length / element_len]),
       Buffer.from([element_len]),
-      ...returned_elements,
+      returned_elements,
     ]);
   }
 }
@@ -281,7 +605,10 @@ export class ClientCommandInterpreter {
 
   private yielded: Buffer[] = [];
 
-  private queue: Buffer[] = [];
+  // records stored by the device with STORE_RECORD, indexed by their key
+  private readonly records: Map<string, Buffer> = new Map();
+
+  private queue: ElementsQueue = new ElementsQueue();
 
   private readonly commands: Map<ClientCommandCode, ClientCommand> = new Map();
 
@@ -291,6 +618,10 @@ export class ClientCommandInterpreter {
       new GetPreimageCommand(this.preimages, this.queue),
       new GetMerkleLeafIndexCommand(this.roots),
       new GetMerkleLeafProofCommand(this.roots, this.queue),
+      new GetMerkleTreeLeavesCommand(this.preimages, this.roots),
+      new GetMerkleLeafElementCommand(this.preimages, this.roots, this.queue),
+      new StoreRecordCommand(this.records),
+      new GetRecordCommand(this.records),
       new GetMoreElementsCommand(this.queue),
     ];
 
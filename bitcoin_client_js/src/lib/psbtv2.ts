@@ -278,6 +278,10 @@ export class PsbtV2 {
     const buf = this.getOutput(outputIndex, psbtOut.AMOUNT, b());
     return unsafeFrom64bitLE(buf);
   }
+  // The raw 8 bytes of the amount, that might not fit in a number
+  getOutputAmountBytes(outputIndex: number): Buffer {
+    return this.getOutput(outputIndex, psbtOut.AMOUNT, b());
+  }
   setOutputScript(outputIndex: number, scriptPubKey: Buffer) {
     this.setOutput(outputIndex, psbtOut.SCRIPT, b(), scriptPubKey);
   }
@@ -0,0 +1,175 @@
+import sys
+import json
+
+from dataclasses import dataclass, field
+
+from typing import List, Mapping, Optional
+
+from bitcoin_client.ledger_bitcoin.client_command import ClientCommandCode
+from bitcoin_client.ledger_bitcoin.command_builder import BitcoinInsType, FrameworkInsType, BitcoinCommandBuilder
+
+"""
+Parses from standard input a transcript of a complete APDU exchange with the app, in the same format accepted by
+tag_apdus.py, and summarizes the cost of each top-level command: number of interruptions for each client command,
+and number of bytes sent in each direction.
+
+If the app is compiled with HAVE_APDU_STATS and the transcript contains the GET_COMMAND_STATS framework APDU, the
+statistics measured by the device for the previous command are also reported.
+
+With the --json argument, the summary is printed as a JSON list (one element per command), which is convenient to
+track the number of round trips for a given PSBT shape across versions of the app.
+
+It must be run from the root of the repository.
+"""
+
+
+@dataclass
+class CommandSummary:
+    name: str
+    n_apdus: int = 0
+    bytes_in: int = 0  # bytes sent to the device, including the APDU headers
+    bytes_out: int = 0  # bytes of the responses, including the status words
+    interruptions: Mapping[str, int] = field(default_factory=dict)
+    sw: Optional[int] = None
+    device_stats: Optional[dict] = None
+
+    @property
+    def n_interruptions(self) -> int:
+        return sum(self.interruptions.values())
+
+    def to_dict(self) -> dict:
+        return {
+            "command": self.name,
+            "n_apdus": self.n_apdus,
+            "n_interruptions": self.n_interruptions,
+            "interruptions": dict(self.interruptions),
+            "bytes_in": self.bytes_in,
+            "bytes_out": self.bytes_out,
+            "sw": self.sw,
+            "device_stats": self.device_stats,
+        }
+
+
+def client_command_name(code: int) -> str:
+    try:
+        return ClientCommandCode(code).name
+    except ValueError:
+        return f"0x{code:02x}"
+
+
+def parse_command_stats(response: bytes) -> dict:
+    """Parses the response to GET_COMMAND_STATS; see send_apdu_stats in src/boilerplate/dispatcher.c."""
+
+    if len(response) < 21:
+        raise ValueError("Response to GET_COMMAND_STATS too short")
+
+    n_codes = response[20]
+    if len(response) != 21 + 3 * n_codes:
+        raise ValueError("Invalid response to GET_COMMAND_STATS")
+
+    return {
+        "ticks": int.from_bytes(response[0:2], byteorder="big"),
+        "ticks_waiting_host": int.from_bytes(response[2:4], byteorder="big"),
+        "n_processors": int.from_bytes(response[4:8], byteorder="big"),
+        "bytes_in": int.from_bytes(response[8:12], byteorder="big"),
+        "bytes_out": int.from_bytes(response[12:16], byteorder="big"),
+        "n_interruptions": int.from_bytes(response[16:20], byteorder="big"),
+        "interruptions": {
+            client_command_name(response[21 + 3*i]): int.from_bytes(response[22 + 3*i: 24 + 3*i], byteorder="big")
+            for i in range(n_codes)
+        }
+    }
+
+
+def summarize(lines) -> List[CommandSummary]:
+    summaries: List[CommandSummary] = []
+
+    # True if expecting an APDU going to the HWW (line starting with '=>'),
+    # False if expecting a response (line starting with '<=')
+    reading_apdu_in = True
+
+    # True if the last APDU was GET_COMMAND_STATS
+    reading_stats = False
+
+    for line in lines:
+        line = line.strip()
+        if len(line) == 0:
+            continue
+
+        line_pieces = line.split(' ')
+        assert len(line_pieces) == 2
+
+        apdu_raw = bytes.fromhex(line_pieces[1])
+
+        if reading_apdu_in:
+            assert line_pieces[0] == '=>'
+            assert len(apdu_raw) >= 5
+
+            cla, ins = apdu_raw[0], apdu_raw[1]
+
+            if cla == BitcoinCommandBuilder.CLA_FRAMEWORK and ins == FrameworkInsType.GET_COMMAND_STATS:
+                reading_stats = True
+            elif cla == BitcoinCommandBuilder.CLA_FRAMEWORK and ins == FrameworkInsType.CONTINUE_INTERRUPTED:
+                if len(summaries) == 0:
+                    raise RuntimeError("Unexpected CONTINUE_INTERRUPTED with no interrupted command")
+            else:
+                try:
+                    name = BitcoinInsType(ins).name if cla == BitcoinCommandBuilder.CLA_BITCOIN else None
+                except ValueError:
+                    name = None
+                summaries.append(CommandSummary(name or f"{cla:02x}{ins:02x}"))
+
+            if not reading_stats:
+                summaries[-1].n_apdus += 1
+                summaries[-1].bytes_in += len(apdu_raw)
+        else:
+            assert line_pieces[0] == '<='
+            assert len(apdu_raw) >= 2
+
+            sw = int.from_bytes(apdu_raw[-2:], byteorder="big")
+            response = apdu_raw[:-2]
+
+            if reading_stats:
+                if sw == 0x9000 and len(summaries) > 0:
+                    summaries[-1].device_stats = parse_command_stats(response)
+                reading_stats = False
+            else:
+                summaries[-1].bytes_out += len(apdu_raw)
+
+                if sw == 0xE000:
+                    assert len(response) > 0
+                    name = client_command_name(response[0])
+                    summaries[-1].interruptions[name] = summaries[-1].interruptions.get(name, 0) + 1
+                else:
+                    summaries[-1].sw = sw
+
+        reading_apdu_in = not reading_apdu_in
+
+    return summaries
+
+
+def print_summary(summary: CommandSummary):
+    sw = "pending" if summary.sw is None else f"{summary.sw:04x}"
+    print(f"{summary.name} (sw={sw}): {summary.n_apdus} APDUs, {summary.n_interruptions} interruptions, "
+          f"{summary.bytes_in} bytes in, {summary.bytes_out} bytes out")
+    for name, count in sorted(summary.interruptions.items(), key=lambda item: -item[1]):
+        print(f"    {name}: {count}")
+
+    if summary.device_stats is not None:
+        stats = summary.device_stats
+        print(f"  device: {stats['ticks']} ticks ({stats['ticks_waiting_host']} waiting for the host), "
+              f"{stats['n_processors']} processors, {stats['bytes_in']} bytes in, {stats['bytes_out']} bytes out")
+
+
+def run():
+    summaries = summarize(sys.stdin)
+
+    if "--json" in sys.argv[1:]:
+        print(json.dumps([s.to_dict() for s in summaries], indent=2))
+    else:
+        for summary in summaries:
+            print_summary(summary)
+
+
+if __name__ == "__main__":
+    run()
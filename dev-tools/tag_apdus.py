@@ -6,7 +6,7 @@ from dataclasses import dataclass
 from typing import List, Mapping, Optional
 
 from bitcoin_client.ledger_bitcoin.client_command import ClientCommandCode
-from bitcoin_client.ledger_bitcoin.command_builder import BitcoinInsType, FrameworkInsType, BitcoinCommandBuilder
+from bitcoin_client.ledger_bitcoin.command_builder import BitcoinInsType, FrameworkInsType, MessageCommitmentType, BitcoinCommandBuilder, CURRENT_PROTOCOL_VERSION
 from bitcoin_client.ledger_bitcoin.common import ByteStreamParser, sha256
 
 """
@@ -98,7 +98,7 @@ class CommandContext:
         # state only relevant during GET_PREIMAGE client command
         self.get_preimage__hash: Optional[bytes] = None
 
-        # state only relevant during GET_MERKLE_LEAF_PROOF client command
+        # state only relevant during GET_MERKLE_LEAF_PROOF and GET_MERKLE_LEAF_ELEMENT client commands
         self.get_merkle_leaf_proof__root: Optional[bytes] = None
         self.get_merkle_leaf_proof__leaf_index: Optional[int] = None
 
@@ -161,7 +161,7 @@ class GetExtendedPubkeyCommandFormatter(BitcoinCommandFormatter):
     @staticmethod
     def format_request(apdu: APDU, stream: ByteStreamParser, context: CommandContext):
         assert len(apdu.data) >= 2
-        assert apdu.p1 == 0 and apdu.p2 == 0
+        assert apdu.p1 == 0 and apdu.p2 <= CURRENT_PROTOCOL_VERSION
 
         display = apdu.data[0]
         assert display == 0 or display == 1
@@ -177,6 +177,22 @@ class GetExtendedPubkeyCommandFormatter(BitcoinCommandFormatter):
             f"=> GET_EXTENDED_PUBKEY(display={display},path=\"{format_bip32_path(bip32_path)}\")")
 
 
+class GetExtendedPubkeysCommandFormatter(BitcoinCommandFormatter):
+    ins_type = BitcoinInsType.GET_EXTENDED_PUBKEYS
+
+    @staticmethod
+    def format_request(apdu: APDU, stream: ByteStreamParser, context: CommandContext):
+        n_paths = stream.read_uint(1)
+        paths = []
+        for _ in range(n_paths):
+            bip32_path_len = stream.read_uint(1)
+            bip32_path = [stream.read_uint(4) for _ in range(bip32_path_len)]
+            paths.append(f"\"{format_bip32_path(bip32_path)}\"")
+        stream.assert_empty()
+
+        print(f"=> GET_EXTENDED_PUBKEYS(paths=[{', '.join(paths)}])")
+
+
 class RegisterWalletCommandFormatter(BitcoinCommandFormatter):
     ins_type = BitcoinInsType.REGISTER_WALLET
 
@@ -208,6 +224,22 @@ class GetWalletAddressCommandFormatter(BitcoinCommandFormatter):
             f"=> GET_WALLET_ADDRESS(wallet_id={wallet_id.hex()}, wallet_hmac={wallet_hmac.hex()}, change={change}, address_index={address_index})")
 
 
+class GetWalletAddressesCommandFormatter(BitcoinCommandFormatter):
+    ins_type = BitcoinInsType.GET_WALLET_ADDRESSES
+
+    @staticmethod
+    def format_request(apdu: APDU, stream: ByteStreamParser, context: CommandContext):
+        wallet_id = stream.read_bytes(32)
+        wallet_hmac = stream.read_bytes(32)
+        change = stream.read_uint(1)
+        start_index = stream.read_uint(4)
+        count = stream.read_uint(4)
+        stream.assert_empty()
+
+        print(
+            f"=> GET_WALLET_ADDRESSES(wallet_id={wallet_id.hex()}, wallet_hmac={wallet_hmac.hex()}, change={change}, start_index={start_index}, count={count})")
+
+
 class SignPsbtCommandFormatter(BitcoinCommandFormatter):
     ins_type = BitcoinInsType.SIGN_PSBT
 
@@ -253,20 +285,93 @@ class SignMessageCommandFormatter(BitcoinCommandFormatter):
                       for _ in range(bip32_path_len)]
 
         message_length = stream.read_varint()
-        message_merkle_root = stream.read_bytes(32)
+        message_commitment = stream.read_bytes(32)
+        message_commitment_type = MessageCommitmentType.MERKLE_ROOT
+        if not stream.is_empty():
+            message_commitment_type = MessageCommitmentType(stream.read_bytes(1)[0])
         stream.assert_empty()
 
-        print(
-            f"=> SIGN_MESSAGE(path=\"{format_bip32_path(bip32_path)}\",message_length={message_length},message_tree_hash={format_merkle_root(message_merkle_root, context)})")
+        if message_commitment_type == MessageCommitmentType.PREIMAGE:
+            print(
+                f"=> SIGN_MESSAGE(path=\"{format_bip32_path(bip32_path)}\",message_length={message_length},message_hash={format_hash_image(message_commitment, context)})")
+        else:
+            print(
+                f"=> SIGN_MESSAGE(path=\"{format_bip32_path(bip32_path)}\",message_length={message_length},message_tree_hash={format_merkle_root(message_commitment, context)})")
 
 
 bitcoin_command_formatters: List[BitcoinCommandFormatter] = [GetExtendedPubkeyCommandFormatter, RegisterWalletCommandFormatter,
-                                                             GetWalletAddressCommandFormatter, SignPsbtCommandFormatter, GetMasterFingerprintCommandFormatter, SignMessageCommandFormatter]
+                                                             GetWalletAddressCommandFormatter, SignPsbtCommandFormatter, GetMasterFingerprintCommandFormatter,
+                                                             GetWalletAddressesCommandFormatter, GetExtendedPubkeysCommandFormatter,
+                                                             SignMessageCommandFormatter]
 bitcoin_command_formatters_map: Mapping[BitcoinInsType, BitcoinCommandFormatter] = {
     f.ins_type: f for f in bitcoin_command_formatters
 }
 
 
+def format_preimage_response(stream: ByteStreamParser, context: CommandContext) -> str:
+    """Parses the response to GET_PREIMAGE for the hash in context.get_preimage__hash."""
+
+    preimage_len = stream.read_varint()
+    payload_size = stream.read_bytes(1)[0]
+    payload = stream.read_bytes(payload_size)
+
+    # If returning a preimage for leaf of the input commitments Merkle tree, the payload is
+    # an input's map commitment. We parse it and name the keys and values Merkle trees for easier reference
+    # (only if it is all in the response, which might not be the case for GET_MERKLE_LEAF_ELEMENT)
+    if context.get_preimage__hash in context.sign_psbt__input_map_commitment_hashes and preimage_len == payload_size:
+
+        payload_stream = ByteStreamParser(payload)
+        assert payload_stream.read_bytes(1) == b'\0'  # skip initial zero
+
+        input_map_commitment_size = payload_stream.read_varint()
+        input_map_commitment_keys_root = payload_stream.read_bytes(32)
+        input_map_commitment_values_root = payload_stream.read_bytes(32)
+
+        in_index = context.sign_psbt__input_map_commitment_hashes[context.get_preimage__hash]
+
+        context.merkle_root_names[
+            input_map_commitment_keys_root] = f"input_{in_index}_map_commitment_keys_root"
+        context.merkle_root_names[
+            input_map_commitment_values_root] = f"input_{in_index}_map_commitment_values_root"
+
+    # Same as above for output map commitments
+    if context.get_preimage__hash in context.sign_psbt__output_map_commitment_hashes and preimage_len == payload_size:
+
+        payload_stream = ByteStreamParser(payload)
+        assert payload_stream.read_bytes(1) == b'\0'  # skip initial zero
+
+        output_map_commitment_size = payload_stream.read_varint()
+        output_map_commitment_keys_root = payload_stream.read_bytes(32)
+        output_map_commitment_values_root = payload_stream.read_bytes(32)
+
+        out_index = context.sign_psbt__output_map_commitment_hashes[context.get_preimage__hash]
+
+        context.merkle_root_names[
+            output_map_commitment_keys_root] = f"output_{out_index}_map_commitment_keys_root"
+        context.merkle_root_names[
+            output_map_commitment_values_root] = f"output_{out_index}_map_commitment_values_root"
+
+    context.get_preimage__hash = None
+
+    return f"<preimage_len:{preimage_len}><payload_size: {payload_size}><payload:{payload.hex()}>"
+
+
+def record_merkle_leaf_hash(leaf_hash: bytes, context: CommandContext):
+    """Records the leaf hash returned for the leaf requested with GET_MERKLE_LEAF_PROOF or GET_MERKLE_LEAF_ELEMENT."""
+
+    assert context.get_merkle_leaf_proof__root is not None and context.get_merkle_leaf_proof__leaf_index is not None
+
+    # If it's a leaf of the inputs_map_commitments_tree or the outputs_map_commitments_tree_root, we store the corresponding hash
+    if context.get_merkle_leaf_proof__root in context.merkle_root_names:
+        root_name = context.merkle_root_names[context.get_merkle_leaf_proof__root]
+        if root_name == 'inputs_map_commitments_tree_root':
+            context.sign_psbt__input_map_commitment_hashes[
+                leaf_hash] = context.get_merkle_leaf_proof__leaf_index
+        if root_name == 'outputs_map_commitments_tree_root':
+            context.sign_psbt__output_map_commitment_hashes[
+                leaf_hash] = context.get_merkle_leaf_proof__leaf_index
+
+
 class ClientCommandFormatter:
     code: ClientCommandCode
 
@@ -309,51 +414,7 @@ class GetPreimageClientCommandFormatter(ClientCommandFormatter):
 
     @staticmethod
     def format_cmd_response(apdu: APDU, stream: ByteStreamParser, context: CommandContext):
-        preimage_len = stream.read_varint()
-        payload_size = stream.read_bytes(1)[0]
-        payload = stream.read_bytes(payload_size)
-
-        # If returning a preimage for leaf of the input commitments Merkle tree, the payload is
-        # an input's map commitment. We parse it and name the keys and values Merkle trees for easier reference
-        if context.get_preimage__hash in context.sign_psbt__input_map_commitment_hashes:
-            assert preimage_len == payload_size
-
-            payload_stream = ByteStreamParser(payload)
-            assert payload_stream.read_bytes(1) == b'\0'  # skip initial zero
-
-            input_map_commitment_size = payload_stream.read_varint()
-            input_map_commitment_keys_root = payload_stream.read_bytes(32)
-            input_map_commitment_values_root = payload_stream.read_bytes(32)
-
-            in_index = context.sign_psbt__input_map_commitment_hashes[context.get_preimage__hash]
-
-            context.merkle_root_names[
-                input_map_commitment_keys_root] = f"input_{in_index}_map_commitment_keys_root"
-            context.merkle_root_names[
-                input_map_commitment_values_root] = f"input_{in_index}_map_commitment_values_root"
-
-        # Same as above for output map commitments
-        if context.get_preimage__hash in context.sign_psbt__output_map_commitment_hashes:
-            assert preimage_len == payload_size
-
-            payload_stream = ByteStreamParser(payload)
-            assert payload_stream.read_bytes(1) == b'\0'  # skip initial zero
-
-            output_map_commitment_size = payload_stream.read_varint()
-            output_map_commitment_keys_root = payload_stream.read_bytes(32)
-            output_map_commitment_values_root = payload_stream.read_bytes(32)
-
-            out_index = context.sign_psbt__output_map_commitment_hashes[context.get_preimage__hash]
-
-            context.merkle_root_names[
-                output_map_commitment_keys_root] = f"output_{out_index}_map_commitment_keys_root"
-            context.merkle_root_names[
-                output_map_commitment_values_root] = f"output_{out_index}_map_commitment_values_root"
-
-        print(
-            f"=> ▶ <preimage_len:{preimage_len}><payload_size: {payload_size}><payload:{payload.hex()}>)")
-
-        context.get_preimage__hash = None
+        print(f"=> ▶ {format_preimage_response(stream, context)})")
 
 
 class GetMerkleLeafProofClientCommandFormatter(ClientCommandFormatter):
@@ -364,13 +425,15 @@ class GetMerkleLeafProofClientCommandFormatter(ClientCommandFormatter):
         root = stream.read_bytes(32)
         tree_size = stream.read_varint()
         leaf_index = stream.read_varint()
+        proof_len = None if stream.is_empty() else stream.read_uint(1)
         stream.assert_empty()
 
         context.get_merkle_leaf_proof__root = root
         context.get_merkle_leaf_proof__leaf_index = leaf_index
 
+        proof_len_str = "" if proof_len is None else f",proof_len={proof_len}"
         print(
-            f"<= ⏸ GET_MERKLE_LEAF_PROOF(root={format_merkle_root(root, context)},tree_size={tree_size},leaf_index={leaf_index})")
+            f"<= ⏸ GET_MERKLE_LEAF_PROOF(root={format_merkle_root(root, context)},tree_size={tree_size},leaf_index={leaf_index}{proof_len_str})")
 
     @staticmethod
     def format_cmd_response(apdu: APDU, stream: ByteStreamParser, context: CommandContext):
@@ -386,17 +449,7 @@ class GetMerkleLeafProofClientCommandFormatter(ClientCommandFormatter):
                 break
         stream.assert_empty()
 
-        assert context.get_merkle_leaf_proof__root is not None and context.get_merkle_leaf_proof__leaf_index is not None
-
-        # If it's a leaf of the inputs_map_commitments_tree or the outputs_map_commitments_tree_root, we store the corresponding hash
-        if context.get_merkle_leaf_proof__root in context.merkle_root_names:
-            root_name = context.merkle_root_names[context.get_merkle_leaf_proof__root]
-            if root_name == 'inputs_map_commitments_tree_root':
-                context.sign_psbt__input_map_commitment_hashes[
-                    leaf_hash] = context.get_merkle_leaf_proof__leaf_index
-            if root_name == 'outputs_map_commitments_tree_root':
-                context.sign_psbt__output_map_commitment_hashes[
-                    leaf_hash] = context.get_merkle_leaf_proof__leaf_index
+        record_merkle_leaf_hash(leaf_hash, context)
 
         proof_str = f"[{','.join(proof_el.hex() for proof_el in proof)}]"
 
@@ -427,6 +480,86 @@ class GetMerkleLeafIndexClientCommandFormatter(ClientCommandFormatter):
         print(f"=> ▶ <found:{found}><leaf_index:{leaf_index}>")
 
 
+class GetMerkleLeafElementClientCommandFormatter(ClientCommandFormatter):
+    code = ClientCommandCode.GET_MERKLE_LEAF_ELEMENT
+
+    @staticmethod
+    def format_cmd_request(response: bytes, stream: ByteStreamParser, context: CommandContext):
+        root = stream.read_bytes(32)
+        tree_size = stream.read_varint()
+        leaf_index = stream.read_varint()
+        proof_len = None if stream.is_empty() else stream.read_uint(1)
+        stream.assert_empty()
+
+        context.get_merkle_leaf_proof__root = root
+        context.get_merkle_leaf_proof__leaf_index = leaf_index
+
+        proof_len_str = "" if proof_len is None else f",proof_len={proof_len}"
+        print(
+            f"<= ⏸ GET_MERKLE_LEAF_ELEMENT(root={format_merkle_root(root, context)},tree_size={tree_size},leaf_index={leaf_index}{proof_len_str})")
+
+    @staticmethod
+    def format_cmd_response(apdu: APDU, stream: ByteStreamParser, context: CommandContext):
+        leaf_hash = stream.read_bytes(32)
+        proof_length = stream.read_bytes(1)[0]
+        n_proof_elements = stream.read_bytes(1)[0]
+        proof = [stream.read_bytes(32) for _ in range(n_proof_elements)]
+
+        record_merkle_leaf_hash(leaf_hash, context)
+
+        proof_str = f"[{','.join(proof_el.hex() for proof_el in proof)}]"
+
+        # the preimage is only in the response if the whole proof fits
+        preimage_str = ""
+        if n_proof_elements == proof_length:
+            context.get_preimage__hash = leaf_hash
+            preimage_str = format_preimage_response(stream, context)
+        stream.assert_empty()
+
+        print(
+            f"=> ▶ <leaf_hash:{format_hash_image(leaf_hash, context)}><proof_length:{proof_length}><n_proof_elements:{n_proof_elements}><proof:{proof_str}>{preimage_str}")
+
+        context.get_merkle_leaf_proof__root = None
+        context.get_merkle_leaf_proof__leaf_index = None
+
+
+class StoreRecordClientCommandFormatter(ClientCommandFormatter):
+    code = ClientCommandCode.STORE_RECORD
+
+    @staticmethod
+    def format_cmd_request(response: bytes, stream: ByteStreamParser, context: CommandContext):
+        key = stream.read_bytes(32)
+        record_len = stream.read_uint(1)
+        record = stream.read_bytes(record_len)
+        stream.assert_empty()
+
+        print(f"<= ⏸ STORE_RECORD(key={key.hex()},record={record.hex()})")
+
+    @staticmethod
+    def format_cmd_response(apdu: APDU, stream: ByteStreamParser, context: CommandContext):
+        assert len(apdu.data) == 0
+        print(f"=> ▶")
+
+
+class GetRecordClientCommandFormatter(ClientCommandFormatter):
+    code = ClientCommandCode.GET_RECORD
+
+    @staticmethod
+    def format_cmd_request(response: bytes, stream: ByteStreamParser, context: CommandContext):
+        key = stream.read_bytes(32)
+        stream.assert_empty()
+
+        print(f"<= ⏸ GET_RECORD(key={key.hex()})")
+
+    @staticmethod
+    def format_cmd_response(apdu: APDU, stream: ByteStreamParser, context: CommandContext):
+        record_len = stream.read_uint(1)
+        record = stream.read_bytes(record_len)
+        stream.assert_empty()
+
+        print(f"=> ▶ <record_len:{record_len}><record:{record.hex()}>")
+
+
 class GetMoreElementsClientCommandFormatter(ClientCommandFormatter):
     code = ClientCommandCode.GET_MORE_ELEMENTS
 
@@ -447,7 +580,9 @@ class GetMoreElementsClientCommandFormatter(ClientCommandFormatter):
 
 
 client_command_formatters: List[ClientCommandFormatter] = [YieldClientCommandFormatter, GetPreimageClientCommandFormatter,
-                                                           GetMerkleLeafProofClientCommandFormatter, GetMerkleLeafIndexClientCommandFormatter, GetMoreElementsClientCommandFormatter]
+                                                           GetMerkleLeafProofClientCommandFormatter, GetMerkleLeafIndexClientCommandFormatter,
+                                                           GetMerkleLeafElementClientCommandFormatter, StoreRecordClientCommandFormatter,
+                                                           GetRecordClientCommandFormatter, GetMoreElementsClientCommandFormatter]
 
 client_command_formatters_map: Mapping[ClientCommandCode, ClientCommandFormatter] = {
     f.code: f for f in client_command_formatters
@@ -517,6 +652,9 @@ def run():
                         print(f"=> ▶ {apdu.data.hex()}")
 
                     processing_client_command = None
+                elif ins_type == FrameworkInsType.GET_COMMAND_STATS:
+                    processing_command = ins_type
+                    print("=> GET_COMMAND_STATS()")
                 else:
                     # Unknown command, invalid logs or this tool needs to be updated!
                     raise RuntimeError("Unknown framework APDU")
@@ -9,3 +9,15 @@
  * Framework instruction to continue execution after an interruption.
  */
 #define INS_CONTINUE 0x01
+
+/**
+ * Framework instruction to get the statistics of the last command (only if compiled with
+ * HAVE_APDU_STATS).
+ */
+#define INS_GET_COMMAND_STATS 0x02
+
+/**
+ * Version of the protocol implemented by the app, negotiated with the P2 field of the commands.
+ * A host sending P2 = 0 only implements the client commands of the first version of the protocol.
+ */
+#define CURRENT_PROTOCOL_VERSION 1
@@ -17,6 +17,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "dispatcher.h"
 #include "constants.h"
@@ -25,14 +26,63 @@
 #include "sw.h"
 
 #include "common/buffer.h"
+#include "common/write.h"
 
 extern dispatcher_context_t G_dispatcher_context;
 
 extern bool G_was_processing_screen_shown;
 
+#ifdef HAVE_APDU_STATS
+
+extern uint16_t G_ticks;
+
+static apdu_stats_t G_apdu_stats;
+
+static void apdu_stats_count_interruption(uint8_t code) {
+    ++G_apdu_stats.n_interruptions;
+    for (int i = 0; i < G_apdu_stats.n_ccmd_codes; i++) {
+        if (G_apdu_stats.ccmd_counts[i].code == code) {
+            ++G_apdu_stats.ccmd_counts[i].count;
+            return;
+        }
+    }
+    if (G_apdu_stats.n_ccmd_codes < APDU_STATS_MAX_CCMD_CODES) {
+        G_apdu_stats.ccmd_counts[G_apdu_stats.n_ccmd_codes].code = code;
+        G_apdu_stats.ccmd_counts[G_apdu_stats.n_ccmd_codes].count = 1;
+        ++G_apdu_stats.n_ccmd_codes;
+    }
+}
+
+/**
+ * Responds to INS_GET_COMMAND_STATS with:
+ * <ticks : 2> <ticks_waiting_host : 2> <n_processors : 4> <bytes_in : 4> <bytes_out : 4>
+ * <n_interruptions : 4> <n_ccmd_codes : 1>, followed by <code : 1> <count : 2> for each client
+ * command code. All the integers are big-endian.
+ */
+static void send_apdu_stats() {
+    uint8_t response[2 + 2 + 4 + 4 + 4 + 4 + 1 + 3 * APDU_STATS_MAX_CCMD_CODES];
+
+    write_u16_be(response, 0, G_apdu_stats.ticks);
+    write_u16_be(response, 2, G_apdu_stats.ticks_waiting_host);
+    write_u32_be(response, 4, G_apdu_stats.n_processors);
+    write_u32_be(response, 8, G_apdu_stats.bytes_in);
+    write_u32_be(response, 12, G_apdu_stats.bytes_out);
+    write_u32_be(response, 16, G_apdu_stats.n_interruptions);
+    response[20] = G_apdu_stats.n_ccmd_codes;
+    for (int i = 0; i < G_apdu_stats.n_ccmd_codes; i++) {
+        response[21 + 3 * i] = G_apdu_stats.ccmd_counts[i].code;
+        write_u16_be(response, 21 + 3 * i + 1, G_apdu_stats.ccmd_counts[i].count);
+    }
+
+    io_send_response(response, 21 + 3 * G_apdu_stats.n_ccmd_codes, SW_OK);
+}
+
+#endif
+
 // Private state that is not made accessible from the dispatcher context
 struct {
     void (*termination_cb)(void);
+    void (*cleanup_cb)(void);
     bool paused;
     uint16_t sw;
     bool had_ux_flow;  // set to true if there was any UX flow during the APDU processing
@@ -51,6 +101,13 @@ static void add_to_response(const void *rdata, size_t rdata_len) {
 static void finalize_response(uint16_t sw) {
     G_dispatcher_state.sw = sw;
     io_finalize_response(sw);
+
+#ifdef HAVE_APDU_STATS
+    G_apdu_stats.bytes_out += G_output_len;
+    if (sw == SW_INTERRUPTED_EXECUTION && G_output_len > 2) {
+        apdu_stats_count_interruption(G_io_apdu_buffer[0]);
+    }
+#endif
 }
 
 static void send_response() {
@@ -96,6 +153,10 @@ static int process_interruption(dispatcher_context_t *dc) {
 
     io_start_interruption_timeout();
 
+#ifdef HAVE_APDU_STATS
+    uint16_t exchange_start_tick = G_ticks;
+#endif
+
     // Receive command bytes in G_io_apdu_buffer
     if ((input_len = io_exchange(CHANNEL_APDU, G_output_len)) < 0) {
         return -1;
@@ -103,6 +164,10 @@ static int process_interruption(dispatcher_context_t *dc) {
 
     io_clear_interruption_timeout();
 
+#ifdef HAVE_APDU_STATS
+    G_apdu_stats.ticks_waiting_host += (uint16_t) (G_ticks - exchange_start_tick);
+#endif
+
     G_output_len = 0;
 
     // As we are not yet returning anything here, we communicate to io_exchange that the apdu
@@ -138,6 +203,10 @@ static int process_interruption(dispatcher_context_t *dc) {
 
     dc->read_buffer = buffer_create(cmd.data, cmd.lc);
 
+#ifdef HAVE_APDU_STATS
+    G_apdu_stats.bytes_in += cmd.lc;
+#endif
+
     return 0;
 }
 
@@ -146,10 +215,12 @@ void apdu_dispatcher(command_descriptor_t const cmd_descriptors[],
                      machine_context_t *top_context,
                      size_t top_context_size,
                      void (*termination_cb)(void),
+                     void (*cleanup_cb)(void),
                      const command_t *cmd) {
     G_dispatcher_state.had_ux_flow = false;
 
     G_dispatcher_state.termination_cb = termination_cb;
+    G_dispatcher_state.cleanup_cb = cleanup_cb;
     G_dispatcher_state.paused = false;
     G_dispatcher_state.sw = 0;
 
@@ -164,6 +235,20 @@ void apdu_dispatcher(command_descriptor_t const cmd_descriptors[],
 
     G_dispatcher_context.read_buffer = buffer_create(cmd->data, cmd->lc);
 
+#ifdef HAVE_APDU_STATS
+    if (cmd->cla == CLA_FRAMEWORK && cmd->ins == INS_GET_COMMAND_STATS) {
+        // does not affect the state of the current command, if any
+        send_apdu_stats();
+        return;
+    }
+
+    if (!(cmd->cla == CLA_FRAMEWORK && cmd->ins == INS_CONTINUE)) {
+        memset(&G_apdu_stats, 0, sizeof(G_apdu_stats));
+        G_apdu_stats.start_tick = G_ticks;
+    }
+    G_apdu_stats.bytes_in += cmd->lc;
+#endif
+
     if (cmd->cla == CLA_FRAMEWORK && cmd->ins == INS_CONTINUE) {
         if (cmd->p1 != 0 || cmd->p2 != 0) {
             io_send_sw(SW_WRONG_P1P2);
@@ -184,6 +269,9 @@ void apdu_dispatcher(command_descriptor_t const cmd_descriptors[],
 
         // Safety measure: reset to 0 the entire context before starting.
         explicit_bzero(top_context, top_context_size);
+        if (cleanup_cb != NULL) {
+            cleanup_cb();
+        }
 
         bool cla_found = false, ins_found = false;
         command_handler_t handler;
@@ -205,6 +293,12 @@ void apdu_dispatcher(command_descriptor_t const cmd_descriptors[],
             return;
         }
 
+        if (cmd->p2 > CURRENT_PROTOCOL_VERSION) {
+            io_send_sw(SW_WRONG_P1P2);
+            return;
+        }
+        G_dispatcher_context.protocol_version = cmd->p2;
+
         io_start_processing_timeout();
         handler(&G_dispatcher_context);
     }
@@ -234,6 +328,10 @@ static void dispatcher_loop() {
             command_processor_t proc = G_dispatcher_context.machine_context_ptr->next_processor;
             G_dispatcher_context.machine_context_ptr->next_processor = NULL;
 
+#ifdef HAVE_APDU_STATS
+            ++G_apdu_stats.n_processors;
+#endif
+
             proc(&G_dispatcher_context);
 
             // if an interruption is sent, should exit the loop and persist the context for the next
@@ -263,6 +361,15 @@ static void dispatcher_loop() {
         io_send_sw(SW_BAD_STATE);
     }
 
+    // The command terminated; let the app wipe its state that must not outlive it
+    if (G_dispatcher_state.cleanup_cb != NULL) {
+        G_dispatcher_state.cleanup_cb();
+    }
+
+#ifdef HAVE_APDU_STATS
+    G_apdu_stats.ticks = (uint16_t) (G_ticks - G_apdu_stats.start_tick);
+#endif
+
     // We call the termination callback if given, but only if the UX is "dirty", that is either
     // - there was some kind of UX flow with user interaction;
     // - background processing took long enough that the "Processing..." screen was shown.
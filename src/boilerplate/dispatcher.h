@@ -49,6 +49,10 @@ struct dispatcher_context_s {
     machine_context_t *machine_context_ptr;
     buffer_t read_buffer;
 
+    // version of the protocol of the host, from the P2 field of the command; the client commands
+    // that a host with version 0 does not implement must not be sent
+    uint8_t protocol_version;
+
     void (*pause)();
     void (*run)();
     void (*next)(command_processor_t next_processor);
@@ -108,6 +112,9 @@ typedef struct {
  *   Array of command descriptors.
  * @param[in] n_descriptors
  *   Length of the command_descriptors array.
+ * @param[in] cleanup_cb
+ *   If not NULL, called before a new command starts and once a command terminates, to wipe any
+ *   state of the app that must not outlive a command.
  * @param[in] cmd
  *   Structured APDU command (CLA, INS, P1, P2, Lc, Command data).
  *
@@ -119,8 +126,34 @@ void apdu_dispatcher(command_descriptor_t const cmd_descriptors[],
                      machine_context_t *top_context,
                      size_t top_context_size,
                      void (*termination_cb)(void),
+                     void (*cleanup_cb)(void),
                      const command_t *cmd);
 
+#ifdef HAVE_APDU_STATS
+
+// maximum number of distinct client command codes that are counted separately
+#define APDU_STATS_MAX_CCMD_CODES 8
+
+/**
+ * Statistics of the last (or current) top-level command, returned by INS_GET_COMMAND_STATS.
+ */
+typedef struct {
+    uint16_t start_tick;
+    uint16_t ticks;               // ticks elapsed from the start to the termination of the command
+    uint16_t ticks_waiting_host;  // ticks spent waiting for the response to client commands
+    uint32_t n_processors;        // number of command processors executed
+    uint32_t bytes_in;            // bytes of command data received, including INS_CONTINUE
+    uint32_t bytes_out;           // bytes of the responses sent, including the status words
+    uint32_t n_interruptions;     // number of client commands sent to the host
+    uint8_t n_ccmd_codes;
+    struct {
+        uint8_t code;
+        uint16_t count;
+    } ccmd_counts[APDU_STATS_MAX_CCMD_CODES];  // number of interruptions per client command code
+} apdu_stats_t;
+
+#endif
+
 // Debug utilities
 
 #if DEBUG == 0
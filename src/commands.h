@@ -18,6 +18,8 @@ typedef enum {
     GET_WALLET_ADDRESS = 0x03,
     SIGN_PSBT = 0x04,
     GET_MASTER_FINGERPRINT = 0x05,
+    GET_WALLET_ADDRESSES = 0x06,
+    GET_EXTENDED_PUBKEYS = 0x07,
     SIGN_MESSAGE = 0x10,
 } command_e;
 
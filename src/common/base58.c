@@ -54,7 +54,7 @@ char const BASE58_ALPHABET[] = {
     'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z'             //
 };
 
-int base58_decode(const char *in, size_t in_len, uint8_t *out, size_t out_len) {
+int base58_decode_bytewise(const char *in, size_t in_len, uint8_t *out, size_t out_len) {
 #ifdef USE_CXRAM_SECTION
     // allocate buffers inside the cxram section; safe as there are no syscalls here
     uint8_t *tmp = get_cxram_buffer();                          // MAX_DEC_INPUT_SIZE bytes buffer
@@ -141,7 +141,7 @@ int base58_decode(const char *in, size_t in_len, uint8_t *out, size_t out_len) {
     return length;
 }
 
-int base58_encode(const uint8_t *in, size_t in_len, char *out, size_t out_len) {
+int base58_encode_bytewise(const uint8_t *in, size_t in_len, char *out, size_t out_len) {
     uint8_t buffer[MAX_ENC_INPUT_SIZE * 138 / 100 + 1] = {0};
     size_t i, j;
     size_t stop_at;
@@ -190,3 +190,169 @@ int base58_encode(const uint8_t *in, size_t in_len, char *out, size_t out_len) {
 
     return i;
 }
+
+// 58^5 is the largest power of 58 that fits in 32 bits
+#define BASE58_LIMB 656356768U
+#define BASE58_DIGITS_PER_LIMB 5
+
+// Number of 32-bit limbs to hold any number with MAX_DEC_INPUT_SIZE digits in base 58
+#define DEC_N_LIMBS ((MAX_DEC_INPUT_SIZE * 586 / 100 + 31) / 32 + 1)
+// Number of base 58^5 limbs to hold any number with MAX_ENC_INPUT_SIZE bytes
+#define ENC_N_LIMBS \
+    ((MAX_ENC_INPUT_SIZE * 138 / 100 + 1 + BASE58_DIGITS_PER_LIMB - 1) / BASE58_DIGITS_PER_LIMB)
+
+int base58_decode_limbs(const char *in, size_t in_len, uint8_t *out, size_t out_len) {
+    // little-endian limbs of the decoded number
+    uint32_t limbs[DEC_N_LIMBS] = {0};
+    size_t n_limbs = 0;
+
+    if (in_len > MAX_DEC_INPUT_SIZE || in_len < 2) {
+        return -1;
+    }
+
+    size_t zero_count = 0;
+    while (zero_count < in_len && in[zero_count] == BASE58_ALPHABET[0]) {
+        ++zero_count;
+    }
+
+    // the digits are consumed in chunks of up to 5, so that the number is multiplied by at most
+    // 58^5 at each step; the first chunk is shorter if in_len is not a multiple of 5
+    size_t i = 0;
+    size_t chunk_len = in_len % BASE58_DIGITS_PER_LIMB;
+    if (chunk_len == 0) {
+        chunk_len = BASE58_DIGITS_PER_LIMB;
+    }
+    while (i < in_len) {
+        uint32_t chunk = 0;
+        uint32_t multiplier = 1;
+        for (size_t k = 0; k < chunk_len; k++, i++) {
+            // uses a trimmed version of BASE58_TABLE, as in base58_decode_bytewise
+            int pos_trimmed = (in[i]) - 49;
+            if (pos_trimmed < 0 || pos_trimmed >= (int) sizeof(BASE58_TABLE_TRIMMED) ||
+                BASE58_TABLE_TRIMMED[pos_trimmed] == 0xFF) {
+                return -1;
+            }
+            chunk = chunk * 58 + BASE58_TABLE_TRIMMED[pos_trimmed];
+            multiplier *= 58;
+        }
+        chunk_len = BASE58_DIGITS_PER_LIMB;
+
+        // limbs = limbs * multiplier + chunk
+        uint64_t carry = chunk;
+        for (size_t l = 0; l < n_limbs; l++) {
+            carry += (uint64_t) limbs[l] * multiplier;
+            limbs[l] = (uint32_t) carry;
+            carry >>= 32;
+        }
+        if (carry != 0) {
+            limbs[n_limbs++] = (uint32_t) carry;
+        }
+    }
+
+    size_t n_bytes = 4 * n_limbs;
+    while (n_bytes > 0 && (uint8_t) (limbs[(n_bytes - 1) / 4] >> (8 * ((n_bytes - 1) % 4))) == 0) {
+        --n_bytes;
+    }
+
+    size_t length = zero_count + n_bytes;
+    if (out_len < length) {
+        return -1;
+    }
+
+    memset(out, 0, zero_count);
+    for (size_t j = 0; j < n_bytes; j++) {
+        size_t pos = n_bytes - 1 - j;  // position of the byte, from the least significant
+        out[zero_count + j] = (uint8_t) (limbs[pos / 4] >> (8 * (pos % 4)));
+    }
+
+    return length;
+}
+
+int base58_encode_limbs(const uint8_t *in, size_t in_len, char *out, size_t out_len) {
+    // little-endian limbs of the number in base 58^5
+    uint32_t limbs[ENC_N_LIMBS] = {0};
+    size_t n_limbs = 0;
+
+    if (in_len > MAX_ENC_INPUT_SIZE) {
+        return -1;
+    }
+
+    size_t zero_count = 0;
+    while (zero_count < in_len && in[zero_count] == 0) {
+        ++zero_count;
+    }
+
+    // the bytes are consumed in big-endian chunks of up to 4 bytes; the first chunk is shorter if
+    // in_len is not a multiple of 4
+    size_t i = zero_count;
+    size_t chunk_len = (in_len - zero_count) % 4;
+    if (chunk_len == 0) {
+        chunk_len = 4;
+    }
+    while (i < in_len) {
+        uint32_t chunk = 0;
+        for (size_t k = 0; k < chunk_len; k++, i++) {
+            chunk = (chunk << 8) | in[i];
+        }
+        unsigned int shift = 8 * chunk_len;
+        chunk_len = 4;
+
+        // limbs = limbs * 2^shift + chunk
+        uint64_t carry = chunk;
+        for (size_t l = 0; l < n_limbs; l++) {
+            carry += (uint64_t) limbs[l] << shift;
+            limbs[l] = (uint32_t) (carry % BASE58_LIMB);
+            carry /= BASE58_LIMB;
+        }
+        while (carry != 0) {
+            limbs[n_limbs++] = (uint32_t) (carry % BASE58_LIMB);
+            carry /= BASE58_LIMB;
+        }
+    }
+
+    // number of significant digits; the most significant limb is not 0, if there is any
+    size_t n_digits = BASE58_DIGITS_PER_LIMB * n_limbs;
+    if (n_limbs > 0) {
+        for (uint32_t top = limbs[n_limbs - 1]; top < BASE58_LIMB / 58 && n_digits > 0;
+             top *= 58) {
+            --n_digits;
+        }
+    }
+
+    if (out_len < zero_count + n_digits) {
+        return -1;
+    }
+
+    memset(out, BASE58_ALPHABET[0], zero_count);
+
+    // fill the digits from the least significant
+    char *digit = out + zero_count + n_digits;
+    for (size_t l = 0; l < n_limbs; l++) {
+        uint32_t limb = limbs[l];
+        for (int k = 0; k < BASE58_DIGITS_PER_LIMB && digit > out + zero_count; k++) {
+            *--digit = BASE58_ALPHABET[limb % 58];
+            limb /= 58;
+        }
+    }
+
+    return zero_count + n_digits;
+}
+
+// On NanoS, the byte-wise implementations are kept: the decoder only uses the cxram section, and
+// the Cortex-M0 has no hardware divider for the 64-bit divisions of base58_encode_limbs.
+
+int base58_decode(const char *in, size_t in_len, uint8_t *out, size_t out_len) {
+#ifdef USE_CXRAM_SECTION
+    return base58_decode_bytewise(in, in_len, out, out_len);
+#else
+    return base58_decode_limbs(in, in_len, out, out_len);
+#endif
+}
+
+int base58_encode(const uint8_t *in, size_t in_len, char *out, size_t out_len) {
+#ifdef USE_CXRAM_SECTION
+    return base58_encode_bytewise(in, in_len, out, out_len);
+#else
+    return base58_encode_limbs(in, in_len, out, out_len);
+#endif
+}
@@ -50,3 +50,28 @@ int base58_decode(const char *in, size_t in_len, uint8_t *out, size_t out_len);
  *
  */
 int base58_encode(const uint8_t *in, size_t in_len, char *out, size_t out_len);
+
+/**
+ * Implementation of base58_decode with a long division of the input for each output byte, running
+ * in quadratic time. On NanoS, it is the implementation of base58_decode, using the cxram section
+ * as temporary memory.
+ */
+int base58_decode_bytewise(const char *in, size_t in_len, uint8_t *out, size_t out_len);
+
+/**
+ * Implementation of base58_encode with a long division of the output for each input byte, running
+ * in quadratic time. On NanoS, it is the implementation of base58_encode.
+ */
+int base58_encode_bytewise(const uint8_t *in, size_t in_len, char *out, size_t out_len);
+
+/**
+ * Implementation of base58_decode working on 32-bit limbs, consuming 5 base58 digits at a time.
+ * Same result as base58_decode_bytewise.
+ */
+int base58_decode_limbs(const char *in, size_t in_len, uint8_t *out, size_t out_len);
+
+/**
+ * Implementation of base58_encode working on limbs in base 58^5, consuming 4 bytes at a time.
+ * Same result as base58_encode_bytewise.
+ */
+int base58_encode_limbs(const uint8_t *in, size_t in_len, char *out, size_t out_len);
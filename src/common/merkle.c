@@ -71,35 +71,65 @@ void merkle_combine_hashes(const uint8_t left[static 32],
     explicit_bzero(&G_cx.sha256, sizeof(cx_sha256_t));
 }
 
-// TODO: make this O(log n), or possibly O(1). Currently O(log^2 n).
-int merkle_get_ith_direction(size_t size, size_t index, size_t i) {
-    if (size <= 1 || index >= size) {
+// number of bits set in n, which is also the number of pending subtree roots in a merkle_stream_t
+static uint8_t count_bits(uint32_t n) {
+    uint8_t r = 0;
+    while (n != 0) {
+        r += n & 1;
+        n >>= 1;
+    }
+    return r;
+}
+
+void merkle_stream_init(merkle_stream_t *stream) {
+    memset(stream, 0, sizeof(merkle_stream_t));
+}
+
+int merkle_stream_add_leaf_hash(merkle_stream_t *stream, const uint8_t leaf_hash[static 32]) {
+    if (stream->n_leaves >= MERKLE_STREAM_MAX_LEAVES) {
         return -1;
     }
 
-    uint8_t n_directions = 0;
-    while (size > 1) {
-        uint8_t depth = ceil_lg(size);
+    uint8_t n_pending = count_bits(stream->n_leaves);
+    memcpy(stream->pending[n_pending], leaf_hash, 32);
 
-        // bitmask of the direction from the current node, where 0 = left, 1 = right;
-        // also the number of leaves of the left subtree
-        uint32_t mask = 1 << (depth - 1);
+    // Each trailing zero bit of the new number of leaves completes a subtree: merge the last two
+    // pending roots, which always have the same size.
+    for (uint32_t c = stream->n_leaves + 1; (c & 1) == 0; c >>= 1) {
+        --n_pending;
+        merkle_combine_hashes(stream->pending[n_pending],
+                              stream->pending[n_pending + 1],
+                              stream->pending[n_pending]);
+    }
 
-        uint8_t is_right_child = (index & mask) != 0 ? 1 : 0;
+    ++stream->n_leaves;
+    return 0;
+}
 
-        if (n_directions == i) {
-            return is_right_child;
-        }
+void merkle_stream_get_root(merkle_stream_t *stream, uint8_t out[static 32]) {
+    uint8_t n_pending = count_bits(stream->n_leaves);
 
-        ++n_directions;
+    if (n_pending == 0) {
+        memset(out, 0, 32);  // empty tree
+        return;
+    }
 
-        if (is_right_child) {
-            size -= mask;
-            index -= mask;
-        } else {
-            size = mask;
-        }
+    // The pending roots are the subtrees of decreasing size given by the binary expansion of
+    // n_leaves, which is exactly how the tree is split; combine them from right to left.
+    for (int i = n_pending - 2; i >= 0; i--) {
+        merkle_combine_hashes(stream->pending[i],
+                              stream->pending[i + 1],
+                              stream->pending[i]);
     }
+    memcpy(out, stream->pending[0], 32);
+}
 
-    return -1;
-}
\ No newline at end of file
+int merkle_get_ith_direction(size_t size, size_t index, size_t i) {
+    if (size <= 1 || index >= size || size > UINT32_MAX) {
+        return -1;
+    }
+
+    merkle_path_t path;
+    merkle_path_init(&path, (uint32_t) size, (uint32_t) index);
+    return merkle_path_get_direction(&path, i);
+}
@@ -1,6 +1,7 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 // TODO: RFC6962 defines the empty list hash as sha256(b''); while we're using 0 here. Should we
@@ -68,10 +69,129 @@ static inline uint8_t ceil_lg(uint32_t n) {
     return r;
 }
 
+/**
+ * Directions of the path from the root of a Merkle tree to one of its leaves. It is computed once
+ * per leaf, so that each step of the verification of a Merkle proof takes constant time.
+ */
+typedef struct {
+    // bit i is the direction at depth i: 0 for the left child, 1 for the right child
+    uint32_t directions;
+    uint8_t depth;  // depth of the leaf, which is also the length of its Merkle proof
+} merkle_path_t;
+
+/**
+ * Computes the path to the leaf with the given index in a Merkle tree of the given size, in
+ * O(log size) time.
+ *
+ * @param[out] path
+ *   Pointer to the path to initialize.
+ * @param[in] size
+ *   Number of leaves of the Merkle tree.
+ * @param[in] index
+ *   Index of the leaf.
+ *
+ * @return 0 on success, -1 if index >= size.
+ */
+// inlined to save on stack depth
+static inline int merkle_path_init(merkle_path_t *path, uint32_t size, uint32_t index) {
+    if (index >= size) {
+        return -1;
+    }
+
+    path->directions = 0;
+    path->depth = 0;
+
+    // number of leaves of the left subtree, that is the largest power of 2 strictly smaller than
+    // size; it is only meaningful while size > 1
+    uint32_t mask = 1;
+    while (mask < size - mask) {
+        mask *= 2;
+    }
+
+    while (size > 1) {
+        if (index >= mask) {
+            path->directions |= (uint32_t) 1 << path->depth;
+            index -= mask;
+            size -= mask;
+        } else {
+            size = mask;
+        }
+        ++path->depth;
+
+        // the subtree is at most as large as mask, therefore the total number of halvings is
+        // logarithmic in the size of the tree
+        while (size > 1 && mask >= size) {
+            mask /= 2;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Returns the direction at the given depth of a path: 0 for the left child, 1 for the right one,
+ * or -1 if the depth is not smaller than the depth of the leaf.
+ */
+static inline int merkle_path_get_direction(const merkle_path_t *path, size_t depth) {
+    if (depth >= path->depth) {
+        return -1;
+    }
+    return (path->directions >> depth) & 1;
+}
+
 // Returns the ith member of the directions array for the leaf with the given index in a Merkle tree
 // of the given size. Returns -1 on error.
+// In a loop over the steps of a proof, prefer merkle_path_init and merkle_path_get_direction.
 int merkle_get_ith_direction(size_t size, size_t index, size_t i);
 
+/**
+ * Maximum number of leaves supported by the streaming Merkle root accumulator.
+ * Larger trees must be verified one leaf at a time with Merkle proofs.
+ */
+#define MERKLE_STREAM_MAX_LEAVES 128
+
+/**
+ * State of the streaming computation of the root of a Merkle tree, given all its leaf hashes in
+ * order. Only the roots of the complete subtrees built so far are kept, one for each bit set in
+ * n_leaves; this allows to verify the root of a tree of n leaves with exactly n - 1 internal
+ * hashes, without any Merkle proof.
+ */
+typedef struct {
+    uint32_t n_leaves;
+    // popcount(MERKLE_STREAM_MAX_LEAVES - 1) + 1 pending subtree roots
+    uint8_t pending[8][32];
+} merkle_stream_t;
+
+/**
+ * Initializes the streaming Merkle root accumulator.
+ *
+ * @param[out] stream
+ *   Pointer to the state to initialize.
+ */
+void merkle_stream_init(merkle_stream_t *stream);
+
+/**
+ * Adds the next leaf hash to the streaming Merkle root accumulator.
+ *
+ * @param[in,out] stream
+ *   Pointer to the accumulator state.
+ * @param[in] leaf_hash
+ *   Pointer to the 32-byte hash of the next leaf.
+ *
+ * @return 0 on success, -1 if more than MERKLE_STREAM_MAX_LEAVES leaves are added.
+ */
+int merkle_stream_add_leaf_hash(merkle_stream_t *stream, const uint8_t leaf_hash[static 32]);
+
+/**
+ * Computes the root of the Merkle tree of all the leaves added to the accumulator.
+ * The accumulator must not be used after this call, unless it is re-initialized.
+ *
+ * @param[in,out] stream
+ *   Pointer to the accumulator state.
+ * @param[out] out
+ *   Pointer to a 32-bytes buffer to store the Merkle root.
+ */
+void merkle_stream_get_root(merkle_stream_t *stream, uint8_t out[static 32]);
+
 /**
  * Represents the Merkleized version of a key-value map, holding the number of elements, the root of
  * the Merkle tree of the sorted list of keys, and the root of the Merkle tree of the values (sorted
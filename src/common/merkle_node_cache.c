@@ -0,0 +1,132 @@
+/*****************************************************************************
+ *   Ledger App Bitcoin.
+ *   (c) 2021 Ledger SAS.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *****************************************************************************/
+
+#include <stdint.h>   // uint*_t
+#include <string.h>   // memcmp, memcpy
+#include <stdbool.h>  // bool
+
+#include "merkle_node_cache.h"
+
+// Returns the number of leaves of the left subtree of a tree with size > 1 leaves, that is the
+// largest power of 2 strictly smaller than size.
+static uint32_t left_subtree_size(uint32_t size) {
+    uint32_t mask = 1;
+    while (2 * mask < size) {
+        mask *= 2;
+    }
+    return mask;
+}
+
+bool merkle_get_subtree(uint32_t tree_size,
+                        uint32_t leaf_index,
+                        int depth,
+                        uint32_t *start,
+                        uint32_t *size) {
+    if (leaf_index >= tree_size || depth < 0) {
+        return false;
+    }
+
+    uint32_t cur_start = 0;
+    for (int i = 0; i < depth; i++) {
+        if (tree_size <= 1) {
+            return false;  // deeper than the leaf
+        }
+
+        uint32_t mask = left_subtree_size(tree_size);
+        if (leaf_index - cur_start >= mask) {
+            cur_start += mask;
+            tree_size -= mask;
+        } else {
+            tree_size = mask;
+        }
+    }
+
+    *start = cur_start;
+    *size = tree_size;
+    return true;
+}
+
+void merkle_node_cache_init(merkle_node_cache_t *cache) {
+    cache->n_entries = 0;
+    cache->next = 0;
+}
+
+int merkle_node_cache_find(const merkle_node_cache_t *cache,
+                           const uint8_t root[static 32],
+                           uint32_t tree_size,
+                           uint32_t leaf_index,
+                           int *depth) {
+    int result = -1;
+
+    for (int i = 0; i < cache->n_entries; i++) {
+        const merkle_node_cache_entry_t *entry = &cache->entries[i];
+
+        // the subtree must contain the leaf, and not be the whole tree
+        if (leaf_index < entry->start || leaf_index - entry->start >= entry->size ||
+            entry->size >= tree_size || memcmp(entry->root, root, 32) != 0) {
+            continue;
+        }
+
+        // smaller subtrees are deeper; each subtree that is a node of the tree is only found once
+        if (result == -1 || entry->size < cache->entries[result].size) {
+            result = i;
+        }
+    }
+
+    if (result == -1) {
+        return -1;
+    }
+
+    // make sure that the entry is indeed a node of the tree on the path to the leaf
+    const merkle_node_cache_entry_t *entry = &cache->entries[result];
+    for (int d = 1;; d++) {
+        uint32_t start, size;
+        if (!merkle_get_subtree(tree_size, leaf_index, d, &start, &size) || size < entry->size) {
+            return -1;
+        }
+        if (start == entry->start && size == entry->size) {
+            *depth = d;
+            return result;
+        }
+    }
+}
+
+void merkle_node_cache_add(merkle_node_cache_t *cache,
+                           const uint8_t root[static 32],
+                           uint32_t start,
+                           uint32_t size,
+                           const uint8_t hash[static 32]) {
+    for (int i = 0; i < cache->n_entries; i++) {
+        const merkle_node_cache_entry_t *entry = &cache->entries[i];
+        if (entry->start == start && entry->size == size && memcmp(entry->root, root, 32) == 0) {
+            return;
+        }
+    }
+
+    merkle_node_cache_entry_t *entry;
+    if (cache->n_entries < MERKLE_NODE_CACHE_SIZE) {
+        entry = &cache->entries[cache->n_entries++];
+    } else {
+        entry = &cache->entries[cache->next];
+        cache->next = (cache->next + 1) % MERKLE_NODE_CACHE_SIZE;
+    }
+
+    memcpy(entry->root, root, 32);
+    entry->start = start;
+    entry->size = size;
+    memcpy(entry->hash, hash, 32);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdint.h>   // uint*_t
+#include <stdbool.h>  // bool
+
+/*
+  Cache of internal node hashes of Merkle trees, used to shorten the Merkle proofs for leaves of a
+  tree that was already accessed during the same session.
+
+  A node is identified by the root of its Merkle tree, and by the range of leaves [start, start +
+  size) of the subtree it is the root of (which determines its position in the tree). Only nodes
+  whose hash was verified with a Merkle proof against the root must be added to the cache: a leaf
+  whose proof leads to the hash of a cached node is then in the tree, exactly as if its full proof
+  was verified against the root.
+
+  The cache only contains public data, and it is never invalid: the same root always identifies the
+  same tree.
+*/
+
+#ifdef TARGET_NANOS
+#define MERKLE_NODE_CACHE_SIZE 4
+#else
+#define MERKLE_NODE_CACHE_SIZE 8
+#endif
+
+typedef struct {
+    uint8_t root[32];
+    uint32_t start;
+    uint32_t size;
+    uint8_t hash[32];
+} merkle_node_cache_entry_t;
+
+typedef struct {
+    merkle_node_cache_entry_t entries[MERKLE_NODE_CACHE_SIZE];
+    uint8_t n_entries;
+    uint8_t next;  // index of the entry replaced by the next insertion, once the cache is full
+} merkle_node_cache_t;
+
+/**
+ * Computes the range of leaves of the subtree at the given depth that contains a leaf.
+ *
+ * @param[in] tree_size
+ *   Number of leaves of the Merkle tree.
+ * @param[in] leaf_index
+ *   Index of the leaf.
+ * @param[in] depth
+ *   Depth of the subtree, at most equal to the depth of the leaf; the whole tree has depth 0.
+ * @param[out] start
+ *   Index of the first leaf of the subtree.
+ * @param[out] size
+ *   Number of leaves of the subtree.
+ *
+ * @return true on success, false if leaf_index >= tree_size, or if depth is too large.
+ */
+bool merkle_get_subtree(uint32_t tree_size,
+                        uint32_t leaf_index,
+                        int depth,
+                        uint32_t *start,
+                        uint32_t *size);
+
+/**
+ * Initializes an empty cache.
+ */
+void merkle_node_cache_init(merkle_node_cache_t *cache);
+
+/**
+ * Finds the deepest cached node on the path from the root to a leaf, excluding the root itself.
+ *
+ * @param[in] cache
+ *   Pointer to the cache.
+ * @param[in] root
+ *   Root of the Merkle tree.
+ * @param[in] tree_size
+ *   Number of leaves of the Merkle tree.
+ * @param[in] leaf_index
+ *   Index of the leaf.
+ * @param[out] depth
+ *   If an entry is found, the depth of its node in the tree.
+ *
+ * @return the index of the entry in cache->entries, or -1 if no node is found.
+ */
+int merkle_node_cache_find(const merkle_node_cache_t *cache,
+                           const uint8_t root[static 32],
+                           uint32_t tree_size,
+                           uint32_t leaf_index,
+                           int *depth);
+
+/**
+ * Adds a verified node to the cache, replacing the oldest entry if the cache is full. Nothing is
+ * done if the node is already in the cache.
+ *
+ * @param[in,out] cache
+ *   Pointer to the cache.
+ * @param[in] root
+ *   Root of the Merkle tree.
+ * @param[in] start
+ *   Index of the first leaf of the subtree of the node.
+ * @param[in] size
+ *   Number of leaves of the subtree of the node.
+ * @param[in] hash
+ *   Hash of the node.
+ */
+void merkle_node_cache_add(merkle_node_cache_t *cache,
+                           const uint8_t root[static 32],
+                           uint32_t start,
+                           uint32_t size,
+                           const uint8_t hash[static 32]);
@@ -1,6 +1,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <limits.h>
+#include <string.h>
 
 #include "../common/bip32.h"
 #include "../common/buffer.h"
@@ -13,12 +14,12 @@
 #endif
 
 int get_script_type(const uint8_t script[], size_t script_len) {
-    if (script_len >= 25 &&  script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == 0x14 &&
+    if (script_len == 25 && script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == 0x14 &&
         script[23] == OP_EQUALVERIFY && script[24] == OP_CHECKSIG) {
         return SCRIPT_TYPE_P2PKH;
     }
 
-    if (script_len >= 23 && script[0] == OP_HASH160 && script[1] == 0x14 &&
+    if (script_len == 23 && script[0] == OP_HASH160 && script[1] == 0x14 &&
         script[22] == OP_EQUAL) {
         return SCRIPT_TYPE_P2SH;
     }
@@ -50,6 +51,143 @@ int get_script_type(const uint8_t script[], size_t script_len) {
     return -1;
 }
 
+static bool is_printable_ascii(const uint8_t *str, size_t str_len) {
+    for (size_t i = 0; i < str_len; i++) {
+        if (str[i] < 0x20 || str[i] > 0x7e) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool is_asset_name_valid(const uint8_t *name, size_t name_len) {
+    return name_len >= 3 && name_len <= MAX_ASSET_NAME_LENGTH && is_printable_ascii(name, name_len);
+}
+
+// Parses a script starting with OP_RVN_ASSET, without an address
+static int parse_null_asset_script(const uint8_t script[], size_t script_len, asset_script_t *out) {
+    out->base_script_len = 0;
+    out->amount = 0;
+
+    if (script_len >= 2 + 20 + 2 && script[1] == 0x14) {
+        // OP_RVN_ASSET <hash160> <push> <name_len> <name> <flag>
+        out->type = ASSET_SCRIPT_TAG;
+        out->tagged_hash160 = script + 2;
+        out->name_len = script[23];
+        out->name = script + 24;
+    } else if (script_len >= 5 && script[1] == OP_RESERVED && script[2] == OP_RESERVED) {
+        // OP_RVN_ASSET OP_RESERVED OP_RESERVED <push> <name_len> <name> <flag>
+        out->type = ASSET_SCRIPT_GLOBAL_RESTRICTION;
+        out->name_len = script[4];
+        out->name = script + 5;
+    } else if (script_len >= 4 && script[1] == OP_RESERVED) {
+        // OP_RVN_ASSET OP_RESERVED <push> <string_len> <string>
+        out->type = ASSET_SCRIPT_VERIFIER;
+        out->name_len = script[3];
+        out->name = script + 4;
+
+        if (out->name_len == 0 || out->name_len > MAX_ASSET_VERIFIER_LENGTH ||
+            (size_t) (out->name - script) + out->name_len != script_len ||
+            !is_printable_ascii(out->name, out->name_len)) {
+            return -1;
+        }
+        return out->type;
+    } else {
+        return -1;
+    }
+
+    // tags and global restrictions end with the flag
+    size_t flag_offset = (size_t) (out->name - script) + out->name_len;
+    if (flag_offset + 1 != script_len || !is_asset_name_valid(out->name, out->name_len)) {
+        return -1;
+    }
+    out->flag = script[flag_offset];
+    if (out->flag > 1) {
+        return -1;
+    }
+    return out->type;
+}
+
+int parse_asset_script(const uint8_t script[], size_t script_len, asset_script_t *out) {
+    memset(out, 0, sizeof(asset_script_t));
+
+    if (script_len == 0) {
+        return -1;
+    }
+
+    if (script[0] == OP_RVN_ASSET) {
+        return parse_null_asset_script(script, script_len, out);
+    }
+
+    if (script_len > 25 && get_script_type(script, 25) == SCRIPT_TYPE_P2PKH) {
+        out->base_script_len = 25;
+    } else if (script_len > 23 && get_script_type(script, 23) == SCRIPT_TYPE_P2SH) {
+        out->base_script_len = 23;
+    } else {
+        return -1;
+    }
+
+    // OP_RVN_ASSET <push> "rvn" <type> ..., where the push opcode can be OP_PUSHDATA1 <len>
+    size_t offset = out->base_script_len;
+    if (script[offset] != OP_RVN_ASSET || script[script_len - 1] != OP_DROP) {
+        return -1;
+    }
+    // excluding OP_DROP, the fields end at script_len - 1
+    size_t end = script_len - 1;
+    if (end >= offset + 2 + 4 && memcmp(script + offset + 2, "rvn", 3) == 0) {
+        offset += 2 + 3;
+    } else if (end >= offset + 3 + 4 && memcmp(script + offset + 3, "rvn", 3) == 0) {
+        offset += 3 + 3;
+    } else {
+        return -1;
+    }
+
+    out->type = script[offset++];
+    if (out->type != ASSET_SCRIPT_NEW && out->type != ASSET_SCRIPT_OWNER &&
+        out->type != ASSET_SCRIPT_REISSUE && out->type != ASSET_SCRIPT_TRANSFER) {
+        return -1;
+    }
+
+    if (offset >= end) {
+        return -1;
+    }
+    out->name_len = script[offset++];
+    out->name = script + offset;
+    if (end - offset < out->name_len || !is_asset_name_valid(out->name, out->name_len)) {
+        return -1;
+    }
+    offset += out->name_len;
+
+    if (out->type == ASSET_SCRIPT_OWNER) {
+        // the name of ownership tokens ends with '!', and there is no amount
+        if (out->name[out->name_len - 1] != '!') {
+            return -1;
+        }
+        out->amount = ASSET_OWNER_AMOUNT;
+        return offset == end ? (int) out->type : -1;
+    }
+
+    if (end - offset < 8) {
+        return -1;
+    }
+    out->amount = read_u64_le(script, offset);
+    offset += 8;
+
+    size_t remaining = end - offset;
+    bool valid;
+    if (out->type == ASSET_SCRIPT_NEW) {
+        // <units> <reissuable> <has_ipfs> [<ipfs_hash:34>]
+        valid = remaining >= 3 && remaining == 3 + (script[offset + 2] != 0 ? 34 : 0);
+    } else if (out->type == ASSET_SCRIPT_REISSUE) {
+        // <units> <reissuable> [<ipfs_hash:34>]
+        valid = remaining == 2 || remaining == 2 + 34;
+    } else {
+        // [<message:34> [<expire_time:8>]]
+        valid = remaining == 0 || remaining == 34 || remaining == 34 + 8;
+    }
+    return valid ? (int) out->type : -1;
+}
+
 #ifndef SKIP_FOR_CMOCKA
 
 // TODO: add unit tests
@@ -110,12 +248,54 @@ int get_script_address(const uint8_t script[],
     return addr_len;
 }
 
+int format_null_asset_script(const asset_script_t *asset,
+                             const global_context_t *coin_config,
+                             char out[static MAX_NULL_ASSET_OUTPUT_DESC_SIZE]) {
+    const char *prefix;
+    switch (asset->type) {
+        case ASSET_SCRIPT_TAG:
+            prefix = asset->flag ? "Add tag " : "Remove tag ";
+            break;
+        case ASSET_SCRIPT_VERIFIER:
+            prefix = "Verifier ";
+            break;
+        case ASSET_SCRIPT_GLOBAL_RESTRICTION:
+            prefix = asset->flag ? "Freeze " : "Unfreeze ";
+            break;
+        default:
+            return -1;
+    }
+
+    size_t out_len = strlen(prefix);
+    memcpy(out, prefix, out_len);
+    memcpy(out + out_len, asset->name, asset->name_len);
+    out_len += asset->name_len;
+
+    if (asset->type == ASSET_SCRIPT_TAG) {
+        const char *separator = asset->flag ? " to " : " from ";
+        memcpy(out + out_len, separator, strlen(separator));
+        out_len += strlen(separator);
+
+        int addr_len = base58_encode_address(asset->tagged_hash160,
+                                             coin_config->p2pkh_version,
+                                             out + out_len,
+                                             MAX_NULL_ASSET_OUTPUT_DESC_SIZE - out_len - 1);
+        if (addr_len < 0) {
+            return -1;
+        }
+        out_len += addr_len;
+    }
+
+    out[out_len] = '\0';
+    return out_len;
+}
+
 #endif
 
 int format_opscript_script(const uint8_t script[],
                            size_t script_len,
                            char out[static MAX_OPRETURN_OUTPUT_DESC_SIZE]) {
-    if (script_len == 0 || script[0] != OP_RETURN) {
+    if (script_len < 2 || script[0] != OP_RETURN) {
         return -1;
     }
 
@@ -1,5 +1,11 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../constants.h"
+
 #ifndef SKIP_FOR_CMOCKA
 #include "../context.h"
 #endif
@@ -175,7 +181,8 @@ static inline bool is_opreturn(const uint8_t script[], size_t script_len) {
 
 /**
  * Returns a constant of type `script_type_e` indicating the type of known script type with an
- * address, or -1 for any invalid script, or valid script without an address.
+ * address, or -1 for any invalid script, or valid script without an address. The script must match
+ * exactly: for a Ravencoin asset script, pass the base_script_len returned by parse_asset_script.
  *
  * @param script the script
  * @param script_len the length of the script
@@ -206,6 +213,86 @@ int get_script_address(const uint8_t script[],
 
 #endif
 
+/** Ravencoin assets */
+
+// Longest verifier string of a restricted asset (characters)
+#define MAX_ASSET_VERIFIER_LENGTH 80
+
+// Amount of the ownership token of an asset (in 1/100_000_000th)
+#define ASSET_OWNER_AMOUNT 100000000
+
+typedef enum {
+    // scripts with an address, where OP_RVN_ASSET follows a P2PKH or P2SH script; the value is the
+    // byte following "rvn" in the script
+    ASSET_SCRIPT_NEW = 0x71,       // 'q', issuance of a new asset
+    ASSET_SCRIPT_OWNER = 0x6f,     // 'o', ownership token of a new asset
+    ASSET_SCRIPT_REISSUE = 0x72,   // 'r', reissuance of an asset
+    ASSET_SCRIPT_TRANSFER = 0x74,  // 't', transfer of an asset
+    // null asset scripts, that start with OP_RVN_ASSET and have no address nor amount
+    ASSET_SCRIPT_TAG = 0x01,                 // adds or removes a qualifier tag to an address
+    ASSET_SCRIPT_VERIFIER = 0x02,            // sets the verifier string of a restricted asset
+    ASSET_SCRIPT_GLOBAL_RESTRICTION = 0x03,  // freezes or unfreezes a restricted asset
+} asset_script_type_e;
+
+/**
+ * A parsed Ravencoin asset script. The pointers point into the parsed script, which must outlive
+ * the struct; the strings are not 0-terminated.
+ */
+typedef struct {
+    asset_script_type_e type;
+    // length of the P2PKH or P2SH script that precedes OP_RVN_ASSET; 0 for null asset scripts
+    size_t base_script_len;
+    // the asset name, or the string of a verifier
+    const uint8_t *name;
+    size_t name_len;
+    // amount of the asset (in 1/100_000_000th); 0 for null asset scripts
+    uint64_t amount;
+    // for tags, the hash160 of the tagged address
+    const uint8_t *tagged_hash160;
+    // for tags, 1 if the tag is added and 0 if it is removed; for global restrictions, 1 if the
+    // asset is frozen and 0 if it is unfrozen
+    uint8_t flag;
+} asset_script_t;
+
+/**
+ * Parses a Ravencoin asset script, without copying it. As in Ravencoin Core, the data following
+ * OP_RVN_ASSET is read at fixed offsets, whatever its push opcode. The fields must fill the script
+ * exactly; the scripts with an address must end with OP_DROP.
+ *
+ * The message of a transfer is accepted, but not returned. Its expiration time is 8 bytes long, as
+ * serialized by Ravencoin Core.
+ *
+ * @param script the script
+ * @param script_len the length of the script
+ * @param out the parsed script; only valid on success
+ * @return a constant of type `asset_script_type_e` on success, -1 if the script is not a valid
+ * asset script.
+ */
+int parse_asset_script(const uint8_t script[], size_t script_len, asset_script_t *out);
+
+#ifndef SKIP_FOR_CMOCKA
+
+// the longest description of a null asset script is "Remove tag <name> from <address>"
+#define MAX_NULL_ASSET_OUTPUT_DESC_SIZE \
+    (sizeof("Remove tag  from ") - 1 + MAX_ASSET_NAME_LENGTH + MAX_ADDRESS_LENGTH_STR + 1)
+
+/**
+ * Formats a null asset script parsed with parse_asset_script for user verification, as
+ * "Add tag <name> to <address>", "Remove tag <name> from <address>", "Verifier <string>",
+ * "Freeze <name>" or "Unfreeze <name>". The string is 0-terminated.
+ *
+ * @param asset the parsed null asset script
+ * @param coin_config the configuration for the coin, for the address of tags
+ * @param out the output array
+ * @return the length of the string written into `out` (excluding the terminating 0) on success;
+ * -1 if the script is not a null asset script.
+ */
+int format_null_asset_script(const asset_script_t *asset,
+                             const global_context_t *coin_config,
+                             char out[static MAX_NULL_ASSET_OUTPUT_DESC_SIZE]);
+
+#endif
+
 // the longest OP_RETURN description "OP_RETURN 0x" followed by 160 hexadecimal characters
 #define MAX_OPRETURN_OUTPUT_DESC_SIZE (12 + 80 * 2 + 1)
 
@@ -0,0 +1,556 @@
+#include <string.h>
+
+#include "tx_parser.h"
+
+#include "read.h"
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+#define OP_DUP       0x76
+#define OP_EQUAL     0x87
+#define OP_HASH160   0xa9
+#define OP_CHECKSIG  0xac
+#define OP_RVN_ASSET 0xc0
+
+// Offsets of OP_RVN_ASSET in the scripts with an asset part: after a P2SH or a P2PKH script, or at
+// the start of the null asset scripts (tags and restrictions)
+#define ASSET_OFFSET_P2SH  23
+#define ASSET_OFFSET_P2PKH 25
+#define ASSET_OFFSET_NONE  UINT32_MAX
+
+// pic_fn relocates data pointers; the hooks go through this union rather than through casts between
+// function and object pointers, which ISO C does not define
+typedef union {
+    void *address;
+    tx_hash_hook_t hash;
+    tx_hook_t hook;
+    tx_data_hook_t data_hook;
+    tx_step_hook_t step_hook;
+} tx_hook_address_t;
+
+static tx_hook_address_t hook_address(const tx_parser_t *parser, tx_hook_address_t hook) {
+    if (parser->pic_fn != NULL) {
+        hook.address = parser->pic_fn(hook.address);
+    }
+    return hook;
+}
+
+// Hooks are optional, except hash; the parsing continues if they are missing
+static int call_hook(tx_parser_t *parser, tx_hook_t hook) {
+    if (hook == NULL) {
+        return 1;
+    }
+    tx_hook_address_t address = {.hook = hook};
+    return hook_address(parser, address).hook(parser) < 0 ? -1 : 1;
+}
+
+static int call_data_hook(tx_parser_t *parser, tx_data_hook_t hook, const uint8_t *data) {
+    if (hook == NULL) {
+        return 1;
+    }
+    tx_hook_address_t address = {.data_hook = hook};
+    return hook_address(parser, address).data_hook(parser, data) < 0 ? -1 : 1;
+}
+
+void tx_parser_flush(tx_parser_t *parser) {
+    if (parser->run_length > 0) {
+        tx_hook_address_t address = {.hash = parser->hooks->hash};
+        hook_address(parser, address).hash(parser, parser->run_ptr, parser->run_length);
+        parser->run_length = 0;
+    }
+}
+
+void tx_parser_hash(tx_parser_t *parser, const uint8_t *data, size_t length) {
+    tx_parser_flush(parser);
+    parser->run_ptr = data;
+    parser->run_length = length;
+    tx_parser_flush(parser);
+}
+
+bool tx_parser_peek(buffer_t *buffers[2], size_t index, uint8_t *out) {
+    size_t length0 = buffers[0]->size - buffers[0]->offset;
+    if (index < length0) {
+        *out = buffers[0]->ptr[buffers[0]->offset + index];
+        return true;
+    }
+    index -= length0;
+    if (index < buffers[1]->size - buffers[1]->offset) {
+        *out = buffers[1]->ptr[buffers[1]->offset + index];
+        return true;
+    }
+    return false;
+}
+
+static bool read_bytes(tx_parser_t *parser,
+                       buffer_t *buffers[2],
+                       uint8_t *out,
+                       size_t n,
+                       bool hashed) {
+    if (!dbuffer_can_read(buffers, n)) {
+        return false;
+    }
+
+    for (int i = 0; i < 2 && n > 0; i++) {
+        size_t length = MIN(n, buffers[i]->size - buffers[i]->offset);
+        if (length == 0) {
+            continue;
+        }
+        const uint8_t *data = buffers[i]->ptr + buffers[i]->offset;
+
+        if (hashed) {
+            // extend the pending run if the bytes follow it in memory, otherwise start a new one
+            if (parser->run_length == 0 || parser->run_ptr + parser->run_length != data) {
+                tx_parser_flush(parser);
+                parser->run_ptr = data;
+            }
+            parser->run_length += length;
+        }
+        if (out != NULL) {
+            memcpy(out, data, length);
+            out += length;
+        }
+        buffer_seek_cur(buffers[i], length);
+        n -= length;
+    }
+    return true;
+}
+
+bool tx_parser_read(tx_parser_t *parser, buffer_t *buffers[2], uint8_t *out, size_t n) {
+    return read_bytes(parser, buffers, out, n, false);
+}
+
+bool tx_parser_read_hashed(tx_parser_t *parser, buffer_t *buffers[2], uint8_t *out, size_t n) {
+    return read_bytes(parser, buffers, out, n, true);
+}
+
+// Same return values as a parsing step. Varints of 8 bytes are not valid in a transaction.
+static int read_varint(tx_parser_t *parser,
+                       buffer_t *buffers[2],
+                       uint32_t *out,
+                       bool hashed) {
+    uint8_t prefix;
+    if (!tx_parser_peek(buffers, 0, &prefix)) {
+        return 0;
+    }
+
+    size_t length = prefix < 0xfd ? 0 : prefix == 0xfd ? 2 : prefix == 0xfe ? 4 : 8;
+    if (length == 8) {
+        return -1;
+    }
+
+    uint8_t data[1 + 4] = {0};
+    if (!read_bytes(parser, buffers, data, 1 + length, hashed)) {
+        return 0;
+    }
+    *out = length == 0 ? prefix : read_u32_le(data, 1);
+    return 1;
+}
+
+// Passes the next bytes of the script of an output, starting at the given offset in the script, to
+// the sinks
+static void sink_output_script(tx_parser_t *parser,
+                               const uint8_t *data,
+                               size_t length,
+                               uint32_t offset) {
+    tx_output_sink_t *output_sink = parser->output_sink;
+    if (output_sink != NULL && output_sink->index == parser->item_index &&
+        offset < output_sink->script_max_length) {
+        memcpy(output_sink->script + offset,
+               data,
+               MIN(length, output_sink->script_max_length - offset));
+    }
+
+    tx_asset_sink_t *asset_sink = parser->asset_sink;
+    if (asset_sink == NULL) {
+        return;
+    }
+    // looks for OP_RVN_ASSET only where a standard script can be followed by it
+    for (size_t i = 0; i < length && !asset_sink->found && offset + i <= ASSET_OFFSET_P2PKH;
+         i++) {
+        uint32_t position = offset + i;
+        uint8_t previous_byte = i > 0 ? data[i - 1] : parser->script_last_byte;
+        if (position == 0) {
+            parser->script_first_byte = data[i];
+        }
+        if (data[i] == OP_RVN_ASSET &&
+            (position == 0 ||
+             (position == ASSET_OFFSET_P2SH && parser->script_first_byte == OP_HASH160 &&
+              previous_byte == OP_EQUAL) ||
+             (position == ASSET_OFFSET_P2PKH && parser->script_first_byte == OP_DUP &&
+              previous_byte == OP_CHECKSIG))) {
+            asset_sink->found = true;
+            asset_sink->script_length = parser->script_size - position;
+            parser->asset_offset = position;
+        }
+    }
+    if (asset_sink->found && offset + length > parser->asset_offset) {
+        uint32_t start = MAX(offset, parser->asset_offset);  // in the script
+        uint32_t asset_start = start - parser->asset_offset;
+        if (asset_start < asset_sink->script_max_length) {
+            memcpy(asset_sink->script + asset_start,
+                   data + (start - offset),
+                   MIN(offset + length - start, asset_sink->script_max_length - asset_start));
+        }
+    }
+    // previous byte of the next call
+    parser->script_last_byte = data[length - 1];
+}
+
+// Reads the bytes of a script, as many as available, remembering the last one; the bytes of the
+// scripts of the outputs are passed to the sinks
+static int read_script(tx_parser_t *parser, buffer_t *buffers[2], bool hashed, bool is_output) {
+    size_t length = MIN(parser->script_remaining, dbuffer_get_length(buffers));
+    if (length > 0) {
+        if (is_output && (parser->output_sink != NULL || parser->asset_sink != NULL)) {
+            uint32_t offset = parser->script_size - parser->script_remaining;
+            size_t remaining = length;
+            for (int i = 0; i < 2 && remaining > 0; i++) {
+                size_t n = MIN(remaining, buffers[i]->size - buffers[i]->offset);
+                if (n > 0) {
+                    sink_output_script(parser, buffers[i]->ptr + buffers[i]->offset, n, offset);
+                    offset += n;
+                    remaining -= n;
+                }
+            }
+        }
+        tx_parser_peek(buffers, length - 1, &parser->script_last_byte);
+        read_bytes(parser, buffers, NULL, length, hashed);
+        parser->script_remaining -= length;
+    }
+    return parser->script_remaining == 0 ? 1 : 0;
+}
+
+/*   PARSER FOR AN INPUT */
+
+static int parse_input_header(tx_parser_t *parser, buffer_t *buffers[2]) {
+    if (parser->hooks->input_header == NULL) {
+        // prevout : 32 hash + 4 index
+        return tx_parser_read_hashed(parser, buffers, NULL, 36);
+    }
+    tx_hook_address_t address = {.step_hook = parser->hooks->input_header};
+    return hook_address(parser, address).step_hook(parser, buffers);
+}
+
+static int parse_input_script_size(tx_parser_t *parser, buffer_t *buffers[2]) {
+    int result = read_varint(parser, buffers, &parser->script_size, true);
+    if (result != 1) {
+        return result;
+    }
+    parser->script_remaining = parser->script_size;
+    return call_hook(parser, parser->hooks->input_script_size);
+}
+
+static int parse_input_script(tx_parser_t *parser, buffer_t *buffers[2]) {
+    return read_script(parser, buffers, true, false);
+}
+
+// Does not read any bytes
+static int parse_input_script_end(tx_parser_t *parser, buffer_t *buffers[2]) {
+    (void) buffers;
+
+    return call_hook(parser, parser->hooks->input_script_end);
+}
+
+static int parse_input_sequence(tx_parser_t *parser, buffer_t *buffers[2]) {
+    uint8_t sequence[4];
+    if (!read_bytes(parser, buffers, sequence, sizeof(sequence), true)) {
+        return 0;
+    }
+    return call_data_hook(parser, parser->hooks->input_sequence, sequence);
+}
+
+static const parsing_step_t parse_input_steps[] = {
+    (parsing_step_t) parse_input_header,
+    (parsing_step_t) parse_input_script_size,
+    (parsing_step_t) parse_input_script,
+    (parsing_step_t) parse_input_script_end,
+    (parsing_step_t) parse_input_sequence,
+};
+
+static const size_t n_parse_input_steps = sizeof(parse_input_steps) / sizeof(parse_input_steps[0]);
+
+/*   PARSER FOR AN OUTPUT */
+
+static int parse_output_amount(tx_parser_t *parser, buffer_t *buffers[2]) {
+    uint8_t amount[8];
+    if (!read_bytes(parser, buffers, amount, sizeof(amount), true)) {
+        return 0;
+    }
+    if (parser->output_sink != NULL && parser->output_sink->index == parser->item_index) {
+        memcpy(parser->output_sink->amount, amount, sizeof(amount));
+    }
+    return call_data_hook(parser, parser->hooks->output_amount, amount);
+}
+
+static int parse_output_script_size(tx_parser_t *parser, buffer_t *buffers[2]) {
+    int result = read_varint(parser, buffers, &parser->script_size, true);
+    if (result != 1) {
+        return result;
+    }
+    parser->script_remaining = parser->script_size;
+
+    if (parser->output_sink != NULL && parser->output_sink->index == parser->item_index) {
+        parser->output_sink->found = true;
+        parser->output_sink->script_length = parser->script_size;
+    }
+    if (parser->asset_sink != NULL) {
+        parser->asset_sink->found = false;
+        parser->asset_sink->script_length = 0;
+        parser->asset_offset = ASSET_OFFSET_NONE;
+    }
+    return 1;
+}
+
+static int parse_output_script(tx_parser_t *parser, buffer_t *buffers[2]) {
+    return read_script(parser, buffers, true, true);
+}
+
+// Does not read any bytes
+static int parse_output_end(tx_parser_t *parser, buffer_t *buffers[2]) {
+    (void) buffers;
+
+    return call_hook(parser, parser->hooks->output_end);
+}
+
+static const parsing_step_t parse_output_steps[] = {
+    (parsing_step_t) parse_output_amount,
+    (parsing_step_t) parse_output_script_size,
+    (parsing_step_t) parse_output_script,
+    (parsing_step_t) parse_output_end,
+};
+
+static const size_t n_parse_output_steps =
+    sizeof(parse_output_steps) / sizeof(parse_output_steps[0]);
+
+/*   PARSER FOR A WITNESS */
+
+static int parse_witness_element_count(tx_parser_t *parser, buffer_t *buffers[2]) {
+    int result = read_varint(parser, buffers, &parser->n_witness_elements, false);
+    if (result == 1) {
+        parser->witness_element_index = 0;
+        parser->witness_element_started = false;
+    }
+    return result;
+}
+
+// The witnesses are not part of the txid, and are skipped
+static int parse_witness_elements(tx_parser_t *parser, buffer_t *buffers[2]) {
+    while (parser->witness_element_index < parser->n_witness_elements) {
+        if (!parser->witness_element_started) {
+            int result = read_varint(parser, buffers, &parser->script_remaining, false);
+            if (result != 1) {
+                return result;
+            }
+            parser->witness_element_started = true;
+        }
+
+        size_t length = MIN(parser->script_remaining, dbuffer_get_length(buffers));
+        read_bytes(parser, buffers, NULL, length, false);
+        parser->script_remaining -= length;
+        if (parser->script_remaining > 0) {
+            return 0;
+        }
+
+        parser->witness_element_started = false;
+        ++parser->witness_element_index;
+    }
+    return 1;
+}
+
+static const parsing_step_t parse_witness_steps[] = {
+    (parsing_step_t) parse_witness_element_count,
+    (parsing_step_t) parse_witness_elements,
+};
+
+static const size_t n_parse_witness_steps =
+    sizeof(parse_witness_steps) / sizeof(parse_witness_steps[0]);
+
+/*   PARSER FOR A TRANSACTION */
+
+static int parse_items(tx_parser_t *parser,
+                       buffer_t *buffers[2],
+                       const parsing_step_t *steps,
+                       size_t n_steps) {
+    while (parser->item_index < parser->n_items) {
+        int result =
+            parser_run(steps, n_steps, &parser->item_parser_context, buffers, parser->pic_fn);
+        if (result != 1) {
+            return result;  // stream exhausted, or error
+        }
+
+        ++parser->item_index;
+        parser_init_context(&parser->item_parser_context, parser);
+    }
+    return 1;
+}
+
+static int parse_item_count(tx_parser_t *parser, buffer_t *buffers[2]) {
+    int result = read_varint(parser, buffers, &parser->n_items, true);
+    if (result == 1) {
+        parser->item_index = 0;
+        parser_init_context(&parser->item_parser_context, parser);
+    }
+    return result;
+}
+
+static int parse_version(tx_parser_t *parser, buffer_t *buffers[2]) {
+    uint8_t version[4];
+    if (!read_bytes(parser, buffers, version, sizeof(version), true)) {
+        return 0;
+    }
+    return call_data_hook(parser, parser->hooks->version, version);
+}
+
+static int parse_timestamp(tx_parser_t *parser, buffer_t *buffers[2]) {
+    if (!parser->has_timestamp) {
+        return 1;
+    }
+    return read_bytes(parser, buffers, NULL, 4, true);
+}
+
+// In the BIP144 serialization, a 0x00 marker and a 0x01 flag are where the input count would be
+static int parse_segwit_marker(tx_parser_t *parser, buffer_t *buffers[2]) {
+    if ((parser->flags & TX_PARSER_SEGWIT) == 0) {
+        return 1;
+    }
+
+    uint8_t marker;
+    if (!tx_parser_peek(buffers, 0, &marker)) {
+        return 0;
+    }
+    if (marker != 0x00) {
+        return 1;  // legacy serialization
+    }
+
+    uint8_t marker_flag[2];
+    if (!read_bytes(parser, buffers, marker_flag, sizeof(marker_flag), false)) {
+        return 0;
+    }
+    if (marker_flag[1] != 0x01) {
+        return -1;
+    }
+    parser->is_segwit = true;
+    return 1;
+}
+
+static int parse_input_count(tx_parser_t *parser, buffer_t *buffers[2]) {
+    int result = parse_item_count(parser, buffers);
+    if (result != 1) {
+        return result;
+    }
+    parser->n_inputs = parser->n_items;
+    return call_hook(parser, parser->hooks->inputs_start);
+}
+
+static int parse_inputs(tx_parser_t *parser, buffer_t *buffers[2]) {
+    return parse_items(parser, buffers, parse_input_steps, n_parse_input_steps);
+}
+
+// Does not read any bytes
+static int parse_inputs_end(tx_parser_t *parser, buffer_t *buffers[2]) {
+    (void) buffers;
+
+    return call_hook(parser, parser->hooks->inputs_end);
+}
+
+static int parse_output_count(tx_parser_t *parser, buffer_t *buffers[2]) {
+    return parse_item_count(parser, buffers);
+}
+
+static int parse_outputs(tx_parser_t *parser, buffer_t *buffers[2]) {
+    return parse_items(parser, buffers, parse_output_steps, n_parse_output_steps);
+}
+
+// Does not read any bytes
+static int parse_witnesses_start(tx_parser_t *parser, buffer_t *buffers[2]) {
+    (void) buffers;
+
+    // one witness per input
+    parser->n_items = parser->is_segwit ? parser->n_inputs : 0;
+    parser->item_index = 0;
+    parser_init_context(&parser->item_parser_context, parser);
+    return 1;
+}
+
+static int parse_witnesses(tx_parser_t *parser, buffer_t *buffers[2]) {
+    return parse_items(parser, buffers, parse_witness_steps, n_parse_witness_steps);
+}
+
+static int parse_locktime(tx_parser_t *parser, buffer_t *buffers[2]) {
+    return read_bytes(parser, buffers, NULL, 4, true);
+}
+
+static int parse_extra_size(tx_parser_t *parser, buffer_t *buffers[2]) {
+    if ((parser->flags & TX_PARSER_EXTRA_DATA) == 0 || dbuffer_get_length(buffers) == 0) {
+        parser->script_remaining = 0;
+        return 1;
+    }
+    return read_varint(parser, buffers, &parser->script_remaining, false);
+}
+
+static int parse_extra(tx_parser_t *parser, buffer_t *buffers[2]) {
+    return read_script(parser, buffers, true, false);
+}
+
+static const parsing_step_t parse_tx_steps[] = {
+    (parsing_step_t) parse_version,
+    (parsing_step_t) parse_timestamp,
+    (parsing_step_t) parse_segwit_marker,
+    (parsing_step_t) parse_input_count,
+    (parsing_step_t) parse_inputs,
+    (parsing_step_t) parse_inputs_end,
+    (parsing_step_t) parse_output_count,
+    (parsing_step_t) parse_outputs,
+    (parsing_step_t) parse_witnesses_start,
+    (parsing_step_t) parse_witnesses,
+    (parsing_step_t) parse_locktime,
+    (parsing_step_t) parse_extra_size,
+    (parsing_step_t) parse_extra,
+};
+
+// steps up to parse_inputs_end included
+#define N_PARSE_TX_INPUTS_STEPS 6
+
+static const size_t n_parse_tx_steps = sizeof(parse_tx_steps) / sizeof(parse_tx_steps[0]);
+
+void tx_parser_init(tx_parser_t *parser,
+                    const tx_parser_hooks_t *hooks,
+                    void *(*pic_fn)(void *),
+                    uint8_t flags) {
+    memset(parser, 0, sizeof(tx_parser_t));
+    parser->hooks = hooks;
+    parser->pic_fn = pic_fn;
+    parser->flags = flags;
+    parser->n_steps =
+        (flags & TX_PARSER_INPUTS_ONLY) != 0 ? N_PARSE_TX_INPUTS_STEPS : n_parse_tx_steps;
+    parser_init_context(&parser->parser_context, parser);
+}
+
+int tx_parser_process(tx_parser_t *parser, const uint8_t *data, size_t length) {
+    buffer_t store_buf = buffer_create(parser->store, parser->store_length);
+    buffer_t data_buf = buffer_create((uint8_t *) data, length);
+    buffer_t *buffers[] = {&store_buf, &data_buf};
+
+    int result = parser_run(parse_tx_steps,
+                            parser->n_steps,
+                            &parser->parser_context,
+                            buffers,
+                            parser->pic_fn);
+
+    // the run can point to the chunk, which is only valid during this call
+    tx_parser_flush(parser);
+
+    if (result == 0) {
+        if (!parser_consolidate_buffers(buffers, sizeof(parser->store))) {
+            return -1;
+        }
+        parser->store_length = store_buf.size;
+    }
+    return result;
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "parser.h"
+
+/**
+ * Resumable parser of serialized transactions, built on the parsing steps of parser.h. It is shared
+ * by the legacy GET TRUSTED INPUT and HASH INPUT START commands and by the parsing of the
+ * non-witness UTXOs of a PSBT.
+ *
+ * The parser does not depend on the SDK. What the transaction is parsed for is plugged in as sinks:
+ * - the hash hook receives the bytes that are part of the txid (or of the legacy hashes);
+ * - an output sink extracts the amount and the script of one output;
+ * - an asset sink extracts the Ravencoin asset part of the script of each output, from the
+ *   OP_RVN_ASSET opcode to the end of the script;
+ * - the other hooks let the legacy commands check and hash each input in their own way.
+ *
+ * The bytes consumed from a chunk are not hashed field by field, but accumulated in a pending run
+ * that is passed to the hash hook once the run is interrupted, so that most of a chunk is hashed in
+ * a single call.
+ */
+
+// Largest field that must be read at once is a legacy input with a Trusted Input: flag, length and
+// the 56 bytes of the Trusted Input.
+#define TX_PARSER_STORE_SIZE 64
+
+// The parsing is complete once the inputs_end hook is called
+#define TX_PARSER_INPUTS_ONLY 0x01
+// Accept the BIP144 serialization; the marker, the flag and the witnesses are not hashed
+#define TX_PARSER_SEGWIT 0x02
+// Some coins append extra data after the locktime, in the same chunk; its length is not hashed
+#define TX_PARSER_EXTRA_DATA 0x04
+
+typedef struct tx_parser_s tx_parser_t;
+
+// Hashes bytes of the transaction
+typedef void (*tx_hash_hook_t)(tx_parser_t *parser, const uint8_t *data, size_t length);
+// Hooks return a negative number to abort the parsing
+typedef int (*tx_hook_t)(tx_parser_t *parser);
+typedef int (*tx_data_hook_t)(tx_parser_t *parser, const uint8_t *data);
+// Same return values as a parsing_step_t
+typedef int (*tx_step_hook_t)(tx_parser_t *parser, buffer_t *buffers[2]);
+
+typedef struct {
+    tx_hash_hook_t hash;
+    // called with the 4 bytes of the version; can set has_timestamp
+    tx_data_hook_t version;
+    // called once n_items is the number of inputs
+    tx_hook_t inputs_start;
+    // reads the input up to its script length, excluded; if NULL, the 36 bytes of the prevout are
+    // read and hashed
+    tx_step_hook_t input_header;
+    // called once script_size is known, before the script
+    tx_hook_t input_script_size;
+    // called after the script, before the sequence
+    tx_hook_t input_script_end;
+    // called with the 4 bytes of the sequence
+    tx_data_hook_t input_sequence;
+    tx_hook_t inputs_end;
+    // called with the 8 bytes of the amount of the output item_index
+    tx_data_hook_t output_amount;
+    // called after the script of the output item_index, once the sinks are filled for it
+    tx_hook_t output_end;
+} tx_parser_hooks_t;
+
+// Extracts the amount and the script of the output at the given index
+typedef struct {
+    uint32_t index;
+    uint8_t *script;  // receives the first script_max_length bytes of the script
+    size_t script_max_length;
+
+    // set by the parser
+    bool found;
+    uint8_t amount[8];
+    uint32_t script_length;  // length of the whole script, can be larger than script_max_length
+} tx_output_sink_t;
+
+// Extracts the asset part of the script of each output; filled again for each output, it must be
+// read in the output_end hook
+typedef struct {
+    uint8_t *script;  // receives the first script_max_length bytes from the OP_RVN_ASSET opcode
+    size_t script_max_length;
+
+    // set by the parser
+    bool found;              // the script of the output has an asset part
+    uint32_t script_length;  // length of the asset part, can be larger than script_max_length
+} tx_asset_sink_t;
+
+struct tx_parser_s {
+    const tx_parser_hooks_t *hooks;
+    void *(*pic_fn)(void *);
+    void *state;  // state of the caller, for its hooks
+    tx_output_sink_t *output_sink;
+    tx_asset_sink_t *asset_sink;
+    uint8_t flags;
+    uint8_t n_steps;
+    bool has_timestamp;  // a timestamp follows the version
+    bool is_segwit;      // the transaction has witnesses
+
+    // bytes consumed and not hashed yet
+    const uint8_t *run_ptr;
+    size_t run_length;
+
+    uint8_t store[TX_PARSER_STORE_SIZE];  // bytes of an incomplete field of the last chunk
+    size_t store_length;
+
+    parser_context_t parser_context;
+    parser_context_t item_parser_context;
+
+    uint32_t n_inputs;
+    uint32_t n_items;     // number of inputs, outputs or witnesses
+    uint32_t item_index;  // index of the current input, output or witness
+    uint32_t script_size;
+    uint32_t script_remaining;
+    uint32_t asset_offset;  // offset of OP_RVN_ASSET in the script of the current output
+    uint32_t n_witness_elements;
+    uint32_t witness_element_index;
+    bool witness_element_started;  // the length of the current witness element is read
+    uint8_t script_first_byte;
+    uint8_t script_last_byte;
+    uint8_t input_type;  // set by the input_header hook, for the next hooks of the same input
+};
+
+/**
+ * Initializes the parser for a new transaction, with a combination of the TX_PARSER_* flags. The
+ * hooks must be reachable without pic_fn, while the functions in them are passed to pic_fn (if not
+ * NULL). The sinks and the state are not set.
+ */
+void tx_parser_init(tx_parser_t *parser,
+                    const tx_parser_hooks_t *hooks,
+                    void *(*pic_fn)(void *),
+                    uint8_t flags);
+
+/**
+ * Parses the next chunk of the transaction. Returns 1 once the transaction is complete (any data
+ * after it is ignored), 0 if more data is needed, or a negative number on error.
+ */
+int tx_parser_process(tx_parser_t *parser, const uint8_t *data, size_t length);
+
+/**
+ * Passes the pending run of consumed bytes to the hash hook. Hooks must call it before changing
+ * what the hash hook does, or before hashing anything else in the same hash contexts.
+ */
+void tx_parser_flush(tx_parser_t *parser);
+
+/**
+ * Hashes data that is not read from the transaction, like the prevout of a Trusted Input, in
+ * order with the bytes already consumed.
+ */
+void tx_parser_hash(tx_parser_t *parser, const uint8_t *data, size_t length);
+
+/**
+ * Helpers for the input_header hook: peek at the byte at the given index without consuming it,
+ * and read n bytes (out can be NULL), either skipping them or adding them to the hash.
+ */
+bool tx_parser_peek(buffer_t *buffers[2], size_t index, uint8_t *out);
+
+bool tx_parser_read(tx_parser_t *parser, buffer_t *buffers[2], uint8_t *out, size_t n);
+
+bool tx_parser_read_hashed(tx_parser_t *parser, buffer_t *buffers[2], uint8_t *out, size_t n);
@@ -58,14 +58,26 @@
 #define EXPONENT_SMALLEST_UNIT 3
 
 /**
- * Maximum scriptPubKey length for an input that we can sign.
+ * Maximum scriptPubKey length for an input that we can sign, other than Ravencoin asset scripts.
  */
 #define MAX_PREVOUT_SCRIPTPUBKEY_LEN 34  // P2WSH's scriptPubKeys are the longest supported
 
+/**
+ * Maximum length of a Ravencoin asset scriptPubKey: a P2PKH script, followed by the transfer of an
+ * asset with the longest name, a message and an expiration time.
+ */
+#define MAX_ASSET_SCRIPTPUBKEY_LEN 115
+
+/**
+ * Maximum length of the name of a Ravencoin asset (characters), including the '!' of ownership
+ * tokens.
+ */
+#define MAX_ASSET_NAME_LENGTH 31
+
 /**
  * Maximum scriptPubKey length for an output that we can recognize.
  */
-#define MAX_OUTPUT_SCRIPTPUBKEY_LEN 83  // max 83 for OP_RETURN; other scripts are shorter
+#define MAX_OUTPUT_SCRIPTPUBKEY_LEN MAX_ASSET_SCRIPTPUBKEY_LEN  // OP_RETURN (max 83) is shorter
 
 /**
  * Maximum length of a wallet registered into the device (characters), excluding terminating NULL.
@@ -86,6 +86,163 @@ static int secp256k1_point(const uint8_t k[static 32], uint8_t out[static 65]) {
     return cx_ecfp_scalar_mult(CX_CURVE_SECP256K1, out, 65, k, 32);
 }
 
+/**
+ * Cache of the last node derived from the seed, at the longest hardened prefix of the requested
+ * path (typically, the account). Derivations below it (like the change and address index steps, or
+ * the accounts of a cached purpose and coin type) are computed from the cached node, instead of
+ * deriving the whole path again from the seed.
+ * It is wiped with crypto_clear_derivation_cache at the end of each command, and by the callers
+ * that derive keys outside of a command (like the swap address check).
+ */
+static struct {
+    bool is_valid;
+    uint8_t path_len;
+    uint32_t path[MAX_BIP32_PATH_STEPS];
+    uint8_t private_key[32];
+    uint8_t chain_code[32];
+    uint8_t compressed_pubkey[33];
+} G_derivation_cache;
+
+void crypto_clear_derivation_cache() {
+    explicit_bzero(&G_derivation_cache, sizeof(G_derivation_cache));
+}
+
+/**
+ * Computes the private key and chain code of the child with the given index, in place. The
+ * compressed pubkey of the parent is only used for unhardened children. If child_pubkey is not
+ * NULL, it also computes the child's compressed pubkey.
+ * It must be wrapped in a TRY block.
+ * Returns 0 on success, -1 in the (extremely unlikely) case that the child key is invalid.
+ */
+static int bip32_CKDpriv(uint8_t private_key[static 32],
+                         uint8_t chain_code[static 32],
+                         const uint8_t pubkey[static 33],
+                         uint32_t index,
+                         uint8_t *child_pubkey) {
+    uint8_t I[64];
+
+    {
+        // 0x00 || private_key || index for a hardened child, pubkey || index otherwise
+        uint8_t tmp[33 + 4];
+        if (index >= BIP32_FIRST_HARDENED_CHILD) {
+            tmp[0] = 0x00;
+            memcpy(tmp + 1, private_key, 32);
+        } else {
+            memcpy(tmp, pubkey, 33);
+        }
+        write_u32_be(tmp, 33, index);
+
+        cx_hmac_sha512(chain_code, 32, tmp, sizeof(tmp), I, 64);
+        explicit_bzero(tmp, sizeof(tmp));
+    }
+
+    int ret = 0;
+    // fail if I_L is not smaller than the group order n, but the probability is < 1/2^128
+    if (cx_math_cmp(I, secp256k1_n, 32) >= 0) {
+        ret = -1;
+    } else {
+        cx_math_addm(private_key, private_key, I, secp256k1_n, 32);
+        memcpy(chain_code, &I[32], 32);
+
+        if (cx_math_is_zero(private_key, 32)) {
+            ret = -1;
+        } else if (child_pubkey != NULL) {
+            uint8_t P[65];
+            secp256k1_point(private_key, P);
+            crypto_get_compressed_pubkey(P, child_pubkey);
+        }
+    }
+
+    explicit_bzero(I, sizeof(I));
+    return ret;
+}
+
+/**
+ * Derives the private key and chain code at the given path; if pubkey is not NULL, it also receives
+ * the compressed pubkey of the node. The path is derived from the cached node if it is a prefix of
+ * the hardened steps of the path; otherwise, the longest hardened prefix of the path is derived
+ * from the seed and cached.
+ * It must be wrapped in a TRY block.
+ * Returns 0 on success, -1 in the (extremely unlikely) case that a child key is invalid.
+ */
+static int derive_node(const uint32_t *bip32_path,
+                       uint8_t bip32_path_len,
+                       uint8_t private_key[static 32],
+                       uint8_t chain_code[static 32],
+                       uint8_t *pubkey) {
+    // length of the prefix of the path up to the last hardened step
+    uint8_t prefix_len = bip32_path_len;
+    while (prefix_len > 0 && bip32_path[prefix_len - 1] < BIP32_FIRST_HARDENED_CHILD) {
+        --prefix_len;
+    }
+
+    if (prefix_len > MAX_BIP32_PATH_STEPS) {
+        // too long to be cached; derive the seed with bip32_path
+        os_perso_derive_node_bip32(CX_CURVE_256K1,
+                                   bip32_path,
+                                   bip32_path_len,
+                                   private_key,
+                                   chain_code);
+        if (pubkey != NULL) {
+            uint8_t P[65];
+            secp256k1_point(private_key, P);
+            crypto_get_compressed_pubkey(P, pubkey);
+        }
+        return 0;
+    }
+
+    // The master node is not used as a prefix: deriving the hardened steps from it is not cheaper
+    // than deriving them from the seed, and it would stay cached instead of the account.
+    bool is_cached = G_derivation_cache.is_valid && G_derivation_cache.path_len > 0 &&
+                     G_derivation_cache.path_len <= prefix_len &&
+                     memcmp(G_derivation_cache.path,
+                            bip32_path,
+                            G_derivation_cache.path_len * sizeof(uint32_t)) == 0;
+    if (!is_cached) {
+        // derive the seed with the hardened prefix of bip32_path, and cache it
+        G_derivation_cache.is_valid = false;
+
+        os_perso_derive_node_bip32(CX_CURVE_256K1,
+                                   bip32_path,
+                                   prefix_len,
+                                   G_derivation_cache.private_key,
+                                   G_derivation_cache.chain_code);
+
+        uint8_t P[65];
+        secp256k1_point(G_derivation_cache.private_key, P);
+        crypto_get_compressed_pubkey(P, G_derivation_cache.compressed_pubkey);
+
+        memcpy(G_derivation_cache.path, bip32_path, prefix_len * sizeof(uint32_t));
+        G_derivation_cache.path_len = prefix_len;
+        G_derivation_cache.is_valid = true;
+    }
+
+    memcpy(private_key, G_derivation_cache.private_key, 32);
+    memcpy(chain_code, G_derivation_cache.chain_code, 32);
+
+    // derive the remaining steps from the cached node; the pubkey of a child is only computed if
+    // the next step is unhardened, or if it is the requested node and pubkey is not NULL
+    uint8_t node_pubkey[33];
+    memcpy(node_pubkey, G_derivation_cache.compressed_pubkey, 33);
+    for (uint8_t i = G_derivation_cache.path_len; i < bip32_path_len; i++) {
+        bool is_pubkey_needed = i + 1 < bip32_path_len
+                                    ? bip32_path[i + 1] < BIP32_FIRST_HARDENED_CHILD
+                                    : pubkey != NULL;
+        if (bip32_CKDpriv(private_key,
+                          chain_code,
+                          node_pubkey,
+                          bip32_path[i],
+                          is_pubkey_needed ? node_pubkey : NULL) < 0) {
+            return -1;
+        }
+    }
+
+    if (pubkey != NULL) {
+        memcpy(pubkey, node_pubkey, 33);
+    }
+    return 0;
+}
+
 int crypto_derive_private_key(cx_ecfp_private_key_t *private_key,
                               uint8_t chain_code[static 32],
                               const uint32_t *bip32_path,
@@ -95,19 +252,15 @@ int crypto_derive_private_key(cx_ecfp_private_key_t *private_key,
     int ret = 0;
     BEGIN_TRY {
         TRY {
-            // derive the seed with bip32_path
-
-            os_perso_derive_node_bip32(CX_CURVE_256K1,
-                                       bip32_path,
-                                       bip32_path_len,
-                                       raw_private_key,
-                                       chain_code);
-
-            // new private_key from raw
-            cx_ecfp_init_private_key(CX_CURVE_256K1,
-                                     raw_private_key,
-                                     sizeof(raw_private_key),
-                                     private_key);
+            ret = derive_node(bip32_path, bip32_path_len, raw_private_key, chain_code, NULL);
+
+            if (ret == 0) {
+                // new private_key from raw
+                cx_ecfp_init_private_key(CX_CURVE_256K1,
+                                         raw_private_key,
+                                         sizeof(raw_private_key),
+                                         private_key);
+            }
         }
         CATCH_ALL {
             ret = -1;
@@ -272,34 +425,21 @@ bool crypto_get_compressed_pubkey_at_path(const uint32_t bip32_path[],
                                           uint8_t bip32_path_len,
                                           uint8_t pubkey[static 33],
                                           uint8_t chain_code[]) {
-    struct {
-        uint8_t prefix;
-        uint8_t raw_public_key[64];
-        uint8_t chain_code[32];
-    } keydata;
-
-    cx_ecfp_private_key_t private_key = {0};
-    cx_ecfp_public_key_t public_key;
+    uint8_t raw_private_key[32];
+    uint8_t node_chain_code[32];
 
     bool result = true;
     BEGIN_TRY {
         TRY {
-            keydata.prefix = 0x04;  // uncompressed public keys always start with 04
-            // derive private key according to BIP32 path
-            crypto_derive_private_key(&private_key, keydata.chain_code, bip32_path, bip32_path_len);
-
-            if (chain_code != NULL) {
-                memmove(chain_code, keydata.chain_code, 32);
-            }
-
-            // generate corresponding public key
-            cx_ecfp_generate_pair(CX_CURVE_256K1, &public_key, &private_key, 1);
-
-            memmove(keydata.raw_public_key, public_key.W + 1, 64);
-
-            // compute compressed public key
-            if (crypto_get_compressed_pubkey((uint8_t *) &keydata, pubkey) < 0) {
+            // the pubkey is computed while deriving the node, instead of generating the pair again
+            if (derive_node(bip32_path,
+                            bip32_path_len,
+                            raw_private_key,
+                            node_chain_code,
+                            pubkey) < 0) {
                 result = false;
+            } else if (chain_code != NULL) {
+                memmove(chain_code, node_chain_code, 32);
             }
         }
         CATCH_ALL {
@@ -307,8 +447,8 @@ bool crypto_get_compressed_pubkey_at_path(const uint32_t bip32_path[],
         }
         FINALLY {
             // delete sensitive data
-            explicit_bzero(keydata.chain_code, 32);
-            explicit_bzero(&private_key, sizeof(private_key));
+            explicit_bzero(raw_private_key, sizeof(raw_private_key));
+            explicit_bzero(node_chain_code, sizeof(node_chain_code));
         }
     }
     END_TRY;
@@ -355,20 +495,29 @@ int get_serialized_extended_pubkey_at_path(const uint32_t bip32_path[],
                                            uint8_t bip32_path_len,
                                            uint32_t bip32_pubkey_version,
                                            char out[static MAX_SERIALIZED_PUBKEY_LENGTH + 1]) {
-    // find parent key's fingerprint and child number
+    // find parent key's fingerprint
     uint32_t parent_fingerprint = 0;
-    uint32_t child_number = 0;
     if (bip32_path_len > 0) {
-        // here we reuse the storage for the parent keys that we will later use
-        // for the response, in order to save memory
-
         uint8_t parent_pubkey[33];
         crypto_get_compressed_pubkey_at_path(bip32_path, bip32_path_len - 1, parent_pubkey, NULL);
 
         parent_fingerprint = crypto_get_key_fingerprint(parent_pubkey);
-        child_number = bip32_path[bip32_path_len - 1];
     }
 
+    return serialize_extended_pubkey_at_path(bip32_path,
+                                             bip32_path_len,
+                                             bip32_pubkey_version,
+                                             parent_fingerprint,
+                                             out);
+}
+
+int serialize_extended_pubkey_at_path(const uint32_t bip32_path[],
+                                      uint8_t bip32_path_len,
+                                      uint32_t bip32_pubkey_version,
+                                      uint32_t parent_fingerprint,
+                                      char out[static MAX_SERIALIZED_PUBKEY_LENGTH + 1]) {
+    uint32_t child_number = bip32_path_len > 0 ? bip32_path[bip32_path_len - 1] : 0;
+
     struct {
         serialized_extended_pubkey_t ext_pubkey;
         uint8_t checksum[4];
@@ -50,6 +50,12 @@ int crypto_derive_private_key(cx_ecfp_private_key_t *private_key,
                               const uint32_t *bip32_path,
                               uint8_t bip32_path_len);
 
+/**
+ * Wipes the cache of derived private keys used by crypto_derive_private_key. It must be called
+ * when a command terminates; the app registers it as the cleanup callback of apdu_dispatcher.
+ */
+void crypto_clear_derivation_cache();
+
 /**
  * Initialize public key given private key.
  *
@@ -290,6 +296,31 @@ int get_serialized_extended_pubkey_at_path(const uint32_t bip32_path[],
                                            uint32_t bip32_pubkey_version,
                                            char out[static MAX_SERIALIZED_PUBKEY_LENGTH + 1]);
 
+/**
+ * Like get_serialized_extended_pubkey_at_path, but with the fingerprint of the parent key given by
+ * the caller, so that the parent is not derived again for keys that share the same parent.
+ *
+ * @param[in]  bip32_path
+ *   Pointer to 32-bit array of BIP-32 derivation steps.
+ * @param[in]  bip32_path_len
+ *   Number of steps in the BIP32 derivation.
+ * @param[in]  bip32_pubkey_version
+ *   Version prefix to use for the pubkey.
+ * @param[in]  parent_fingerprint
+ *   The fingerprint of the key at the first bip32_path_len - 1 steps of bip32_path, or 0 if
+ * bip32_path_len is 0.
+ * @param[out] out
+ *   Pointer to the output buffer, which must be long enough to contain the result (including the
+ * terminating null).
+ *
+ * @return the length of the output pubkey (not including the null character), or -1 on error.
+ */
+int serialize_extended_pubkey_at_path(const uint32_t bip32_path[],
+                                      uint8_t bip32_path_len,
+                                      uint32_t bip32_pubkey_version,
+                                      uint32_t parent_fingerprint,
+                                      char out[static MAX_SERIALIZED_PUBKEY_LENGTH + 1]);
+
 /**
  * Derives the level-1 symmetric key at the given label using SLIP-0021.
  * Must be wrapped in a TRY/FINALLY block to make sure that the output key is wiped after using it.
@@ -15,16 +15,53 @@
 #define CCMD_GET_PREIMAGE 0x40
 
 // Request : <GET_MERKLE_LEAF_PROOF : 1> <merkle_root : 32> <tree_size: 4> <leaf_index: 4>
+//           [<proof_size : 1>]
 // Response: <leaf_hash: 32> <proof_size: 1> <n_proof_elements: 1> <proof_hash 1: 32> <proof_hash 2:
 // 32> ... <proof_hash n_proof_elements: 32>
 //           If n_proof_elements < proof_size, then subsequent elements will be given as responses
 //           of CCMD_GET_MORE_ELEMENTS.
+//           If proof_size is in the request, only the first proof_size hashes of the proof
+//           (starting from the sibling of the leaf) are returned, up to an internal node known to
+//           the HWW.
 #define CCMD_GET_MERKLE_LEAF_PROOF 0x41
 
 // Request : <CCMD_GET_MERKLE_LEAF_INDEX : 1> <merkle_root : 32> <leaf_hash : 32>
 // Response: <is_found(0 or 1) : 1> <leaf_index : 4>
 #define CCMD_GET_MERKLE_LEAF_INDEX 0x42
 
+// Request : <CCMD_GET_MERKLE_TREE_LEAVES : 1> <merkle_root : 32> <tree_size : varint>
+//           <start_index : varint>
+// Response: <n_leaves : 1> <len_1 : 1> <leaf_1 : len_1> ... <len_n_leaves : 1>
+//           <leaf_n_leaves : len_n_leaves>
+//           The leaf preimages (without the 0x00 prefix) starting from start_index, as many as fit
+//           in the response. No proof is sent: the root is recomputed from all the leaves.
+#define CCMD_GET_MERKLE_TREE_LEAVES 0x43
+
+// Request : <CCMD_GET_MERKLE_LEAF_ELEMENT : 1> <merkle_root : 32> <tree_size : varint>
+//           <leaf_index : varint> [<proof_size : 1>]
+// Response: <leaf_hash : 32> <proof_size : 1> <n_proof_elements : 1> <proof_hash 1 : 32> ...
+//           <proof_hash n_proof_elements : 32> [<preimage_len : varint> <partial_data_len : 1>
+//           <partial_data : partial_data_len>]
+//           Combines CCMD_GET_MERKLE_LEAF_PROOF and CCMD_GET_PREIMAGE for the leaf hash in a single
+//           response. If n_proof_elements == proof_size, the beginning of the leaf preimage follows
+//           as in the response to CCMD_GET_PREIMAGE, and the rest of the preimage (if any) is given
+//           as responses of CCMD_GET_MORE_ELEMENTS. Otherwise, the remaining proof elements are
+//           given as responses of CCMD_GET_MORE_ELEMENTS, and the preimage is asked separately.
+#define CCMD_GET_MERKLE_LEAF_ELEMENT 0x44
+
+/* RECORDS AUTHENTICATED BY THE HWW */
+
+// Asks the host to store a record, which the HWW authenticates and can ask back later in the same
+// command with CCMD_GET_RECORD. Storing a record with the same key replaces the previous one.
+// Request : <CCMD_STORE_RECORD : 1> <key : 32> <record_len : 1> <record : record_len>
+// Response: empty
+#define CCMD_STORE_RECORD 0x50
+
+// Request : <CCMD_GET_RECORD : 1> <key : 32>
+// Response: <record_len : 1> <record : record_len>
+//           The last record stored with that key, or record_len = 0 if the host does not know it.
+#define CCMD_GET_RECORD 0x51
+
 /* GENERIC/MULTIPURPOSE */
 
 // Used to get additional elements from the host when the required response from an interruption did
@@ -32,4 +69,11 @@
 // Request : <CCMD_GET_MORE_ELEMENTS : 1>
 // Response: <n_elements : 1> <el_len = size of each element: 1> <element 1 : el_len> <element 2 :
 // el_len> ... <element n_elements : el_len>
+//           The host returns as many elements as fit in the response, that is at most
+//           GET_MORE_ELEMENTS_MAX_PAYLOAD bytes. The continuation of a preimage is a sequence of
+//           1-byte elements, therefore it is returned in contiguous chunks of that size.
 #define CCMD_GET_MORE_ELEMENTS 0xA0
+
+// Maximum length of the elements in a response to CCMD_GET_MORE_ELEMENTS: the 255 bytes of an
+// APDU, minus <n_elements> and <el_len>.
+#define GET_MORE_ELEMENTS_MAX_PAYLOAD 253
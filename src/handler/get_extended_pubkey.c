@@ -16,6 +16,7 @@
  *****************************************************************************/
 
 #include <stdint.h>
+#include <string.h>
 
 #include "boilerplate/io.h"
 #include "boilerplate/dispatcher.h"
@@ -26,9 +27,12 @@
 #include "../ui/display.h"
 #include "../ui/menu.h"
 
+#include "client_commands.h"
+
 extern global_context_t *G_coin_config;
 
 static void send_response(dispatcher_context_t *dc);
+static void compute_pubkeys(dispatcher_context_t *dc);
 
 static bool is_path_safe_for_pubkey_export(const uint32_t bip32_path[],
                                            size_t bip32_path_len,
@@ -183,3 +187,134 @@ static void send_response(dispatcher_context_t *dc) {
 
     SEND_RESPONSE(dc, state->serialized_pubkey_str, strlen(state->serialized_pubkey_str), SW_OK);
 }
+
+// Reads the next path of the list of paths of GET_EXTENDED_PUBKEYS from the buffer.
+static bool read_path(buffer_t *buffer, uint32_t bip32_path[], uint8_t *bip32_path_len) {
+    return buffer_read_u8(buffer, bip32_path_len) && *bip32_path_len <= MAX_BIP32_PATH_STEPS &&
+           buffer_read_bip32_path(buffer, bip32_path, *bip32_path_len);
+}
+
+void handler_get_extended_pubkeys(dispatcher_context_t *dc) {
+    get_extended_pubkey_state_t *state = (get_extended_pubkey_state_t *) &G_command_state;
+
+    LOG_PROCESSOR(dc, __FILE__, __LINE__, __func__);
+
+    // Device must be unlocked
+    if (os_global_pin_is_validated() != BOLOS_UX_OK) {
+        SEND_SW(dc, SW_SECURITY_STATUS_NOT_SATISFIED);
+        return;
+    }
+
+    if (!buffer_read_u8(&dc->read_buffer, &state->n_remaining_paths)) {
+        SEND_SW(dc, SW_WRONG_DATA_LENGTH);
+        return;
+    }
+
+    if (state->n_remaining_paths == 0) {
+        SEND_SW(dc, SW_INCORRECT_DATA);
+        return;
+    }
+
+    // the read buffer is overwritten by the responses to the yields, so the paths are kept
+    size_t paths_len = dc->read_buffer.size - dc->read_buffer.offset;
+    if (paths_len > sizeof(state->paths) ||
+        !buffer_read_bytes(&dc->read_buffer, state->paths, paths_len)) {
+        SEND_SW(dc, SW_WRONG_DATA_LENGTH);
+        return;
+    }
+    state->paths_buffer = buffer_create(state->paths, paths_len);
+
+    // Keys are never shown on screen with this command, so all the paths must be safe; they are all
+    // validated before any key is exported.
+    uint32_t coin_types[2] = {G_coin_config->bip44_coin_type, G_coin_config->bip44_coin_type2};
+    buffer_t paths_buffer = state->paths_buffer;
+    for (unsigned int i = 0; i < state->n_remaining_paths; i++) {
+        uint32_t bip32_path[MAX_BIP32_PATH_STEPS];
+        uint8_t bip32_path_len;
+        if (!read_path(&paths_buffer, bip32_path, &bip32_path_len)) {
+            SEND_SW(dc, SW_WRONG_DATA_LENGTH);
+            return;
+        }
+
+        if (!is_path_safe_for_pubkey_export(bip32_path, bip32_path_len, coin_types, 2)) {
+            SEND_SW(dc, SW_NOT_SUPPORTED);
+            return;
+        }
+    }
+    if (buffer_can_read(&paths_buffer, 1)) {
+        SEND_SW(dc, SW_WRONG_DATA_LENGTH);
+        return;
+    }
+
+    state->parent_path_len = 0xFF;  // no parent fingerprint computed yet
+
+    dc->next(compute_pubkeys);
+}
+
+// Consecutive paths with the same parent (for example, several accounts of the same purpose and
+// coin type) share the parent's fingerprint, that is only computed once. Deriving the parent leaves
+// its node in the derivation cache, so each child, hardened or not, is derived from it in a single
+// step rather than from the seed.
+static void compute_pubkeys(dispatcher_context_t *dc) {
+    get_extended_pubkey_state_t *state = (get_extended_pubkey_state_t *) &G_command_state;
+
+    LOG_PROCESSOR(dc, __FILE__, __LINE__, __func__);
+
+    while (state->n_remaining_paths > 0) {
+        // <CCMD_YIELD> followed by <pubkey_len : 1> <pubkey : pubkey_len> for each pubkey
+        size_t yield_len = 1;
+        state->pubkeys[0] = CCMD_YIELD;
+
+        while (state->n_remaining_paths > 0 &&
+               yield_len + 1 + MAX_SERIALIZED_PUBKEY_LENGTH <= sizeof(state->pubkeys)) {
+            uint32_t bip32_path[MAX_BIP32_PATH_STEPS];
+            uint8_t bip32_path_len;
+            if (!read_path(&state->paths_buffer, bip32_path, &bip32_path_len) ||
+                bip32_path_len == 0) {
+                SEND_SW(dc, SW_BAD_STATE);  // unexpected, the paths were already validated
+                return;
+            }
+
+            uint8_t parent_path_len = bip32_path_len - 1;
+            if (parent_path_len != state->parent_path_len ||
+                memcmp(bip32_path, state->parent_path, 4 * parent_path_len) != 0) {
+                uint8_t parent_pubkey[33];
+                crypto_get_compressed_pubkey_at_path(bip32_path,
+                                                     parent_path_len,
+                                                     parent_pubkey,
+                                                     NULL);
+
+                memcpy(state->parent_path, bip32_path, 4 * parent_path_len);
+                state->parent_path_len = parent_path_len;
+                state->parent_fingerprint = crypto_get_key_fingerprint(parent_pubkey);
+            }
+
+            int serialized_pubkey_len =
+                serialize_extended_pubkey_at_path(bip32_path,
+                                                  bip32_path_len,
+                                                  G_coin_config->bip32_pubkey_version,
+                                                  state->parent_fingerprint,
+                                                  state->serialized_pubkey_str);
+            if (serialized_pubkey_len < 0) {
+                SEND_SW(dc, SW_BAD_STATE);
+                return;
+            }
+
+            state->pubkeys[yield_len] = (uint8_t) serialized_pubkey_len;
+            memcpy(state->pubkeys + yield_len + 1,
+                   state->serialized_pubkey_str,
+                   serialized_pubkey_len);
+            yield_len += 1 + serialized_pubkey_len;
+
+            --state->n_remaining_paths;
+        }
+
+        SET_RESPONSE(dc, state->pubkeys, yield_len, SW_INTERRUPTED_EXECUTION);
+        if (dc->process_interruption(dc) < 0) {
+            SEND_SW(dc, SW_BAD_STATE);
+            return;
+        }
+    }
+
+    SEND_SW(dc, SW_OK);
+}
@@ -3,9 +3,26 @@
 #include "../common/bip32.h"
 #include "../boilerplate/dispatcher.h"
 
+// Maximum length of the data of a yield of the GET_EXTENDED_PUBKEYS command, including the
+// CCMD_YIELD byte
+#define GET_EXTENDED_PUBKEYS_MAX_YIELD_LEN 255
+
 typedef struct {
     machine_context_t ctx;
     char serialized_pubkey_str[MAX_SERIALIZED_PUBKEY_LENGTH + 1];
+
+    // only used by GET_EXTENDED_PUBKEYS
+    uint8_t n_remaining_paths;
+    uint8_t paths[255];  // the list of paths from the request, still to be processed
+    buffer_t paths_buffer;
+
+    // the parent of the last exported key, and its fingerprint
+    uint32_t parent_path[MAX_BIP32_PATH_STEPS];
+    uint8_t parent_path_len;
+    uint32_t parent_fingerprint;
+
+    uint8_t pubkeys[GET_EXTENDED_PUBKEYS_MAX_YIELD_LEN];
 } get_extended_pubkey_state_t;
 
 void handler_get_extended_pubkey(dispatcher_context_t *dispatcher_context);
+void handler_get_extended_pubkeys(dispatcher_context_t *dispatcher_context);
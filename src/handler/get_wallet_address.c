@@ -43,40 +43,13 @@ extern global_context_t *G_coin_config;
 static void compute_address(dispatcher_context_t *dc);
 static void send_response(dispatcher_context_t *dc);
 
-void handler_get_wallet_address(dispatcher_context_t *dc) {
-    LOG_PROCESSOR(dc, __FILE__, __LINE__, __func__);
+static void compute_addresses(dispatcher_context_t *dc);
 
+// Fetches and validates the wallet policy, checking that the addresses up to last_address_index are
+// standard if the wallet is canonical. Sends the status word and returns false on failure.
+static bool load_wallet_policy(dispatcher_context_t *dc, uint32_t last_address_index) {
     get_wallet_address_state_t *state = (get_wallet_address_state_t *) &G_command_state;
 
-    // Device must be unlocked
-    if (os_global_pin_is_validated() != BOLOS_UX_OK) {
-        SEND_SW(dc, SW_SECURITY_STATUS_NOT_SATISFIED);
-        return;
-    }
-
-    if (!buffer_read_u8(&dc->read_buffer, &state->display_address) ||
-        !buffer_read_bytes(&dc->read_buffer, state->wallet_id, 32) ||
-        !buffer_read_bytes(&dc->read_buffer, state->wallet_hmac, 32)) {
-        SEND_SW(dc, SW_WRONG_DATA_LENGTH);
-        return;
-    }
-
-    // change
-    if (!buffer_read_u8(&dc->read_buffer, &state->is_change)) {
-        SEND_SW(dc, SW_WRONG_DATA_LENGTH);
-        return;
-    }
-    if (state->is_change != 0 && state->is_change != 1) {
-        SEND_SW(dc, SW_INCORRECT_DATA);
-        return;
-    }
-
-    // address index
-    if (!buffer_read_u32(&dc->read_buffer, &state->address_index, BE)) {
-        SEND_SW(dc, SW_WRONG_DATA_LENGTH);
-        return;
-    }
-
     // Fetch the serialized wallet policy from the client
     int serialized_wallet_policy_len = call_get_preimage(dc,
                                                          state->wallet_id,
@@ -84,14 +57,14 @@ void handler_get_wallet_address(dispatcher_context_t *dc) {
                                                          sizeof(state->serialized_wallet_policy));
     if (serialized_wallet_policy_len < 0) {
         SEND_SW(dc, SW_INCORRECT_DATA);
-        return;
+        return false;
     }
 
     buffer_t serialized_wallet_policy_buf =
         buffer_create(state->serialized_wallet_policy, serialized_wallet_policy_len);
     if ((read_policy_map_wallet(&serialized_wallet_policy_buf, &state->wallet_header)) < 0) {
         SEND_SW(dc, SW_INCORRECT_DATA);
-        return;
+        return false;
     }
 
     memcpy(state->wallet_header_keys_info_merkle_root,
@@ -106,7 +79,7 @@ void handler_get_wallet_address(dispatcher_context_t *dc) {
                          state->wallet_policy_map_bytes,
                          sizeof(state->wallet_policy_map_bytes)) < 0) {
         SEND_SW(dc, SW_INCORRECT_DATA);
-        return;
+        return false;
     }
 
     // the binary OR of all the hmac bytes (so == 0 iff the hmac is identically 0)
@@ -121,13 +94,13 @@ void handler_get_wallet_address(dispatcher_context_t *dc) {
         if (state->address_type == -1) {
             PRINTF("Non-standard policy, and no hmac provided\n");
             SEND_SW(dc, SW_SIGNATURE_FAIL);
-            return;
+            return false;
         }
 
         if (state->wallet_header.n_keys != 1) {
             PRINTF("Standard wallets must have exactly 1 key\n");
             SEND_SW(dc, SW_INCORRECT_DATA);
-            return;
+            return false;
         }
 
         // we check if the key is indeed internal
@@ -141,7 +114,7 @@ void handler_get_wallet_address(dispatcher_context_t *dc) {
                                                         sizeof(state->key_info_str));
         if (key_info_len < 0) {
             SEND_SW(dc, SW_INCORRECT_DATA);
-            return;
+            return false;
         }
 
         // Make a sub-buffer for the pubkey info
@@ -150,12 +123,12 @@ void handler_get_wallet_address(dispatcher_context_t *dc) {
         policy_map_key_info_t key_info;
         if (parse_policy_map_key_info(&key_info_buffer, &key_info) == -1) {
             SEND_SW(dc, SW_INCORRECT_DATA);
-            return;
+            return false;
         }
 
         if (read_u32_be(key_info.master_key_fingerprint, 0) != master_key_fingerprint) {
             SEND_SW(dc, SW_INCORRECT_DATA);
-            return;
+            return false;
         }
 
         // generate pubkey and check if it matches
@@ -167,12 +140,12 @@ void handler_get_wallet_address(dispatcher_context_t *dc) {
                                                    pubkey_derived);
         if (serialized_pubkey_len == -1) {
             SEND_SW(dc, SW_BAD_STATE);
-            return;
+            return false;
         }
 
         if (strncmp(key_info.ext_pubkey, pubkey_derived, MAX_SERIALIZED_PUBKEY_LENGTH) != 0) {
             SEND_SW(dc, SW_INCORRECT_DATA);
-            return;
+            return false;
         }
 
         // check if derivation path is indeed standard
@@ -182,7 +155,7 @@ void handler_get_wallet_address(dispatcher_context_t *dc) {
 
         if (key_info.master_key_derivation_len != 3) {
             SEND_SW(dc, SW_INCORRECT_DATA);
-            return;
+            return false;
         }
 
         uint32_t coin_types[2] = {G_coin_config->bip44_coin_type, G_coin_config->bip44_coin_type2};
@@ -192,11 +165,11 @@ void handler_get_wallet_address(dispatcher_context_t *dc) {
             bip32_path[i] = key_info.master_key_derivation[i];
         }
         bip32_path[3] = state->is_change ? 1 : 0;
-        bip32_path[4] = state->address_index;
+        bip32_path[4] = last_address_index;
 
         if (!is_address_path_standard(bip32_path, 5, bip44_purpose, coin_types, 2, -1)) {
             SEND_SW(dc, SW_INCORRECT_DATA);
-            return;
+            return false;
         }
 
         state->is_wallet_canonical = true;
@@ -206,7 +179,7 @@ void handler_get_wallet_address(dispatcher_context_t *dc) {
         if (!check_wallet_hmac(state->wallet_id, state->wallet_hmac)) {
             PRINTF("Incorrect hmac\n");
             SEND_SW(dc, SW_SIGNATURE_FAIL);
-            return;
+            return false;
         }
 
         state->is_wallet_canonical = false;
@@ -217,18 +190,58 @@ void handler_get_wallet_address(dispatcher_context_t *dc) {
 
     if (memcmp(state->wallet_id, state->computed_wallet_id, sizeof(state->wallet_id)) != 0) {
         SEND_SW(dc, SW_INCORRECT_DATA);
-        return;
+        return false;
     }
 
-    dc->next(compute_address);
+    return true;
 }
 
-// stack-intensive, split from the previous function to optimize stack usage
-static void compute_address(dispatcher_context_t *dc) {
+void handler_get_wallet_address(dispatcher_context_t *dc) {
     LOG_PROCESSOR(dc, __FILE__, __LINE__, __func__);
 
     get_wallet_address_state_t *state = (get_wallet_address_state_t *) &G_command_state;
 
+    // Device must be unlocked
+    if (os_global_pin_is_validated() != BOLOS_UX_OK) {
+        SEND_SW(dc, SW_SECURITY_STATUS_NOT_SATISFIED);
+        return;
+    }
+
+    if (!buffer_read_u8(&dc->read_buffer, &state->display_address) ||
+        !buffer_read_bytes(&dc->read_buffer, state->wallet_id, 32) ||
+        !buffer_read_bytes(&dc->read_buffer, state->wallet_hmac, 32)) {
+        SEND_SW(dc, SW_WRONG_DATA_LENGTH);
+        return;
+    }
+
+    // change
+    if (!buffer_read_u8(&dc->read_buffer, &state->is_change)) {
+        SEND_SW(dc, SW_WRONG_DATA_LENGTH);
+        return;
+    }
+    if (state->is_change != 0 && state->is_change != 1) {
+        SEND_SW(dc, SW_INCORRECT_DATA);
+        return;
+    }
+
+    // address index
+    if (!buffer_read_u32(&dc->read_buffer, &state->address_index, BE)) {
+        SEND_SW(dc, SW_WRONG_DATA_LENGTH);
+        return;
+    }
+
+    if (!load_wallet_policy(dc, state->address_index)) {
+        return;
+    }
+
+    dc->next(compute_address);
+}
+
+// Computes the address of the wallet for state->is_change and state->address_index into
+// state->address. Returns the length of the address, or -1 on failure.
+static int derive_address(dispatcher_context_t *dc) {
+    get_wallet_address_state_t *state = (get_wallet_address_state_t *) &G_command_state;
+
     buffer_t script_buf = buffer_create(state->script, sizeof(state->script));
 
     int script_len = call_get_wallet_script(dc,
@@ -239,16 +252,23 @@ static void compute_address(dispatcher_context_t *dc) {
                                             state->address_index,
                                             &script_buf);
     if (script_len < 0) {
-        SEND_SW(dc, SW_BAD_STATE);  // unexpected
-        return;
+        return -1;
     }
 
-    state->address_len = get_script_address(state->script,
-                                            script_len,
-                                            G_coin_config,
-                                            state->address,
-                                            sizeof(state->address));
+    return get_script_address(state->script,
+                              script_len,
+                              G_coin_config,
+                              state->address,
+                              sizeof(state->address));
+}
 
+// stack-intensive, split from the previous function to optimize stack usage
+static void compute_address(dispatcher_context_t *dc) {
+    LOG_PROCESSOR(dc, __FILE__, __LINE__, __func__);
+
+    get_wallet_address_state_t *state = (get_wallet_address_state_t *) &G_command_state;
+
+    state->address_len = derive_address(dc);
     if (state->address_len < 0) {
         SEND_SW(dc, SW_BAD_STATE);  // unexpected
         return;
@@ -270,4 +290,83 @@ static void send_response(dispatcher_context_t *dc) {
     LOG_PROCESSOR(dc, __FILE__, __LINE__, __func__);
 
     SEND_RESPONSE(dc, state->address, state->address_len, SW_OK);
-}
\ No newline at end of file
+}
+
+void handler_get_wallet_addresses(dispatcher_context_t *dc) {
+    LOG_PROCESSOR(dc, __FILE__, __LINE__, __func__);
+
+    get_wallet_address_state_t *state = (get_wallet_address_state_t *) &G_command_state;
+
+    // Device must be unlocked
+    if (os_global_pin_is_validated() != BOLOS_UX_OK) {
+        SEND_SW(dc, SW_SECURITY_STATUS_NOT_SATISFIED);
+        return;
+    }
+
+    state->display_address = 0;
+
+    if (!buffer_read_bytes(&dc->read_buffer, state->wallet_id, 32) ||
+        !buffer_read_bytes(&dc->read_buffer, state->wallet_hmac, 32) ||
+        !buffer_read_u8(&dc->read_buffer, &state->is_change) ||
+        !buffer_read_u32(&dc->read_buffer, &state->address_index, BE) ||
+        !buffer_read_u32(&dc->read_buffer, &state->n_remaining_addresses, BE)) {
+        SEND_SW(dc, SW_WRONG_DATA_LENGTH);
+        return;
+    }
+
+    if (state->is_change != 0 && state->is_change != 1) {
+        SEND_SW(dc, SW_INCORRECT_DATA);
+        return;
+    }
+
+    // at least one address, and no overflow of the last address index
+    if (state->n_remaining_addresses == 0 ||
+        state->n_remaining_addresses - 1 > UINT32_MAX - state->address_index) {
+        SEND_SW(dc, SW_INCORRECT_DATA);
+        return;
+    }
+
+    if (!load_wallet_policy(dc, state->address_index + (state->n_remaining_addresses - 1))) {
+        return;
+    }
+
+    dc->next(compute_addresses);
+}
+
+// The wallet policy and the derived keys (see get_derived_pubkey in lib/policy.c) are kept from
+// one address to the next, so that only the last derivation step is computed for each address.
+static void compute_addresses(dispatcher_context_t *dc) {
+    LOG_PROCESSOR(dc, __FILE__, __LINE__, __func__);
+
+    get_wallet_address_state_t *state = (get_wallet_address_state_t *) &G_command_state;
+
+    while (state->n_remaining_addresses > 0) {
+        // <CCMD_YIELD> followed by <address_len : 1> <address : address_len> for each address
+        size_t yield_len = 1;
+        state->addresses[0] = CCMD_YIELD;
+
+        while (state->n_remaining_addresses > 0 &&
+               yield_len + 1 + MAX_ADDRESS_LENGTH_STR <= sizeof(state->addresses)) {
+            int address_len = derive_address(dc);
+            if (address_len < 0) {
+                SEND_SW(dc, SW_BAD_STATE);  // unexpected
+                return;
+            }
+
+            state->addresses[yield_len] = (uint8_t) address_len;
+            memcpy(state->addresses + yield_len + 1, state->address, address_len);
+            yield_len += 1 + address_len;
+
+            ++state->address_index;
+            --state->n_remaining_addresses;
+        }
+
+        SET_RESPONSE(dc, state->addresses, yield_len, SW_INTERRUPTED_EXECUTION);
+        if (dc->process_interruption(dc) < 0) {
+            SEND_SW(dc, SW_BAD_STATE);
+            return;
+        }
+    }
+
+    SEND_SW(dc, SW_OK);
+}
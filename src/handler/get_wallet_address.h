@@ -7,19 +7,30 @@
 
 #include "lib/get_merkle_leaf_element.h"
 
+// Maximum length of each YIELD of GET_WALLET_ADDRESSES, including the client command code
+#define GET_WALLET_ADDRESSES_MAX_YIELD_LEN 255
+
 typedef struct {
     machine_context_t ctx;
 
     uint32_t address_index;
+    uint32_t n_remaining_addresses;  // only used by GET_WALLET_ADDRESSES
     uint8_t is_change;
     uint8_t display_address;
 
     bool is_wallet_canonical;
     int address_type;
 
-    // as deriving wallet addresses is stack-intensive, we move some
-    // variables here to use less stack overall
-    uint8_t serialized_wallet_policy[MAX_POLICY_MAP_SERIALIZED_LENGTH];
+    union {
+        // as deriving wallet addresses is stack-intensive, we move some
+        // variables here to use less stack overall; they are only used to load the wallet policy
+        struct {
+            uint8_t serialized_wallet_policy[MAX_POLICY_MAP_SERIALIZED_LENGTH];
+            uint8_t key_info_str[MAX_POLICY_KEY_INFO_LEN];
+        };
+        // the addresses sent in the next YIELD of GET_WALLET_ADDRESSES
+        uint8_t addresses[GET_WALLET_ADDRESSES_MAX_YIELD_LEN];
+    };
 
     policy_map_wallet_header_t wallet_header;
 
@@ -39,8 +50,12 @@ typedef struct {
 
     int address_len;
     char address[MAX_ADDRESS_LENGTH_STR + 1];  // null-terminated string
-
-    uint8_t key_info_str[MAX_POLICY_KEY_INFO_LEN];
 } get_wallet_address_state_t;
 
 void handler_get_wallet_address(dispatcher_context_t *dispatcher_context);
+
+/**
+ * Returns the addresses of a wallet for consecutive address indexes, without displaying them. The
+ * addresses are sent with YIELD, as many as fit in each message.
+ */
+void handler_get_wallet_addresses(dispatcher_context_t *dispatcher_context);
@@ -3,17 +3,110 @@
 #include "check_merkle_tree_sorted.h"
 #include "get_merkle_leaf_element.h"
 
+#include "../../common/buffer.h"
+#include "../../common/merkle.h"
+#include "../../common/varint.h"
+#include "../../boilerplate/sw.h"
+#include "../client_commands.h"
+
 static int compare_byte_arrays(const uint8_t array1[],
                                size_t array1_len,
                                const uint8_t array2[],
                                size_t array2_len);
 
-int call_check_merkle_tree_sorted_with_callback(dispatcher_context_t *dispatcher_context,
-                                                const uint8_t root[static 32],
-                                                size_t size,
-                                                dispatcher_callback_descriptor_t callback) {
-    // LOG_PROCESSOR(dispatcher_context, __FILE__, __LINE__, __func__);
+// Fetches all the leaves with CCMD_GET_MERKLE_TREE_LEAVES, recomputing the Merkle root from them.
+static int check_merkle_tree_sorted_batched(dispatcher_context_t *dc,
+                                            const uint8_t root[static 32],
+                                            size_t size,
+                                            dispatcher_callback_descriptor_t callback) {
+    merkle_stream_t stream;
+    merkle_stream_init(&stream);
+
+    int prev_el_len = 0;
+    uint8_t prev_el[MAX_CHECK_MERKLE_TREE_SORTED_PREIMAGE_SIZE];
+
+    size_t cur_el_idx = 0;
+    while (cur_el_idx < size) {
+        {  // make sure memory is deallocated as soon as possible
+            uint8_t tmp[9];
+            tmp[0] = CCMD_GET_MERKLE_TREE_LEAVES;
+            dc->add_to_response(tmp, 1);
+
+            dc->add_to_response(root, 32);
+
+            int tree_size_len = varint_write(tmp, 0, size);
+            dc->add_to_response(tmp, tree_size_len);
+
+            int start_index_len = varint_write(tmp, 0, cur_el_idx);
+            dc->add_to_response(tmp, start_index_len);
+
+            dc->finalize_response(SW_INTERRUPTED_EXECUTION);
+        }
+
+        if (dc->process_interruption(dc) < 0) {
+            return -1;
+        }
+
+        uint8_t n_leaves;
+        if (!buffer_read_u8(&dc->read_buffer, &n_leaves) || n_leaves == 0 ||
+            n_leaves > size - cur_el_idx) {
+            return -1;
+        }
+
+        for (int i = 0; i < n_leaves; i++) {
+            uint8_t cur_el_len;
+            if (!buffer_read_u8(&dc->read_buffer, &cur_el_len) ||
+                cur_el_len > MAX_CHECK_MERKLE_TREE_SORTED_PREIMAGE_SIZE ||
+                !buffer_can_read(&dc->read_buffer, cur_el_len)) {
+                return -1;
+            }
 
+            // we use the memory in the buffer directly, to avoid copying the element unnecessarily
+            const uint8_t *cur_el = dc->read_buffer.ptr + dc->read_buffer.offset;
+
+            uint8_t leaf_hash[32];
+            merkle_compute_element_hash(cur_el, cur_el_len, leaf_hash);
+            if (merkle_stream_add_leaf_hash(&stream, leaf_hash) < 0) {
+                return -1;
+            }
+
+            if (cur_el_idx > 0 &&
+                compare_byte_arrays(prev_el, prev_el_len, cur_el, cur_el_len) >= 0) {
+                // elements are not in (strict) lexicographical order
+                PRINTF("Keys not in order\n");
+                return -1;
+            }
+
+            memcpy(prev_el, cur_el, cur_el_len);
+            prev_el_len = cur_el_len;
+
+            buffer_seek_cur(&dc->read_buffer, cur_el_len);
+            ++cur_el_idx;
+
+            if (callback.fn != NULL) {
+                // call callback with data
+                buffer_t buf = buffer_create(prev_el, prev_el_len);
+                callback.fn(callback.state, &buf);
+            }
+        }
+    }
+
+    uint8_t computed_root[32];
+    merkle_stream_get_root(&stream, computed_root);
+    if (memcmp(root, computed_root, 32) != 0) {
+        PRINTF("Merkle root mismatch\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+// Fetches and verifies each leaf separately, for trees too large for
+// check_merkle_tree_sorted_batched and for hosts that do not implement CCMD_GET_MERKLE_TREE_LEAVES
+static int check_merkle_tree_sorted_one_by_one(dispatcher_context_t *dispatcher_context,
+                                               const uint8_t root[static 32],
+                                               size_t size,
+                                               dispatcher_callback_descriptor_t callback) {
     int prev_el_len = 0;
     uint8_t prev_el[MAX_CHECK_MERKLE_TREE_SORTED_PREIMAGE_SIZE];
 
@@ -48,6 +141,19 @@ int call_check_merkle_tree_sorted_with_callback(dispatcher_context_t *dispatcher
     return 0;
 }
 
+int call_check_merkle_tree_sorted_with_callback(dispatcher_context_t *dispatcher_context,
+                                                const uint8_t root[static 32],
+                                                size_t size,
+                                                dispatcher_callback_descriptor_t callback) {
+    // LOG_PROCESSOR(dispatcher_context, __FILE__, __LINE__, __func__);
+
+    if (dispatcher_context->protocol_version >= 1 && size <= MERKLE_STREAM_MAX_LEAVES) {
+        return check_merkle_tree_sorted_batched(dispatcher_context, root, size, callback);
+    } else {
+        return check_merkle_tree_sorted_one_by_one(dispatcher_context, root, size, callback);
+    }
+}
+
 // Returns a negative number, 0 or a positive number if the first array is (respectively)
 // lexicographically smaller, equal, or larger than the second. If one array is prefix than the
 // other, then the shorter ones comes first in lexicographical order.
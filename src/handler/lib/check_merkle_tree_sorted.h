@@ -12,6 +12,11 @@
  * callback to a non-NULL function is given, it is called once for each of the elements of the
  * Merkle tree, in lexicographical order.
  *
+ * If the host negotiated the protocol version 1, trees with at most MERKLE_STREAM_MAX_LEAVES
+ * elements are fetched in batches with CCMD_GET_MERKLE_TREE_LEAVES, and the Merkle root is only
+ * verified after the last element; in that case, the callback might be called with elements that
+ * are later rejected. Callers must discard any state built by the callback if this function fails.
+ *
  * Returns 0 on success, or a negative number on failure.
  */
 int call_check_merkle_tree_sorted_with_callback(dispatcher_context_t *dispatcher_context,
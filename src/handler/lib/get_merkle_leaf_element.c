@@ -3,6 +3,8 @@
 #include "get_merkle_leaf_hash.h"
 #include "get_merkle_preimage.h"
 
+#include "../client_commands.h"
+
 int call_get_merkle_leaf_element(dispatcher_context_t *dispatcher_context,
                                  const uint8_t merkle_root[static 32],
                                  uint32_t tree_size,
@@ -13,13 +15,31 @@ int call_get_merkle_leaf_element(dispatcher_context_t *dispatcher_context,
 
     uint8_t leaf_hash[32];
 
-    int res = call_get_merkle_leaf_hash(dispatcher_context,
+    if (dispatcher_context->protocol_version < 1) {
+        // the host does not implement CCMD_GET_MERKLE_LEAF_ELEMENT
+        if (call_get_merkle_leaf_hash(dispatcher_context,
+                                      merkle_root,
+                                      tree_size,
+                                      leaf_index,
+                                      leaf_hash) < 0) {
+            return -1;
+        }
+        return call_get_merkle_preimage(dispatcher_context, leaf_hash, out_ptr, out_ptr_len);
+    }
+
+    int res = request_merkle_leaf_proof(dispatcher_context,
+                                        CCMD_GET_MERKLE_LEAF_ELEMENT,
                                         merkle_root,
                                         tree_size,
                                         leaf_index,
                                         leaf_hash);
     if (res < 0) {
         return res;
+    } else if (res == 0) {
+        // the whole proof was in the response, followed by the beginning of the preimage
+        return receive_merkle_preimage(dispatcher_context, leaf_hash, out_ptr, out_ptr_len);
+    } else {
+        // the proof did not fit in the response; the preimage is asked separately
+        return call_get_merkle_preimage(dispatcher_context, leaf_hash, out_ptr, out_ptr_len);
     }
-    return call_get_merkle_preimage(dispatcher_context, leaf_hash, out_ptr, out_ptr_len);
 }
@@ -3,7 +3,13 @@
 #include "../../boilerplate/dispatcher.h"
 
 /**
- * TODO: docs
+ * Requests the leaf with index leaf_index of the Merkle tree with root merkle_root and size
+ * tree_size using CCMD_GET_MERKLE_LEAF_ELEMENT. Both the Merkle proof and the preimage of the leaf
+ * hash are verified. The preimage (without the 0x00 prefix) is written in out_ptr.
+ * If the host negotiated the protocol version 0, CCMD_GET_MERKLE_LEAF_PROOF and CCMD_GET_PREIMAGE
+ * are used instead.
+ *
+ * Returns the length of the leaf element on success, or a negative number in case of failure.
  */
 int call_get_merkle_leaf_element(dispatcher_context_t *dispatcher_context,
                                  const uint8_t merkle_root[static 32],
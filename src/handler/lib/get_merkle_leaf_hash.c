@@ -5,10 +5,15 @@
 #include "../../common/buffer.h"
 #include "../../common/write.h"
 #include "../../common/merkle.h"
+#include "../../common/merkle_node_cache.h"
 #include "../../common/varint.h"
 #include "../../boilerplate/sw.h"
 #include "../client_commands.h"
 
+// Internal nodes of the Merkle trees that were verified so far; the proofs for other leaves of the
+// same trees are only requested up to the deepest cached node.
+static merkle_node_cache_t G_merkle_node_cache;
+
 // Reads the inputs and sends the GET_MERKLE_LEAF_PROOF request.
 int call_get_merkle_leaf_hash(dispatcher_context_t *dc,
                               const uint8_t merkle_root[static 32],
@@ -17,11 +22,48 @@ int call_get_merkle_leaf_hash(dispatcher_context_t *dc,
                               uint8_t out[static 32]) {
     // LOG_PROCESSOR(dc, __FILE__, __LINE__, __func__);
 
+    if (request_merkle_leaf_proof(dc,
+                                  CCMD_GET_MERKLE_LEAF_PROOF,
+                                  merkle_root,
+                                  tree_size,
+                                  leaf_index,
+                                  out) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int request_merkle_leaf_proof(dispatcher_context_t *dc,
+                              uint8_t cmd,
+                              const uint8_t merkle_root[static 32],
+                              uint32_t tree_size,
+                              uint32_t leaf_index,
+                              uint8_t leaf_hash[static 32]) {
     PRINT_STACK_POINTER();
 
+    // directions from the root to the leaf, computed once for all the steps of the proof
+    merkle_path_t path;
+    if (merkle_path_init(&path, tree_size, leaf_index) < 0) {
+        return -1;
+    }
+    int leaf_depth = path.depth;
+
+    // The proof only needs to reach the deepest node on the path to the leaf that is in the cache;
+    // the whole tree (at depth 0) otherwise. Hosts of protocol version 0 cannot truncate the proof.
+    int top_depth = 0;
+    int cache_index = -1;
+    if (dc->protocol_version >= 1) {
+        cache_index = merkle_node_cache_find(&G_merkle_node_cache,
+                                             merkle_root,
+                                             tree_size,
+                                             leaf_index,
+                                             &top_depth);
+    }
+
     {  // make sure memory is deallocated as soon as possible
         uint8_t tmp[9];
-        tmp[0] = CCMD_GET_MERKLE_LEAF_PROOF;
+        tmp[0] = cmd;
         dc->add_to_response(tmp, 1);
 
         dc->add_to_response(merkle_root, 32);
@@ -32,6 +74,12 @@ int call_get_merkle_leaf_hash(dispatcher_context_t *dc,
         int leaf_index_len = varint_write(tmp, 0, leaf_index);
         dc->add_to_response(tmp, leaf_index_len);
 
+        if (cache_index >= 0) {
+            // ask for a truncated proof
+            tmp[0] = (uint8_t) (leaf_depth - top_depth);
+            dc->add_to_response(tmp, 1);
+        }
+
         dc->finalize_response(SW_INTERRUPTED_EXECUTION);
     }
 
@@ -39,87 +87,117 @@ int call_get_merkle_leaf_hash(dispatcher_context_t *dc,
         return -1;
     }
 
-    {
-        int cur_step;          // counter for the proof steps
-        uint8_t cur_hash[32];  // temporary buffer for intermediate hashes
-        uint8_t proof_size;
-        uint8_t n_proof_elements;
-        if (!buffer_read_bytes(&dc->read_buffer, cur_hash, 32) ||
-            !buffer_read_u8(&dc->read_buffer, &proof_size) ||
-            !buffer_read_u8(&dc->read_buffer, &n_proof_elements)) {
-            return -1;
-        }
+    int cur_step;          // counter for the proof steps
+    uint8_t cur_hash[32];  // temporary buffer for intermediate hashes
+    uint8_t proof_size;
+    uint8_t n_proof_elements;
+    bool used_more_elements = false;
 
-        if (n_proof_elements > proof_size) {
-            PRINTF("Received more proof data than expected.\n");
+    // the deepest and the topmost internal nodes computed while verifying the proof, if any
+    uint8_t bottom_node_hash[32];
+    uint8_t top_node_hash[32];
 
-            // Wrong length of the Merkle proof.
-            return -1;
-        }
-
-        if (!buffer_can_read(&dc->read_buffer, 32 * (size_t) n_proof_elements)) {
-            return -1;
-        }
-
-        // Copy leaf hash to output (although it is not verified yet)
-        memcpy(out, cur_hash, 32);
+    // Copy leaf hash to output (although it is not verified yet)
+    if (!buffer_read_bytes(&dc->read_buffer, leaf_hash, 32) ||
+        !buffer_read_u8(&dc->read_buffer, &proof_size) ||
+        !buffer_read_u8(&dc->read_buffer, &n_proof_elements)) {
+        return -1;
+    }
 
-        // Initialize proof verification
-        cur_step = 0;
+    if (proof_size != leaf_depth - top_depth) {
+        PRINTF("Wrong length of the Merkle proof.\n");
+        return -1;
+    }
 
-        while (true) {
-            int end_step = cur_step + n_proof_elements;
-            for (; cur_step < end_step; cur_step++) {
-                // we use the memory in the buffer directly, to avoid copying the hash unnecessarily
-                const uint8_t *sibling_hash = dc->read_buffer.ptr + dc->read_buffer.offset;
+    if (n_proof_elements > proof_size) {
+        PRINTF("Received more proof data than expected.\n");
 
-                int i = proof_size - cur_step - 1;
-                int direction = merkle_get_ith_direction(tree_size, leaf_index, i);
+        // Wrong length of the Merkle proof.
+        return -1;
+    }
 
-                if (direction == 0) {
-                    merkle_combine_hashes(cur_hash, sibling_hash, cur_hash);
-                } else if (direction == 1) {
-                    merkle_combine_hashes(sibling_hash, cur_hash, cur_hash);
-                } else {
-                    return -1;  // unexpected, proof too long?
-                }
+    if (!buffer_can_read(&dc->read_buffer, 32 * (size_t) n_proof_elements)) {
+        return -1;
+    }
 
-                buffer_seek_cur(&dc->read_buffer, 32);  // consume the bytes of the sibling hash
+    // Initialize proof verification
+    memcpy(cur_hash, leaf_hash, 32);
+    cur_step = 0;
+
+    while (true) {
+        int end_step = cur_step + n_proof_elements;
+        for (; cur_step < end_step; cur_step++) {
+            // we use the memory in the buffer directly, to avoid copying the hash unnecessarily
+            const uint8_t *sibling_hash = dc->read_buffer.ptr + dc->read_buffer.offset;
+
+            // depth of the node computed in this step
+            int i = leaf_depth - cur_step - 1;
+            int direction = merkle_path_get_direction(&path, i);
+
+            if (direction == 0) {
+                merkle_combine_hashes(cur_hash, sibling_hash, cur_hash);
+            } else if (direction == 1) {
+                merkle_combine_hashes(sibling_hash, cur_hash, cur_hash);
+            } else {
+                return -1;  // unexpected, proof too long?
             }
 
-            if (cur_step == proof_size) {
-                break;
+            if (i > top_depth && i == leaf_depth - 1) {
+                memcpy(bottom_node_hash, cur_hash, 32);
+            } else if (i == top_depth + 1) {
+                memcpy(top_node_hash, cur_hash, 32);
             }
 
-            uint8_t req_more[] = {CCMD_GET_MORE_ELEMENTS};
-            SET_RESPONSE(dc, req_more, sizeof(req_more), SW_INTERRUPTED_EXECUTION);
-            if (dc->process_interruption(dc) < 0) {
-                return -1;
-            }
+            buffer_seek_cur(&dc->read_buffer, 32);  // consume the bytes of the sibling hash
+        }
 
-            // Parse response to CCMD_GET_MORE_ELEMENTS
-            uint8_t elements_len;
-            if (!buffer_read_u8(&dc->read_buffer, &n_proof_elements) ||
-                !buffer_read_u8(&dc->read_buffer, &elements_len) ||
-                !buffer_can_read(&dc->read_buffer, (size_t) n_proof_elements * elements_len)) {
-                return -1;
-            }
+        if (cur_step == proof_size) {
+            break;
+        }
 
-            if (elements_len != 32) {
-                return -1;
-            }
+        uint8_t req_more[] = {CCMD_GET_MORE_ELEMENTS};
+        SET_RESPONSE(dc, req_more, sizeof(req_more), SW_INTERRUPTED_EXECUTION);
+        if (dc->process_interruption(dc) < 0) {
+            return -1;
+        }
+        used_more_elements = true;
 
-            if (cur_step + n_proof_elements > proof_size) {
-                // Receiving more data then expected
-                return -1;
-            }
+        // Parse response to CCMD_GET_MORE_ELEMENTS
+        uint8_t elements_len;
+        if (!buffer_read_u8(&dc->read_buffer, &n_proof_elements) ||
+            !buffer_read_u8(&dc->read_buffer, &elements_len) ||
+            !buffer_can_read(&dc->read_buffer, (size_t) n_proof_elements * elements_len)) {
+            return -1;
+        }
+
+        if (elements_len != 32) {
+            return -1;
         }
 
-        if (memcmp(merkle_root, cur_hash, 32) != 0) {
-            PRINTF("Merkle root mismatch");
+        if (cur_step + n_proof_elements > proof_size) {
+            // Receiving more data then expected
             return -1;
         }
     }
 
-    return 0;
+    const uint8_t *expected_hash =
+        cache_index >= 0 ? G_merkle_node_cache.entries[cache_index].hash : merkle_root;
+    if (memcmp(expected_hash, cur_hash, 32) != 0) {
+        PRINTF("Merkle root mismatch");
+        return -1;
+    }
+
+    // The proof is valid: cache the new nodes, so that the proofs for the leaves close to this one
+    // are shorter.
+    uint32_t start, size;
+    if (leaf_depth - 1 > top_depth &&
+        merkle_get_subtree(tree_size, leaf_index, leaf_depth - 1, &start, &size)) {
+        merkle_node_cache_add(&G_merkle_node_cache, merkle_root, start, size, bottom_node_hash);
+    }
+    if (leaf_depth - 1 > top_depth + 1 &&
+        merkle_get_subtree(tree_size, leaf_index, top_depth + 1, &start, &size)) {
+        merkle_node_cache_add(&G_merkle_node_cache, merkle_root, start, size, top_node_hash);
+    }
+
+    return used_more_elements ? 1 : 0;
 }
@@ -9,4 +9,28 @@ int call_get_merkle_leaf_hash(dispatcher_context_t *dispatcher_context,
                               const uint8_t merkle_root[static 32],
                               uint32_t tree_size,
                               uint32_t leaf_index,
-                              uint8_t out[static 32]);
\ No newline at end of file
+                              uint8_t out[static 32]);
+
+/**
+ * Sends the client command cmd (CCMD_GET_MERKLE_LEAF_PROOF or CCMD_GET_MERKLE_LEAF_ELEMENT) for the
+ * leaf with index leaf_index of the Merkle tree with root merkle_root and size tree_size, then
+ * parses the leaf hash and the Merkle proof from the response:
+ * <leaf_hash : 32> <proof_size : 1> <n_proof_elements : 1> <proof_hash 1 : 32> ...
+ * <proof_hash n_proof_elements : 32>
+ * The remaining proof elements, if any, are requested with CCMD_GET_MORE_ELEMENTS.
+ *
+ * If a node on the path from the root to the leaf was already verified and the host negotiated the
+ * protocol version 1, only the part of the proof up to that node is requested, and verified against
+ * the cached node hash. The nodes computed while
+ * verifying the proof are cached for the following requests.
+ *
+ * Returns 0 if the whole proof was in the response to cmd, 1 if CCMD_GET_MORE_ELEMENTS was used,
+ * or -1 if the proof is malformed or invalid. If 0 is returned, the read buffer is positioned right
+ * after the last proof element.
+ */
+int request_merkle_leaf_proof(dispatcher_context_t *dispatcher_context,
+                              uint8_t cmd,
+                              const uint8_t merkle_root[static 32],
+                              uint32_t tree_size,
+                              uint32_t leaf_index,
+                              uint8_t leaf_hash[static 32]);
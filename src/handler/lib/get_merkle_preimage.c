@@ -30,6 +30,13 @@ int call_get_merkle_preimage(dispatcher_context_t *dispatcher_context,
         return -1;
     }
 
+    return receive_merkle_preimage(dispatcher_context, hash, out_ptr, out_ptr_len);
+}
+
+int receive_merkle_preimage(dispatcher_context_t *dispatcher_context,
+                            const uint8_t hash[static 32],
+                            uint8_t *out_ptr,
+                            size_t out_ptr_len) {
     uint64_t preimage_len;
 
     uint8_t partial_data_len;
@@ -95,11 +102,11 @@ int call_get_merkle_preimage(dispatcher_context_t *dispatcher_context,
             return -9;
         }
 
+        // the data is in the response to CCMD_GET_MORE_ELEMENTS, not in the initial response
+        data_ptr = dispatcher_context->read_buffer.ptr + dispatcher_context->read_buffer.offset;
+
         // update hash
-        crypto_hash_update(
-            &hash_context.header,
-            dispatcher_context->read_buffer.ptr + dispatcher_context->read_buffer.offset,
-            n_bytes);
+        crypto_hash_update(&hash_context.header, data_ptr, n_bytes);
 
         // write bytes to output
         buffer_write_bytes(&out_buffer, data_ptr, n_bytes);
@@ -14,3 +14,15 @@ int call_get_merkle_preimage(dispatcher_context_t *dispatcher_context,
                              const uint8_t hash[static 32],
                              uint8_t *out_ptr,
                              size_t out_ptr_len);
+
+/**
+ * Parses from the read buffer a preimage of hash, in the format of the response to
+ * CCMD_GET_PREIMAGE: <preimage_len : varint> <partial_data_len : 1> <partial_data>. The rest of
+ * the preimage, if any, is requested with CCMD_GET_MORE_ELEMENTS.
+ *
+ * Returns the length of the preimage on success, or a negative number in case of failure.
+ */
+int receive_merkle_preimage(dispatcher_context_t *dispatcher_context,
+                            const uint8_t hash[static 32],
+                            uint8_t *out_ptr,
+                            size_t out_ptr_len);
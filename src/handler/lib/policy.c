@@ -112,24 +112,64 @@ static int __attribute__((noinline)) get_extended_pubkey(policy_parser_state_t *
     return key_info.has_wildcard ? 1 : 0;
 }
 
+/**
+ * Cache of the last key used in get_derived_pubkey. For keys with the wildcard, it contains the
+ * /0 and /1 children, so that only the final derivation step is computed for each address.
+ * The key is identified by the Merkle root of the keys information and its index; as the key
+ * information is verified against that root when the cache is filled, using the cache always gives
+ * the same result as fetching and deriving the key again.
+ */
+static struct {
+    bool is_valid;
+    bool has_wildcard;
+    int key_index;
+    uint8_t keys_merkle_root[32];
+    // the /0 and /1 children if has_wildcard; otherwise, only the first element is used for the key
+    serialized_extended_pubkey_t ext_pubkeys[2];
+} G_derived_pubkey_cache;
+
 static int get_derived_pubkey(policy_parser_state_t *state, int key_index, uint8_t out[static 33]) {
     PRINT_STACK_POINTER();
 
-    serialized_extended_pubkey_t ext_pubkey;
+    if (!G_derived_pubkey_cache.is_valid || G_derived_pubkey_cache.key_index != key_index ||
+        memcmp(G_derived_pubkey_cache.keys_merkle_root, state->keys_merkle_root, 32) != 0) {
+        serialized_extended_pubkey_t ext_pubkey;
 
-    int ret = get_extended_pubkey(state, key_index, &ext_pubkey);
-    if (ret < 0) {
-        return -1;
-    }
+        G_derived_pubkey_cache.is_valid = false;
+
+        int ret = get_extended_pubkey(state, key_index, &ext_pubkey);
+        if (ret < 0) {
+            return -1;
+        }
 
-    if (ret == 1) {
-        // we derive the /0/i child of this pubkey
-        // we reuse the same memory of ext_pubkey
-        bip32_CKDpub(&ext_pubkey, state->change, &ext_pubkey);
-        bip32_CKDpub(&ext_pubkey, state->address_index, &ext_pubkey);
+        if (ret == 1) {
+            // we derive the /0 and /1 children of this pubkey
+            if (bip32_CKDpub(&ext_pubkey, 0, &G_derived_pubkey_cache.ext_pubkeys[0]) < 0 ||
+                bip32_CKDpub(&ext_pubkey, 1, &G_derived_pubkey_cache.ext_pubkeys[1]) < 0) {
+                return -1;
+            }
+        } else {
+            memcpy(&G_derived_pubkey_cache.ext_pubkeys[0], &ext_pubkey, sizeof(ext_pubkey));
+        }
+
+        G_derived_pubkey_cache.has_wildcard = (ret == 1);
+        G_derived_pubkey_cache.key_index = key_index;
+        memcpy(G_derived_pubkey_cache.keys_merkle_root, state->keys_merkle_root, 32);
+        G_derived_pubkey_cache.is_valid = true;
     }
 
-    memcpy(out, ext_pubkey.compressed_pubkey, 33);
+    if (G_derived_pubkey_cache.has_wildcard) {
+        // we derive the /change/address_index child of the key
+        serialized_extended_pubkey_t ext_pubkey;
+        if (bip32_CKDpub(&G_derived_pubkey_cache.ext_pubkeys[state->change ? 1 : 0],
+                         state->address_index,
+                         &ext_pubkey) < 0) {
+            return -1;
+        }
+        memcpy(out, ext_pubkey.compressed_pubkey, 33);
+    } else {
+        memcpy(out, G_derived_pubkey_cache.ext_pubkeys[0].compressed_pubkey, 33);
+    }
 
     return 0;
 }
@@ -25,6 +25,7 @@
 #include "../crypto.h"
 #include "../ui/display.h"
 #include "../ui/menu.h"
+#include "lib/stream_preimage.h"
 
 extern global_context_t *G_coin_config;
 
@@ -34,6 +35,49 @@ static unsigned char const BSM_SIGN_MAGIC[] = {'\x18', 'B', 'i', 't', 'c', 'o',
                                                'S',    'i', 'g', 'n', 'e', 'd', ' ', 'M', 'e',
                                                's',    's', 'a', 'g', 'e', ':', '\n'};
 
+// Hashes the message from the Merkle tree of its 64-byte chunks, asking each chunk separately
+static int hash_message_chunks(dispatcher_context_t *dc, sign_message_state_t *state) {
+    size_t n_chunks = (state->message_length + 63) / 64;
+    for (unsigned int i = 0; i < n_chunks; i++) {
+        uint8_t message_chunk[64];
+        int chunk_len = call_get_merkle_leaf_element(dc,
+                                                     state->message_commitment,
+                                                     n_chunks,
+                                                     i,
+                                                     message_chunk,
+                                                     sizeof(message_chunk));
+
+        if (chunk_len < 0 || (chunk_len != 64 && i != n_chunks - 1)) {
+            return -1;
+        }
+
+        crypto_hash_update(&state->msg_hash_context.header, message_chunk, chunk_len);
+        crypto_hash_update(&state->bsm_digest_context.header, message_chunk, chunk_len);
+    }
+    return 0;
+}
+
+static void hash_message_data(buffer_t *data, void *callback_state) {
+    sign_message_state_t *state = (sign_message_state_t *) callback_state;
+
+    size_t data_len = data->size - data->offset;
+    crypto_hash_update(&state->msg_hash_context.header, data->ptr + data->offset, data_len);
+    crypto_hash_update(&state->bsm_digest_context.header, data->ptr + data->offset, data_len);
+}
+
+// Hashes the message streamed as the preimage of its commitment, in chunks as large as the host can
+// send in a response
+static int hash_message_streamed(dispatcher_context_t *dc, sign_message_state_t *state) {
+    int message_len =
+        call_stream_preimage(dc, state->message_commitment, NULL, hash_message_data, state);
+
+    // the message length is already in the BSM digest, and must match the streamed message
+    if (message_len < 0 || (uint64_t) message_len != state->message_length) {
+        return -1;
+    }
+    return 0;
+}
+
 void handler_sign_message(dispatcher_context_t *dc) {
     sign_message_state_t *state = (sign_message_state_t *) &G_command_state;
 
@@ -48,12 +92,20 @@ void handler_sign_message(dispatcher_context_t *dc) {
     if (!buffer_read_u8(&dc->read_buffer, &state->bip32_path_len) ||
         !buffer_read_bip32_path(&dc->read_buffer, state->bip32_path, state->bip32_path_len) ||
         !buffer_read_varint(&dc->read_buffer, &state->message_length) ||
-        !buffer_read_bytes(&dc->read_buffer, state->message_merkle_root, 32)) {
+        !buffer_read_bytes(&dc->read_buffer, state->message_commitment, 32)) {
         SEND_SW(dc, SW_WRONG_DATA_LENGTH);
         return;
     }
 
-    if (state->bip32_path_len > MAX_BIP32_PATH_STEPS || state->message_length >= (1LL << 32)) {
+    // the type of commitment is optional, for compatibility with the clients that only use the
+    // Merkle root
+    if (!buffer_read_u8(&dc->read_buffer, &state->message_commitment_type)) {
+        state->message_commitment_type = MESSAGE_COMMITMENT_MERKLE_ROOT;
+    }
+
+    if (state->bip32_path_len > MAX_BIP32_PATH_STEPS || state->message_length >= (1LL << 32) ||
+        (state->message_commitment_type != MESSAGE_COMMITMENT_MERKLE_ROOT &&
+         state->message_commitment_type != MESSAGE_COMMITMENT_PREIMAGE)) {
         SEND_SW(dc, SW_INCORRECT_DATA);
         return;
     }
@@ -69,23 +121,15 @@ void handler_sign_message(dispatcher_context_t *dc) {
     crypto_hash_update(&state->bsm_digest_context.header, BSM_SIGN_MAGIC, sizeof(BSM_SIGN_MAGIC));
     crypto_hash_update_varint(&state->bsm_digest_context.header, state->message_length);
 
-    size_t n_chunks = (state->message_length + 63) / 64;
-    for (unsigned int i = 0; i < n_chunks; i++) {
-        uint8_t message_chunk[64];
-        int chunk_len = call_get_merkle_leaf_element(dc,
-                                                     state->message_merkle_root,
-                                                     n_chunks,
-                                                     i,
-                                                     message_chunk,
-                                                     sizeof(message_chunk));
-
-        if (chunk_len < 0 || (chunk_len != 64 && i != n_chunks - 1)) {
-            SEND_SW(dc, SW_BAD_STATE);  // should never happen
+    if (state->message_commitment_type == MESSAGE_COMMITMENT_PREIMAGE) {
+        // the host sent a wrong preimage, or one whose length is not the message length
+        if (hash_message_streamed(dc, state) < 0) {
+            SEND_SW(dc, SW_INCORRECT_DATA);
             return;
         }
-
-        crypto_hash_update(&state->msg_hash_context.header, message_chunk, chunk_len);
-        crypto_hash_update(&state->bsm_digest_context.header, message_chunk, chunk_len);
+    } else if (hash_message_chunks(dc, state) < 0) {
+        SEND_SW(dc, SW_BAD_STATE);  // should never happen
+        return;
     }
 
     crypto_hash_digest(&state->msg_hash_context.header, state->message_hash, 32);
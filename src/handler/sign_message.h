@@ -3,13 +3,18 @@
 #include "../common/bip32.h"
 #include "../boilerplate/dispatcher.h"
 
+// Types of the commitment to the message in the SIGN_MESSAGE request
+#define MESSAGE_COMMITMENT_MERKLE_ROOT 0  // Merkle root of the 64-byte chunks of the message
+#define MESSAGE_COMMITMENT_PREIMAGE    1  // sha256(0x00 || message), streamed with GET_PREIMAGE
+
 typedef struct {
     machine_context_t ctx;
 
     uint8_t bip32_path_len;
     uint32_t bip32_path[MAX_BIP32_PATH_STEPS];
     uint64_t message_length;
-    uint8_t message_merkle_root[32];
+    uint8_t message_commitment_type;
+    uint8_t message_commitment[32];
 
     cx_sha256_t msg_hash_context;    // used to compute sha256(message)
     cx_sha256_t bsm_digest_context;  // used to compute the Bitcoin Message Signing digest
@@ -37,15 +37,18 @@
 #include "lib/policy.h"
 #include "lib/check_merkle_tree_sorted.h"
 #include "lib/get_preimage.h"
+#include "lib/get_merkle_leaf_element.h"
 #include "lib/get_merkleized_map.h"
 #include "lib/get_merkleized_map_value.h"
 #include "lib/psbt_parse_rawtx.h"
+#include "lib/stream_preimage.h"
 
 #include "sign_psbt.h"
 
 #include "sign_psbt/compare_wallet_script_at_path.h"
 #include "sign_psbt/get_fingerprint_and_path.h"
 #include "sign_psbt/is_in_out_internal.h"
+#include "sign_psbt/prevout_record.h"
 #include "sign_psbt/update_hashes_with_map_value.h"
 
 #include "../swap/swap_globals.h"
@@ -63,6 +66,7 @@ static void verify_outputs_init(dispatcher_context_t *dc);
 static void process_output_map(dispatcher_context_t *dc);
 static void check_output_owned(dispatcher_context_t *dc);
 static void output_validate_external(dispatcher_context_t *dc);
+static void output_validate_asset(dispatcher_context_t *dc);
 static void output_next(dispatcher_context_t *dc);
 
 // User confirmation (all)
@@ -106,49 +110,123 @@ the right paths to identify internal inputs/outputs.
 
 // HELPER FUNCTIONS
 
-// Updates the hash_context with the network serialization of all the outputs
+// Callback for call_get_merkleized_map_with_callback, recording the index of each key that only
+// consists of a key type. Does not consume the data in the buffer.
+static void record_key_index(map_key_index_t *key_index, buffer_t *data) {
+    if (data->size - data->offset == 1) {
+        uint8_t key_type = data->ptr[data->offset];
+        if (key_type < N_INDEXED_KEY_TYPES && key_index->n_keys_seen < 255) {
+            key_index->index[key_type] = (uint8_t) (key_index->n_keys_seen + 1);
+        }
+    }
+    ++key_index->n_keys_seen;
+}
+
+// Like call_get_merkleized_map_value for the key made only of key_type, but avoids asking the index
+// of the key to the client if it was recorded with record_key_index when the map was opened.
+// If all the keys of the map were recorded, a missing key is known to be absent without any query.
+static int get_map_value_by_key_type(dispatcher_context_t *dc,
+                                     const merkleized_map_commitment_t *map,
+                                     const map_key_index_t *key_index,
+                                     uint8_t key_type,
+                                     uint8_t *out,
+                                     int out_len) {
+    if (key_type < N_INDEXED_KEY_TYPES) {
+        if (key_index->index[key_type] != 0) {
+            return call_get_merkle_leaf_element(dc,
+                                                map->values_root,
+                                                map->size,
+                                                key_index->index[key_type] - 1,
+                                                out,
+                                                out_len);
+        } else if (key_index->n_keys_seen == map->size && map->size <= 255) {
+            return -1;  // key not present
+        }
+    }
+    return call_get_merkleized_map_value(dc, map, &key_type, 1, out, out_len);
+}
+
+// Opens the i-th map of the tree with the given root, recording the index of its keys
+static int get_indexed_map(dispatcher_context_t *dc,
+                           const uint8_t root[static 32],
+                           int size,
+                           int index,
+                           merkleized_map_commitment_t *map,
+                           map_key_index_t *key_index) {
+    memset(key_index, 0, sizeof(map_key_index_t));
+    return call_get_merkleized_map_with_callback(
+        dc,
+        root,
+        size,
+        index,
+        make_callback(key_index, (dispatcher_callback_t) record_key_index),
+        map);
+}
+
+static void cb_hash_serialized_outputs(buffer_t *data, void *cb_state) {
+    cx_hash_t *hash_context = (cx_hash_t *) cb_state;
+
+    size_t data_len = data->size - data->offset;
+    crypto_hash_update(hash_context, data->ptr + data->offset, data_len);
+    buffer_seek_cur(data, data_len);
+}
+
+// Updates the hash_context with the network serialization of all the outputs, which is streamed
+// from the client as the preimage of the hash committed to while verifying the outputs. Hosts of
+// protocol version 0 do not know that preimage; the outputs are then read again from their maps.
 // returns -1 on error. 0 on success.
 static int hash_outputs(dispatcher_context_t *dc, cx_hash_t *hash_context) {
     sign_psbt_state_t *state = (sign_psbt_state_t *) &G_command_state;
 
     // TODO: support other SIGHASH FLAGS
-    for (unsigned int i = 0; i < state->n_outputs; i++) {
-        // get this output's map
-        merkleized_map_commitment_t ith_map;
-
-        int res = call_get_merkleized_map(dc, state->outputs_root, state->n_outputs, i, &ith_map);
-        if (res < 0) {
-            return -1;
-        }
+    if (dc->protocol_version < 1) {
+        for (unsigned int i = 0; i < state->n_outputs; i++) {
+            merkleized_map_commitment_t ith_map;
+            map_key_index_t ith_key_index;
+            if (0 > get_indexed_map(dc,
+                                    state->outputs_root,
+                                    state->n_outputs,
+                                    i,
+                                    &ith_map,
+                                    &ith_key_index)) {
+                return -1;
+            }
 
-        // get output's amount
-        uint8_t amount_raw[8];
-        if (8 != call_get_merkleized_map_value(dc,
+            uint8_t amount_raw[8];
+            if (8 != get_map_value_by_key_type(dc,
                                                &ith_map,
-                                               (uint8_t[]){PSBT_OUT_AMOUNT},
-                                               1,
+                                               &ith_key_index,
+                                               PSBT_OUT_AMOUNT,
                                                amount_raw,
                                                8)) {
-            return -1;
-        }
-
-        crypto_hash_update(hash_context, amount_raw, 8);
-
-        // get output's scriptPubKey
+                return -1;
+            }
+            crypto_hash_update(hash_context, amount_raw, 8);
 
-        uint8_t out_script[MAX_OUTPUT_SCRIPTPUBKEY_LEN];
-        int out_script_len = call_get_merkleized_map_value(dc,
+            uint8_t out_script[MAX_OUTPUT_SCRIPTPUBKEY_LEN];
+            int out_script_len = get_map_value_by_key_type(dc,
                                                            &ith_map,
-                                                           (uint8_t[]){PSBT_OUT_SCRIPT},
-                                                           1,
+                                                           &ith_key_index,
+                                                           PSBT_OUT_SCRIPT,
                                                            out_script,
                                                            sizeof(out_script));
-        if (out_script_len == -1) {
-            return -1;
+            if (out_script_len < 0) {
+                return -1;
+            }
+            crypto_hash_update_varint(hash_context, out_script_len);
+            crypto_hash_update(hash_context, out_script, out_script_len);
         }
+        return 0;
+    }
 
-        crypto_hash_update_varint(hash_context, out_script_len);
-        crypto_hash_update(hash_context, out_script, out_script_len);
+    int res = call_stream_preimage(dc,
+                                   state->serialized_outputs_hash,
+                                   NULL,
+                                   cb_hash_serialized_outputs,
+                                   hash_context);
+    if (res < 0) {
+        PRINTF("Error fetching the serialized outputs\n");
+        return -1;
     }
     return 0;
 }
@@ -177,8 +255,9 @@ static int get_segwit_version(const uint8_t scriptPubKey[], int scriptPubKey_len
 static int get_amount_scriptpubkey_from_psbt_nonwitness(
     dispatcher_context_t *dc,
     const merkleized_map_commitment_t *input_map,
+    const map_key_index_t *input_key_index,
     uint64_t *amount,
-    uint8_t scriptPubKey[static MAX_PREVOUT_SCRIPTPUBKEY_LEN],
+    uint8_t scriptPubKey[static MAX_ASSET_SCRIPTPUBKEY_LEN],
     size_t *scriptPubKey_len,
     const uint8_t *expected_prevout_hash) {
     // If there is no witness-utxo, it must be the case that this is a legacy input.
@@ -186,14 +265,16 @@ static int get_amount_scriptpubkey_from_psbt_nonwitness(
     // the non-witness-utxo
 
     // Read the prevout index
-    uint32_t prevout_n;
-    if (4 != call_get_merkleized_map_value_u32_le(dc,
-                                                  input_map,
-                                                  (uint8_t[]){PSBT_IN_OUTPUT_INDEX},
-                                                  1,
-                                                  &prevout_n)) {
+    uint8_t prevout_n_raw[4];
+    if (4 != get_map_value_by_key_type(dc,
+                                       input_map,
+                                       input_key_index,
+                                       PSBT_IN_OUTPUT_INDEX,
+                                       prevout_n_raw,
+                                       4)) {
         return -1;
     }
+    uint32_t prevout_n = read_u32_le(prevout_n_raw, 0);
 
     txid_parser_outputs_t parser_outputs;
     // request non-witness utxo, and get the prevout's value and scriptpubkey
@@ -231,17 +312,18 @@ static int get_amount_scriptpubkey_from_psbt_nonwitness(
 static int get_amount_scriptpubkey_from_psbt_witness(
     dispatcher_context_t *dc,
     const merkleized_map_commitment_t *input_map,
+    const map_key_index_t *input_key_index,
     uint64_t *amount,
     uint8_t scriptPubKey[static MAX_PREVOUT_SCRIPTPUBKEY_LEN],
     size_t *scriptPubKey_len) {
     uint8_t raw_witnessUtxo[8 + 1 + MAX_PREVOUT_SCRIPTPUBKEY_LEN];
 
-    int wit_utxo_len = call_get_merkleized_map_value(dc,
-                                                     input_map,
-                                                     (uint8_t[]){PSBT_IN_WITNESS_UTXO},
-                                                     1,
-                                                     raw_witnessUtxo,
-                                                     sizeof(raw_witnessUtxo));
+    int wit_utxo_len = get_map_value_by_key_type(dc,
+                                                 input_map,
+                                                 input_key_index,
+                                                 PSBT_IN_WITNESS_UTXO,
+                                                 raw_witnessUtxo,
+                                                 sizeof(raw_witnessUtxo));
 
     if (wit_utxo_len < 0) {
         return -1;
@@ -265,17 +347,21 @@ static int get_amount_scriptpubkey_from_psbt_witness(
 /*
  Convenience function to get the amount and scriptpubkey of a certain input in a PSBTv2.
  It first tries to obtain it from the witness-utxo field; in case of failure, it then obtains it
- from the non-witness-utxo.
+ from the prevout record stored by the host while processing the inputs, or from the
+ non-witness-utxo if the host does not have the record.
  Returns -1 on failure, 0 on success.
 */
 static int get_amount_scriptpubkey_from_psbt(
     dispatcher_context_t *dc,
+    uint32_t input_index,
     const merkleized_map_commitment_t *input_map,
+    const map_key_index_t *input_key_index,
     uint64_t *amount,
-    uint8_t scriptPubKey[static MAX_PREVOUT_SCRIPTPUBKEY_LEN],
+    uint8_t scriptPubKey[static MAX_ASSET_SCRIPTPUBKEY_LEN],
     size_t *scriptPubKey_len) {
     int ret = get_amount_scriptpubkey_from_psbt_witness(dc,
                                                         input_map,
+                                                        input_key_index,
                                                         amount,
                                                         scriptPubKey,
                                                         scriptPubKey_len);
@@ -283,8 +369,21 @@ static int get_amount_scriptpubkey_from_psbt(
         return ret;
     }
 
+    sign_psbt_state_t *state = (sign_psbt_state_t *) &G_command_state;
+    ret = get_prevout_record(dc,
+                             state->prevout_record_key,
+                             input_index,
+                             input_map,
+                             amount,
+                             scriptPubKey,
+                             scriptPubKey_len);
+    if (ret != 0) {
+        return ret > 0 ? 0 : -1;
+    }
+
     return get_amount_scriptpubkey_from_psbt_nonwitness(dc,
                                                         input_map,
+                                                        input_key_index,
                                                         amount,
                                                         scriptPubKey,
                                                         scriptPubKey_len,
@@ -323,12 +422,6 @@ void handler_sign_psbt(dispatcher_context_t *dc) {
         SEND_SW(dc, SW_WRONG_DATA_LENGTH);
         return;
     }
-    if (n_inputs > MAX_N_INPUTS_CAN_SIGN) {
-        // TODO: remove this limitation
-        PRINTF("At most %d inputs are supported\n", MAX_N_INPUTS_CAN_SIGN);
-        SEND_SW(dc, SW_NOT_SUPPORTED);
-        return;
-    }
     state->n_inputs = (unsigned int) n_inputs;
 
     uint64_t n_outputs;
@@ -434,10 +527,12 @@ void handler_sign_psbt(dispatcher_context_t *dc) {
 
     state->inputs_total_value = 0;
     state->internal_inputs_total_value = 0;
-    memset(state->internal_inputs, 0, sizeof(state->internal_inputs));
+    state->n_internal_inputs = 0;
 
     state->master_key_fingerprint = crypto_get_master_key_fingerprint();
 
+    cx_rng(state->prevout_record_key, sizeof(state->prevout_record_key));
+
     // process global map
     {
         // Check integrity of the global map
@@ -486,6 +581,9 @@ void handler_sign_psbt(dispatcher_context_t *dc) {
 
     state->cur_input_index = 0;
 
+    cx_sha256_init(&state->serialization_hash_context);
+    crypto_hash_update_u8(&state->serialization_hash_context.header, 0x00);
+
     if (state->is_wallet_canonical) {
         // Canonical wallet, we start processing the psbt directly
         dc->next(process_input_map);
@@ -508,6 +606,8 @@ void handler_sign_psbt(dispatcher_context_t *dc) {
  * Keeps track if the current input has a witness_utxo and/or a redeemScript.
  */
 static void input_keys_callback(sign_psbt_state_t *state, buffer_t *data) {
+    record_key_index(&state->cur.in_out.key_index, data);
+
     size_t data_len = data->size - data->offset;
     if (data_len >= 1) {
         uint8_t key_type;
@@ -550,6 +650,10 @@ static void process_input_map(dispatcher_context_t *dc) {
 
     if (state->cur_input_index >= state->n_inputs) {
         // all inputs already processed
+        crypto_hash_digest(&state->serialization_hash_context.header,
+                           state->serialized_inputs_hash,
+                           32);
+
         dc->next(alert_external_inputs);
         return;
     }
@@ -583,26 +687,52 @@ static void process_input_map(dispatcher_context_t *dc) {
         return;
     }
 
-    // validate non-witness utxo (if present) and witness utxo (if present)
-
-    if (state->cur.input.has_nonWitnessUtxo) {
-        uint8_t prevout_hash[32];
-
-        // check if the prevout_hash of the transaction matches the computed one from the
-        // non-witness utxo
-        if (0 > call_get_merkleized_map_value(dc,
-                                              &state->cur.in_out.map,
-                                              (uint8_t[]){PSBT_IN_PREVIOUS_TXID},
-                                              1,
-                                              prevout_hash,
-                                              sizeof(prevout_hash))) {
+    // add the outpoint and the nSequence of this input to the serialization of the inputs
+    uint8_t prevout_hash[32];
+    {
+        if (32 != get_map_value_by_key_type(dc,
+                                            &state->cur.in_out.map,
+                                            &state->cur.in_out.key_index,
+                                            PSBT_IN_PREVIOUS_TXID,
+                                            prevout_hash,
+                                            sizeof(prevout_hash))) {
             SEND_SW(dc, SW_INCORRECT_DATA);
             return;
         }
+        crypto_hash_update(&state->serialization_hash_context.header, prevout_hash, 32);
+
+        uint8_t raw_result[4];
+        if (4 != get_map_value_by_key_type(dc,
+                                           &state->cur.in_out.map,
+                                           &state->cur.in_out.key_index,
+                                           PSBT_IN_OUTPUT_INDEX,
+                                           raw_result,
+                                           4)) {
+            SEND_SW(dc, SW_INCORRECT_DATA);
+            return;
+        }
+        crypto_hash_update(&state->serialization_hash_context.header, raw_result, 4);
+
+        if (4 != get_map_value_by_key_type(dc,
+                                           &state->cur.in_out.map,
+                                           &state->cur.in_out.key_index,
+                                           PSBT_IN_SEQUENCE,
+                                           raw_result,
+                                           4)) {
+            // if no PSBT_IN_SEQUENCE is present, we must assume nSequence 0xFFFFFFFF
+            memset(raw_result, 0xFF, 4);
+        }
+        crypto_hash_update(&state->serialization_hash_context.header, raw_result, 4);
+    }
+
+    // validate non-witness utxo (if present) and witness utxo (if present)
 
-        // request non-witness utxo, and get the prevout's value and scriptpubkey
+    if (state->cur.input.has_nonWitnessUtxo) {
+        // request non-witness utxo, and get the prevout's value and scriptpubkey; also check that
+        // the prevout_hash of the transaction matches the computed one from the non-witness utxo
         if (0 > get_amount_scriptpubkey_from_psbt_nonwitness(dc,
                                                              &state->cur.in_out.map,
+                                                             &state->cur.in_out.key_index,
                                                              &state->cur.input.prevout_amount,
                                                              state->cur.in_out.scriptPubKey,
                                                              &state->cur.in_out.scriptPubKey_len,
@@ -612,6 +742,20 @@ static void process_input_map(dispatcher_context_t *dc) {
         }
 
         state->inputs_total_value += state->cur.input.prevout_amount;
+
+        // without a witness utxo, the amount and scriptPubKey are needed again while signing; the
+        // host stores them, so that the non-witness utxo is not parsed again
+        if (!state->cur.input.has_witnessUtxo &&
+            0 > store_prevout_record(dc,
+                                     state->prevout_record_key,
+                                     state->cur_input_index,
+                                     &state->cur.in_out.map,
+                                     state->cur.input.prevout_amount,
+                                     state->cur.in_out.scriptPubKey,
+                                     state->cur.in_out.scriptPubKey_len)) {
+            SEND_SW(dc, SW_INCORRECT_DATA);
+            return;
+        }
     }
 
     if (state->cur.input.has_witnessUtxo) {
@@ -621,6 +765,7 @@ static void process_input_map(dispatcher_context_t *dc) {
 
         if (0 > get_amount_scriptpubkey_from_psbt_witness(dc,
                                                           &state->cur.in_out.map,
+                                                          &state->cur.in_out.key_index,
                                                           &wit_utxo_prevout_amount,
                                                           wit_utxo_scriptPubkey,
                                                           &wit_utxo_scriptPubkey_len)) {
@@ -668,7 +813,7 @@ static void check_input_owned(dispatcher_context_t *dc) {
     } else if (is_internal == 0) {
         PRINTF("INPUT %d is external\n", state->cur_input_index);
     } else {
-        bitvector_set(state->internal_inputs, state->cur_input_index, 1);
+        ++state->n_internal_inputs;
         state->internal_inputs_total_value += state->cur.input.prevout_amount;
 
         int segwit_version =
@@ -699,12 +844,7 @@ static void alert_external_inputs(dispatcher_context_t *dc) {
 
     LOG_PROCESSOR(dc, __FILE__, __LINE__, __func__);
 
-    size_t count_external_inputs = 0;
-    for (unsigned int i = 0; i < state->n_inputs; i++) {
-        if (!bitvector_get(state->internal_inputs, i)) {
-            ++count_external_inputs;
-        }
-    }
+    size_t count_external_inputs = state->n_inputs - state->n_internal_inputs;
 
     if (count_external_inputs == 0) {
         // no external inputs
@@ -747,6 +887,9 @@ static void verify_outputs_init(dispatcher_context_t *dc) {
 
     state->external_outputs_count = 0;
 
+    cx_sha256_init(&state->serialization_hash_context);
+    crypto_hash_update_u8(&state->serialization_hash_context.header, 0x00);
+
     dc->next(process_output_map);
 }
 
@@ -755,6 +898,8 @@ static void verify_outputs_init(dispatcher_context_t *dc) {
  * Keeps track if the current input has a witness_utxo and/or a redeemScript.
  */
 static void output_keys_callback(sign_psbt_state_t *state, buffer_t *data) {
+    record_key_index(&state->cur.in_out.key_index, data);
+
     size_t data_len = data->size - data->offset;
     if (data_len >= 1) {
         uint8_t key_type;
@@ -787,6 +932,10 @@ static void process_output_map(dispatcher_context_t *dc) {
 
     if (state->cur_output_index >= state->n_outputs) {
         // all outputs already processed
+        crypto_hash_digest(&state->serialization_hash_context.header,
+                           state->serialized_outputs_hash,
+                           32);
+
         dc->next(confirm_transaction);
         return;
     }
@@ -817,12 +966,12 @@ static void process_output_map(dispatcher_context_t *dc) {
     uint8_t raw_result[8];
 
     // Read the output's amount
-    int result_len = call_get_merkleized_map_value(dc,
-                                                   &state->cur.in_out.map,
-                                                   (uint8_t[]){PSBT_OUT_AMOUNT},
-                                                   1,
-                                                   raw_result,
-                                                   sizeof(raw_result));
+    int result_len = get_map_value_by_key_type(dc,
+                                               &state->cur.in_out.map,
+                                               &state->cur.in_out.key_index,
+                                               PSBT_OUT_AMOUNT,
+                                               raw_result,
+                                               sizeof(raw_result));
     if (result_len != 8) {
         SEND_SW(dc, SW_INCORRECT_DATA);
         return;
@@ -833,12 +982,12 @@ static void process_output_map(dispatcher_context_t *dc) {
     state->outputs_total_value += value;
 
     // Read the output's scriptPubKey
-    result_len = call_get_merkleized_map_value(dc,
-                                               &state->cur.in_out.map,
-                                               (uint8_t[]){PSBT_OUT_SCRIPT},
-                                               1,
-                                               state->cur.in_out.scriptPubKey,
-                                               sizeof(state->cur.in_out.scriptPubKey));
+    result_len = get_map_value_by_key_type(dc,
+                                           &state->cur.in_out.map,
+                                           &state->cur.in_out.key_index,
+                                           PSBT_OUT_SCRIPT,
+                                           state->cur.in_out.scriptPubKey,
+                                           sizeof(state->cur.in_out.scriptPubKey));
 
     if (result_len == -1 || result_len > (int) sizeof(state->cur.in_out.scriptPubKey)) {
         SEND_SW(dc, SW_INCORRECT_DATA);
@@ -847,6 +996,13 @@ static void process_output_map(dispatcher_context_t *dc) {
 
     state->cur.in_out.scriptPubKey_len = result_len;
 
+    // add the output's serialization to the committed outputs
+    crypto_hash_update(&state->serialization_hash_context.header, raw_result, 8);
+    crypto_hash_update_varint(&state->serialization_hash_context.header, result_len);
+    crypto_hash_update(&state->serialization_hash_context.header,
+                       state->cur.in_out.scriptPubKey,
+                       result_len);
+
     dc->next(check_output_owned);
 }
 
@@ -883,6 +1039,14 @@ static void output_validate_external(dispatcher_context_t *dc) {
 
     LOG_PROCESSOR(dc, __FILE__, __LINE__, __func__);
 
+    asset_script_t asset;
+    if (parse_asset_script(state->cur.in_out.scriptPubKey,
+                           state->cur.in_out.scriptPubKey_len,
+                           &asset) >= 0) {
+        dc->next(output_validate_asset);
+        return;
+    }
+
     // show this output's address
     char output_address[MAX(MAX_ADDRESS_LENGTH_STR + 1, MAX_OPRETURN_OUTPUT_DESC_SIZE)];
     int address_len = get_script_address(state->cur.in_out.scriptPubKey,
@@ -935,6 +1099,69 @@ static void output_validate_external(dispatcher_context_t *dc) {
     }
 }
 
+// Shows an output with a Ravencoin asset, which is described by its script instead of its value
+static void output_validate_asset(dispatcher_context_t *dc) {
+    sign_psbt_state_t *state = (sign_psbt_state_t *) &G_command_state;
+
+    LOG_PROCESSOR(dc, __FILE__, __LINE__, __func__);
+
+    asset_script_t asset;
+    if (parse_asset_script(state->cur.in_out.scriptPubKey,
+                           state->cur.in_out.scriptPubKey_len,
+                           &asset) < 0) {
+        SEND_SW(dc, SW_BAD_STATE);  // should never happen
+        return;
+    }
+
+    // Ravencoin requires a zero value for the outputs with an asset; it would not be shown
+    if (state->cur.output.value != 0) {
+        PRINTF("Non-zero value for the asset output %d\n", state->cur_output_index);
+        SEND_SW(dc, SW_INCORRECT_DATA);
+        return;
+    }
+
+    // Swap feature: only the coin can be swapped
+    if (G_swap_state.called_from_swap) {
+        PRINTF("Asset outputs not allowed in swap transactions\n");
+        SEND_SW(dc, SW_INCORRECT_DATA);
+        return;
+    }
+
+    char output_description[MAX(MAX_ADDRESS_LENGTH_STR + 1, MAX_NULL_ASSET_OUTPUT_DESC_SIZE)];
+    if (asset.base_script_len == 0) {
+        // null asset script, without an address nor an amount
+        if (format_null_asset_script(&asset, G_coin_config, output_description) < 0) {
+            PRINTF("Invalid null asset script for output %d\n", state->cur_output_index);
+            SEND_SW(dc, SW_NOT_SUPPORTED);
+            return;
+        }
+        ui_validate_output(dc,
+                           state->external_outputs_count,
+                           output_description,
+                           G_coin_config->name_short,
+                           state->cur.output.value,
+                           output_next);
+        return;
+    }
+
+    if (get_script_address(state->cur.in_out.scriptPubKey,
+                           asset.base_script_len,
+                           G_coin_config,
+                           output_description,
+                           sizeof(output_description)) < 0) {
+        PRINTF("Invalid address for output %d\n", state->cur_output_index);
+        SEND_SW(dc, SW_NOT_SUPPORTED);
+        return;
+    }
+    ui_validate_asset_output(dc,
+                             state->external_outputs_count,
+                             output_description,
+                             asset.name,
+                             asset.name_len,
+                             asset.amount,
+                             output_next);
+}
+
 static void output_next(dispatcher_context_t *dc) {
     sign_psbt_state_t *state = (sign_psbt_state_t *) &G_command_state;
 
@@ -1072,6 +1299,10 @@ static void sign_init(dispatcher_context_t *dc) {
     }
 
     state->segwit_hashes_computed = false;
+    state->taproot_hashes_computed = false;
+
+    state->n_signed_inputs = 0;
+    state->signed_inputs_total_value = 0;
 
     state->cur_input_index = 0;
     dc->next(sign_process_input_map);
@@ -1082,15 +1313,15 @@ static void sign_process_input_map(dispatcher_context_t *dc) {
 
     LOG_PROCESSOR(dc, __FILE__, __LINE__, __func__);
 
-    // skip external inputs
-    while (state->cur_input_index < state->n_inputs &&
-           !bitvector_get(state->internal_inputs, state->cur_input_index)) {
-        PRINTF("Skipping signing external input %d\n", state->cur_input_index);
-        ++state->cur_input_index;
-    }
-
     if (state->cur_input_index >= state->n_inputs) {
-        // all inputs already processed
+        // all inputs already processed; the internal inputs must all have been signed
+        if (state->n_signed_inputs != state->n_internal_inputs ||
+            state->signed_inputs_total_value != state->internal_inputs_total_value) {
+            PRINTF("Signed inputs do not match the internal inputs\n");
+            SEND_SW(dc, SW_BAD_STATE);
+            return;
+        }
+
         dc->next(finalize);
         return;
     }
@@ -1110,20 +1341,64 @@ static void sign_process_input_map(dispatcher_context_t *dc) {
         return;
     }
 
+    // recognize again if the input is internal, as in check_input_owned; skip external inputs
+    int is_internal = 0;
+    if (state->cur.in_out.has_bip32_derivation && !state->cur.in_out.unexpected_pubkey_error) {
+        if (0 > get_amount_scriptpubkey_from_psbt(dc,
+                                                  state->cur_input_index,
+                                                  &state->cur.in_out.map,
+                                                  &state->cur.in_out.key_index,
+                                                  &state->cur.input.prevout_amount,
+                                                  state->cur.in_out.scriptPubKey,
+                                                  &state->cur.in_out.scriptPubKey_len)) {
+            SEND_SW(dc, SW_INCORRECT_DATA);
+            return;
+        }
+
+        is_internal = is_in_out_internal(dc, state, &state->cur.in_out, true);
+        if (is_internal < 0) {
+            PRINTF("Error checking if input %d is internal\n", state->cur_input_index);
+            SEND_SW(dc, SW_INCORRECT_DATA);
+            return;
+        }
+    }
+
+    if (is_internal == 0) {
+        PRINTF("Skipping signing external input %d\n", state->cur_input_index);
+        ++state->cur_input_index;
+        dc->next(sign_process_input_map);
+        return;
+    }
+
+    // checked before the input is signed: no more inputs, and no more value, than the internal
+    // inputs counted while verifying the inputs can be signed
+    if (state->n_signed_inputs >= state->n_internal_inputs ||
+        state->cur.input.prevout_amount >
+            state->internal_inputs_total_value - state->signed_inputs_total_value) {
+        PRINTF("Input %d was not counted as internal\n", state->cur_input_index);
+        SEND_SW(dc, SW_BAD_STATE);
+        return;
+    }
+    ++state->n_signed_inputs;
+    state->signed_inputs_total_value += state->cur.input.prevout_amount;
+
     if (!state->cur.input.has_sighash_type) {
         state->cur.input.sighash_type = SIGHASH_ALL;
     } else {
         // Get sighash type
-        if (4 != call_get_merkleized_map_value_u32_le(dc,
-                                                      &state->cur.in_out.map,
-                                                      (uint8_t[]){PSBT_IN_SIGHASH_TYPE},
-                                                      1,
-                                                      &state->cur.input.sighash_type)) {
+        uint8_t sighash_type_raw[4];
+        if (4 != get_map_value_by_key_type(dc,
+                                           &state->cur.in_out.map,
+                                           &state->cur.in_out.key_index,
+                                           PSBT_IN_SIGHASH_TYPE,
+                                           sighash_type_raw,
+                                           4)) {
             PRINTF("Malformed PSBT_IN_SIGHASH_TYPE for input %d\n", state->cur_input_index);
 
             SEND_SW(dc, SW_INCORRECT_DATA);
             return;
         }
+        state->cur.input.sighash_type = read_u32_le(sighash_type_raw, 0);
     }
 
     // TODO: add support for other sighash flags
@@ -1185,24 +1460,117 @@ static void sign_process_input_map(dispatcher_context_t *dc) {
 static void sign_legacy(dispatcher_context_t *dc) {
     // sign legacy P2PKH or P2SH
 
-    sign_psbt_state_t *state = (sign_psbt_state_t *) &G_command_state;
-
     LOG_PROCESSOR(dc, __FILE__, __LINE__, __func__);
 
     // sign_non_witness(non_witness_utxo.vout[psbt.tx.input_[i].prevout.n].scriptPubKey, i)
+    // The scriptPubKey was obtained from the non-witness utxo in sign_process_input_map, as there
+    // is no witness utxo.
 
-    uint64_t tmp;  // unused
-    if (0 > get_amount_scriptpubkey_from_psbt_nonwitness(dc,
-                                                         &state->cur.in_out.map,
-                                                         &tmp,
-                                                         state->cur.in_out.scriptPubKey,
-                                                         &state->cur.in_out.scriptPubKey_len,
-                                                         NULL)) {
-        SEND_SW(dc, SW_INCORRECT_DATA);
-        return;
+    dc->next(sign_legacy_compute_sighash);
+}
+
+// Length of each input in the serialization committed by serialized_inputs_hash
+#define SERIALIZED_INPUT_OUTPOINT_LEN (32 + 4)
+#define SERIALIZED_INPUT_LEN          (SERIALIZED_INPUT_OUTPOINT_LEN + 4)
+
+typedef struct {
+    cx_hash_t *sighash_context;
+    unsigned int signing_input_index;
+    const uint8_t *script_code;
+    size_t script_code_len;
+    size_t n_processed_bytes;
+} legacy_inputs_callback_state_t;
+
+// Adds the streamed serialization of the inputs to the legacy sighash, inserting the scriptCode
+// between the outpoint and the nSequence of each input.
+static void cb_legacy_sighash_inputs(buffer_t *data, void *cb_state) {
+    legacy_inputs_callback_state_t *state = (legacy_inputs_callback_state_t *) cb_state;
+
+    while (buffer_can_read(data, 1)) {
+        size_t pos = state->n_processed_bytes % SERIALIZED_INPUT_LEN;
+        size_t field_end = SERIALIZED_INPUT_LEN;
+        if (pos < SERIALIZED_INPUT_OUTPOINT_LEN) {
+            field_end = SERIALIZED_INPUT_OUTPOINT_LEN;
+        }
+
+        size_t data_len = data->size - data->offset;
+        size_t n_bytes = MIN(field_end - pos, data_len);
+
+        crypto_hash_update(state->sighash_context, data->ptr + data->offset, n_bytes);
+        buffer_seek_cur(data, n_bytes);
+        state->n_processed_bytes += n_bytes;
+
+        if (state->n_processed_bytes % SERIALIZED_INPUT_LEN == SERIALIZED_INPUT_OUTPOINT_LEN) {
+            if (state->n_processed_bytes / SERIALIZED_INPUT_LEN == state->signing_input_index) {
+                crypto_hash_update_varint(state->sighash_context, state->script_code_len);
+                crypto_hash_update(state->sighash_context,
+                                   state->script_code,
+                                   state->script_code_len);
+            } else {
+                // empty scriptcode
+                crypto_hash_update_u8(state->sighash_context, 0x00);
+            }
+        }
     }
+}
 
-    dc->next(sign_legacy_compute_sighash);
+// Streams to the callback the serialization of the inputs committed by serialized_inputs_hash.
+// Hosts of protocol version 0 do not know its preimage; the fields are then read again from each
+// input map. Returns the length of the serialization, or -1 on error.
+static int stream_serialized_inputs(dispatcher_context_t *dc,
+                                    void (*callback)(buffer_t *, void *),
+                                    void *callback_state) {
+    sign_psbt_state_t *state = (sign_psbt_state_t *) &G_command_state;
+
+    if (dc->protocol_version >= 1) {
+        return call_stream_preimage(dc,
+                                    state->serialized_inputs_hash,
+                                    NULL,
+                                    callback,
+                                    callback_state);
+    }
+
+    for (unsigned int i = 0; i < state->n_inputs; i++) {
+        merkleized_map_commitment_t ith_map;
+        map_key_index_t ith_key_index;
+        if (0 > get_indexed_map(dc,
+                                state->inputs_root,
+                                state->n_inputs,
+                                i,
+                                &ith_map,
+                                &ith_key_index)) {
+            return -1;
+        }
+
+        uint8_t serialized_input[SERIALIZED_INPUT_LEN];
+        if (32 != get_map_value_by_key_type(dc,
+                                            &ith_map,
+                                            &ith_key_index,
+                                            PSBT_IN_PREVIOUS_TXID,
+                                            serialized_input,
+                                            32) ||
+            4 != get_map_value_by_key_type(dc,
+                                           &ith_map,
+                                           &ith_key_index,
+                                           PSBT_IN_OUTPUT_INDEX,
+                                           serialized_input + 32,
+                                           4)) {
+            return -1;
+        }
+        if (4 != get_map_value_by_key_type(dc,
+                                           &ith_map,
+                                           &ith_key_index,
+                                           PSBT_IN_SEQUENCE,
+                                           serialized_input + 36,
+                                           4)) {
+            // if no PSBT_IN_SEQUENCE is present, we must assume nSequence 0xFFFFFFFF
+            memset(serialized_input + 36, 0xFF, 4);
+        }
+
+        buffer_t buf = buffer_create(serialized_input, sizeof(serialized_input));
+        callback(&buf, callback_state);
+    }
+    return state->n_inputs * SERIALIZED_INPUT_LEN;
 }
 
 static void sign_legacy_compute_sighash(dispatcher_context_t *dc) {
@@ -1219,92 +1587,41 @@ static void sign_legacy_compute_sighash(dispatcher_context_t *dc) {
 
     crypto_hash_update_varint(&sighash_context.header, state->n_inputs);
 
-    for (unsigned int i = 0; i < state->n_inputs; i++) {
-        // get this input's map
-        merkleized_map_commitment_t ith_map;
-
-        if (i != state->cur_input_index) {
-            int res = call_get_merkleized_map(dc, state->inputs_root, state->n_inputs, i, &ith_map);
-            if (res < 0) {
+    {
+        legacy_inputs_callback_state_t cb_state = {.sighash_context = &sighash_context.header,
+                                                   .signing_input_index = state->cur_input_index,
+                                                   .n_processed_bytes = 0};
+
+        if (!state->cur.input.has_redeemScript) {
+            // P2PKH, the script_code is the prevout's scriptPubKey
+            cb_state.script_code = state->cur.in_out.scriptPubKey;
+            cb_state.script_code_len = state->cur.in_out.scriptPubKey_len;
+        } else {
+            // P2SH, the script_code is the redeemScript
+            int redeemScript_len = get_map_value_by_key_type(dc,
+                                                             &state->cur.in_out.map,
+                                                             &state->cur.in_out.key_index,
+                                                             PSBT_IN_REDEEM_SCRIPT,
+                                                             state->cur.input.script,
+                                                             sizeof(state->cur.input.script));
+            if (redeemScript_len < 0) {
+                PRINTF("Error fetching redeemScript\n");
                 SEND_SW(dc, SW_INCORRECT_DATA);
                 return;
             }
-        } else {
-            // Avoid requesting the same map unnecessarily
-            // (might be removed once a caching mechanism is implemented)
-            memcpy(&ith_map, &state->cur.in_out.map, sizeof(state->cur.in_out.map));
-        }
+            state->cur.input.script_len = redeemScript_len;
 
-        // get prevout hash and output index for the i-th input
-        uint8_t ith_prevout_hash[32];
-        if (32 != call_get_merkleized_map_value(dc,
-                                                &ith_map,
-                                                (uint8_t[]){PSBT_IN_PREVIOUS_TXID},
-                                                1,
-                                                ith_prevout_hash,
-                                                32)) {
-            SEND_SW(dc, SW_INCORRECT_DATA);
-            return;
+            cb_state.script_code = state->cur.input.script;
+            cb_state.script_code_len = state->cur.input.script_len;
         }
 
-        crypto_hash_update(&sighash_context.header, ith_prevout_hash, 32);
-
-        uint8_t ith_prevout_n_raw[4];
-        if (4 != call_get_merkleized_map_value(dc,
-                                               &ith_map,
-                                               (uint8_t[]){PSBT_IN_OUTPUT_INDEX},
-                                               1,
-                                               ith_prevout_n_raw,
-                                               4)) {
+        // the serialization of all the inputs was committed to while verifying the inputs
+        int res = stream_serialized_inputs(dc, cb_legacy_sighash_inputs, &cb_state);
+        if (res != (int) (state->n_inputs * SERIALIZED_INPUT_LEN)) {
+            PRINTF("Error fetching the serialized inputs\n");
             SEND_SW(dc, SW_INCORRECT_DATA);
             return;
         }
-
-        crypto_hash_update(&sighash_context.header, ith_prevout_n_raw, 4);
-
-        if (i != state->cur_input_index) {
-            // empty scriptcode
-            crypto_hash_update_u8(&sighash_context.header, 0x00);
-        } else {
-            if (!state->cur.input.has_redeemScript) {
-                // P2PKH, the script_code is the prevout's scriptPubKey
-                crypto_hash_update_varint(&sighash_context.header,
-                                          state->cur.in_out.scriptPubKey_len);
-                crypto_hash_update(&sighash_context.header,
-                                   state->cur.in_out.scriptPubKey,
-                                   state->cur.in_out.scriptPubKey_len);
-            } else {
-                // P2SH, the script_code is the redeemScript
-
-                // update sighash_context with the length-prefixed redeem script
-                int redeemScript_len =
-                    update_hashes_with_map_value(dc,
-                                                 &state->cur.in_out.map,
-                                                 (uint8_t[]){PSBT_IN_REDEEM_SCRIPT},
-                                                 1,
-                                                 NULL,
-                                                 &sighash_context.header);
-
-                if (redeemScript_len < 0) {
-                    PRINTF("Error fetching redeemScript\n");
-                    SEND_SW(dc, SW_INCORRECT_DATA);
-                    return;
-                }
-            }
-        }
-
-        uint8_t ith_nSequence_raw[4];
-        if (4 != call_get_merkleized_map_value(dc,
-                                               &ith_map,
-                                               (uint8_t[]){PSBT_IN_SEQUENCE},
-                                               1,
-                                               ith_nSequence_raw,
-                                               4)) {
-            // if no PSBT_IN_SEQUENCE is present, we must assume nSequence 0xFFFFFFFF
-            memset(ith_nSequence_raw, 0xFF, 4);
-        }
-
-        crypto_hash_update(&sighash_context.header, ith_nSequence_raw, 4);
     }
 
     // outputs
@@ -1337,29 +1654,19 @@ static void sign_segwit(dispatcher_context_t *dc) {
     int segwit_version;
 
     {
-        uint64_t amount;
-        if (0 > get_amount_scriptpubkey_from_psbt_witness(dc,
-                                                          &state->cur.in_out.map,
-                                                          &amount,
-                                                          state->cur.in_out.scriptPubKey,
-                                                          &state->cur.in_out.scriptPubKey_len)) {
-            SEND_SW(dc, SW_INCORRECT_DATA);
-            return;
-        }
-
-        state->inputs_total_value += amount;
+        // the amount and scriptPubKey were obtained from the witness utxo in sign_process_input_map
 
         if (state->cur.input.has_redeemScript) {
             // Get redeemScript
             uint8_t redeemScript[64];
 
             int redeemScript_length =
-                call_get_merkleized_map_value(dc,
-                                              &state->cur.in_out.map,
-                                              (uint8_t[]){PSBT_IN_REDEEM_SCRIPT},
-                                              1,
-                                              redeemScript,
-                                              sizeof(redeemScript));
+                get_map_value_by_key_type(dc,
+                                          &state->cur.in_out.map,
+                                          &state->cur.in_out.key_index,
+                                          PSBT_IN_REDEEM_SCRIPT,
+                                          redeemScript,
+                                          sizeof(redeemScript));
             if (redeemScript_length < 0) {
                 PRINTF("Error fetching redeem script\n");
                 SEND_SW(dc, SW_INCORRECT_DATA);
@@ -1413,9 +1720,14 @@ static void sign_segwit(dispatcher_context_t *dc) {
             for (unsigned int i = 0; i < state->n_inputs; i++) {
                 // get this input's map
                 merkleized_map_commitment_t ith_map;
-
-                int res =
-                    call_get_merkleized_map(dc, state->inputs_root, state->n_inputs, i, &ith_map);
+                map_key_index_t ith_key_index;
+
+                int res = get_indexed_map(dc,
+                                          state->inputs_root,
+                                          state->n_inputs,
+                                          i,
+                                          &ith_map,
+                                          &ith_key_index);
                 if (res < 0) {
                     SEND_SW(dc, SW_INCORRECT_DATA);
                     return;
@@ -1423,12 +1735,12 @@ static void sign_segwit(dispatcher_context_t *dc) {
 
                 // get prevout hash and output index for the i-th input
                 uint8_t ith_prevout_hash[32];
-                if (32 != call_get_merkleized_map_value(dc,
-                                                        &ith_map,
-                                                        (uint8_t[]){PSBT_IN_PREVIOUS_TXID},
-                                                        1,
-                                                        ith_prevout_hash,
-                                                        32)) {
+                if (32 != get_map_value_by_key_type(dc,
+                                                    &ith_map,
+                                                    &ith_key_index,
+                                                    PSBT_IN_PREVIOUS_TXID,
+                                                    ith_prevout_hash,
+                                                    32)) {
                     SEND_SW(dc, SW_INCORRECT_DATA);
                     return;
                 }
@@ -1436,12 +1748,12 @@ static void sign_segwit(dispatcher_context_t *dc) {
                 crypto_hash_update(&sha_prevouts_context.header, ith_prevout_hash, 32);
 
                 uint8_t ith_prevout_n_raw[4];
-                if (4 != call_get_merkleized_map_value(dc,
-                                                       &ith_map,
-                                                       (uint8_t[]){PSBT_IN_OUTPUT_INDEX},
-                                                       1,
-                                                       ith_prevout_n_raw,
-                                                       4)) {
+                if (4 != get_map_value_by_key_type(dc,
+                                                   &ith_map,
+                                                   &ith_key_index,
+                                                   PSBT_IN_OUTPUT_INDEX,
+                                                   ith_prevout_n_raw,
+                                                   4)) {
                     SEND_SW(dc, SW_INCORRECT_DATA);
                     return;
                 }
@@ -1449,12 +1761,12 @@ static void sign_segwit(dispatcher_context_t *dc) {
                 crypto_hash_update(&sha_prevouts_context.header, ith_prevout_n_raw, 4);
 
                 uint8_t ith_nSequence_raw[4];
-                if (4 != call_get_merkleized_map_value(dc,
-                                                       &ith_map,
-                                                       (uint8_t[]){PSBT_IN_SEQUENCE},
-                                                       1,
-                                                       ith_nSequence_raw,
-                                                       4)) {
+                if (4 != get_map_value_by_key_type(dc,
+                                                   &ith_map,
+                                                   &ith_key_index,
+                                                   PSBT_IN_SEQUENCE,
+                                                   ith_nSequence_raw,
+                                                   4)) {
                     // if no PSBT_IN_SEQUENCE is present, we must assume nSequence 0xFFFFFFFF
                     memset(ith_nSequence_raw, 0xFF, 4);
                 }
@@ -1478,57 +1790,63 @@ static void sign_segwit(dispatcher_context_t *dc) {
 
             crypto_hash_digest(&sha_outputs_context.header, state->hashes.sha_outputs, 32);
         }
+    }
+    state->segwit_hashes_computed = true;
 
-        {
-            // compute sha_amounts and sha_scriptpubkeys
-            // TODO: could be skipped if there are no segwitv1 inputs to sign
-
-            cx_sha256_t sha_amounts_context, sha_scriptpubkeys_context;
-
-            cx_sha256_init(&sha_amounts_context);
-            cx_sha256_init(&sha_scriptpubkeys_context);
-
-            for (unsigned int i = 0; i < state->n_inputs; i++) {
-                // get this input's map
-                merkleized_map_commitment_t ith_map;
-
-                int res =
-                    call_get_merkleized_map(dc, state->inputs_root, state->n_inputs, i, &ith_map);
-                if (res < 0) {
-                    SEND_SW(dc, SW_INCORRECT_DATA);
-                    return;
-                }
-
-                uint64_t in_amount;
-                uint8_t in_scriptPubKey[MAX_PREVOUT_SCRIPTPUBKEY_LEN];
-                size_t in_scriptPubKey_len;
-
-                if (0 > get_amount_scriptpubkey_from_psbt(dc,
-                                                          &ith_map,
-                                                          &in_amount,
-                                                          in_scriptPubKey,
-                                                          &in_scriptPubKey_len)) {
-                    SEND_SW(dc, SW_INCORRECT_DATA);
-                    return;
-                }
-
-                uint8_t in_amount_le[8];
-                write_u64_le(in_amount_le, 0, in_amount);
-                crypto_hash_update(&sha_amounts_context.header, in_amount_le, 8);
+    // sha_amounts and sha_scriptpubkeys are only part of the BIP341 sighash. They need the prevout
+    // of every input, which for legacy inputs means asking the host for their record again, so
+    // they are only computed if a segwit v1 input is signed.
+    if (segwit_version == 1 && !state->taproot_hashes_computed) {
+        cx_sha256_t sha_amounts_context, sha_scriptpubkeys_context;
+
+        cx_sha256_init(&sha_amounts_context);
+        cx_sha256_init(&sha_scriptpubkeys_context);
+
+        for (unsigned int i = 0; i < state->n_inputs; i++) {
+            // get this input's map
+            merkleized_map_commitment_t ith_map;
+            map_key_index_t ith_key_index;
+
+            int res = get_indexed_map(dc,
+                                      state->inputs_root,
+                                      state->n_inputs,
+                                      i,
+                                      &ith_map,
+                                      &ith_key_index);
+            if (res < 0) {
+                SEND_SW(dc, SW_INCORRECT_DATA);
+                return;
+            }
 
-                crypto_hash_update_varint(&sha_scriptpubkeys_context.header, in_scriptPubKey_len);
-                crypto_hash_update(&sha_scriptpubkeys_context.header,
-                                   in_scriptPubKey,
-                                   in_scriptPubKey_len);
+            uint64_t in_amount;
+            uint8_t in_scriptPubKey[MAX_ASSET_SCRIPTPUBKEY_LEN];
+            size_t in_scriptPubKey_len;
+
+            if (0 > get_amount_scriptpubkey_from_psbt(dc,
+                                                      i,
+                                                      &ith_map,
+                                                      &ith_key_index,
+                                                      &in_amount,
+                                                      in_scriptPubKey,
+                                                      &in_scriptPubKey_len)) {
+                SEND_SW(dc, SW_INCORRECT_DATA);
+                return;
             }
 
-            crypto_hash_digest(&sha_amounts_context.header, state->hashes.sha_amounts, 32);
-            crypto_hash_digest(&sha_scriptpubkeys_context.header,
-                               state->hashes.sha_scriptpubkeys,
-                               32);
+            uint8_t in_amount_le[8];
+            write_u64_le(in_amount_le, 0, in_amount);
+            crypto_hash_update(&sha_amounts_context.header, in_amount_le, 8);
+
+            crypto_hash_update_varint(&sha_scriptpubkeys_context.header, in_scriptPubKey_len);
+            crypto_hash_update(&sha_scriptpubkeys_context.header,
+                               in_scriptPubKey,
+                               in_scriptPubKey_len);
         }
+
+        crypto_hash_digest(&sha_amounts_context.header, state->hashes.sha_amounts, 32);
+        crypto_hash_digest(&sha_scriptpubkeys_context.header, state->hashes.sha_scriptpubkeys, 32);
+        state->taproot_hashes_computed = true;
     }
-    state->segwit_hashes_computed = true;
 
     if (segwit_version == 0) {
         dc->next(sign_segwit_v0);
@@ -1574,12 +1892,12 @@ static void sign_segwit_v0(dispatcher_context_t *dc) {
 
         // get prevout hash and output index for the current input
         uint8_t prevout_hash[32];
-        if (32 != call_get_merkleized_map_value(dc,
-                                                &state->cur.in_out.map,
-                                                (uint8_t[]){PSBT_IN_PREVIOUS_TXID},
-                                                1,
-                                                prevout_hash,
-                                                32)) {
+        if (32 != get_map_value_by_key_type(dc,
+                                            &state->cur.in_out.map,
+                                            &state->cur.in_out.key_index,
+                                            PSBT_IN_PREVIOUS_TXID,
+                                            prevout_hash,
+                                            32)) {
             SEND_SW(dc, SW_INCORRECT_DATA);
             return;
         }
@@ -1587,12 +1905,12 @@ static void sign_segwit_v0(dispatcher_context_t *dc) {
         crypto_hash_update(&sighash_context.header, prevout_hash, 32);
 
         uint8_t prevout_n_raw[4];
-        if (4 != call_get_merkleized_map_value(dc,
-                                               &state->cur.in_out.map,
-                                               (uint8_t[]){PSBT_IN_OUTPUT_INDEX},
-                                               1,
-                                               prevout_n_raw,
-                                               4)) {
+        if (4 != get_map_value_by_key_type(dc,
+                                           &state->cur.in_out.map,
+                                           &state->cur.in_out.key_index,
+                                           PSBT_IN_OUTPUT_INDEX,
+                                           prevout_n_raw,
+                                           4)) {
             SEND_SW(dc, SW_INCORRECT_DATA);
             return;
         }
@@ -1649,12 +1967,12 @@ static void sign_segwit_v0(dispatcher_context_t *dc) {
         // input value, taken from the WITNESS_UTXO field
         uint8_t witness_utxo[8 + 1 + MAX_PREVOUT_SCRIPTPUBKEY_LEN];
 
-        int witness_utxo_len = call_get_merkleized_map_value(dc,
-                                                             &state->cur.in_out.map,
-                                                             (uint8_t[]){PSBT_IN_WITNESS_UTXO},
-                                                             1,
-                                                             witness_utxo,
-                                                             sizeof(witness_utxo));
+        int witness_utxo_len = get_map_value_by_key_type(dc,
+                                                         &state->cur.in_out.map,
+                                                         &state->cur.in_out.key_index,
+                                                         PSBT_IN_WITNESS_UTXO,
+                                                         witness_utxo,
+                                                         sizeof(witness_utxo));
         if (witness_utxo_len < 8) {
             SEND_SW(dc, SW_INCORRECT_DATA);
             return;
@@ -1668,12 +1986,12 @@ static void sign_segwit_v0(dispatcher_context_t *dc) {
     // nSequence
     {
         uint8_t nSequence_raw[4];
-        if (4 != call_get_merkleized_map_value(dc,
-                                               &state->cur.in_out.map,
-                                               (uint8_t[]){PSBT_IN_SEQUENCE},
-                                               1,
-                                               nSequence_raw,
-                                               4)) {
+        if (4 != get_map_value_by_key_type(dc,
+                                           &state->cur.in_out.map,
+                                           &state->cur.in_out.key_index,
+                                           PSBT_IN_SEQUENCE,
+                                           nSequence_raw,
+                                           4)) {
             // if no PSBT_IN_SEQUENCE is present, we must assume nSequence 0xFFFFFFFF
             memset(nSequence_raw, 0xFF, 4);
         }
@@ -1744,24 +2062,24 @@ static void sign_segwit_v1(dispatcher_context_t *dc) {
 
     if ((sighash_byte & 0x80) == SIGHASH_ANYONECANPAY) {
         // outpoint (hash)
-        if (32 != call_get_merkleized_map_value(dc,
-                                                &state->cur.in_out.map,
-                                                (uint8_t[]){PSBT_IN_PREVIOUS_TXID},
-                                                1,
-                                                tmp,
-                                                32)) {
+        if (32 != get_map_value_by_key_type(dc,
+                                            &state->cur.in_out.map,
+                                            &state->cur.in_out.key_index,
+                                            PSBT_IN_PREVIOUS_TXID,
+                                            tmp,
+                                            32)) {
             SEND_SW(dc, SW_INCORRECT_DATA);
             return;
         }
         crypto_hash_update(&sighash_context.header, tmp, 32);
 
         // outpoint (output index)
-        if (4 != call_get_merkleized_map_value(dc,
-                                               &state->cur.in_out.map,
-                                               (uint8_t[]){PSBT_IN_OUTPUT_INDEX},
-                                               1,
-                                               tmp,
-                                               4)) {
+        if (4 != get_map_value_by_key_type(dc,
+                                           &state->cur.in_out.map,
+                                           &state->cur.in_out.key_index,
+                                           PSBT_IN_OUTPUT_INDEX,
+                                           tmp,
+                                           4)) {
             SEND_SW(dc, SW_INCORRECT_DATA);
             return;
         }
@@ -1777,12 +2095,12 @@ static void sign_segwit_v1(dispatcher_context_t *dc) {
                            state->cur.in_out.scriptPubKey_len);
 
         // nSequence
-        if (4 != call_get_merkleized_map_value(dc,
-                                               &state->cur.in_out.map,
-                                               (uint8_t[]){PSBT_IN_SEQUENCE},
-                                               1,
-                                               tmp,
-                                               4)) {
+        if (4 != get_map_value_by_key_type(dc,
+                                           &state->cur.in_out.map,
+                                           &state->cur.in_out.key_index,
+                                           PSBT_IN_SEQUENCE,
+                                           tmp,
+                                           4)) {
             // if no PSBT_IN_SEQUENCE is present, we must assume nSequence 0xFFFFFFFF
             memset(tmp, 0xFF, 4);
         }
@@ -1,16 +1,29 @@
 #pragma once
 
+#include "../crypto.h"
 #include "../boilerplate/dispatcher.h"
 #include "../constants.h"
-#include "../common/bitvector.h"
 #include "../common/merkle.h"
 #include "../common/wallet.h"
 
-#define MAX_N_INPUTS_CAN_SIGN 512
+// Keys made only of a key type smaller than this have their index recorded when a map is opened;
+// this covers all the PSBT_IN_* and PSBT_OUT_* key types looked up while signing.
+#define N_INDEXED_KEY_TYPES 0x20
+
+/**
+ * Index of the keys of a Merkleized map that only consist of a key type (without key data),
+ * recorded while the keys are verified during call_get_merkleized_map_with_callback. It allows to
+ * look up the value of such keys without asking the client for their index.
+ */
+typedef struct {
+    size_t n_keys_seen;
+    uint8_t index[N_INDEXED_KEY_TYPES];  // 1 + the index of the key, or 0 if unknown
+} map_key_index_t;
 
 // common info that applies to either the current input or the current output
 typedef struct {
     merkleized_map_commitment_t map;
+    map_key_index_t key_index;
 
     bool unexpected_pubkey_error;  // Set to true if the pubkey in the keydata of
                                    // PSBT_{IN,OUT}_BIP32_DERIVATION or
@@ -80,8 +93,18 @@ typedef struct {
 
     uint32_t master_key_fingerprint;
 
-    // bitmap to track of which inputs are internal
-    uint8_t internal_inputs[BITVECTOR_REAL_SIZE(MAX_N_INPUTS_CAN_SIGN)];
+    // Random key generated for each command, authenticating the prevout records of legacy inputs
+    // stored by the host (see sign_psbt/prevout_record.h)
+    uint8_t prevout_record_key[32];
+
+    // Number of internal inputs found while verifying the inputs. Internal inputs are not stored,
+    // so that the number of inputs is not limited by the available memory: they are recognized
+    // again during the signing flow. Before each signature, the count and total value of the
+    // signed inputs must not exceed the ones computed while verifying the inputs; once all the
+    // inputs are processed, they must be equal.
+    unsigned int n_internal_inputs;
+    unsigned int n_signed_inputs;
+    uint64_t signed_inputs_total_value;
 
     union {
         unsigned int cur_input_index;
@@ -105,7 +128,20 @@ typedef struct {
         uint8_t sha_sequences[32];
         uint8_t sha_outputs[32];
     } hashes;
-    bool segwit_hashes_computed;
+    bool segwit_hashes_computed;   // sha_prevouts, sha_sequences and sha_outputs
+    bool taproot_hashes_computed;  // sha_amounts and sha_scriptpubkeys
+
+    // While verifying the inputs (resp. outputs), accumulates the hash of their serialization
+    cx_sha256_t serialization_hash_context;
+
+    // sha256(0x00 || serialized_inputs), where serialized_inputs is the concatenation of
+    // <prevout_hash : 32> <prevout_n : 4> <nSequence : 4> for each input. The client reveals it
+    // with a single GET_PREIMAGE for each legacy sighash, instead of each field of each input map.
+    uint8_t serialized_inputs_hash[32];
+
+    // sha256(0x00 || serialized_outputs), where serialized_outputs is the network serialization
+    // <amount : 8> <varint len> <scriptPubKey : len> of each output, as hashed in the sighash.
+    uint8_t serialized_outputs_hash[32];
 
     uint64_t inputs_total_value;
     uint64_t outputs_total_value;
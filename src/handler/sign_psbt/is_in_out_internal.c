@@ -25,10 +25,17 @@ int is_in_out_internal(dispatcher_context_t *dispatcher_context,
     uint32_t bip32_path[MAX_BIP32_PATH_STEPS];
     uint32_t fingerprint;
 
-    int script_type = get_script_type(in_out_info->scriptPubKey, in_out_info->scriptPubKey_len);
+    // the wallet script of an input or output with a Ravencoin asset is the one preceding the asset
+    size_t script_len = in_out_info->scriptPubKey_len;
+    asset_script_t asset;
+    if (parse_asset_script(in_out_info->scriptPubKey, script_len, &asset) >= 0) {
+        script_len = asset.base_script_len;
+    }
+
+    int script_type = get_script_type(in_out_info->scriptPubKey, script_len);
     if (script_type == -1) {
-        // OP_RETURN outputs would return -1 despite being valid; but for those, there shouldn't be
-        // any BIP32 derivation in the PSBT, so no special case is needed here.
+        // OP_RETURN and null asset outputs would return -1 despite being valid; but for those,
+        // there shouldn't be any BIP32 derivation in the PSBT, so no special case is needed here.
 
         PRINTF("Invalid script type\n");
         return -1;
@@ -101,5 +108,5 @@ int is_in_out_internal(dispatcher_context_t *dispatcher_context,
                                          state->wallet_header_keys_info_merkle_root,
                                          state->wallet_header_n_keys,
                                          in_out_info->scriptPubKey,
-                                         in_out_info->scriptPubKey_len);
+                                         script_len);
 }
\ No newline at end of file
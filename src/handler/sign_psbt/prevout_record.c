@@ -0,0 +1,162 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "prevout_record.h"
+
+#include "../client_commands.h"
+
+#include "../../boilerplate/sw.h"
+#include "../../common/read.h"
+#include "../../common/write.h"
+#include "../../crypto.h"
+
+// Size of the data identifying the input of a record: <input_index : 4> <keys_root : 32>
+// <values_root : 32>
+#define PREVOUT_RECORD_INPUT_LEN (4 + 32 + 32)
+
+static void write_prevout_record_input(uint32_t input_index,
+                                       const merkleized_map_commitment_t *input_map,
+                                       uint8_t out[static PREVOUT_RECORD_INPUT_LEN]) {
+    write_u32_le(out, 0, input_index);
+    memcpy(out + 4, input_map->keys_root, 32);
+    memcpy(out + 4 + 32, input_map->values_root, 32);
+}
+
+// Computes the id of the record of an input, used by the host to find it
+static void compute_prevout_record_id(uint32_t input_index,
+                                      const merkleized_map_commitment_t *input_map,
+                                      uint8_t out[static 32]) {
+    uint8_t data[PREVOUT_RECORD_INPUT_LEN];
+    write_prevout_record_input(input_index, input_map, data);
+
+    cx_hash_sha256(data, sizeof(data), out, 32);
+}
+
+// Computes the hmac of the record (without the hmac) of an input
+static void compute_prevout_record_hmac(const uint8_t session_key[static 32],
+                                        uint32_t input_index,
+                                        const merkleized_map_commitment_t *input_map,
+                                        const uint8_t *record,
+                                        size_t record_len,
+                                        uint8_t out[static 32]) {
+    uint8_t data[PREVOUT_RECORD_INPUT_LEN + PREVOUT_RECORD_MAX_LEN - 32];
+    write_prevout_record_input(input_index, input_map, data);
+    memcpy(data + PREVOUT_RECORD_INPUT_LEN, record, record_len);
+
+    cx_hmac_sha256(session_key, 32, data, PREVOUT_RECORD_INPUT_LEN + record_len, out, 32);
+}
+
+int store_prevout_record(dispatcher_context_t *dc,
+                         const uint8_t session_key[static 32],
+                         uint32_t input_index,
+                         const merkleized_map_commitment_t *input_map,
+                         uint64_t amount,
+                         const uint8_t *scriptPubKey,
+                         size_t scriptPubKey_len) {
+    LOG_PROCESSOR(dc, __FILE__, __LINE__, __func__);
+
+    if (scriptPubKey_len > MAX_ASSET_SCRIPTPUBKEY_LEN) {
+        return -1;
+    }
+
+    if (dc->protocol_version < 1) {
+        return 0;  // the host does not implement CCMD_STORE_RECORD
+    }
+
+    {  // free memory as soon as possible
+        uint8_t request[1 + 32 + 1 + PREVOUT_RECORD_MAX_LEN];
+        uint8_t *record = request + 1 + 32 + 1;
+
+        size_t record_len = 8 + 1 + scriptPubKey_len;
+        write_u64_le(record, 0, amount);
+        record[8] = (uint8_t) scriptPubKey_len;
+        memcpy(record + 9, scriptPubKey, scriptPubKey_len);
+
+        compute_prevout_record_hmac(session_key,
+                                    input_index,
+                                    input_map,
+                                    record,
+                                    record_len,
+                                    record + record_len);
+        record_len += 32;
+
+        request[0] = CCMD_STORE_RECORD;
+        compute_prevout_record_id(input_index, input_map, request + 1);
+        request[1 + 32] = (uint8_t) record_len;
+
+        SET_RESPONSE(dc, request, 1 + 32 + 1 + record_len, SW_INTERRUPTED_EXECUTION);
+    }
+    if (dc->process_interruption(dc) < 0) {
+        return -1;
+    }
+
+    if (buffer_can_read(&dc->read_buffer, 1)) {
+        return -1;  // the response must be empty
+    }
+    return 0;
+}
+
+int get_prevout_record(dispatcher_context_t *dc,
+                       const uint8_t session_key[static 32],
+                       uint32_t input_index,
+                       const merkleized_map_commitment_t *input_map,
+                       uint64_t *amount,
+                       uint8_t scriptPubKey[static MAX_ASSET_SCRIPTPUBKEY_LEN],
+                       size_t *scriptPubKey_len) {
+    LOG_PROCESSOR(dc, __FILE__, __LINE__, __func__);
+
+    if (dc->protocol_version < 1) {
+        return 0;  // the host does not implement CCMD_GET_RECORD
+    }
+
+    {  // free memory as soon as possible
+        uint8_t request[1 + 32];
+        request[0] = CCMD_GET_RECORD;
+        compute_prevout_record_id(input_index, input_map, request + 1);
+
+        SET_RESPONSE(dc, request, sizeof(request), SW_INTERRUPTED_EXECUTION);
+    }
+    if (dc->process_interruption(dc) < 0) {
+        return -1;
+    }
+
+    uint8_t record_len;
+    if (!buffer_read_u8(&dc->read_buffer, &record_len)) {
+        return -1;
+    }
+
+    if (record_len == 0) {
+        return buffer_can_read(&dc->read_buffer, 1) ? -1 : 0;  // unknown record
+    }
+
+    uint8_t record[PREVOUT_RECORD_MAX_LEN];
+    if (record_len < 8 + 1 + 32 || record_len > sizeof(record) ||
+        !buffer_read_bytes(&dc->read_buffer, record, record_len) ||
+        buffer_can_read(&dc->read_buffer, 1)) {
+        return -1;
+    }
+
+    size_t spk_len = record[8];
+    if (record_len != 8 + 1 + spk_len + 32) {
+        return -1;
+    }
+
+    uint8_t correct_hmac[32];
+    compute_prevout_record_hmac(session_key,
+                                input_index,
+                                input_map,
+                                record,
+                                record_len - 32,
+                                correct_hmac);
+
+    // constant-time comparison, as for the wallet hmac
+    if (os_secure_memcmp(record + record_len - 32, correct_hmac, 32) != 0) {
+        PRINTF("Wrong hmac for the prevout record\n");
+        return -1;
+    }
+
+    *amount = read_u64_le(record, 0);
+    *scriptPubKey_len = spk_len;
+    memcpy(scriptPubKey, record + 9, spk_len);
+    return 1;
+}
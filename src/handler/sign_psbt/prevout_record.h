@@ -0,0 +1,82 @@
+#pragma once
+
+#include "../../boilerplate/dispatcher.h"
+#include "../../common/merkle.h"
+#include "../../constants.h"
+
+/*
+  Parsing the non-witness-utxo of a legacy input requires streaming and hashing the whole previous
+  transaction. Once it is parsed and verified while processing the inputs, the prevout's amount and
+  scriptPubKey are sent to the host as a compact record with CCMD_STORE_RECORD, authenticated with
+  an HMAC-SHA256 under a random key generated for each sign_psbt command. The host gives the record
+  back with CCMD_GET_RECORD while signing, instead of the whole transaction.
+
+  The hmac covers the index of the input and the keys_root and values_root of its map, so that a
+  record can not be given back for another input, even one with the same values. The host finds the
+  record by its id, the sha256 of the same data. A record that is not known to the host is not an
+  error, as the caller can still parse the non-witness-utxo.
+
+  Hosts of protocol version 0 do not implement the records: nothing is sent to them, and no record
+  is ever known.
+*/
+
+// <amount : 8> <scriptPubKey_len : 1> <scriptPubKey : scriptPubKey_len> <hmac : 32>
+#define PREVOUT_RECORD_MAX_LEN (8 + 1 + MAX_ASSET_SCRIPTPUBKEY_LEN + 32)
+
+/**
+ * Sends to the host the authenticated record of the prevout of an input.
+ *
+ * @param[in] dispatcher_context
+ *   Pointer to the dispatcher context.
+ * @param[in] session_key
+ *   The key used to authenticate the records in the current command.
+ * @param[in] input_index
+ *   The index of the input.
+ * @param[in] input_map
+ *   The commitment to the input map.
+ * @param[in] amount
+ *   The amount of the prevout.
+ * @param[in] scriptPubKey
+ *   The scriptPubKey of the prevout.
+ * @param[in] scriptPubKey_len
+ *   The length of the scriptPubKey, at most MAX_ASSET_SCRIPTPUBKEY_LEN.
+ *
+ * @return 0 on success, a negative number on failure.
+ */
+int store_prevout_record(dispatcher_context_t *dispatcher_context,
+                         const uint8_t session_key[static 32],
+                         uint32_t input_index,
+                         const merkleized_map_commitment_t *input_map,
+                         uint64_t amount,
+                         const uint8_t *scriptPubKey,
+                         size_t scriptPubKey_len);
+
+/**
+ * Asks the host for the record of the prevout of an input that was sent with store_prevout_record
+ * during the same command, and verifies it.
+ *
+ * @param[in] dispatcher_context
+ *   Pointer to the dispatcher context.
+ * @param[in] session_key
+ *   The key used to authenticate the records in the current command.
+ * @param[in] input_index
+ *   The index of the input.
+ * @param[in] input_map
+ *   The commitment to the input map.
+ * @param[out] amount
+ *   The amount of the prevout.
+ * @param[out] scriptPubKey
+ *   The scriptPubKey of the prevout.
+ * @param[out] scriptPubKey_len
+ *   The length of the scriptPubKey.
+ *
+ * @return 1 if a valid record was returned, 0 if the host does not know the record, a negative
+ * number on failure (including if the hmac is wrong).
+ */
+int get_prevout_record(dispatcher_context_t *dispatcher_context,
+                       const uint8_t session_key[static 32],
+                       uint32_t input_index,
+                       const merkleized_map_commitment_t *input_map,
+                       uint64_t *amount,
+                       uint8_t scriptPubKey[static MAX_ASSET_SCRIPTPUBKEY_LEN],
+                       size_t *scriptPubKey_len);
@@ -120,11 +120,13 @@ unsigned short btchip_apdu_hash_input_start() {
     }
 
     // Start parsing of the 1st chunk
-    btchip_context_D.transactionBufferPointer =
-        G_io_apdu_buffer + ISO_OFFSET_CDATA;
-    btchip_context_D.transactionDataRemaining = apduLength;
-
-    transaction_parse(PARSE_MODE_SIGNATURE);
+    if (!transaction_parse(PARSE_MODE_SIGNATURE,
+                           G_io_apdu_buffer + ISO_OFFSET_CDATA, apduLength)) {
+        // Invalid inputs, like a forged Trusted Input, halt the dongle, as
+        // they used to by raising an exception
+        SB_SET(btchip_context_D.halted, 1);
+        return BTCHIP_SW_TECHNICAL_PROBLEM | EXCEPTION;
+    }
 
     return BTCHIP_SW_OK;
 }
@@ -23,13 +23,6 @@
 
 #define DEBUG_LONG "%d"
 
-void check_transaction_available(unsigned char x) {
-    if (btchip_context_D.transactionDataRemaining < x) {
-        PRINTF("Check transaction available failed %d < %d\n", btchip_context_D.transactionDataRemaining, x);
-        THROW(EXCEPTION);
-    }
-}
-
 #define OP_HASH160 0xA9
 #define OP_EQUAL 0x87
 #define OP_CHECKMULTISIG 0xAE
@@ -73,784 +66,459 @@ unsigned char transaction_amount_sub_be(unsigned char *target,
     return borrow;
 }
 
-void transaction_offset(unsigned char value) {
+
+// Type of an input in PARSE_MODE_SIGNATURE, given by its first byte
+#define INPUT_UNTRUSTED 0x00
+#define INPUT_TRUSTED 0x01
+#define INPUT_SEGWIT 0x02
+#define INPUT_SESSION 0x03
+
+static void transaction_set_hash_option(tx_parser_t *parser,
+                                        unsigned char option) {
+    // the pending run is hashed with the option it was consumed with
+    tx_parser_flush(parser);
+    btchip_context_D.transactionHashOption = option;
+}
+
+static void transaction_hash(tx_parser_t *parser, const uint8_t *data,
+                             size_t length) {
+    (void)parser;
     if ((btchip_context_D.transactionHashOption & TRANSACTION_HASH_FULL) != 0) {
-        PRINTF("--- ADD TO HASH FULL:\n%.*H\n", value, btchip_context_D.transactionBufferPointer);
-     
+        PRINTF("--- ADD TO HASH FULL:\n%.*H\n", length, data);
         cx_hash(&btchip_context_D.transactionHashFull.sha256.header, 0,
-            btchip_context_D.transactionBufferPointer, value, NULL, 0);
-        
+                (unsigned char *)data, length, NULL, 0);
     }
     if ((btchip_context_D.transactionHashOption &
          TRANSACTION_HASH_AUTHORIZATION) != 0) {
-        PRINTF("--- ADD TO HASH AUTH:\n%.*H\n", value, btchip_context_D.transactionBufferPointer);
+        PRINTF("--- ADD TO HASH AUTH:\n%.*H\n", length, data);
         cx_hash(&btchip_context_D.transactionHashAuthorization.header, 0,
-                btchip_context_D.transactionBufferPointer, value, NULL, 0);
+                (unsigned char *)data, length, NULL, 0);
     }
 }
 
-void transaction_offset_increase(unsigned char value) {
-    transaction_offset(value);
-    btchip_context_D.transactionBufferPointer += value;
-    btchip_context_D.transactionDataRemaining -= value;
+// Hashes in the full hash only, whatever the hash option
+static void transaction_hash_full(tx_parser_t *parser,
+                                  unsigned char *data, size_t length) {
+    tx_parser_flush(parser);
+    PRINTF("--- ADD TO HASH FULL:\n%.*H\n", length, data);
+    cx_hash(&btchip_context_D.transactionHashFull.sha256.header, 0, data,
+            length, NULL, 0);
 }
 
-unsigned long int transaction_get_varint(void) {
-    unsigned char firstByte;
-    check_transaction_available(1);
-    firstByte = *btchip_context_D.transactionBufferPointer;
-    if (firstByte < 0xFD) {
-        transaction_offset_increase(1);
-        return firstByte;
-    } else if (firstByte == 0xFD) {
-        unsigned long int result;
-        transaction_offset_increase(1);
-        check_transaction_available(2);
-        result =
-            (unsigned long int)(*btchip_context_D.transactionBufferPointer) |
-            ((unsigned long int)(*(btchip_context_D.transactionBufferPointer +
-                                   1))
-             << 8);
-        transaction_offset_increase(2);
-        return result;
-    } else if (firstByte == 0xFE) {
-        unsigned long int result;
-        transaction_offset_increase(1);
-        check_transaction_available(4);
-        result =
-            btchip_read_u32(btchip_context_D.transactionBufferPointer, 0, 0);
-        transaction_offset_increase(4);
-        return result;
-    } else {
-        PRINTF("Varint parsing failed\n");
-        THROW(INVALID_PARAMETER);
-        return 0;
+static int transaction_add_amount(unsigned char *amountLE) {
+    unsigned char amount[8];
+    btchip_swap_bytes(amount, amountLE, 8);
+    if (transaction_amount_add_be(
+            btchip_context_D.transactionContext.transactionAmount,
+            btchip_context_D.transactionContext.transactionAmount, amount)) {
+        PRINTF("Overflow\n");
+        return -1;
+    }
+    PRINTF("Adding amount\n%.*H\n", 8, amountLE);
+    PRINTF("New amount\n%.*H\n", 8,
+           btchip_context_D.transactionContext.transactionAmount);
+    return 0;
+}
+
+static int transaction_parse_version(tx_parser_t *parser,
+                                     const uint8_t *version) {
+    os_memmove(btchip_context_D.transactionVersion, version, 4);
+
+    if (G_coin_config->flags & FLAG_PEERCOIN_SUPPORT) {
+        if (((G_coin_config->family == BTCHIP_FAMILY_PEERCOIN) &&
+             (btchip_context_D.transactionVersion[0] < 3)) ||
+            ((G_coin_config->family == BTCHIP_FAMILY_STEALTH) &&
+             (btchip_context_D.transactionVersion[0] < 2))) {
+            parser->has_timestamp = true;
+        }
+    }
+    return 0;
+}
+
+static int transaction_parse_inputs_start(tx_parser_t *parser) {
+    PRINTF("Number of inputs : " DEBUG_LONG "\n", parser->n_items);
+    if (G_swap_state.called_from_swap) {
+        // remember number of inputs to know when to exit from library
+        // we will count number of already signed inputs and compare with this value
+        // As there are a lot of different states in which we can have different number of input
+        // (when for ex. we sign segregated witness)
+        if (vars.swap_data.totalNumberOfInputs == 0) {
+            vars.swap_data.totalNumberOfInputs = parser->n_items;
+        }
+        // Reseting the flag, because we should check address ones for each input
+        vars.swap_data.was_address_checked = 0;
     }
+    return 0;
 }
 
-void transaction_parse(unsigned char parseMode) {
+static int transaction_parse_input_header(tx_parser_t *parser,
+                                          buffer_t *buffers[2]) {
     unsigned char optionP2SHSkip2FA =
         ((N_btchip.bkp.config.options & BTCHIP_OPTION_SKIP_2FA_P2SH) != 0);
-    btchip_set_check_internal_structure_integrity(0);
-    BEGIN_TRY {
-        TRY {
-            for (;;) {
-                switch (btchip_context_D.transactionContext.transactionState) {
-                case BTCHIP_TRANSACTION_NONE: {
-                    PRINTF("Init transaction parser\n");
-                    // Reset transaction state
-                    btchip_context_D.transactionContext
-                        .transactionRemainingInputsOutputs = 0;
-                    btchip_context_D.transactionContext
-                        .transactionCurrentInputOutput = 0;
-                    btchip_context_D.transactionContext.scriptRemaining = 0;
-                    os_memset(
-                        btchip_context_D.transactionContext.transactionAmount,
-                        0, sizeof(btchip_context_D.transactionContext
-                                      .transactionAmount));
-                    // TODO : transactionControlFid
-                    // Reset hashes
-                    
-                    cx_sha256_init(&btchip_context_D.transactionHashFull.sha256);
-                    
-                    cx_sha256_init(
-                        &btchip_context_D.transactionHashAuthorization);
-                    if (btchip_context_D.usingSegwit) {
-                        btchip_context_D.transactionHashOption = 0;
-                        if (!btchip_context_D.segwitParsedOnce) {
-                            
-                            cx_sha256_init(
-                                &btchip_context_D.segwit.hash.hashPrevouts.sha256);
-                            
-                        } else {
-                            PRINTF("Resume SegWit hash\n");
-                            PRINTF("SEGWIT Version\n%.*H\n",sizeof(btchip_context_D.transactionVersion),btchip_context_D.transactionVersion);
-                            PRINTF("SEGWIT HashedPrevouts\n%.*H\n",sizeof(btchip_context_D.segwit.cache.hashedPrevouts),btchip_context_D.segwit.cache.hashedPrevouts);
-                            PRINTF("SEGWIT HashedSequence\n%.*H\n",sizeof(btchip_context_D.segwit.cache.hashedSequence),btchip_context_D.segwit.cache.hashedSequence);
-                            
-                            PRINTF("--- ADD TO HASH FULL:\n%.*H\n", sizeof(btchip_context_D.transactionVersion), btchip_context_D.transactionVersion);
-                            cx_hash(
-                                &btchip_context_D.transactionHashFull.sha256.header, 0,
-                                btchip_context_D.transactionVersion,
-                                sizeof(btchip_context_D.transactionVersion),
-                                NULL, 0);
-                            PRINTF("--- ADD TO HASH FULL:\n%.*H\n", sizeof(btchip_context_D.segwit.cache.hashedPrevouts), btchip_context_D.segwit.cache.hashedPrevouts);
-                            cx_hash(
-                                &btchip_context_D.transactionHashFull.sha256.header, 0,
-                                btchip_context_D.segwit.cache.hashedPrevouts,
-                                sizeof(btchip_context_D.segwit.cache
-                                        .hashedPrevouts),
-                                NULL, 0);
-                            PRINTF("--- ADD TO HASH FULL:\n%.*H\n", sizeof(btchip_context_D.segwit.cache.hashedSequence), btchip_context_D.segwit.cache.hashedSequence);
-                            cx_hash(
-                                &btchip_context_D.transactionHashFull.sha256.header, 0,
-                                btchip_context_D.segwit.cache.hashedSequence,
-                                sizeof(btchip_context_D.segwit.cache
-                                        .hashedSequence),
-                                NULL, 0);
-                            PRINTF("--- ADD TO HASH AUTH:\n%.*H\n", sizeof(btchip_context_D.segwit.cache), (unsigned char *)&btchip_context_D.segwit.cache);
-                            cx_hash(&btchip_context_D
-                                        .transactionHashAuthorization.header,
-                                0,
-                                (unsigned char *)&btchip_context_D
-                                    .segwit.cache,
-                                sizeof(btchip_context_D.segwit.cache),
-                                NULL, 0);
-
-                        }
-                    }
-                    // Parse the beginning of the transaction
-                    // Version
-                    check_transaction_available(4);
-                    os_memmove(btchip_context_D.transactionVersion,
-                               btchip_context_D.transactionBufferPointer, 4);
-                    transaction_offset_increase(4);
-
-                    if (G_coin_config->flags & FLAG_PEERCOIN_SUPPORT) {
-                        if (((G_coin_config->family ==
-                            BTCHIP_FAMILY_PEERCOIN &&
-                            (btchip_context_D.transactionVersion[0] < 3))) ||
-                            ((G_coin_config->family == BTCHIP_FAMILY_STEALTH) &&
-                            (btchip_context_D.transactionVersion[0] < 2))) {
-                            // Timestamp
-                            check_transaction_available(4);
-                            transaction_offset_increase(4);
-                        }
-                    }
-
-                    // Number of inputs
-                    btchip_context_D.transactionContext
-                        .transactionRemainingInputsOutputs =
-                        transaction_get_varint();
-                    PRINTF("Number of inputs : " DEBUG_LONG "\n",btchip_context_D.transactionContext.transactionRemainingInputsOutputs);
-                    if (G_swap_state.called_from_swap && parseMode == PARSE_MODE_SIGNATURE) {
-                        // remember number of inputs to know when to exit from library
-                        // we will count number of already signed inputs and compare with this value
-                        // As there are a lot of different states in which we can have different number of input
-                        // (when for ex. we sign segregated witness)
-                        if (vars.swap_data.totalNumberOfInputs == 0) {
-                            vars.swap_data.totalNumberOfInputs =
-                                btchip_context_D.transactionContext.transactionRemainingInputsOutputs;
-                        }
-                        // Reseting the flag, because we should check address ones for each input
-                        vars.swap_data.was_address_checked = 0;
-                    }
-                    // Ready to proceed
-                    btchip_context_D.transactionContext.transactionState =
-                        BTCHIP_TRANSACTION_DEFINED_WAIT_INPUT;
-
-                    // no break is intentional
-                }
-
-                case BTCHIP_TRANSACTION_DEFINED_WAIT_INPUT: {
-                    unsigned char trustedInputFlag = 1;
-                    PRINTF("Process input\n");
-                    if (btchip_context_D.transactionContext
-                            .transactionRemainingInputsOutputs == 0) {
-                        // No more inputs to hash, move forward
-                        btchip_context_D.transactionContext.transactionState =
-                            BTCHIP_TRANSACTION_INPUT_HASHING_DONE;
-                        continue;
-                    }
-                    if (btchip_context_D.transactionDataRemaining < 1) {
-                        // No more data to read, ok
-                        goto ok;
-                    }
-                    // Proceed with the next input
-                    if (parseMode == PARSE_MODE_TRUSTED_INPUT) {
-                        check_transaction_available(
-                            36); // prevout : 32 hash + 4 index
-                        transaction_offset_increase(36);
-                    }
-                    if (parseMode == PARSE_MODE_SIGNATURE) {
-                        unsigned char trustedInputLength;
-                        unsigned char trustedInput[TRUSTED_INPUT_TOTAL_SIZE];
-                        unsigned char amount[8];
-                        unsigned char *savePointer;
-
-                        // Expect the trusted input flag and trusted input length
-                        check_transaction_available(2);
-                        switch (*btchip_context_D.transactionBufferPointer) {
-                        case 0:
-                            if (btchip_context_D.usingSegwit) {
-                                PRINTF("Non trusted input used in segwit mode\n");
-                                goto fail;
-                            }
-                            trustedInputFlag = 0;
-                            break;
-                        case 1:
-                            if (btchip_context_D.usingSegwit) {
-                                // Segwit inputs can be passed as TrustedInput also
-                                PRINTF("Trusted input used in segwit mode\n");
-                            }
-                            trustedInputFlag = 1;
-                            break;
-                        case 2:
-                            if (!btchip_context_D.usingSegwit) {
-                                PRINTF("Segwit input not used in segwit mode\n");
-                                goto fail;
-                            }
-                            trustedInputFlag = 0;
-                            break;
-                        default:
-                            PRINTF("Invalid trusted input flag\n");
-                            goto fail;
-                        }
-                        /*
-                        trustedInputLength =
-                        *(btchip_context_D.transactionBufferPointer + 1);
-                        if (trustedInputLength > sizeof(trustedInput)) {
-                          PRINTF("Trusted input too long\n");
-                          goto fail;
-                        }
-                        */
-                        // Check TrustedInput (TI) integrity, be it a non-segwit TI or a segwit TI
-                        if (trustedInputFlag) {
-                            trustedInputLength = *(
-                                btchip_context_D.transactionBufferPointer + 1);
-                            if ((trustedInputLength > sizeof(trustedInput)) ||
-                                (trustedInputLength < 8)) {
-                                PRINTF("Invalid trusted input size\n");
-                                goto fail;
-                            }
-
-                            check_transaction_available(2 + trustedInputLength);
-                            // Check TrustedInput Hmac
-                            cx_hmac_sha256(
-                                (uint8_t *)N_btchip.bkp.trustedinput_key,
-                                sizeof(N_btchip.bkp.trustedinput_key),
-                                btchip_context_D.transactionBufferPointer + 2,
-                                trustedInputLength - 8, trustedInput, trustedInputLength);
-                                PRINTF("====> Input HMAC:    %.*H\n", 8, btchip_context_D.transactionBufferPointer + 2 + trustedInputLength - 8);
-                                PRINTF("====> Computed HMAC: %.*H\n", 8, trustedInput);
-
-                            if (btchip_secure_memcmp(
-                                    trustedInput,       // Contains computed Hmac for now
-                                    btchip_context_D.transactionBufferPointer +
-                                        2 + trustedInputLength - 8,
-                                    8) != 0) {
-                                PRINTF("Invalid signature\n");
-                                goto fail;
-                            }
-                            // Hmac is valid. If TrustedInput contains a segwit input, update data pointer & length
-                            // to fake the parser into believing a normal segwit input was received. Do not use
-                            // transaction_offset_increase() here as it could update the hash being computed.
-                            if (btchip_context_D.usingSegwit) {
-                                // Overwrite the no longer needed HMAC's 1st byte w/ the input script length byte.
-                                *(btchip_context_D.transactionBufferPointer + 1 + TRUSTED_INPUT_SIZE + 1) =
-                                    *(btchip_context_D.transactionBufferPointer + 1 + TRUSTED_INPUT_TOTAL_SIZE + 1);
-                                // Set tx data pointer on TI header's (i.e. 0x38||0x32||0x00||Nonce (2B)) last byte
-                                // before prevout tx hash. Also remove HMAC size from remaining data length.
-                                btchip_context_D.transactionBufferPointer += 5;
-                                btchip_context_D.transactionDataRemaining -= (5+8);
-                            }
-                        }
-                        // Handle pure segwit inputs, whether trusted or not (i.e. InputHashStart 1st APDU's P2==02
-                        // & data[0]=={0x01, 0x02})
-                        if (btchip_context_D.usingSegwit) {
-                            transaction_offset_increase(1);     // Set tx pointer on 1st byte of hash
-                            check_transaction_available(
-                                36); // prevout : 32 hash + 4 index
-                            if (!btchip_context_D.segwitParsedOnce) {
-                                
-                                cx_hash(
-                                    &btchip_context_D.segwit.hash.hashPrevouts
-                                        .sha256.header,
-                                    0,
-                                    btchip_context_D.transactionBufferPointer,
-                                    36, NULL, 0);
-                                
-                                transaction_offset_increase(36);
-                                check_transaction_available(8); // update amount
-                                btchip_swap_bytes(
-                                    amount,
-                                    btchip_context_D.transactionBufferPointer,
-                                    8);
-                                if (transaction_amount_add_be(
-                                        btchip_context_D.transactionContext
-                                            .transactionAmount,
-                                        btchip_context_D.transactionContext
-                                            .transactionAmount,
-                                        amount)) {
-                                    PRINTF("Overflow\n");
-                                    goto fail;
-                                }
-                                PRINTF("Adding amount\n%.*H\n",8,btchip_context_D.transactionBufferPointer);
-                                PRINTF("New amount\n%.*H\n",8,btchip_context_D.transactionContext.transactionAmount);
-                                transaction_offset_increase(8);
-                            } else {
-                                btchip_context_D.transactionHashOption =
-                                    TRANSACTION_HASH_FULL;
-                                transaction_offset_increase(36);
-                                btchip_context_D.transactionHashOption = 0;
-                                check_transaction_available(8); // save amount
-                                os_memmove(
-                                    btchip_context_D.inputValue,
-                                    btchip_context_D.transactionBufferPointer,
-                                    8);
-                                transaction_offset_increase(8);
-                                btchip_context_D.transactionHashOption =
-                                    TRANSACTION_HASH_FULL;
-                            }
-                        }
-                        // Handle non-segwit inputs (i.e. InputHashStart 1st APDU's P2==00 && data[0]==0x00)
-                        else if (!trustedInputFlag) {
-                            // Only authorized in relaxed wallet and server
-                            // modes
-                            SB_CHECK(N_btchip.bkp.config.operationMode);
-                            switch (SB_GET(N_btchip.bkp.config.operationMode)) {
-                            case BTCHIP_MODE_WALLET:
-                                if (!optionP2SHSkip2FA) {
-                                    PRINTF("Untrusted input not authorized\n");
-                                    goto fail;
-                                }
-                                break;
-                            case BTCHIP_MODE_RELAXED_WALLET:
-                            case BTCHIP_MODE_SERVER:
-                                break;
-                            default:
-                                PRINTF("Untrusted input not authorized\n");
-                                goto fail;
-                            }
-                            btchip_context_D.transactionBufferPointer++;
-                            btchip_context_D.transactionDataRemaining--;
-                            check_transaction_available(
-                                36); // prevout : 32 hash + 4 index
-                            transaction_offset_increase(36);
-                            PRINTF("Marking relaxed input\n");
-                            btchip_context_D.transactionContext.relaxed = 1;
-                            /*
-                            PRINTF("Clearing P2SH consumption\n");
-                            btchip_context_D.transactionContext.consumeP2SH = 0;
-                            */
-                        }
-                        // Handle non-segwit TrustedInput (i.e. InputHashStart 1st APDU's P2==00 & data[0]==0x01)
-                        else if (trustedInputFlag && !btchip_context_D.usingSegwit) {
-                            os_memmove(
-                                trustedInput,
-                                btchip_context_D.transactionBufferPointer + 2,
-                                trustedInputLength - 8);
-                            if (trustedInput[0] != MAGIC_TRUSTED_INPUT) {
-                                PRINTF("Failed to verify trusted input signature\n");
-                                goto fail;
-                            }
-                            // Update the hash with prevout data
-                            savePointer =
-                                btchip_context_D.transactionBufferPointer;
-                            /*
-                            // Check if a P2SH script is used
-                            if ((trustedInput[1] & FLAG_TRUSTED_INPUT_P2SH) ==
-                            0) {
-                              PRINTF("Clearing P2SH consumption\n");
-                              btchip_context_D.transactionContext.consumeP2SH =
-                            0;
-                            }
-                            */
-                            btchip_context_D.transactionBufferPointer =
-                                trustedInput + 4;
-                            PRINTF("Trusted input hash\n%.*H\n",36,btchip_context_D.transactionBufferPointer);
-                            transaction_offset(36);
-
-                            btchip_context_D.transactionBufferPointer =
-                                savePointer + (2 + trustedInputLength);
-                            btchip_context_D.transactionDataRemaining -=
-                                (2 + trustedInputLength);
-
-                            // Update the amount
-
-                            btchip_swap_bytes(amount, trustedInput + 40, 8);
-                            if (transaction_amount_add_be(
-                                    btchip_context_D.transactionContext
-                                        .transactionAmount,
-                                    btchip_context_D.transactionContext
-                                        .transactionAmount,
-                                    amount)) {
-                                PRINTF("Overflow\n");
-                                goto fail;
-                            }
-
-                            PRINTF("Adding amount\n%.*H\n",8,(trustedInput + 40));
-                            PRINTF("New amount\n%.*H\n",8,btchip_context_D.transactionContext.transactionAmount);
-                        }
-
-                        if (!btchip_context_D.usingSegwit) {
-                            // Do not include the input script length + value in
-                            // the authentication hash
-                            btchip_context_D.transactionHashOption =
-                                TRANSACTION_HASH_FULL;
-                        }
-                    }
-                    // Read the script length
-                    btchip_context_D.transactionContext.scriptRemaining =
-                        transaction_get_varint();
-                    PRINTF("Script to read " DEBUG_LONG "\n",btchip_context_D.transactionContext.scriptRemaining);
-
-                    if ((parseMode == PARSE_MODE_SIGNATURE) &&
-                        !trustedInputFlag && !btchip_context_D.usingSegwit) {
-                        // Only proceeds if this is not to be signed - so length
-                        // should be null
-                        if (btchip_context_D.transactionContext
-                                .scriptRemaining != 0) {
-                            PRINTF("Request to sign relaxed input\n");
-                            if (!optionP2SHSkip2FA) {
-                                goto fail;
-                            }
-                        }
-                    }
-                    // Move on
-                    btchip_context_D.transactionContext.transactionState =
-                        BTCHIP_TRANSACTION_INPUT_HASHING_IN_PROGRESS_INPUT_SCRIPT;
-
-                    // no break is intentional
-                }
-                case BTCHIP_TRANSACTION_INPUT_HASHING_IN_PROGRESS_INPUT_SCRIPT: {
-                    unsigned char dataAvailable;
-                    PRINTF("Process input script, remaining " DEBUG_LONG "\n",btchip_context_D.transactionContext.scriptRemaining);
-                    if (btchip_context_D.transactionDataRemaining < 1) {
-                        // No more data to read, ok
-                        goto ok;
-                    }
-                    // Scan for P2SH consumption - huge shortcut, but fine
-                    // enough
-                    // Also usable in SegWit mode
-                    if (btchip_context_D.transactionContext.scriptRemaining ==
-                        1) {
-                        if (*btchip_context_D.transactionBufferPointer ==
-                            OP_CHECKMULTISIG) {
-                            if (optionP2SHSkip2FA) {
-                                PRINTF("Marking P2SH consumption\n");
-                                btchip_context_D.transactionContext
-                                    .consumeP2SH = 1;
-                            }
-                        } else {
-                            // When using the P2SH shortcut, all inputs must use
-                            // P2SH
-                            PRINTF("Disabling P2SH consumption\n");
-                            btchip_context_D.transactionContext.consumeP2SH = 0;
-                        }
-                        transaction_offset_increase(1);
-                        btchip_context_D.transactionContext.scriptRemaining--;
-                    }
-
-                    if (btchip_context_D.transactionContext.scriptRemaining ==
-                        0) {
-                        if (parseMode == PARSE_MODE_SIGNATURE) {
-                            if (!btchip_context_D.usingSegwit) {
-                                // Restore dual hash for signature +
-                                // authentication
-                                btchip_context_D.transactionHashOption =
-                                    TRANSACTION_HASH_BOTH;
-                            } else {
-                                if (btchip_context_D.segwitParsedOnce) {
-                                    // Append the saved value
-                                    PRINTF("SEGWIT Add value\n%.*H\n",8,btchip_context_D.inputValue);
-                                    
-                                    PRINTF("--- ADD TO HASH FULL:\n%.*H\n", sizeof(btchip_context_D.inputValue), btchip_context_D.inputValue);
-                                    cx_hash(&btchip_context_D
-                                                .transactionHashFull.sha256.header,
-                                        0, btchip_context_D.inputValue, 8,
-                                        NULL, 0);
-                                }
-                            }
-                        }
-                        // Sequence
-                        check_transaction_available(4);
-                        if (btchip_context_D.usingSegwit &&
-                            !btchip_context_D.segwitParsedOnce) {
-                            
-                            PRINTF("--- ADD TO HASH FULL:\n%.*H\n", 4, btchip_context_D.transactionBufferPointer);
-                            cx_hash(&btchip_context_D.transactionHashFull
-                                        .sha256.header,
-                                0,
-                                btchip_context_D.transactionBufferPointer,
-                                4, NULL, 0);
-                            
-                        }
-                        transaction_offset_increase(4);
-                        // Move to next input
-                        btchip_context_D.transactionContext
-                            .transactionRemainingInputsOutputs--;
-                        btchip_context_D.transactionContext
-                            .transactionCurrentInputOutput++;
-                        btchip_context_D.transactionContext.transactionState =
-                            BTCHIP_TRANSACTION_DEFINED_WAIT_INPUT;
-                        continue;
-                    }
-                    // Save the last script byte for the P2SH check
-                    dataAvailable =
-                        (btchip_context_D.transactionDataRemaining >
-                                 btchip_context_D.transactionContext
-                                         .scriptRemaining -
-                                     1
-                             ? btchip_context_D.transactionContext
-                                       .scriptRemaining -
-                                   1
-                             : btchip_context_D.transactionDataRemaining);
-                    if (dataAvailable == 0) {
-                        goto ok;
-                    }
-                    transaction_offset_increase(dataAvailable);
-                    btchip_context_D.transactionContext.scriptRemaining -=
-                        dataAvailable;
-                    break;
-                }
-                case BTCHIP_TRANSACTION_INPUT_HASHING_DONE: {
-                    PRINTF("Input hashing done\n");
-                    if (parseMode == PARSE_MODE_SIGNATURE) {
-                        // inputs have been prepared, stop the parsing here
-                        if (btchip_context_D.usingSegwit &&
-                            !btchip_context_D.segwitParsedOnce) {
-                            unsigned char hashedPrevouts[32];
-                            unsigned char hashedSequence[32];
-                            // Flush the cache
-                        
-                            cx_hash(&btchip_context_D.segwit.hash.hashPrevouts
-                                        .sha256.header,
-                                CX_LAST, hashedPrevouts, 0, hashedPrevouts, 32);
-                            cx_sha256_init(
-                                &btchip_context_D.segwit.hash.hashPrevouts.sha256);
-                            cx_hash(&btchip_context_D.segwit.hash.hashPrevouts
-                                        .sha256.header,
-                                CX_LAST, hashedPrevouts,
-                                sizeof(hashedPrevouts), hashedPrevouts, 32);
-                            cx_hash(&btchip_context_D.transactionHashFull
-                                        .sha256.header,
-                                CX_LAST, hashedSequence, 0, hashedSequence, 32);
-                            cx_sha256_init(
-                                &btchip_context_D.transactionHashFull.sha256);
-                            PRINTF("--- ADD TO HASH FULL:\n%.*H\n", sizeof(hashedSequence), hashedSequence);
-                            cx_hash(&btchip_context_D.transactionHashFull
-                                        .sha256.header,
-                                CX_LAST, hashedSequence,
-                                sizeof(hashedSequence), hashedSequence, 32);
-
-                            os_memmove(
-                                btchip_context_D.segwit.cache.hashedPrevouts,
-                                hashedPrevouts, sizeof(hashedPrevouts));
-                            os_memmove(
-                                btchip_context_D.segwit.cache.hashedSequence,
-                                hashedSequence, sizeof(hashedSequence));
-                            PRINTF("hashPrevout\n%.*H\n",32,btchip_context_D.segwit.cache.hashedPrevouts);
-                            PRINTF("hashSequence\n%.*H\n",32,btchip_context_D.segwit.cache.hashedSequence);
-                        }
-                        if (btchip_context_D.usingSegwit &&
-                            btchip_context_D.segwitParsedOnce) {
-                            
-                            PRINTF("SEGWIT hashedOutputs\n%.*H\n",sizeof(btchip_context_D.segwit.cache.hashedOutputs),btchip_context_D.segwit.cache.hashedOutputs);
-                            cx_hash(
-                                &btchip_context_D.transactionHashFull.sha256.header, 0,
-                                btchip_context_D.segwit.cache.hashedOutputs,
-                                sizeof(btchip_context_D.segwit.cache
-                                        .hashedOutputs),
-                                NULL, 0);
-                            
-                            btchip_context_D.transactionContext
-                                .transactionState =
-                                BTCHIP_TRANSACTION_SIGN_READY;
-                        } else {
-                            btchip_context_D.transactionContext
-                                .transactionState =
-                                BTCHIP_TRANSACTION_PRESIGN_READY;
-                            
-                            if (btchip_context_D.usingSegwit) {
-                                cx_sha256_init(&btchip_context_D.transactionHashFull.sha256);
-                            }
-                        }
-                        continue;
-                    }
-                    if (btchip_context_D.transactionDataRemaining < 1) {
-                        // No more data to read, ok
-                        goto ok;
-                    }
-                    // Number of outputs
-                    btchip_context_D.transactionContext
-                        .transactionRemainingInputsOutputs =
-                        transaction_get_varint();
-                    btchip_context_D.transactionContext
-                        .transactionCurrentInputOutput = 0;
-                    PRINTF("Number of outputs : " DEBUG_LONG "\n",
-                        btchip_context_D.transactionContext.transactionRemainingInputsOutputs);
-                    // Ready to proceed
-                    btchip_context_D.transactionContext.transactionState =
-                        BTCHIP_TRANSACTION_DEFINED_WAIT_OUTPUT;
-
-                    // no break is intentional
-                }
-                case BTCHIP_TRANSACTION_DEFINED_WAIT_OUTPUT: {
-                    if (btchip_context_D.transactionContext
-                            .transactionRemainingInputsOutputs == 0) {
-                        // No more outputs to hash, move forward
-                        btchip_context_D.transactionContext.transactionState =
-                            BTCHIP_TRANSACTION_OUTPUT_HASHING_DONE;
-                        continue;
-                    }
-                    if (btchip_context_D.transactionDataRemaining < 1) {
-                        // No more data to read, ok
-                        goto ok;
-                    }
-                    // Amount
-                    check_transaction_available(8);
-                    if ((parseMode == PARSE_MODE_TRUSTED_INPUT) &&
-                        (btchip_context_D.transactionContext
-                             .transactionCurrentInputOutput ==
-                         btchip_context_D.transactionTargetInput)) {
-                        // Save the amount
-                        os_memmove(btchip_context_D.transactionContext
-                                       .transactionAmount,
-                                   btchip_context_D.transactionBufferPointer,
-                                   8);
-                        btchip_context_D.trustedInputProcessed = 1;
-                    }
-                    transaction_offset_increase(8);
-                    // Read the script length
-                    btchip_context_D.transactionContext.scriptRemaining =
-                        transaction_get_varint();
-
-                    PRINTF("Script to read " DEBUG_LONG "\n",btchip_context_D.transactionContext.scriptRemaining);
-                    // Move on
-                    btchip_context_D.transactionContext.transactionState =
-                        BTCHIP_TRANSACTION_OUTPUT_HASHING_IN_PROGRESS_OUTPUT_SCRIPT;
-
-                    // no break is intentional
-                }
-                case BTCHIP_TRANSACTION_OUTPUT_HASHING_IN_PROGRESS_OUTPUT_SCRIPT: {
-                    unsigned char dataAvailable;
-                    PRINTF("Process output script, remaining " DEBUG_LONG "\n",btchip_context_D.transactionContext.scriptRemaining);
-                    /*
-                    // Special check if consuming a P2SH script
-                    if (parseMode == PARSE_MODE_TRUSTED_INPUT) {
-                      // Assume the full input script is sent in a single APDU,
-                    then do the ghetto validation
-                      if ((btchip_context_D.transactionBufferPointer[0] ==
-                    OP_HASH160) &&
-                          (btchip_context_D.transactionBufferPointer[btchip_context_D.transactionDataRemaining
-                    - 1] == OP_EQUAL)) {
-                        PRINTF("Marking P2SH output\n");
-                        btchip_context_D.transactionContext.consumeP2SH = 1;
-                      }
-                    }
-                    */
-                    if (btchip_context_D.transactionDataRemaining < 1) {
-                        // No more data to read, ok
-                        goto ok;
-                    }
-                    if (btchip_context_D.transactionContext.scriptRemaining ==
-                        0) {
-                        // Move to next output
-                        btchip_context_D.transactionContext
-                            .transactionRemainingInputsOutputs--;
-                        btchip_context_D.transactionContext
-                            .transactionCurrentInputOutput++;
-                        btchip_context_D.transactionContext.transactionState =
-                            BTCHIP_TRANSACTION_DEFINED_WAIT_OUTPUT;
-                        continue;
-                    }
-                    dataAvailable =
-                        (btchip_context_D.transactionDataRemaining >
-                                 btchip_context_D.transactionContext
-                                     .scriptRemaining
-                             ? btchip_context_D.transactionContext
-                                   .scriptRemaining
-                             : btchip_context_D.transactionDataRemaining);
-                    if (dataAvailable == 0) {
-                        goto ok;
-                    }
-                    transaction_offset_increase(dataAvailable);
-                    btchip_context_D.transactionContext.scriptRemaining -=
-                        dataAvailable;
-                    break;
-                }
-                case BTCHIP_TRANSACTION_OUTPUT_HASHING_DONE: {
-                    PRINTF("Output hashing done\n");
-                    if (btchip_context_D.transactionDataRemaining < 1) {
-                        // No more data to read, ok
-                        goto ok;
-                    }
-                    // Locktime
-                    check_transaction_available(4);
-                    transaction_offset_increase(4);
-
-                    if (btchip_context_D.transactionDataRemaining == 0) {
-                        btchip_context_D.transactionContext.transactionState =
-                            BTCHIP_TRANSACTION_PARSED;
-                        continue;
-                    } else {
-                        btchip_context_D.transactionHashOption = 0;
-                        btchip_context_D.transactionContext.scriptRemaining =
-                            transaction_get_varint();
-                        btchip_context_D.transactionHashOption =
-                            TRANSACTION_HASH_FULL;
-                        btchip_context_D.transactionContext.transactionState =
-                            BTCHIP_TRANSACTION_PROCESS_EXTRA;
-                        continue;
-                    }
-                }
-
-                case BTCHIP_TRANSACTION_PROCESS_EXTRA: {
-                    unsigned char dataAvailable;
-
-                    if (btchip_context_D.transactionContext.scriptRemaining ==
-                        0) {
-                        btchip_context_D.transactionContext.transactionState =
-                            BTCHIP_TRANSACTION_PARSED;
-                        continue;
-                    }
-
-                    if (btchip_context_D.transactionDataRemaining < 1) {
-                        // No more data to read, ok
-                        goto ok;
-                    }
-
-                    dataAvailable =
-                        (btchip_context_D.transactionDataRemaining >
-                                 btchip_context_D.transactionContext
-                                     .scriptRemaining
-                             ? btchip_context_D.transactionContext
-                                   .scriptRemaining
-                             : btchip_context_D.transactionDataRemaining);
-                    if (dataAvailable == 0) {
-                        goto ok;
-                    }
-                    transaction_offset_increase(dataAvailable);
-                    btchip_context_D.transactionContext.scriptRemaining -=
-                        dataAvailable;
-                    break;
-                }
-
-                case BTCHIP_TRANSACTION_PARSED: {
-                    PRINTF("Transaction parsed\n");
-                    goto ok;
-                }
-
-                case BTCHIP_TRANSACTION_PRESIGN_READY: {
-                    PRINTF("Presign ready\n");
-                    goto ok;
-                }
-
-                case BTCHIP_TRANSACTION_SIGN_READY: {
-                    PRINTF("Sign ready\n");
-                    goto ok;
-                }
-                }
+    unsigned char trustedInput[2 + TRUSTED_INPUT_TOTAL_SIZE];
+    unsigned char trustedInputLength;
+    unsigned char *prevout;
+    unsigned char *amount;
+    unsigned char inputType;
+
+    // Expect the input flag, and the trusted input length if any
+    if (!tx_parser_peek(buffers, 0, &inputType)) {
+        return 0;
+    }
+    switch (inputType) {
+    case INPUT_UNTRUSTED:
+        if (btchip_context_D.usingSegwit) {
+            PRINTF("Non trusted input used in segwit mode\n");
+            return -1;
+        }
+        // Only authorized in relaxed wallet and server modes
+        SB_CHECK(N_btchip.bkp.config.operationMode);
+        switch (SB_GET(N_btchip.bkp.config.operationMode)) {
+        case BTCHIP_MODE_WALLET:
+            if (!optionP2SHSkip2FA) {
+                PRINTF("Untrusted input not authorized\n");
+                return -1;
             }
+            break;
+        case BTCHIP_MODE_RELAXED_WALLET:
+        case BTCHIP_MODE_SERVER:
+            break;
+        default:
+            PRINTF("Untrusted input not authorized\n");
+            return -1;
+        }
+        break;
+    case INPUT_TRUSTED:
+        if (btchip_context_D.usingSegwit) {
+            // Segwit inputs can be passed as TrustedInput also
+            PRINTF("Trusted input used in segwit mode\n");
+        }
+        break;
+    case INPUT_SEGWIT:
+        if (!btchip_context_D.usingSegwit) {
+            PRINTF("Segwit input not used in segwit mode\n");
+            return -1;
+        }
+        break;
+    case INPUT_SESSION:
+        // Bare prevout of a transaction already approved with its Trusted
+        // Inputs. The authorization hash check when finalizing ensures that
+        // the prevouts are the ones validated in the first pass, so the HMACs
+        // are not verified again.
+        if (btchip_context_D.usingSegwit ||
+            btchip_context_D.transactionContext.firstSigned) {
+            PRINTF("Session input used outside of a signing session\n");
+            return -1;
+        }
+        break;
+    default:
+        PRINTF("Invalid trusted input flag\n");
+        return -1;
+    }
 
-        fail:
-            PRINTF("Transaction parse - fail\n");
-            THROW(EXCEPTION);
-        ok : {}
+    if (inputType == INPUT_TRUSTED) {
+        unsigned char hmac[32];
+
+        if (!tx_parser_peek(buffers, 1, &trustedInputLength)) {
+            return 0;
+        }
+        if (trustedInputLength != TRUSTED_INPUT_TOTAL_SIZE) {
+            PRINTF("Invalid trusted input size\n");
+            return -1;
+        }
+        if (!tx_parser_read(parser, buffers, trustedInput,
+                            2 + trustedInputLength)) {
+            return 0;
+        }
+        // Check TrustedInput Hmac, be it a non-segwit TI or a segwit TI
+        cx_hmac_sha256((uint8_t *)N_btchip.bkp.trustedinput_key,
+                       sizeof(N_btchip.bkp.trustedinput_key), trustedInput + 2,
+                       trustedInputLength - 8, hmac, sizeof(hmac));
+        PRINTF("====> Input HMAC:    %.*H\n", 8,
+               trustedInput + 2 + trustedInputLength - 8);
+        PRINTF("====> Computed HMAC: %.*H\n", 8, hmac);
+        if (btchip_secure_memcmp(hmac,
+                                 trustedInput + 2 + trustedInputLength - 8,
+                                 8) != 0) {
+            PRINTF("Invalid signature\n");
+            return -1;
+        }
+        if (!btchip_context_D.usingSegwit &&
+            (trustedInput[2] != MAGIC_TRUSTED_INPUT)) {
+            PRINTF("Failed to verify trusted input signature\n");
+            return -1;
+        }
+        prevout = trustedInput + 2 + 4;
+        amount = trustedInput + 2 + 4 + 36;
+    } else {
+        // flag, prevout (32 hash + 4 index), and the amount of segwit inputs
+        unsigned char length =
+            1 + 36 + (btchip_context_D.usingSegwit ? 8 : 0);
+        if (!tx_parser_read(parser, buffers, trustedInput, length)) {
+            return 0;
+        }
+        prevout = trustedInput + 1;
+        amount = trustedInput + 1 + 36;
+    }
+    parser->input_type = inputType;
+
+    if (btchip_context_D.usingSegwit) {
+        if (!btchip_context_D.segwitParsedOnce) {
+            cx_hash(
+                &btchip_context_D.segwit.hash.hashPrevouts.sha256.header,
+                0, prevout, 36, NULL, 0);
+            if (transaction_add_amount(amount) < 0) {
+                return -1;
+            }
+        } else {
+            transaction_set_hash_option(parser, TRANSACTION_HASH_FULL);
+            tx_parser_hash(parser, prevout, 36);
+            // save amount
+            os_memmove(btchip_context_D.inputValue, amount, 8);
+        }
+        return 1;
+    }
+
+    PRINTF("Input prevout\n%.*H\n", 36, prevout);
+    tx_parser_hash(parser, prevout, 36);
+    if (inputType == INPUT_TRUSTED) {
+        if (transaction_add_amount(amount) < 0) {
+            return -1;
+        }
+    } else if (inputType == INPUT_UNTRUSTED) {
+        PRINTF("Marking relaxed input\n");
+        btchip_context_D.transactionContext.relaxed = 1;
+    }
+    // Do not include the input script length + value in the authentication
+    // hash
+    transaction_set_hash_option(parser, TRANSACTION_HASH_FULL);
+    return 1;
+}
+
+static int transaction_parse_input_script_size(tx_parser_t *parser) {
+    PRINTF("Script to read " DEBUG_LONG "\n", parser->script_size);
+    // Untrusted inputs are only accepted if not to be signed - so length
+    // should be null
+    if ((parser->input_type == INPUT_UNTRUSTED) && (parser->script_size != 0)) {
+        PRINTF("Request to sign relaxed input\n");
+        if ((N_btchip.bkp.config.options & BTCHIP_OPTION_SKIP_2FA_P2SH) == 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int transaction_parse_trusted_input_mode_script_end(
+    tx_parser_t *parser) {
+    // Scan for P2SH consumption - huge shortcut, but fine enough
+    // Also usable in SegWit mode
+    if (parser->script_size != 0) {
+        if (parser->script_last_byte == OP_CHECKMULTISIG) {
+            if ((N_btchip.bkp.config.options & BTCHIP_OPTION_SKIP_2FA_P2SH) !=
+                0) {
+                PRINTF("Marking P2SH consumption\n");
+                btchip_context_D.transactionContext.consumeP2SH = 1;
+            }
+        } else {
+            // When using the P2SH shortcut, all inputs must use P2SH
+            PRINTF("Disabling P2SH consumption\n");
+            btchip_context_D.transactionContext.consumeP2SH = 0;
+        }
+    }
+    return 0;
+}
+
+static int transaction_parse_input_script_end(tx_parser_t *parser) {
+    transaction_parse_trusted_input_mode_script_end(parser);
+    if (!btchip_context_D.usingSegwit) {
+        // Restore dual hash for signature + authentication
+        transaction_set_hash_option(parser, TRANSACTION_HASH_BOTH);
+    } else if (btchip_context_D.segwitParsedOnce) {
+        // Append the saved value
+        PRINTF("SEGWIT Add value\n%.*H\n", 8, btchip_context_D.inputValue);
+        transaction_hash_full(parser, btchip_context_D.inputValue, 8);
+    }
+    return 0;
+}
+
+static int transaction_parse_input_sequence(tx_parser_t *parser,
+                                            const uint8_t *sequence) {
+    if (btchip_context_D.usingSegwit && !btchip_context_D.segwitParsedOnce) {
+        // the full hash accumulates hashSequence in the first segwit pass
+        transaction_hash_full(parser, (unsigned char *)sequence, 4);
+    }
+    return 0;
+}
+
+static int transaction_parse_inputs_end(tx_parser_t *parser) {
+    PRINTF("Input hashing done\n");
+    // inputs have been prepared, stop the parsing here
+    tx_parser_flush(parser);
+    if (btchip_context_D.usingSegwit && !btchip_context_D.segwitParsedOnce) {
+        unsigned char hashedPrevouts[32];
+        unsigned char hashedSequence[32];
+        // Flush the cache
+        cx_hash(&btchip_context_D.segwit.hash.hashPrevouts.sha256.header,
+                CX_LAST, hashedPrevouts, 0, hashedPrevouts, 32);
+        cx_sha256_init(&btchip_context_D.segwit.hash.hashPrevouts.sha256);
+        cx_hash(&btchip_context_D.segwit.hash.hashPrevouts.sha256.header,
+                CX_LAST, hashedPrevouts, sizeof(hashedPrevouts),
+                hashedPrevouts, 32);
+        cx_hash(&btchip_context_D.transactionHashFull.sha256.header, CX_LAST,
+                hashedSequence, 0, hashedSequence, 32);
+        cx_sha256_init(&btchip_context_D.transactionHashFull.sha256);
+        cx_hash(&btchip_context_D.transactionHashFull.sha256.header, CX_LAST,
+                hashedSequence, sizeof(hashedSequence), hashedSequence, 32);
+
+        os_memmove(btchip_context_D.segwit.cache.hashedPrevouts,
+                   hashedPrevouts, sizeof(hashedPrevouts));
+        os_memmove(btchip_context_D.segwit.cache.hashedSequence,
+                   hashedSequence, sizeof(hashedSequence));
+        PRINTF("hashPrevout\n%.*H\n", 32,
+               btchip_context_D.segwit.cache.hashedPrevouts);
+        PRINTF("hashSequence\n%.*H\n", 32,
+               btchip_context_D.segwit.cache.hashedSequence);
+    }
+    if (btchip_context_D.usingSegwit && btchip_context_D.segwitParsedOnce) {
+        PRINTF("SEGWIT hashedOutputs\n%.*H\n",
+               sizeof(btchip_context_D.segwit.cache.hashedOutputs),
+               btchip_context_D.segwit.cache.hashedOutputs);
+        cx_hash(&btchip_context_D.transactionHashFull.sha256.header, 0,
+                btchip_context_D.segwit.cache.hashedOutputs,
+                sizeof(btchip_context_D.segwit.cache.hashedOutputs), NULL, 0);
+        btchip_context_D.transactionContext.transactionState =
+            BTCHIP_TRANSACTION_SIGN_READY;
+    } else {
+        btchip_context_D.transactionContext.transactionState =
+            BTCHIP_TRANSACTION_PRESIGN_READY;
+        if (btchip_context_D.usingSegwit) {
+            cx_sha256_init(&btchip_context_D.transactionHashFull.sha256);
+        }
+    }
+    return 0;
+}
+
+static int transaction_parse_output_amount(tx_parser_t *parser,
+                                           const uint8_t *amount) {
+    // Targets are in increasing order, only the next one can match
+    if ((btchip_context_D.trustedInputProcessed <
+         btchip_context_D.transactionTargetInputsCount) &&
+        (parser->item_index ==
+         btchip_context_D
+             .transactionTargetInputs[btchip_context_D.trustedInputProcessed])) {
+        // Save the amount
+        os_memmove(btchip_context_D
+                       .trustedInputAmounts[btchip_context_D.trustedInputProcessed],
+                   amount, 8);
+        btchip_context_D.trustedInputProcessed++;
+    }
+    return 0;
+}
+
+static const tx_parser_hooks_t trusted_input_mode_hooks = {
+    .hash = transaction_hash,
+    .version = transaction_parse_version,
+    .input_script_end = transaction_parse_trusted_input_mode_script_end,
+    .output_amount = transaction_parse_output_amount,
+};
+
+static const tx_parser_hooks_t signature_mode_hooks = {
+    .hash = transaction_hash,
+    .version = transaction_parse_version,
+    .inputs_start = transaction_parse_inputs_start,
+    .input_header = transaction_parse_input_header,
+    .input_script_size = transaction_parse_input_script_size,
+    .input_script_end = transaction_parse_input_script_end,
+    .input_sequence = transaction_parse_input_sequence,
+    .inputs_end = transaction_parse_inputs_end,
+};
+
+static void transaction_parse_init(unsigned char parseMode) {
+    PRINTF("Init transaction parser\n");
+    // Reset transaction state
+    os_memset(btchip_context_D.transactionContext.transactionAmount, 0,
+              sizeof(btchip_context_D.transactionContext.transactionAmount));
+    // TODO : transactionControlFid
+    // Reset hashes
+    cx_sha256_init(&btchip_context_D.transactionHashFull.sha256);
+    cx_sha256_init(&btchip_context_D.transactionHashAuthorization);
+    if (btchip_context_D.usingSegwit) {
+        btchip_context_D.transactionHashOption = 0;
+        if (!btchip_context_D.segwitParsedOnce) {
+            cx_sha256_init(&btchip_context_D.segwit.hash.hashPrevouts.sha256);
+        } else {
+            PRINTF("Resume SegWit hash\n");
+            PRINTF("SEGWIT Version\n%.*H\n",
+                   sizeof(btchip_context_D.transactionVersion),
+                   btchip_context_D.transactionVersion);
+            PRINTF("SEGWIT HashedPrevouts\n%.*H\n",
+                   sizeof(btchip_context_D.segwit.cache.hashedPrevouts),
+                   btchip_context_D.segwit.cache.hashedPrevouts);
+            PRINTF("SEGWIT HashedSequence\n%.*H\n",
+                   sizeof(btchip_context_D.segwit.cache.hashedSequence),
+                   btchip_context_D.segwit.cache.hashedSequence);
+            cx_hash(&btchip_context_D.transactionHashFull.sha256.header, 0,
+                    btchip_context_D.transactionVersion,
+                    sizeof(btchip_context_D.transactionVersion), NULL, 0);
+            cx_hash(&btchip_context_D.transactionHashFull.sha256.header, 0,
+                    btchip_context_D.segwit.cache.hashedPrevouts,
+                    sizeof(btchip_context_D.segwit.cache.hashedPrevouts), NULL,
+                    0);
+            cx_hash(&btchip_context_D.transactionHashFull.sha256.header, 0,
+                    btchip_context_D.segwit.cache.hashedSequence,
+                    sizeof(btchip_context_D.segwit.cache.hashedSequence), NULL,
+                    0);
+            cx_hash(&btchip_context_D.transactionHashAuthorization.header, 0,
+                    (unsigned char *)&btchip_context_D.segwit.cache,
+                    sizeof(btchip_context_D.segwit.cache), NULL, 0);
         }
-        CATCH_OTHER(e) {
-            PRINTF("Transaction parse - surprise fail\n");
+    }
+
+    tx_parser_init(&btchip_context_D.transactionParser,
+                   (const tx_parser_hooks_t *)PIC(
+                       parseMode == PARSE_MODE_SIGNATURE
+                           ? &signature_mode_hooks
+                           : &trusted_input_mode_hooks),
+                   pic,
+                   parseMode == PARSE_MODE_SIGNATURE ? TX_PARSER_INPUTS_ONLY
+                                                     : TX_PARSER_EXTRA_DATA);
+}
+
+unsigned char transaction_parse(unsigned char parseMode,
+                                const unsigned char *data,
+                                unsigned short length) {
+    int result;
+
+    btchip_set_check_internal_structure_integrity(0);
+    switch (btchip_context_D.transactionContext.transactionState) {
+    case BTCHIP_TRANSACTION_NONE:
+        transaction_parse_init(parseMode);
+        btchip_context_D.transactionContext.transactionState =
+            BTCHIP_TRANSACTION_DEFINED_WAIT_INPUT;
+        // no break is intentional
+
+    case BTCHIP_TRANSACTION_DEFINED_WAIT_INPUT:
+        result = tx_parser_process(&btchip_context_D.transactionParser, data,
+                                   length);
+        if (result < 0) {
+            PRINTF("Transaction parse - fail\n");
             btchip_context_D.transactionContext.transactionState =
                 BTCHIP_TRANSACTION_NONE;
             btchip_set_check_internal_structure_integrity(1);
-            THROW(e);
+            return 0;
         }
-        // before the finally to restore the surrounding context if an exception
-        // is raised during finally
-        FINALLY {
-            btchip_set_check_internal_structure_integrity(1);
+        // when signing, the state is updated once the inputs are hashed
+        if ((result == 1) && (parseMode == PARSE_MODE_TRUSTED_INPUT)) {
+            PRINTF("Transaction parsed\n");
+            btchip_context_D.transactionContext.transactionState =
+                BTCHIP_TRANSACTION_PARSED;
         }
+        break;
+
+    default:
+        // Parsed, presign ready or sign ready: any data is ignored
+        break;
     }
-    END_TRY;
+    btchip_set_check_internal_structure_integrity(1);
+    return 1;
 }
@@ -31,7 +31,11 @@
 #define TRUSTED_INPUT_SIZE   48
 #define TRUSTED_INPUT_TOTAL_SIZE (TRUSTED_INPUT_SIZE + 8)
 
-void transaction_parse(unsigned char parseMode);
+// Parses the next chunk of the transaction, updating the transaction state.
+// Returns 0 if the transaction is invalid, after resetting the state.
+unsigned char transaction_parse(unsigned char parseMode,
+                                const unsigned char *data,
+                                unsigned short length);
 
 // target = a + b
 unsigned char transaction_amount_add_be(unsigned char *target,
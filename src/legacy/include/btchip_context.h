@@ -23,12 +23,15 @@
 #include "cx.h"
 #include "btchip_secure_value.h"
 #include "btchip_filesystem_tx.h"
+#include "../../common/tx_parser.h"
 
 #define MAX_OUTPUT_TO_CHECK 120
 #define MAX_COIN_ID 13
 #define MAX_SHORT_COIN_ID 5
 
 #define MAGIC_TRUSTED_INPUT 0x32
+/** Maximum number of outputs of a transaction converted to Trusted Inputs in a single pass */
+#define MAX_TRUSTED_INPUT_TARGETS 4
 #define MAGIC_DEV_KEY 0x01
 
 enum btchip_modes_e {
@@ -54,23 +57,8 @@ enum btchip_options_e {
 enum btchip_transaction_state_e {
     /** No transaction in progress */
     BTCHIP_TRANSACTION_NONE = 0x00,
-    /** Transaction defined, waiting for an input to be hashed */
+    /** Transaction defined, parsing in progress in transactionParser */
     BTCHIP_TRANSACTION_DEFINED_WAIT_INPUT = 0x01,
-    /** Transaction defined, input hashing in progress, pending input script
-       data */
-    BTCHIP_TRANSACTION_INPUT_HASHING_IN_PROGRESS_INPUT_SCRIPT = 0x02,
-    /** Transaction defined, input hashing done, pending output hashing for this
-       input */
-    BTCHIP_TRANSACTION_INPUT_HASHING_DONE = 0x03,
-    /** Transaction defined, waiting for an output to be hashed */
-    BTCHIP_TRANSACTION_DEFINED_WAIT_OUTPUT = 0x04,
-    /** Transaction defined, output hashing in progress for a complex script,
-       pending output script data */
-    BTCHIP_TRANSACTION_OUTPUT_HASHING_IN_PROGRESS_OUTPUT_SCRIPT = 0x05,
-    /** Transaction defined, output hashing done, pending finalization */
-    BTCHIP_TRANSACTION_OUTPUT_HASHING_DONE = 0x06,
-    /** Extra data present */
-    BTCHIP_TRANSACTION_PROCESS_EXTRA = 0x07,
     /** Transaction parsed */
     BTCHIP_TRANSACTION_PARSED = 0x08,
     /** Transaction parsed, ready to prepare for signature after validating the
@@ -109,15 +97,6 @@ struct segwit_cache_s {
  * Structure defining an operation on a transaction
  */
 struct btchip_transaction_context_s {
-    /** Transient over signing components */
-
-    /** Remaining number of inputs/outputs to process for this transaction */
-    unsigned long int transactionRemainingInputsOutputs;
-    /** Index of the currently processed input/output for this transaction */
-    unsigned long int transactionCurrentInputOutput;
-    /** Remaining script bytes to process for the current input or output */
-    unsigned long int scriptRemaining;
-
     /** Persistent over signing components */
 
     /** State of the transaction, type btchip_transaction_state_t */
@@ -184,14 +163,16 @@ struct btchip_context_s {
 
     /* /Segregated Witness changes */
 
-    /** Size currently available to the transaction parser */
-    unsigned char transactionDataRemaining;
-    /** Current pointer to the transaction buffer for the transaction parser */
-    unsigned char *transactionBufferPointer;
-    /** Trusted Input index processed */
+    /** State of the transaction parser, kept between APDUs */
+    tx_parser_t transactionParser;
+    /** Number of Trusted Input indexes processed */
     unsigned char trustedInputProcessed;
-    /** Transaction input to catch for a Trusted Input lookup */
-    unsigned long int transactionTargetInput;
+    /** Number of transaction outputs to catch for a Trusted Input lookup */
+    unsigned char transactionTargetInputsCount;
+    /** Transaction outputs to catch for a Trusted Input lookup, in increasing order */
+    unsigned long int transactionTargetInputs[MAX_TRUSTED_INPUT_TARGETS];
+    /** Values of the transaction outputs caught for a Trusted Input lookup */
+    unsigned char trustedInputAmounts[MAX_TRUSTED_INPUT_TARGETS][8];
 
     /** Length of the incoming command */
     unsigned short inLength;
@@ -32,6 +32,7 @@
 #include "boilerplate/dispatcher.h"
 
 #include "commands.h"
+#include "crypto.h"
 
 // common declarations between legacy and new code; will refactor it out later
 #include "legacy/include/btchip_context.h"
@@ -119,6 +120,16 @@ const command_descriptor_t COMMAND_DESCRIPTORS[] = {
         .ins = GET_MASTER_FINGERPRINT,
         .handler = (command_handler_t)handler_get_master_fingerprint
     },
+    {
+        .cla = CLA_APP,
+        .ins = GET_WALLET_ADDRESSES,
+        .handler = (command_handler_t)handler_get_wallet_addresses
+    },
+    {
+        .cla = CLA_APP,
+        .ins = GET_EXTENDED_PUBKEYS,
+        .handler = (command_handler_t)handler_get_extended_pubkeys
+    },
     {
         .cla = CLA_APP,
         .ins = SIGN_MESSAGE,
@@ -127,6 +138,10 @@ const command_descriptor_t COMMAND_DESCRIPTORS[] = {
 };
 // clang-format on
 
+// BIP32 pubkey versions of Ravencoin (xpub) and Ravencoin testnet (tpub)
+#define RVN_BIP32_PUBKEY_VERSION_MAINNET 0x0488B21E
+#define RVN_BIP32_PUBKEY_VERSION_TESTNET 0x043587CF
+
 void init_coin_config(btchip_altcoin_config_t *coin_config) {
     memset(coin_config, 0, sizeof(btchip_altcoin_config_t));
 
@@ -184,7 +199,7 @@ void app_main() {
         // Length of APDU command received in G_io_apdu_buffer
         int input_len = 0;
         // Structured APDU command
-        //command_t cmd;
+        command_t cmd;
 
         // Reset length of APDU response
         G_output_len = 0;
@@ -198,7 +213,7 @@ void app_main() {
             return;
         }
 
-//#ifndef DISABLE_LEGACY_SUPPORT
+#ifndef DISABLE_LEGACY_SUPPORT
         if (G_io_apdu_buffer[0] == CLA_APP_LEGACY || G_io_apdu_buffer[0] == CLA_APP_LEGACY_JC_EXT) {
             if (G_app_mode != APP_MODE_LEGACY) {
                 explicit_bzero(&btchip_context_D, sizeof(btchip_context_D));
@@ -220,14 +235,12 @@ void app_main() {
             if (G_swap_state.called_from_swap && vars.swap_data.should_exit) {
                 os_sched_exit(0);
             }
-/*
         } else {
 #endif
-            // if not Bitcoin or Bitcoin-testnet, we only support the legacy APDUS.
-            // to be removed once the apps are split
-            // TODO: Is set false for RVN, update logic?
-            if (G_coin_config->bip32_pubkey_version != 0x0488B21E &&
-                G_coin_config->bip32_pubkey_version != 0x043587CF) {
+            // the commands of the new protocol are only supported for Ravencoin and Ravencoin
+            // testnet
+            if (G_coin_config->bip32_pubkey_version != RVN_BIP32_PUBKEY_VERSION_MAINNET &&
+                G_coin_config->bip32_pubkey_version != RVN_BIP32_PUBKEY_VERSION_TESTNET) {
                 io_send_sw(SW_CLA_NOT_SUPPORTED);
                 return;
             }
@@ -271,6 +284,7 @@ void app_main() {
                             (machine_context_t *) &G_command_state,
                             sizeof(G_command_state),
                             ui_menu_main,
+                            crypto_clear_derivation_cache,
                             &cmd);
 
             if (G_swap_state.called_from_swap && G_swap_state.should_exit) {
@@ -280,8 +294,6 @@ void app_main() {
 #ifndef DISABLE_LEGACY_SUPPORT
         }
 #endif
-*/
-        }
     }
 }
 
@@ -111,10 +111,13 @@ int handle_check_address(check_address_parameters_t* params, btchip_altcoin_conf
         return false;
     }
 
-    if (!crypto_get_compressed_pubkey_at_path(path.path,
-                                              path.length,
-                                              compressed_public_key,
-                                              NULL)) {
+    bool derived = crypto_get_compressed_pubkey_at_path(path.path,
+                                                        path.length,
+                                                        compressed_public_key,
+                                                        NULL);
+    // this runs outside of apdu_dispatcher, that wipes the cache at the end of each command
+    crypto_clear_derivation_cache();
+    if (!derived) {
         return 0;
     }
     char address[MAX_ADDRESS_LENGTH_STR + 1];
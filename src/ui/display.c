@@ -64,7 +64,7 @@ typedef struct {
 typedef struct {
     char index[sizeof("output #999")];
     char address_or_description[MAX(MAX_ADDRESS_LENGTH_STR + 1, MAX_OPRETURN_OUTPUT_DESC_SIZE)];
-    char amount[MAX_AMOUNT_LENGTH + 1];
+    char amount[MAX(MAX_AMOUNT_LENGTH, MAX_ASSET_AMOUNT_LENGTH) + 1];
 } ui_validate_output_state_t;
 
 typedef struct {
@@ -644,6 +644,22 @@ void ui_warn_external_inputs(dispatcher_context_t *context, command_processor_t
     ux_flow_init(0, ux_display_warning_external_inputs_flow, NULL);
 }
 
+// Shows the output once its amount is formatted
+static void show_output(int index,
+                        const char *address_or_description,
+                        command_processor_t on_success) {
+    ui_validate_output_state_t *state = (ui_validate_output_state_t *) &g_ui_state;
+
+    snprintf(state->index, sizeof(state->index), "output #%d", index);
+    strncpy(state->address_or_description,
+            address_or_description,
+            sizeof(state->address_or_description));
+
+    g_next_processor = on_success;
+
+    ux_flow_init(0, ux_display_output_address_amount_flow, NULL);
+}
+
 void ui_validate_output(dispatcher_context_t *context,
                         int index,
                         const char *address_or_description,
@@ -654,15 +670,25 @@ void ui_validate_output(dispatcher_context_t *context,
 
     ui_validate_output_state_t *state = (ui_validate_output_state_t *) &g_ui_state;
 
-    snprintf(state->index, sizeof(state->index), "output #%d", index);
-    strncpy(state->address_or_description,
-            address_or_description,
-            sizeof(state->address_or_description));
     format_sats_amount(coin_name, amount, state->amount);
 
-    g_next_processor = on_success;
+    show_output(index, address_or_description, on_success);
+}
 
-    ux_flow_init(0, ux_display_output_address_amount_flow, NULL);
+void ui_validate_asset_output(dispatcher_context_t *context,
+                              int index,
+                              const char *address,
+                              const uint8_t *asset_name,
+                              size_t asset_name_len,
+                              uint64_t amount,
+                              command_processor_t on_success) {
+    context->pause();
+
+    ui_validate_output_state_t *state = (ui_validate_output_state_t *) &g_ui_state;
+
+    format_asset_amount(asset_name, asset_name_len, amount, state->amount);
+
+    show_output(index, address, on_success);
 }
 
 void ui_validate_transaction(dispatcher_context_t *context,
@@ -67,6 +67,14 @@ void ui_validate_output(dispatcher_context_t *context,
                         uint64_t amount,
                         command_processor_t on_success);
 
+void ui_validate_asset_output(dispatcher_context_t *context,
+                              int index,
+                              const char *address,
+                              const uint8_t *asset_name,
+                              size_t asset_name_len,
+                              uint64_t amount,
+                              command_processor_t on_success);
+
 void ui_validate_transaction(dispatcher_context_t *context,
                              const char *coin_name,
                              uint64_t fee,
@@ -49,14 +49,11 @@ static size_t n_digits(uint64_t number) {
     return count;
 }
 
-void format_sats_amount(const char *coin_name,
-                        uint64_t amount,
-                        char out[static MAX_AMOUNT_LENGTH + 1]) {
-    size_t coin_name_len = strlen(coin_name);
-    strncpy(out, coin_name, MAX_AMOUNT_LENGTH);
-    out[MIN(coin_name_len, MAX_AMOUNT_LENGTH)] = ' ';
+// Formats the amount after the first name_len characters of out, that contain the name
+static void format_amount(size_t name_len, uint64_t amount, char *out) {
+    out[name_len] = ' ';
 
-    char *amount_str = out + coin_name_len + 1;
+    char *amount_str = out + name_len + 1;
 
     // HACK: avoid __udivmoddi4
     // uint64_t integral_part = amount / 100000000;
@@ -91,3 +88,20 @@ void format_sats_amount(const char *coin_name,
         }
     }
 }
+
+void format_sats_amount(const char *coin_name,
+                        uint64_t amount,
+                        char out[static MAX_AMOUNT_LENGTH + 1]) {
+    size_t coin_name_len = MIN(strlen(coin_name), 5);
+    memcpy(out, coin_name, coin_name_len);
+    format_amount(coin_name_len, amount, out);
+}
+
+void format_asset_amount(const uint8_t *asset_name,
+                         size_t asset_name_len,
+                         uint64_t amount,
+                         char out[static MAX_ASSET_AMOUNT_LENGTH + 1]) {
+    asset_name_len = MIN(asset_name_len, MAX_ASSET_NAME_LENGTH);
+    memcpy(out, asset_name, asset_name_len);
+    format_amount(asset_name_len, amount, out);
+}
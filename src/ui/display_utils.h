@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "../constants.h"
@@ -7,6 +8,9 @@
 // up to 5 chars for ticker, 1 space, up to 20 digits (20 = digits of 2^64), + 1 decimal separator
 #define MAX_AMOUNT_LENGTH (5 + 1 + 20 + 1)
 
+// same as MAX_AMOUNT_LENGTH, with the name of a Ravencoin asset instead of the ticker
+#define MAX_ASSET_AMOUNT_LENGTH (MAX_ASSET_NAME_LENGTH + 1 + 20 + 1)
+
 /**
  * Converts a 64-bits unsigned integer into a decimal rapresentation, where the `amount` is a
  * multiple of 1/100_000_000th. Trailing decimal zeros are not appended (and no decimal point is
@@ -20,4 +24,18 @@
  */
 void format_sats_amount(const char *coin_name,
                         uint64_t amount,
-                        char out[static MAX_AMOUNT_LENGTH + 1]);
\ No newline at end of file
+                        char out[static MAX_AMOUNT_LENGTH + 1]);
+
+/**
+ * Same as format_sats_amount, for an amount of a Ravencoin asset. The asset name is not necessarily
+ * zero-terminated.
+ *
+ * @param asset_name the asset name
+ * @param asset_name_len the length of the asset name, at most MAX_ASSET_NAME_LENGTH characters
+ * @param amount the amount to format
+ * @param out the output array which must be at least MAX_ASSET_AMOUNT_LENGTH + 1 bytes long
+ */
+void format_asset_amount(const uint8_t *asset_name,
+                         size_t asset_name_len,
+                         uint64_t amount,
+                         char out[static MAX_ASSET_AMOUNT_LENGTH + 1]);
@@ -115,7 +115,11 @@ def createFakeWalletTransaction(n_inputs: int, n_outputs: int, output_amount: in
     return tx, selected_output_index, selected_output_change, selected_output_address_index
 
 
-def createPsbt(wallet: PolicyMapWallet, input_amounts: List[int], output_amounts: List[int], output_is_change: List[bool], output_wallet: Optional[List[Optional[PolicyMapWallet]]] = None) -> PSBT:
+def createPsbt(wallet: PolicyMapWallet, input_amounts: List[int], output_amounts: List[int], output_is_change: List[bool], output_wallet: Optional[List[Optional[PolicyMapWallet]]] = None, prevout_size: Optional[Tuple[int, int]] = None) -> PSBT:
+    """
+    Creates a PSBT spending from wallet, with fake prevout transactions. If prevout_size is given, each prevout
+    transaction has prevout_size[0] inputs and prevout_size[1] outputs; otherwise, random numbers between 1 and 10.
+    """
     if output_wallet is None:
         output_wallet = [None] * len(output_amounts)
 
@@ -139,8 +143,11 @@ def createPsbt(wallet: PolicyMapWallet, input_amounts: List[int], output_amounts
     prevout_path_change: List[int] = []
     prevout_path_addr_idx: List[int] = []
     for i, prevout_amount in enumerate(input_amounts):
-        n_inputs = randint(1, 10)
-        n_outputs = randint(1, 10)
+        if prevout_size is None:
+            n_inputs = randint(1, 10)
+            n_outputs = randint(1, 10)
+        else:
+            n_inputs, n_outputs = prevout_size
         prevout, idx, is_change, addr_idx = createFakeWalletTransaction(
             n_inputs, n_outputs, prevout_amount, wallet)
         prevouts.append(prevout)
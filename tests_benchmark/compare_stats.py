@@ -0,0 +1,45 @@
+#!/usr/bin/env python3
+
+"""
+Compares two files written with --stats-json, and fails if the number of APDUs or of bytes exchanged increased
+for any case that is in both files. Wall times are only printed, as they depend on the machine running Speculos.
+
+Usage: compare_stats.py baseline.json current.json
+"""
+
+import json
+import sys
+
+CHECKED_FIELDS = ["apdus", "bytes_sent", "bytes_received"]
+
+
+def main() -> int:
+    if len(sys.argv) != 3:
+        print(__doc__)
+        return 2
+
+    with open(sys.argv[1]) as f:
+        baseline = json.load(f)
+    with open(sys.argv[2]) as f:
+        current = json.load(f)
+
+    n_regressions = 0
+    for case in sorted(baseline.keys() & current.keys()):
+        old, new = baseline[case], current[case]
+        changes = [f"{field} {old[field]} -> {new[field]}" for field in CHECKED_FIELDS if old[field] != new[field]]
+        if any(new[field] > old[field] for field in CHECKED_FIELDS):
+            n_regressions += 1
+            print(f"REGRESSION {case}: {', '.join(changes)}")
+        elif changes:
+            print(f"improved   {case}: {', '.join(changes)}")
+        print(f"           {case}: wall time {old['wall_time']:.2f} s -> {new['wall_time']:.2f} s")
+
+    for case in sorted(baseline.keys() - current.keys()):
+        print(f"missing    {case}")
+
+    print(f"{n_regressions} regression(s)")
+    return 1 if n_regressions > 0 else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
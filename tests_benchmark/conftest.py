@@ -0,0 +1,74 @@
+import json
+import random
+from pathlib import Path
+
+from test_utils.fixtures import *
+from test_utils.fixtures import pytest_addoption as fixtures_pytest_addoption
+
+from bitcoin_client.ledger_bitcoin.client_base import ApduException
+
+random.seed(0)  # make sure tests are repeatable
+
+
+def pytest_addoption(parser):
+    fixtures_pytest_addoption(parser)
+    parser.addoption("--stats-json", action="store", default=None,
+                     help="Write the APDU count, bytes exchanged and wall time of each case to this JSON file")
+
+
+class ApduCounter:
+    """Wraps the transport of the client, counting the APDUs and the bytes exchanged in each direction."""
+
+    def __init__(self, transport):
+        self.transport = transport
+        self.reset()
+
+    def reset(self) -> None:
+        self.n_apdus = 0
+        self.bytes_sent = 0
+        self.bytes_received = 0
+
+    def apdu_exchange(self, cla: int, ins: int, data: bytes = b"", p1: int = 0, p2: int = 0) -> bytes:
+        self.n_apdus += 1
+        self.bytes_sent += 5 + len(data)
+        try:
+            response = self.transport.apdu_exchange(cla=cla, ins=ins, data=data, p1=p1, p2=p2)
+        except ApduException as e:
+            self.bytes_received += len(e.data) + 2
+            raise
+        self.bytes_received += len(response) + 2  # the status word is not part of the response
+        return response
+
+    def __getattr__(self, name):
+        return getattr(self.transport, name)
+
+
+@pytest.fixture
+def apdu_counter(comm) -> ApduCounter:
+    return ApduCounter(comm)
+
+
+# Same as the client fixture of test_utils, but on the counting transport
+@pytest.fixture
+def client(bitcoin_network: str, apdu_counter: ApduCounter) -> Client:
+    if bitcoin_network == "main":
+        chain = Chain.MAIN
+    elif bitcoin_network == "test":
+        chain = Chain.TEST
+    else:
+        raise ValueError(
+            f'Invalid value for BITCOIN_NETWORK: {bitcoin_network}')
+    return createClient(apdu_counter, chain=chain, debug=False)
+
+
+@pytest.fixture(scope="session")
+def stats_json(pytestconfig) -> dict:
+    """Collects the statistics of each case, written to the --stats-json file at the end of the session."""
+    stats = {}
+
+    yield stats
+
+    path = pytestconfig.getoption("stats_json")
+    if path is not None:
+        # sorted and indented, so that the files of two runs can be compared with a plain diff
+        Path(path).write_text(json.dumps(stats, indent=2, sort_keys=True) + "\n")
@@ -0,0 +1,87 @@
+import random
+
+import pytest
+
+from embit.networks import NETWORKS
+
+from bitcoin_client.ledger_bitcoin import Client, PolicyMapWallet
+
+from test_utils import has_automation
+from test_utils.txmaker import createPsbt, master_key, master_key_fpr
+
+from .conftest import ApduCounter
+
+# Benchmarks of sign_psbt for legacy (P2PKH) transactions of different sizes. For each case, the number of APDUs,
+# the bytes exchanged and the wall time of the signing are reported as extra_info of pytest-benchmark, and in the
+# file given with --stats-json.
+
+N_INPUTS = [1, 10, 50, 100, 200]
+N_OUTPUTS = [1, 10, 50]
+
+# number of inputs and outputs of each prevout transaction for the cases with large non-witness UTXOs
+LARGE_PREVOUT_SIZE = (50, 50)
+
+FEES = 10_000
+
+
+@pytest.fixture
+def wallet(bitcoin_network: str) -> PolicyMapWallet:
+    # the standard BIP-44 account of the Speculos seed: coin type 175 for the Ravencoin app, 1 for the testnet app
+    coin_type = 175 if bitcoin_network == "main" else 1
+    path = f"44'/{coin_type}'/0'"
+    xpub = master_key.derive(f"m/{path}").to_public().to_base58(version=NETWORKS[bitcoin_network]["xpub"])
+
+    return PolicyMapWallet("", "pkh(@0)", [f"[{master_key_fpr.hex()}/{path}]{xpub}/**"])
+
+
+def is_slow_case(n_inputs: int, large_prevouts: bool) -> bool:
+    return n_inputs >= 100 or (large_prevouts and n_inputs >= 50)
+
+
+@pytest.fixture
+def skip_slow_cases(request, enable_slow_tests: bool):
+    # a fixture rather than a check in the test, so that Speculos is not started for the skipped cases
+    params = request.node.callspec.params
+    if is_slow_case(params["n_inputs"], params["large_prevouts"]) and not enable_slow_tests:
+        pytest.skip("slow case, run with --enableslowtests")
+
+
+@has_automation("automations/sign_with_wallet_accept.json")
+@pytest.mark.parametrize("large_prevouts", [False, True], ids=["small_prevouts", "large_prevouts"])
+@pytest.mark.parametrize("n_outputs", N_OUTPUTS, ids=[f"{n}_outputs" for n in N_OUTPUTS])
+@pytest.mark.parametrize("n_inputs", N_INPUTS, ids=[f"{n}_inputs" for n in N_INPUTS])
+def test_benchmark_sign_psbt_pkh(skip_slow_cases, request, benchmark, stats_json: dict, client: Client,
+                                 apdu_counter: ApduCounter, wallet: PolicyMapWallet, n_inputs: int, n_outputs: int,
+                                 large_prevouts: bool):
+    # each case has its own deterministic PSBT, independently of the cases that are run
+    random.seed(f"{n_inputs}-{n_outputs}-{large_prevouts}")
+
+    input_amounts = [random.randint(1_000_000, 10_000_000) for _ in range(n_inputs)]
+    output_amount = (sum(input_amounts) - FEES) // n_outputs
+    output_amounts = [output_amount] * n_outputs
+    # the last output is a change output, unless it is the only one
+    output_is_change = [n_outputs > 1 and i == n_outputs - 1 for i in range(n_outputs)]
+
+    psbt = createPsbt(wallet, input_amounts, output_amounts, output_is_change,
+                      prevout_size=LARGE_PREVOUT_SIZE if large_prevouts else None)
+
+    def sign_psbt():
+        apdu_counter.reset()
+        return client.sign_psbt(psbt, wallet, None)
+
+    # a single round: each signature goes through the whole UI flow
+    result = benchmark.pedantic(sign_psbt, rounds=1, iterations=1)
+
+    assert len(result) == n_inputs
+
+    stats = {
+        "n_inputs": n_inputs,
+        "n_outputs": n_outputs,
+        "large_prevouts": large_prevouts,
+        "apdus": apdu_counter.n_apdus,
+        "bytes_sent": apdu_counter.bytes_sent,
+        "bytes_received": apdu_counter.bytes_received,
+    }
+    benchmark.extra_info.update(stats)
+
+    stats_json[request.node.name] = {**stats, "wall_time": benchmark.stats.stats.total}
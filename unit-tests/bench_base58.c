@@ -0,0 +1,111 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <cmocka.h>
+
+#include "common/base58.h"
+
+// Checks base58_encode_limbs and base58_decode_limbs against the byte-wise implementations, and
+// compares their running time on inputs of the size of an address and of an extended pubkey.
+
+#define N_ITERATIONS 20000
+
+#define ADDRESS_LEN 25  // version, hash160 and checksum
+#define XPUB_LEN 82     // serialized extended pubkey and checksum
+
+typedef int (*encode_fn_t)(const uint8_t *in, size_t in_len, char *out, size_t out_len);
+typedef int (*decode_fn_t)(const char *in, size_t in_len, uint8_t *out, size_t out_len);
+
+// simple deterministic pseudo-random generator, to fill the inputs
+static uint32_t next_random(uint32_t *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+static void test_base58_limbs_equivalence(void **state) {
+    (void) state;
+
+    uint32_t seed = 42;
+    for (int it = 0; it < N_ITERATIONS; it++) {
+        uint8_t in[MAX_ENC_INPUT_SIZE];
+        size_t in_len = next_random(&seed) % (MAX_ENC_INPUT_SIZE + 1);
+        size_t n_zeros = next_random(&seed) % 4;
+        for (size_t i = 0; i < in_len; i++) {
+            in[i] = i < n_zeros ? 0 : (uint8_t) next_random(&seed);
+        }
+
+        char enc_bytewise[200], enc_limbs[200];
+        int enc_len_bytewise =
+            base58_encode_bytewise(in, in_len, enc_bytewise, sizeof(enc_bytewise));
+        int enc_len_limbs = base58_encode_limbs(in, in_len, enc_limbs, sizeof(enc_limbs));
+        assert_int_equal(enc_len_bytewise, enc_len_limbs);
+        assert_memory_equal(enc_bytewise, enc_limbs, enc_len_limbs);
+
+        if (enc_len_limbs < 2) {
+            continue;  // too short to be decoded
+        }
+
+        uint8_t dec_bytewise[200], dec_limbs[200];
+        int dec_len_bytewise =
+            base58_decode_bytewise(enc_limbs, enc_len_limbs, dec_bytewise, sizeof(dec_bytewise));
+        int dec_len_limbs =
+            base58_decode_limbs(enc_limbs, enc_len_limbs, dec_limbs, sizeof(dec_limbs));
+        assert_int_equal(dec_len_bytewise, in_len);
+        assert_int_equal(dec_len_limbs, in_len);
+        assert_memory_equal(dec_bytewise, in, in_len);
+        assert_memory_equal(dec_limbs, in, in_len);
+    }
+}
+
+static void bench_one(const char *name, size_t len, encode_fn_t encode, decode_fn_t decode) {
+    uint8_t in[MAX_ENC_INPUT_SIZE];
+    uint32_t seed = 1;
+    for (size_t i = 0; i < len; i++) {
+        in[i] = (uint8_t) next_random(&seed);
+    }
+
+    char encoded[200];
+    uint8_t decoded[200];
+    uint32_t checksum = 0;
+
+    clock_t start = clock();
+    for (int it = 0; it < N_ITERATIONS; it++) {
+        in[len - 1] = (uint8_t) it;
+        int encoded_len = encode(in, len, encoded, sizeof(encoded));
+        checksum += encoded[encoded_len - 1];
+    }
+    double time_encode = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    int encoded_len = encode(in, len, encoded, sizeof(encoded));
+    start = clock();
+    for (int it = 0; it < N_ITERATIONS; it++) {
+        checksum += decode(encoded, encoded_len, decoded, sizeof(decoded));
+    }
+    double time_decode = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    assert_true(checksum != 0);
+
+    printf("%s, %zu bytes: encode %.3f s, decode %.3f s\n", name, len, time_encode, time_decode);
+}
+
+static void bench_base58(void **state) {
+    (void) state;
+
+    bench_one("bytewise", ADDRESS_LEN, base58_encode_bytewise, base58_decode_bytewise);
+    bench_one("limbs", ADDRESS_LEN, base58_encode_limbs, base58_decode_limbs);
+    bench_one("bytewise", XPUB_LEN, base58_encode_bytewise, base58_decode_bytewise);
+    bench_one("limbs", XPUB_LEN, base58_encode_limbs, base58_decode_limbs);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {cmocka_unit_test(test_base58_limbs_equivalence),
+                                       cmocka_unit_test(bench_base58)};
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,157 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <cmocka.h>
+
+#include "common/merkle.h"
+
+// Checks merkle_path_init against the previous implementation of merkle_get_ith_direction, and
+// compares their running time when computing all the directions of a Merkle proof.
+
+#define MAX_SIZE (1 << 16)
+
+// Previous implementation of merkle_get_ith_direction, recomputing the path from the root at each
+// call in O(log^2 n).
+static int reference_get_ith_direction(size_t size, size_t index, size_t i) {
+    if (size <= 1 || index >= size) {
+        return -1;
+    }
+
+    uint8_t n_directions = 0;
+    while (size > 1) {
+        uint8_t depth = ceil_lg(size);
+
+        // bitmask of the direction from the current node, where 0 = left, 1 = right;
+        // also the number of leaves of the left subtree
+        uint32_t mask = 1 << (depth - 1);
+
+        uint8_t is_right_child = (index & mask) != 0 ? 1 : 0;
+
+        if (n_directions == i) {
+            return is_right_child;
+        }
+
+        ++n_directions;
+
+        if (is_right_child) {
+            size -= mask;
+            index -= mask;
+        } else {
+            size = mask;
+        }
+    }
+
+    return -1;
+}
+
+static void check_path(uint32_t size, uint32_t index) {
+    merkle_path_t path;
+    assert_int_equal(merkle_path_init(&path, size, index), 0);
+
+    for (size_t i = 0; i <= MAX_MERKLE_TREE_DEPTH; i++) {
+        int expected = reference_get_ith_direction(size, index, i);
+        assert_int_equal(merkle_path_get_direction(&path, i), expected);
+        if (expected == -1) {
+            assert_int_equal(path.depth, i);
+            break;
+        }
+    }
+}
+
+static void test_merkle_path_equivalence(void **state) {
+    (void) state;
+
+    for (uint32_t size = 1; size <= MAX_SIZE; size++) {
+        if (size <= 1024) {
+            for (uint32_t index = 0; index < size; index++) {
+                check_path(size, index);
+            }
+        } else {
+            // the first and last leaves, the leaves around the split between the left and right
+            // subtrees of the root, and a couple of leaves in the middle
+            uint32_t mask = 1;
+            while (2 * mask < size) {
+                mask *= 2;
+            }
+            const uint32_t indexes[] = {0, size / 3, mask - 1, mask, size - 2, size - 1};
+            for (size_t k = 0; k < sizeof(indexes) / sizeof(indexes[0]); k++) {
+                check_path(size, indexes[k]);
+            }
+            check_path(size, (uint32_t) (((uint64_t) size * 40503) >> 16));  // ~0.618 * size
+        }
+    }
+
+    merkle_path_t path;
+    assert_int_equal(merkle_path_init(&path, 5, 5), -1);
+    assert_int_equal(merkle_path_init(&path, 0, 0), -1);
+}
+
+static void test_merkle_path_large_trees(void **state) {
+    (void) state;
+
+    merkle_path_t path;
+
+    assert_int_equal(merkle_path_init(&path, UINT32_MAX, UINT32_MAX - 1), 0);
+    assert_int_equal(path.depth, 31);  // the last leaf of the right subtree, of size 2^31 - 1
+
+    assert_int_equal(merkle_path_init(&path, UINT32_MAX, 0), 0);
+    assert_int_equal(path.depth, 32);
+    assert_int_equal(path.directions, 0);
+
+    assert_int_equal(merkle_path_init(&path, (uint32_t) 1 << 31, ((uint32_t) 1 << 31) - 1), 0);
+    assert_int_equal(path.depth, 31);
+    assert_int_equal(path.directions, 0x7FFFFFFF);
+}
+
+static void bench_merkle_path(void **state) {
+    (void) state;
+
+    // all the directions for all the leaves of a few trees, as when verifying their proofs
+    const uint32_t sizes[] = {3, 17, 100, 1000, 12345, MAX_SIZE};
+    uint32_t checksum_reference = 0;
+    uint32_t checksum_path = 0;
+
+    clock_t start = clock();
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (uint32_t index = 0; index < sizes[s]; index++) {
+            int direction;
+            for (size_t i = 0; (direction = reference_get_ith_direction(sizes[s], index, i)) >= 0;
+                 i++) {
+                checksum_reference = 2 * checksum_reference + direction;
+            }
+        }
+    }
+    double time_reference = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (uint32_t index = 0; index < sizes[s]; index++) {
+            merkle_path_t path;
+            merkle_path_init(&path, sizes[s], index);
+            int direction;
+            for (size_t i = 0; (direction = merkle_path_get_direction(&path, i)) >= 0; i++) {
+                checksum_path = 2 * checksum_path + direction;
+            }
+        }
+    }
+    double time_path = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    assert_int_equal(checksum_reference, checksum_path);
+
+    printf("merkle_get_ith_direction (previous): %.3f s\n", time_reference);
+    printf("merkle_path_init + merkle_path_get_direction: %.3f s\n", time_path);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {cmocka_unit_test(test_merkle_path_equivalence),
+                                       cmocka_unit_test(test_merkle_path_large_trees),
+                                       cmocka_unit_test(bench_merkle_path)};
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,385 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <cmocka.h>
+
+#include "common/tx_parser.h"
+
+// Fuzzing and throughput of the transaction parser on Ravencoin transactions: payments, transfers,
+// issuances and reissuances of assets, tags, and a large transaction with many inputs. They are
+// parsed with all the sinks plugged in, as when a PSBT is signed, in chunks of the size of the
+// legacy APDUs and of the GET_PREIMAGE responses. The fuzzer checks that any chunking gives the
+// same result, and that the truncated and mutated transactions are parsed without reading out of
+// bounds (when built with the sanitizers) and without crashing.
+
+#define N_BENCH_ITERATIONS 200
+#define N_FUZZ_ITERATIONS  20000
+
+#define N_LARGE_INPUTS  200
+#define N_LARGE_OUTPUTS 50
+#define MAX_TX_SIZE     (N_LARGE_INPUTS * (36 + 3 + 300 + 4) + N_LARGE_OUTPUTS * (8 + 3 + 300) + 32)
+
+#define ASSET_SCRIPT_MAX_LENGTH 64
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+typedef struct {
+    uint32_t checksum;
+    size_t n_hash_calls;
+    uint32_t n_assets;
+    uint32_t assets_checksum;
+} parse_result_t;
+
+static parse_result_t G_result;
+
+// FNV-1a, as a stand-in for the work per byte of SHA-256
+static uint32_t fnv1a(uint32_t checksum, const uint8_t *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        checksum = (checksum ^ data[i]) * 16777619;
+    }
+    return checksum;
+}
+
+static void checksum_hash(tx_parser_t *parser, const uint8_t *data, size_t length) {
+    (void) parser;
+
+    G_result.checksum = fnv1a(G_result.checksum, data, length);
+    ++G_result.n_hash_calls;
+}
+
+static int checksum_output_end(tx_parser_t *parser) {
+    tx_asset_sink_t *asset_sink = parser->asset_sink;
+    if (asset_sink->found) {
+        ++G_result.n_assets;
+        G_result.assets_checksum =
+            fnv1a(G_result.assets_checksum,
+                  asset_sink->script,
+                  MIN(asset_sink->script_length, asset_sink->script_max_length));
+    }
+    return 0;
+}
+
+static const tx_parser_hooks_t bench_hooks = {
+    .hash = checksum_hash,
+    .output_end = checksum_output_end,
+};
+
+// simple deterministic pseudo-random generator
+static uint32_t next_random(uint32_t *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+/*   RAVENCOIN TRANSACTIONS */
+
+typedef struct {
+    uint8_t data[MAX_TX_SIZE];
+    size_t length;
+} tx_writer_t;
+
+static void write_bytes(tx_writer_t *tx, const void *data, size_t length) {
+    memcpy(tx->data + tx->length, data, length);
+    tx->length += length;
+}
+
+static void write_u8(tx_writer_t *tx, uint8_t value) {
+    tx->data[tx->length++] = value;
+}
+
+static void write_varint(tx_writer_t *tx, uint32_t value) {
+    if (value < 0xfd) {
+        write_u8(tx, value);
+    } else {
+        write_u8(tx, 0xfd);
+        write_u8(tx, value & 0xff);
+        write_u8(tx, value >> 8);
+    }
+}
+
+static void write_amount(tx_writer_t *tx, uint64_t amount) {
+    for (int i = 0; i < 8; i++) {
+        write_u8(tx, (amount >> (8 * i)) & 0xff);
+    }
+}
+
+static void write_filler(tx_writer_t *tx, uint8_t value, size_t length) {
+    memset(tx->data + tx->length, value, length);
+    tx->length += length;
+}
+
+static void write_input(tx_writer_t *tx, uint8_t seed, uint32_t scriptsig_length) {
+    write_filler(tx, seed, 32);               // txid
+    write_bytes(tx, "\x01\x00\x00\x00", 4);  // vout
+    write_varint(tx, scriptsig_length);
+    write_filler(tx, 0x30, scriptsig_length);  // signature and public key
+    write_bytes(tx, "\xff\xff\xff\xff", 4);
+}
+
+static void write_p2pkh(tx_writer_t *tx, uint8_t hash) {
+    write_bytes(tx, "\x76\xa9\x14", 3);
+    write_filler(tx, hash, 20);
+    write_bytes(tx, "\x88\xac", 2);
+}
+
+static void write_p2pkh_output(tx_writer_t *tx, uint64_t amount, uint8_t hash) {
+    write_amount(tx, amount);
+    write_u8(tx, 25);
+    write_p2pkh(tx, hash);
+}
+
+// Output of 0 RVN with an asset script after a P2PKH: OP_RVN_ASSET, then a push of "rvn", the type,
+// the name, the amount of the asset (except for owner tokens), and OP_DROP
+static void write_asset_output(tx_writer_t *tx, uint8_t hash, char type, const char *name) {
+    size_t name_length = strlen(name);
+    size_t payload_length = 4 + 1 + name_length + (type != 'o' ? 8 : 0);
+
+    write_amount(tx, 0);
+    write_u8(tx, 25 + 2 + payload_length + 1);
+    write_p2pkh(tx, hash);
+    write_u8(tx, 0xc0);  // OP_RVN_ASSET
+    write_u8(tx, payload_length);
+    write_bytes(tx, "rvn", 3);
+    write_u8(tx, type);
+    write_u8(tx, name_length);
+    write_bytes(tx, name, name_length);
+    if (type != 'o') {
+        write_amount(tx, 100000000);
+    }
+    write_u8(tx, 0x75);  // OP_DROP
+}
+
+// Null asset output of 0 RVN that tags an address
+static void write_tag_output(tx_writer_t *tx, uint8_t hash, const char *tag) {
+    size_t tag_length = strlen(tag);
+
+    write_amount(tx, 0);
+    write_u8(tx, 2 + 20 + 1 + 1 + tag_length + 1);
+    write_bytes(tx, "\xc0\x14", 2);
+    write_filler(tx, hash, 20);
+    write_u8(tx, 1 + tag_length + 1);
+    write_u8(tx, tag_length);
+    write_bytes(tx, tag, tag_length);
+    write_u8(tx, 0x01);  // add the tag
+}
+
+static void write_header(tx_writer_t *tx, uint32_t n_inputs) {
+    tx->length = 0;
+    write_bytes(tx, "\x02\x00\x00\x00", 4);
+    write_varint(tx, n_inputs);
+    for (uint32_t i = 0; i < n_inputs; i++) {
+        write_input(tx, 0x10 + i, 106);
+    }
+}
+
+static void write_locktime(tx_writer_t *tx) {
+    write_bytes(tx, "\x00\x00\x00\x00", 4);
+}
+
+static void make_payment(tx_writer_t *tx) {
+    write_header(tx, 1);
+    write_varint(tx, 2);
+    write_p2pkh_output(tx, 150000000000, 0x01);
+    write_p2pkh_output(tx, 2849999774000, 0x02);
+    write_locktime(tx);
+}
+
+static void make_transfer(tx_writer_t *tx) {
+    write_header(tx, 3);
+    write_varint(tx, 3);
+    write_p2pkh_output(tx, 99774000, 0x01);
+    write_asset_output(tx, 0x02, 't', "RAVENCOIN_CASH");
+    write_asset_output(tx, 0x03, 't', "RAVENCOIN_CASH");
+    write_locktime(tx);
+}
+
+static void make_issuance(tx_writer_t *tx) {
+    write_header(tx, 1);
+    write_varint(tx, 4);
+    write_p2pkh_output(tx, 50000000000, 0x04);  // burn
+    write_p2pkh_output(tx, 849774000, 0x01);
+    write_asset_output(tx, 0x02, 'o', "LEDGER!");
+    write_asset_output(tx, 0x02, 'q', "LEDGER");
+    write_locktime(tx);
+}
+
+static void make_reissuance(tx_writer_t *tx) {
+    write_header(tx, 2);
+    write_varint(tx, 4);
+    write_p2pkh_output(tx, 10000000000, 0x05);  // burn
+    write_p2pkh_output(tx, 849774000, 0x01);
+    write_asset_output(tx, 0x02, 't', "LEDGER!");
+    write_asset_output(tx, 0x02, 'r', "LEDGER");
+    write_locktime(tx);
+}
+
+static void make_tag(tx_writer_t *tx) {
+    write_header(tx, 2);
+    write_varint(tx, 4);
+    write_p2pkh_output(tx, 10000000, 0x06);  // burn
+    write_p2pkh_output(tx, 849774000, 0x01);
+    write_asset_output(tx, 0x02, 't', "#KYC");
+    write_tag_output(tx, 0x07, "#KYC");
+    write_locktime(tx);
+}
+
+// Many inputs and outputs, with some large scripts that need a 3-byte varint
+static void make_large(tx_writer_t *tx) {
+    uint32_t seed = 42;
+
+    tx->length = 0;
+    write_bytes(tx, "\x02\x00\x00\x00", 4);
+    write_varint(tx, N_LARGE_INPUTS);
+    for (int i = 0; i < N_LARGE_INPUTS; i++) {
+        write_input(tx, i, next_random(&seed) % 8 == 0 ? 253 + next_random(&seed) % 48 : 106);
+    }
+    write_varint(tx, N_LARGE_OUTPUTS);
+    for (int i = 0; i < N_LARGE_OUTPUTS; i++) {
+        if (i % 5 == 4) {
+            write_asset_output(tx, i, 't', "RAVENCOIN_CASH");
+        } else {
+            write_p2pkh_output(tx, 100000 * i, i);
+        }
+    }
+    write_locktime(tx);
+}
+
+typedef struct {
+    const char *name;
+    void (*make)(tx_writer_t *tx);
+    uint32_t n_assets;
+} tx_kind_t;
+
+static const tx_kind_t tx_kinds[] = {
+    {"payment", make_payment, 0},
+    {"transfer", make_transfer, 2},
+    {"issuance", make_issuance, 2},
+    {"reissuance", make_reissuance, 2},
+    {"tag", make_tag, 2},
+    {"large", make_large, N_LARGE_OUTPUTS / 5},
+};
+
+#define N_TX_KINDS (sizeof(tx_kinds) / sizeof(tx_kinds[0]))
+
+/*   PARSING */
+
+// Parses the transaction with all the sinks, in chunks of chunk_size bytes (or of random sizes up
+// to chunk_size if seed is not NULL); returns the last result of the parser
+static int parse(const uint8_t *data, size_t length, size_t chunk_size, uint32_t *seed) {
+    uint8_t script[34];
+    tx_output_sink_t output_sink = {.index = 1,
+                                    .script = script,
+                                    .script_max_length = sizeof(script)};
+    uint8_t asset_script[ASSET_SCRIPT_MAX_LENGTH];
+    tx_asset_sink_t asset_sink = {.script = asset_script,
+                                  .script_max_length = sizeof(asset_script)};
+
+    tx_parser_t parser;
+    tx_parser_init(&parser, &bench_hooks, NULL, TX_PARSER_SEGWIT);
+    parser.output_sink = &output_sink;
+    parser.asset_sink = &asset_sink;
+
+    memset(&G_result, 0, sizeof(G_result));
+    int result = 0;
+    size_t offset = 0;
+    while (offset < length && result == 0) {
+        size_t n = seed != NULL ? 1 + next_random(seed) % chunk_size : chunk_size;
+        n = MIN(n, length - offset);
+        result = tx_parser_process(&parser, data + offset, n);
+        offset += n;
+    }
+    return result;
+}
+
+static void bench_tx_parser(void **state) {
+    (void) state;
+
+    static tx_writer_t tx;
+
+    // the largest payload of a legacy APDU, a smaller one like some hosts use, and about the data
+    // of a GET_PREIMAGE response
+    const size_t chunk_sizes[] = {255, 50, 218};
+
+    for (size_t k = 0; k < N_TX_KINDS; k++) {
+        tx_kinds[k].make(&tx);
+
+        for (size_t c = 0; c < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); c++) {
+            size_t chunk_size = chunk_sizes[c];
+            size_t n_chunks = (tx.length + chunk_size - 1) / chunk_size;
+
+            // enough iterations for a measurable time on the small transactions
+            size_t n_iterations = N_BENCH_ITERATIONS * (MAX_TX_SIZE / 4 / tx.length + 1);
+            clock_t start = clock();
+            for (size_t it = 0; it < n_iterations; it++) {
+                assert_int_equal(parse(tx.data, tx.length, chunk_size, NULL), 1);
+            }
+            double time = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+            assert_int_equal(G_result.n_assets, tx_kinds[k].n_assets);
+            // the bytes of the store, then the bytes of the chunk
+            assert_true(G_result.n_hash_calls <= 2 * n_chunks);
+
+            printf("%-10s %6zu bytes in chunks of %3zu: %7.1f MB/s, %3zu hash calls\n",
+                   tx_kinds[k].name,
+                   tx.length,
+                   chunk_size,
+                   time > 0 ? (double) tx.length * n_iterations / time / 1e6 : 0.0,
+                   G_result.n_hash_calls);
+        }
+    }
+}
+
+static void fuzz_tx_parser(void **state) {
+    (void) state;
+
+    static tx_writer_t tx;
+    static uint8_t mutated[MAX_TX_SIZE];
+    uint32_t seed = 1;
+
+    for (size_t k = 0; k < N_TX_KINDS; k++) {
+        tx_kinds[k].make(&tx);
+
+        assert_int_equal(parse(tx.data, tx.length, tx.length, NULL), 1);
+        parse_result_t expected = G_result;
+
+        size_t n_iterations = N_FUZZ_ITERATIONS / N_TX_KINDS;
+        for (size_t it = 0; it < n_iterations; it++) {
+            // any chunking gives the same result
+            assert_int_equal(parse(tx.data, tx.length, 1 + next_random(&seed) % 300, &seed), 1);
+            assert_int_equal(G_result.checksum, expected.checksum);
+            assert_int_equal(G_result.n_assets, expected.n_assets);
+            assert_int_equal(G_result.assets_checksum, expected.assets_checksum);
+
+            // a truncated transaction is incomplete
+            size_t length = next_random(&seed) % tx.length;
+            assert_int_equal(parse(tx.data, length, 1 + next_random(&seed) % 300, &seed), 0);
+
+            // mutated transactions are valid, incomplete or invalid, and never read out of bounds
+            memcpy(mutated, tx.data, tx.length);
+            uint32_t n_mutations = 1 + next_random(&seed) % 4;
+            for (uint32_t m = 0; m < n_mutations; m++) {
+                uint32_t r = next_random(&seed);
+                size_t position = next_random(&seed) % tx.length;
+                // mostly mutations of the small transactions, or of the varints
+                mutated[position] = r % 4 == 0 ? 0xfd + r % 3 : (uint8_t) r;
+            }
+            length = tx.length - next_random(&seed) % 8;
+            int result = parse(mutated, length, 1 + next_random(&seed) % 300, &seed);
+            assert_true(result >= -1 && result <= 1);
+        }
+    }
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(fuzz_tx_parser),
+        cmocka_unit_test(bench_tx_parser),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
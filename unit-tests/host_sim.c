@@ -0,0 +1,409 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <cmocka.h>
+
+#include "os.h"
+#include "cx.h"
+
+#include "boilerplate/constants.h"
+#include "boilerplate/dispatcher.h"
+#include "boilerplate/sw.h"
+#include "common/buffer.h"
+#include "common/varint.h"
+#include "handler/client_commands.h"
+#include "handler/lib/get_merkleized_map.h"
+#include "handler/lib/get_merkleized_map_value.h"
+
+#include "host_sim/sim_client.h"
+#include "host_sim/sim_io.h"
+
+// Round-trip simulator of the real dispatcher and of the Merkle/merkleized map library of the
+// handlers, with the client commands answered in process by the C port of the client interpreter.
+// The PSBT-shaped command below reads some keys from each of the merkleized maps of a list, as the
+// inputs and outputs of a PSBT are read by sign_psbt; the benchmark reports the number of round
+// trips and the running time for many shapes of the maps.
+// handler_sign_psbt itself is not run: it needs the key derivation and signing of a software
+// secp256k1 backend, that the simulator does not provide.
+
+#define CLA_SIM                0xE1
+#define INS_SIM_GET_MAP_VALUES 0x80
+
+#define SIM_MAX_KEYS      8
+#define SIM_MAX_KEY_LEN   32
+#define SIM_MAX_VALUE_LEN 512
+
+#define N_RANDOM_SHAPES 2000
+
+typedef struct {
+    machine_context_t ctx;
+} sim_state_t;
+
+static sim_state_t G_sim_state;
+
+/**
+ * Request: <maps_root : 32> <n_maps : varint> <n_keys : 1> <key_len : 1> <key : key_len> ...
+ * Response: the SHA-256 of the concatenation of the values of each requested key in each map.
+ */
+static void handler_sim_get_map_values(dispatcher_context_t *dc) {
+    uint8_t maps_root[32];
+    uint64_t n_maps;
+    uint8_t n_keys;
+    uint8_t keys[SIM_MAX_KEYS][SIM_MAX_KEY_LEN];
+    uint8_t key_lens[SIM_MAX_KEYS];
+
+    if (!buffer_read_bytes(&dc->read_buffer, maps_root, 32) ||
+        !buffer_read_varint(&dc->read_buffer, &n_maps) ||
+        !buffer_read_u8(&dc->read_buffer, &n_keys) || n_keys > SIM_MAX_KEYS) {
+        SEND_SW(dc, SW_WRONG_DATA_LENGTH);
+        return;
+    }
+    for (int i = 0; i < n_keys; i++) {
+        if (!buffer_read_u8(&dc->read_buffer, &key_lens[i]) || key_lens[i] > SIM_MAX_KEY_LEN ||
+            !buffer_read_bytes(&dc->read_buffer, keys[i], key_lens[i])) {
+            SEND_SW(dc, SW_WRONG_DATA_LENGTH);
+            return;
+        }
+    }
+
+    cx_sha256_t hash;
+    cx_sha256_init(&hash);
+
+    for (uint64_t i = 0; i < n_maps; i++) {
+        merkleized_map_commitment_t map;
+        if (call_get_merkleized_map(dc, maps_root, n_maps, i, &map) < 0) {
+            SEND_SW(dc, SW_INCORRECT_DATA);
+            return;
+        }
+
+        for (int j = 0; j < n_keys; j++) {
+            uint8_t value[SIM_MAX_VALUE_LEN];
+            int value_len =
+                call_get_merkleized_map_value(dc, &map, keys[j], key_lens[j], value, sizeof(value));
+            if (value_len < 0) {
+                SEND_SW(dc, SW_INCORRECT_DATA);
+                return;
+            }
+            cx_hash(&hash.header, 0, value, value_len, NULL, 0);
+        }
+    }
+
+    uint8_t digest[32];
+    cx_hash(&hash.header, CX_LAST, NULL, 0, digest, 32);
+    SEND_RESPONSE(dc, digest, sizeof(digest), SW_OK);
+}
+
+static const command_descriptor_t SIM_COMMAND_DESCRIPTORS[] = {
+    {.cla = CLA_SIM, .ins = INS_SIM_GET_MAP_VALUES, .handler = handler_sim_get_map_values},
+};
+
+#define N_SIM_COMMAND_DESCRIPTORS \
+    (sizeof(SIM_COMMAND_DESCRIPTORS) / sizeof(SIM_COMMAND_DESCRIPTORS[0]))
+
+// Shape of the merkleized maps of a PSBT-like command
+typedef struct {
+    int n_maps;
+    int n_keys;     // keys requested in each map
+    int n_extra;    // entries of each map that are not requested
+    int value_len;  // length of each value
+} shape_t;
+
+// simple deterministic pseudo-random generator, to fill the values
+static uint32_t next_random(uint32_t *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+// The entries of each map have the 2-byte keys {0xfc, k}, which are sorted; the requested keys are
+// spread among them.
+static int requested_key_index(const shape_t *shape, int j) {
+    return j * (shape->n_keys + shape->n_extra) / shape->n_keys;
+}
+
+/**
+ * Adds the maps of the shape to the client, and runs the command requesting the given keys, from a
+ * host with the given protocol version. Returns the status word; on success, checks the response
+ * against the values of the maps.
+ */
+static uint16_t run_shape(const shape_t *shape,
+                          const uint8_t (*requested_keys)[2],
+                          uint8_t protocol_version,
+                          sim_stats_t *stats) {
+    int n_entries = shape->n_keys + shape->n_extra;
+    uint32_t seed = shape->n_maps * 1000 + n_entries * 10 + shape->value_len;
+
+    uint8_t *all_values = malloc(shape->n_maps * n_entries * shape->value_len);
+    uint8_t *expected = malloc(shape->n_maps * shape->n_keys * shape->value_len + 1);
+    uint8_t(*keys)[2] = malloc(n_entries * sizeof(*keys));
+    const uint8_t **key_ptrs = malloc(n_entries * sizeof(*key_ptrs));
+    const uint8_t **value_ptrs = malloc(n_entries * sizeof(*value_ptrs));
+    size_t *key_lens = malloc(n_entries * sizeof(*key_lens));
+    size_t *value_lens = malloc(n_entries * sizeof(*value_lens));
+    uint8_t(*map_elements)[9 + 64] = malloc(shape->n_maps * sizeof(*map_elements));
+    const uint8_t **map_ptrs = malloc(shape->n_maps * sizeof(*map_ptrs));
+    size_t *map_lens = malloc(shape->n_maps * sizeof(*map_lens));
+
+    sim_client_reset();
+
+    size_t expected_len = 0;
+    for (int i = 0; i < shape->n_maps; i++) {
+        for (int k = 0; k < n_entries; k++) {
+            uint8_t *value = all_values + (i * n_entries + k) * shape->value_len;
+            for (int b = 0; b < shape->value_len; b++) {
+                value[b] = (uint8_t) next_random(&seed);
+            }
+            keys[k][0] = 0xfc;
+            keys[k][1] = (uint8_t) k;
+            key_ptrs[k] = keys[k];
+            key_lens[k] = 2;
+            value_ptrs[k] = value;
+            value_lens[k] = shape->value_len;
+        }
+        for (int j = 0; j < shape->n_keys; j++) {
+            memcpy(expected + expected_len,
+                   value_ptrs[requested_key_index(shape, j)],
+                   shape->value_len);
+            expected_len += shape->value_len;
+        }
+
+        uint8_t keys_root[32], values_root[32];
+        sim_client_add_known_mapping(key_ptrs,
+                                     key_lens,
+                                     value_ptrs,
+                                     value_lens,
+                                     n_entries,
+                                     keys_root,
+                                     values_root);
+
+        int size_len = varint_write(map_elements[i], 0, n_entries);
+        memcpy(map_elements[i] + size_len, keys_root, 32);
+        memcpy(map_elements[i] + size_len + 32, values_root, 32);
+        map_ptrs[i] = map_elements[i];
+        map_lens[i] = size_len + 64;
+    }
+
+    uint8_t maps_root[32];
+    sim_client_add_known_list(map_ptrs, map_lens, shape->n_maps, maps_root);
+
+    uint8_t request[255];
+    size_t request_len = 0;
+    memcpy(request, maps_root, 32);
+    request_len += 32;
+    request_len += varint_write(request, request_len, shape->n_maps);
+    request[request_len++] = (uint8_t) shape->n_keys;
+    for (int j = 0; j < shape->n_keys; j++) {
+        request[request_len++] = 2;
+        memcpy(request + request_len, requested_keys[j], 2);
+        request_len += 2;
+    }
+
+    uint8_t response[255];
+    size_t response_len;
+    uint16_t sw = sim_run_command(SIM_COMMAND_DESCRIPTORS,
+                                  N_SIM_COMMAND_DESCRIPTORS,
+                                  &G_sim_state.ctx,
+                                  sizeof(G_sim_state),
+                                  CLA_SIM,
+                                  INS_SIM_GET_MAP_VALUES,
+                                  0,
+                                  protocol_version,
+                                  request,
+                                  request_len,
+                                  response,
+                                  &response_len,
+                                  stats);
+
+    if (sw == SW_OK) {
+        uint8_t expected_digest[32];
+        cx_hash_sha256(expected, expected_len, expected_digest, 32);
+        assert_int_equal(response_len, 32);
+        assert_memory_equal(response, expected_digest, 32);
+    }
+
+    free(all_values);
+    free(expected);
+    free(keys);
+    free(key_ptrs);
+    free(value_ptrs);
+    free(key_lens);
+    free(value_lens);
+    free(map_elements);
+    free(map_ptrs);
+    free(map_lens);
+    return sw;
+}
+
+static uint16_t run_shape_with_spread_keys(const shape_t *shape,
+                                           uint8_t protocol_version,
+                                           sim_stats_t *stats) {
+    uint8_t requested_keys[SIM_MAX_KEYS][2];
+    for (int j = 0; j < shape->n_keys; j++) {
+        requested_keys[j][0] = 0xfc;
+        requested_keys[j][1] = (uint8_t) requested_key_index(shape, j);
+    }
+    return run_shape(shape, (const uint8_t(*)[2]) requested_keys, protocol_version, stats);
+}
+
+static void test_sim_sha256(void **state) {
+    (void) state;
+
+    static const uint8_t expected[32] = {
+        0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22,
+        0x23, 0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00,
+        0x15, 0xad};
+
+    uint8_t digest[32];
+    cx_hash_sha256((const uint8_t *) "abc", 3, digest, 32);
+    assert_memory_equal(digest, expected, 32);
+}
+
+static void test_sim_shapes(void **state) {
+    (void) state;
+
+    static const shape_t shapes[] = {
+        {.n_maps = 1, .n_keys = 1, .n_extra = 0, .value_len = 1},
+        {.n_maps = 2, .n_keys = 3, .n_extra = 5, .value_len = 32},
+        {.n_maps = 5, .n_keys = 2, .n_extra = 11, .value_len = 80},
+        {.n_maps = 3, .n_keys = 1, .n_extra = 2, .value_len = 300},  // uses GET_MORE_ELEMENTS
+        {.n_maps = 17, .n_keys = 4, .n_extra = 20, .value_len = 34},
+    };
+
+    for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+        sim_stats_t stats;
+        assert_int_equal(
+            run_shape_with_spread_keys(&shapes[i], CURRENT_PROTOCOL_VERSION, &stats),
+            SW_OK);
+        assert_false(stats.client_error);
+        assert_true(stats.n_interruptions > 0);
+    }
+}
+
+static void test_sim_old_host(void **state) {
+    (void) state;
+
+    // a host that does not negotiate any protocol version is not sent GET_MERKLE_LEAF_ELEMENT,
+    // GET_MERKLE_TREE_LEAVES, nor requests for truncated proofs
+    shape_t shape = {.n_maps = 5, .n_keys = 3, .n_extra = 6, .value_len = 40};
+    sim_stats_t stats;
+    assert_int_equal(run_shape_with_spread_keys(&shape, 0, &stats), SW_OK);
+    assert_false(stats.client_error);
+    assert_int_equal(stats.ccmd_counts[CCMD_GET_MERKLE_LEAF_ELEMENT], 0);
+    assert_int_equal(stats.ccmd_counts[CCMD_GET_MERKLE_TREE_LEAVES], 0);
+
+    // unknown protocol versions are rejected
+    assert_int_equal(run_shape_with_spread_keys(&shape, CURRENT_PROTOCOL_VERSION + 1, &stats),
+                     SW_WRONG_P1P2);
+}
+
+static void test_sim_missing_key(void **state) {
+    (void) state;
+
+    shape_t shape = {.n_maps = 2, .n_keys = 2, .n_extra = 3, .value_len = 10};
+    const uint8_t requested_keys[2][2] = {{0xfc, 0x00}, {0xfc, 0x42}};
+
+    // the app finds out that the key is not in the map; the client can answer all the requests
+    sim_stats_t stats;
+    assert_int_equal(run_shape(&shape, requested_keys, CURRENT_PROTOCOL_VERSION, &stats),
+                     SW_INCORRECT_DATA);
+    assert_false(stats.client_error);
+}
+
+static void test_sim_unknown_root(void **state) {
+    (void) state;
+
+    sim_client_reset();
+
+    uint8_t request[32 + 1 + 1 + 3] = {0x42};
+    request[32] = 1;       // n_maps
+    request[33] = 1;       // n_keys
+    request[34] = 2;       // key_len
+    request[35] = 0xfc;    // key
+    request[36] = 0x00;
+
+    uint8_t response[255];
+    size_t response_len;
+    sim_stats_t stats;
+    uint16_t sw = sim_run_command(SIM_COMMAND_DESCRIPTORS,
+                                  N_SIM_COMMAND_DESCRIPTORS,
+                                  &G_sim_state.ctx,
+                                  sizeof(G_sim_state),
+                                  CLA_SIM,
+                                  INS_SIM_GET_MAP_VALUES,
+                                  0,
+                                  CURRENT_PROTOCOL_VERSION,
+                                  request,
+                                  sizeof(request),
+                                  response,
+                                  &response_len,
+                                  &stats);
+    assert_int_not_equal(sw, SW_OK);
+    assert_true(stats.client_error);
+}
+
+static void bench_sim_shapes(void **state) {
+    (void) state;
+
+    uint32_t seed = 42;
+    uint64_t total_interruptions = 0, total_bytes = 0;
+    uint32_t max_interruptions = 0;
+
+    clock_t start = clock();
+    for (int it = 0; it < N_RANDOM_SHAPES; it++) {
+        shape_t shape = {
+            .n_maps = 1 + next_random(&seed) % 16,
+            .n_keys = 1 + next_random(&seed) % 4,
+            .n_extra = next_random(&seed) % 12,
+            .value_len = 1 + next_random(&seed) % (it % 10 == 0 ? SIM_MAX_VALUE_LEN : 80),
+        };
+
+        sim_stats_t stats;
+        assert_int_equal(run_shape_with_spread_keys(&shape, CURRENT_PROTOCOL_VERSION, &stats),
+                         SW_OK);
+        assert_false(stats.client_error);
+
+        total_interruptions += stats.n_interruptions;
+        total_bytes += stats.bytes_in + stats.bytes_out;
+        if (stats.n_interruptions > max_interruptions) {
+            max_interruptions = stats.n_interruptions;
+        }
+    }
+    double elapsed = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    printf("%d shapes: %.3f s, %.1f round trips per command (max %u), %.0f bytes per command\n",
+           N_RANDOM_SHAPES,
+           elapsed,
+           (double) total_interruptions / N_RANDOM_SHAPES,
+           max_interruptions,
+           (double) total_bytes / N_RANDOM_SHAPES);
+
+    // round trips per client command for a typical shape: 5 inputs with 3 requested keys
+    shape_t shape = {.n_maps = 5, .n_keys = 3, .n_extra = 6, .value_len = 40};
+    sim_stats_t stats;
+    assert_int_equal(run_shape_with_spread_keys(&shape, CURRENT_PROTOCOL_VERSION, &stats), SW_OK);
+    printf("5 maps, 3 keys each: %u round trips\n", stats.n_interruptions);
+    for (int code = 0; code < 256; code++) {
+        if (stats.ccmd_counts[code] != 0) {
+            printf("  client command 0x%02x: %u\n", code, stats.ccmd_counts[code]);
+        }
+    }
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {cmocka_unit_test(test_sim_sha256),
+                                       cmocka_unit_test(test_sim_shapes),
+                                       cmocka_unit_test(test_sim_old_host),
+                                       cmocka_unit_test(test_sim_missing_key),
+                                       cmocka_unit_test(test_sim_unknown_root),
+                                       cmocka_unit_test(bench_sim_shapes)};
+
+    int ret = cmocka_run_group_tests(tests, NULL, NULL);
+    sim_client_reset();
+    return ret;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+// Minimal replacement of the SDK header for the host simulator, with the SHA-256 functions that are
+// missing in the mock headers; they are implemented in software in sim_crypto.c.
+
+#include "os.h"
+#include "cx.h"
+
+union cx_u {
+    cx_sha256_t sha256;
+};
+
+extern union cx_u G_cx;
+
+int cx_sha256_init_no_throw(cx_sha256_t *hash);
+int cx_sha256_update(cx_sha256_t *hash, const uint8_t *in, size_t in_len);
+void cx_sha256_final(cx_sha256_t *hash, uint8_t *out);
@@ -0,0 +1,14 @@
+#pragma once
+
+// Replaces src/globals.h in the host simulator, which only links the dispatcher and the handler
+// library, and none of the UX and legacy globals.
+
+#include <stdint.h>
+
+#include "boilerplate/io.h"
+#include "constants.h"
+
+/**
+ * Global variable with the length of APDU response to send back.
+ */
+extern uint16_t G_output_len;
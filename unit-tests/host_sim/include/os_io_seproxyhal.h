@@ -0,0 +1,9 @@
+#pragma once
+
+// Minimal replacement of the SDK header for the host simulator.
+
+typedef struct {
+    unsigned short apdu_length;
+} io_seph_app_t;
+
+extern io_seph_app_t G_io_app;
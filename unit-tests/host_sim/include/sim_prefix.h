@@ -0,0 +1,10 @@
+#pragma once
+
+// Included before any other header in the host simulator. The PIC macro of the mocked os.h calls a
+// pic() that only exists on the device, through a cast to unsigned int that truncates the addresses
+// of a 64-bit host; here the code runs where it is linked, so PIC is the identity. It is defined in
+// a header rather than with target_compile_definitions, that does not pass function-like macros.
+#define PIC(x) (x)
+
+// PRINTF and the other debug macros, that the app gets from the SDK makefiles
+#include "debug-helpers/debug.h"
@@ -0,0 +1,7 @@
+#pragma once
+
+// Minimal replacement of the SDK header for the host simulator, which has no UX.
+
+typedef struct {
+    int unused;
+} bagl_element_t;
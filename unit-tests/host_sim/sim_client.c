@@ -0,0 +1,549 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "os.h"
+#include "cx.h"
+
+#include "common/buffer.h"
+#include "common/merkle.h"
+#include "common/varint.h"
+#include "handler/client_commands.h"
+
+#include "sim_client.h"
+
+typedef struct {
+    uint8_t hash[32];
+    uint8_t *data;
+    size_t len;
+} known_preimage_t;
+
+typedef struct {
+    uint8_t root[32];
+    uint8_t (*leaves)[32];
+    size_t size;
+} known_tree_t;
+
+typedef struct {
+    uint8_t key[32];
+    uint8_t record[255];
+    uint8_t len;
+} record_t;
+
+static struct {
+    uint8_t protocol_version;  // the client commands of later versions are not implemented
+
+    known_preimage_t *preimages;
+    size_t n_preimages;
+    known_tree_t *trees;
+    size_t n_trees;
+    record_t *records;
+    size_t n_records;
+
+    // queue of the elements returned with GET_MORE_ELEMENTS, all of the same length
+    uint8_t *queue;
+    size_t queue_len;     // total bytes in the queue, including the ones already returned
+    size_t queue_offset;  // position of the first element that was not returned yet
+    size_t queue_element_len;
+
+    uint8_t *yielded[SIM_CLIENT_MAX_YIELDED];
+    size_t yielded_lens[SIM_CLIENT_MAX_YIELDED];
+    size_t n_yielded;
+} G_sim_client;
+
+static void *checked_realloc(void *ptr, size_t size) {
+    void *result = realloc(ptr, size);
+    if (result == NULL) {
+        abort();
+    }
+    return result;
+}
+
+void sim_client_reset(void) {
+    for (size_t i = 0; i < G_sim_client.n_preimages; i++) {
+        free(G_sim_client.preimages[i].data);
+    }
+    for (size_t i = 0; i < G_sim_client.n_trees; i++) {
+        free(G_sim_client.trees[i].leaves);
+    }
+    for (size_t i = 0; i < G_sim_client.n_yielded; i++) {
+        free(G_sim_client.yielded[i]);
+    }
+    free(G_sim_client.preimages);
+    free(G_sim_client.trees);
+    free(G_sim_client.records);
+    free(G_sim_client.queue);
+    memset(&G_sim_client, 0, sizeof(G_sim_client));
+}
+
+void sim_client_set_protocol_version(uint8_t protocol_version) {
+    G_sim_client.protocol_version = protocol_version;
+}
+
+void sim_client_add_known_preimage(const uint8_t *preimage, size_t preimage_len) {
+    G_sim_client.preimages =
+        checked_realloc(G_sim_client.preimages,
+                        (G_sim_client.n_preimages + 1) * sizeof(known_preimage_t));
+
+    known_preimage_t *entry = &G_sim_client.preimages[G_sim_client.n_preimages++];
+    cx_hash_sha256(preimage, preimage_len, entry->hash, 32);
+    entry->data = checked_realloc(NULL, preimage_len > 0 ? preimage_len : 1);
+    memcpy(entry->data, preimage, preimage_len);
+    entry->len = preimage_len;
+}
+
+static const known_preimage_t *find_preimage(const uint8_t hash[static 32]) {
+    for (size_t i = 0; i < G_sim_client.n_preimages; i++) {
+        if (memcmp(G_sim_client.preimages[i].hash, hash, 32) == 0) {
+            return &G_sim_client.preimages[i];
+        }
+    }
+    return NULL;
+}
+
+static const known_tree_t *find_tree(const uint8_t root[static 32]) {
+    for (size_t i = 0; i < G_sim_client.n_trees; i++) {
+        if (memcmp(G_sim_client.trees[i].root, root, 32) == 0) {
+            return &G_sim_client.trees[i];
+        }
+    }
+    return NULL;
+}
+
+// largest power of 2 strictly smaller than size, for size > 1
+static size_t left_subtree_size(size_t size) {
+    size_t result = 1;
+    while (2 * result < size) {
+        result *= 2;
+    }
+    return result;
+}
+
+static void subtree_hash(const uint8_t (*leaves)[32], size_t size, uint8_t out[static 32]) {
+    if (size == 1) {
+        memcpy(out, leaves[0], 32);
+        return;
+    }
+    size_t left_size = left_subtree_size(size);
+    uint8_t left[32], right[32];
+    subtree_hash(leaves, left_size, left);
+    subtree_hash(leaves + left_size, size - left_size, right);
+    merkle_combine_hashes(left, right, out);
+}
+
+// Computes the Merkle proof of a leaf, starting from the sibling of the leaf; returns its length
+static size_t get_proof(const uint8_t (*leaves)[32],
+                        size_t size,
+                        size_t index,
+                        uint8_t proof[static MAX_MERKLE_TREE_DEPTH][32]) {
+    if (size == 1) {
+        return 0;
+    }
+    size_t left_size = left_subtree_size(size);
+    size_t proof_len;
+    if (index < left_size) {
+        proof_len = get_proof(leaves, left_size, index, proof);
+        subtree_hash(leaves + left_size, size - left_size, proof[proof_len]);
+    } else {
+        proof_len = get_proof(leaves + left_size, size - left_size, index - left_size, proof);
+        subtree_hash(leaves, left_size, proof[proof_len]);
+    }
+    return proof_len + 1;
+}
+
+void sim_client_add_known_list(const uint8_t *const elements[],
+                               const size_t element_lens[],
+                               size_t n_elements,
+                               uint8_t root[static 32]) {
+    G_sim_client.trees =
+        checked_realloc(G_sim_client.trees, (G_sim_client.n_trees + 1) * sizeof(known_tree_t));
+
+    known_tree_t *tree = &G_sim_client.trees[G_sim_client.n_trees++];
+    tree->leaves = checked_realloc(NULL, (n_elements > 0 ? n_elements : 1) * 32);
+    tree->size = n_elements;
+
+    for (size_t i = 0; i < n_elements; i++) {
+        uint8_t *prefixed = checked_realloc(NULL, 1 + element_lens[i]);
+        prefixed[0] = 0x00;
+        memcpy(prefixed + 1, elements[i], element_lens[i]);
+        sim_client_add_known_preimage(prefixed, 1 + element_lens[i]);
+        free(prefixed);
+
+        merkle_compute_element_hash(elements[i], element_lens[i], tree->leaves[i]);
+    }
+
+    if (n_elements == 0) {
+        memset(tree->root, 0, 32);
+    } else {
+        subtree_hash((const uint8_t(*)[32]) tree->leaves, n_elements, tree->root);
+    }
+    memcpy(root, tree->root, 32);
+}
+
+void sim_client_add_known_mapping(const uint8_t *const keys[],
+                                  const size_t key_lens[],
+                                  const uint8_t *const values[],
+                                  const size_t value_lens[],
+                                  size_t n_entries,
+                                  uint8_t keys_root[static 32],
+                                  uint8_t values_root[static 32]) {
+    sim_client_add_known_list(keys, key_lens, n_entries, keys_root);
+    sim_client_add_known_list(values, value_lens, n_entries, values_root);
+}
+
+static void queue_extend(const uint8_t *data, size_t len, size_t element_len) {
+    G_sim_client.queue = checked_realloc(G_sim_client.queue, G_sim_client.queue_len + len);
+    memcpy(G_sim_client.queue + G_sim_client.queue_len, data, len);
+    G_sim_client.queue_len += len;
+    G_sim_client.queue_element_len = element_len;
+}
+
+static size_t queue_n_elements(void) {
+    if (G_sim_client.queue_element_len == 0) {
+        return 0;
+    }
+    return (G_sim_client.queue_len - G_sim_client.queue_offset) / G_sim_client.queue_element_len;
+}
+
+// Writes the leaf hash and the proof (or its beginning) as in the response to
+// GET_MERKLE_LEAF_PROOF, queueing the rest of the proof
+static int write_proof_response(const uint8_t leaf_hash[static 32],
+                                uint8_t proof[][32],
+                                size_t proof_len,
+                                uint8_t response[static 255]) {
+    size_t n_response_elements = (255 - 32 - 1 - 1) / 32;
+    if (n_response_elements > proof_len) {
+        n_response_elements = proof_len;
+    }
+
+    memcpy(response, leaf_hash, 32);
+    response[32] = (uint8_t) proof_len;
+    response[33] = (uint8_t) n_response_elements;
+    memcpy(response + 34, proof, 32 * n_response_elements);
+
+    if (n_response_elements < proof_len) {
+        queue_extend(proof[n_response_elements], 32 * (proof_len - n_response_elements), 32);
+    }
+    return 34 + 32 * n_response_elements;
+}
+
+// Parses <merkle_root : 32> <tree_size : varint> <leaf_index : varint> [<proof_size : 1>], and
+// computes the requested proof
+static const known_tree_t *read_proof_request(buffer_t *req,
+                                              size_t *leaf_index,
+                                              uint8_t proof[static MAX_MERKLE_TREE_DEPTH][32],
+                                              size_t *proof_len) {
+    uint8_t root[32];
+    uint64_t tree_size, index;
+    if (!buffer_read_bytes(req, root, 32) || !buffer_read_varint(req, &tree_size) ||
+        !buffer_read_varint(req, &index)) {
+        return NULL;
+    }
+
+    const known_tree_t *tree = find_tree(root);
+    if (tree == NULL || index >= tree_size || tree->size != tree_size) {
+        return NULL;
+    }
+
+    *leaf_index = index;
+    *proof_len = get_proof((const uint8_t(*)[32]) tree->leaves, tree->size, index, proof);
+
+    uint8_t requested_len;
+    if (G_sim_client.protocol_version >= 1 && buffer_read_u8(req, &requested_len)) {
+        if (requested_len > *proof_len) {
+            return NULL;
+        }
+        *proof_len = requested_len;
+    }
+
+    if (buffer_can_read(req, 1) || queue_n_elements() != 0) {
+        return NULL;
+    }
+    return tree;
+}
+
+// Writes <preimage_len : varint> <payload_len : 1> <payload>, with as much of the preimage as fits
+// in max_len bytes; the rest is queued as 1-byte elements. Returns the length written, or -1.
+static int write_preimage_response(const known_preimage_t *preimage,
+                                   uint8_t *out,
+                                   int max_len) {
+    uint8_t preimage_len_out[9];
+    int preimage_len_len = varint_write(preimage_len_out, 0, preimage->len);
+
+    int max_payload_size = max_len - preimage_len_len - 1;
+    if (max_payload_size <= 0) {
+        return -1;
+    }
+    size_t payload_size =
+        preimage->len < (size_t) max_payload_size ? preimage->len : (size_t) max_payload_size;
+
+    memcpy(out, preimage_len_out, preimage_len_len);
+    out[preimage_len_len] = (uint8_t) payload_size;
+    memcpy(out + preimage_len_len + 1, preimage->data, payload_size);
+
+    if (payload_size < preimage->len) {
+        queue_extend(preimage->data + payload_size, preimage->len - payload_size, 1);
+    }
+    return preimage_len_len + 1 + payload_size;
+}
+
+static int execute_get_preimage(buffer_t *req, uint8_t response[static 255]) {
+    uint8_t hash_type;
+    uint8_t hash[32];
+    if (!buffer_read_u8(req, &hash_type) || hash_type != 0 || !buffer_read_bytes(req, hash, 32) ||
+        buffer_can_read(req, 1)) {
+        return -1;
+    }
+
+    const known_preimage_t *preimage = find_preimage(hash);
+    if (preimage == NULL) {
+        return -1;
+    }
+    return write_preimage_response(preimage, response, 255);
+}
+
+static int execute_get_merkle_leaf_proof(buffer_t *req, uint8_t response[static 255]) {
+    size_t leaf_index, proof_len;
+    uint8_t proof[MAX_MERKLE_TREE_DEPTH][32];
+    const known_tree_t *tree = read_proof_request(req, &leaf_index, proof, &proof_len);
+    if (tree == NULL) {
+        return -1;
+    }
+    return write_proof_response(tree->leaves[leaf_index], proof, proof_len, response);
+}
+
+static int execute_get_merkle_leaf_index(buffer_t *req, uint8_t response[static 255]) {
+    uint8_t root[32], leaf_hash[32];
+    if (!buffer_read_bytes(req, root, 32) || !buffer_read_bytes(req, leaf_hash, 32) ||
+        buffer_can_read(req, 1)) {
+        return -1;
+    }
+
+    const known_tree_t *tree = find_tree(root);
+    if (tree == NULL) {
+        return -1;
+    }
+
+    size_t leaf_index = 0;
+    uint8_t found = 0;
+    for (size_t i = 0; i < tree->size; i++) {
+        if (memcmp(tree->leaves[i], leaf_hash, 32) == 0) {
+            leaf_index = i;
+            found = 1;
+            break;
+        }
+    }
+
+    response[0] = found;
+    return 1 + varint_write(response, 1, leaf_index);
+}
+
+static int execute_get_merkle_tree_leaves(buffer_t *req, uint8_t response[static 255]) {
+    uint8_t root[32];
+    uint64_t tree_size, start_index;
+    if (!buffer_read_bytes(req, root, 32) || !buffer_read_varint(req, &tree_size) ||
+        !buffer_read_varint(req, &start_index) || buffer_can_read(req, 1)) {
+        return -1;
+    }
+
+    const known_tree_t *tree = find_tree(root);
+    if (tree == NULL || start_index >= tree_size || tree->size != tree_size) {
+        return -1;
+    }
+
+    // as many consecutive leaves as fit in the response, each prefixed by its length
+    size_t response_len = 1;
+    uint8_t n_leaves = 0;
+    for (size_t i = start_index; i < tree->size; i++) {
+        const known_preimage_t *preimage = find_preimage(tree->leaves[i]);
+        if (preimage == NULL) {
+            return -1;
+        }
+        size_t leaf_len = preimage->len - 1;  // without the 0x00 prefix
+        if (response_len + 1 + leaf_len > 255) {
+            break;
+        }
+        response[response_len] = (uint8_t) leaf_len;
+        memcpy(response + response_len + 1, preimage->data + 1, leaf_len);
+        response_len += 1 + leaf_len;
+        ++n_leaves;
+    }
+
+    if (n_leaves == 0) {
+        return -1;  // the leaf is too long to fit in a single response
+    }
+    response[0] = n_leaves;
+    return response_len;
+}
+
+static int execute_get_merkle_leaf_element(buffer_t *req, uint8_t response[static 255]) {
+    size_t leaf_index, proof_len;
+    uint8_t proof[MAX_MERKLE_TREE_DEPTH][32];
+    const known_tree_t *tree = read_proof_request(req, &leaf_index, proof, &proof_len);
+    if (tree == NULL) {
+        return -1;
+    }
+
+    const uint8_t *leaf_hash = tree->leaves[leaf_index];
+    const known_preimage_t *preimage = find_preimage(leaf_hash);
+    if (preimage == NULL) {
+        return -1;
+    }
+
+    int proof_response_len = 32 + 1 + 1 + 32 * proof_len;
+    if (proof_response_len < 255) {
+        int preimage_response_len = write_preimage_response(preimage,
+                                                            response + proof_response_len,
+                                                            255 - proof_response_len);
+        if (preimage_response_len > 0) {
+            memcpy(response, leaf_hash, 32);
+            response[32] = (uint8_t) proof_len;
+            response[33] = (uint8_t) proof_len;
+            memcpy(response + 34, proof, 32 * proof_len);
+            return proof_response_len + preimage_response_len;
+        }
+    }
+
+    // The proof is too long: the response is the same as for GET_MERKLE_LEAF_PROOF, and the app
+    // asks for the preimage with GET_PREIMAGE.
+    return write_proof_response(leaf_hash, proof, proof_len, response);
+}
+
+static int execute_store_record(buffer_t *req) {
+    uint8_t key[32];
+    uint8_t record_len;
+    uint8_t record[255];
+    if (!buffer_read_bytes(req, key, 32) || !buffer_read_u8(req, &record_len) ||
+        !buffer_read_bytes(req, record, record_len) || buffer_can_read(req, 1)) {
+        return -1;
+    }
+
+    record_t *entry = NULL;
+    for (size_t i = 0; i < G_sim_client.n_records; i++) {
+        if (memcmp(G_sim_client.records[i].key, key, 32) == 0) {
+            entry = &G_sim_client.records[i];
+        }
+    }
+    if (entry == NULL) {
+        G_sim_client.records =
+            checked_realloc(G_sim_client.records, (G_sim_client.n_records + 1) * sizeof(record_t));
+        entry = &G_sim_client.records[G_sim_client.n_records++];
+        memcpy(entry->key, key, 32);
+    }
+    memcpy(entry->record, record, record_len);
+    entry->len = record_len;
+    return 0;
+}
+
+static int execute_get_record(buffer_t *req, uint8_t response[static 255]) {
+    uint8_t key[32];
+    if (!buffer_read_bytes(req, key, 32) || buffer_can_read(req, 1)) {
+        return -1;
+    }
+
+    // an unknown record is not an error: the app falls back to the original data
+    response[0] = 0;
+    for (size_t i = 0; i < G_sim_client.n_records; i++) {
+        if (memcmp(G_sim_client.records[i].key, key, 32) == 0) {
+            response[0] = G_sim_client.records[i].len;
+            memcpy(response + 1, G_sim_client.records[i].record, response[0]);
+        }
+    }
+    return 1 + response[0];
+}
+
+static int execute_get_more_elements(buffer_t *req, uint8_t response[static 255]) {
+    size_t n_elements = queue_n_elements();
+    if (buffer_can_read(req, 1) || n_elements == 0) {
+        return -1;
+    }
+
+    size_t element_len = G_sim_client.queue_element_len;
+    size_t n_response_elements = GET_MORE_ELEMENTS_MAX_PAYLOAD / element_len;
+    if (n_response_elements > n_elements) {
+        n_response_elements = n_elements;
+    }
+
+    response[0] = (uint8_t) n_response_elements;
+    response[1] = (uint8_t) element_len;
+    memcpy(response + 2,
+           G_sim_client.queue + G_sim_client.queue_offset,
+           n_response_elements * element_len);
+    G_sim_client.queue_offset += n_response_elements * element_len;
+
+    if (G_sim_client.queue_offset == G_sim_client.queue_len) {
+        G_sim_client.queue_len = 0;
+        G_sim_client.queue_offset = 0;
+        G_sim_client.queue_element_len = 0;
+    }
+    return 2 + n_response_elements * element_len;
+}
+
+static int execute_yield(buffer_t *req) {
+    if (G_sim_client.n_yielded == SIM_CLIENT_MAX_YIELDED) {
+        return -1;
+    }
+
+    size_t len = req->size - req->offset;
+    uint8_t *value = checked_realloc(NULL, len > 0 ? len : 1);
+    memcpy(value, req->ptr + req->offset, len);
+
+    G_sim_client.yielded[G_sim_client.n_yielded] = value;
+    G_sim_client.yielded_lens[G_sim_client.n_yielded] = len;
+    ++G_sim_client.n_yielded;
+    return 0;
+}
+
+int sim_client_execute(const uint8_t *request, size_t request_len, uint8_t response[static 255]) {
+    if (request_len == 0) {
+        return -1;
+    }
+
+    buffer_t req = buffer_create((void *) (request + 1), request_len - 1);
+
+    switch (request[0]) {
+        case CCMD_YIELD:
+            return execute_yield(&req);
+        case CCMD_GET_PREIMAGE:
+            return execute_get_preimage(&req, response);
+        case CCMD_GET_MERKLE_LEAF_PROOF:
+            return execute_get_merkle_leaf_proof(&req, response);
+        case CCMD_GET_MERKLE_LEAF_INDEX:
+            return execute_get_merkle_leaf_index(&req, response);
+        case CCMD_GET_MERKLE_TREE_LEAVES:
+            if (G_sim_client.protocol_version < 1) {
+                return -1;
+            }
+            return execute_get_merkle_tree_leaves(&req, response);
+        case CCMD_GET_MERKLE_LEAF_ELEMENT:
+            if (G_sim_client.protocol_version < 1) {
+                return -1;
+            }
+            return execute_get_merkle_leaf_element(&req, response);
+        case CCMD_STORE_RECORD:
+        case CCMD_GET_RECORD:
+            if (G_sim_client.protocol_version < 1) {
+                return -1;
+            }
+            return request[0] == CCMD_STORE_RECORD ? execute_store_record(&req)
+                                                   : execute_get_record(&req, response);
+        case CCMD_GET_MORE_ELEMENTS:
+            return execute_get_more_elements(&req, response);
+        default:
+            return -1;
+    }
+}
+
+size_t sim_client_n_yielded(void) {
+    return G_sim_client.n_yielded;
+}
+
+const uint8_t *sim_client_get_yielded(size_t i, size_t *len) {
+    if (i >= G_sim_client.n_yielded) {
+        return NULL;
+    }
+    *len = G_sim_client.yielded_lens[i];
+    return G_sim_client.yielded[i];
+}
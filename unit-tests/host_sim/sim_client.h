@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  C port of the ClientCommandInterpreter of the Python client (bitcoin_client/ledger_bitcoin/
+  client_command.py), answering the client commands of the app in process for the host simulator.
+
+  The interpreter knows a set of preimages and Merkle trees, and stores the yielded values and the
+  records sent by the app. Its state is global, and reset with sim_client_reset.
+*/
+
+// Maximum number of values that can be yielded during a command
+#define SIM_CLIENT_MAX_YIELDED 64
+
+/**
+ * Forgets all the known preimages, trees, records and yielded values.
+ */
+void sim_client_reset(void);
+
+/**
+ * Sets the version of the protocol of the client: with version 0, the client commands introduced
+ * later, and the length of the requested proof in GET_MERKLE_LEAF_PROOF, are rejected like an old
+ * host would. The version is 0 after a reset.
+ */
+void sim_client_set_protocol_version(uint8_t protocol_version);
+
+/**
+ * Adds a preimage, that the client returns for a GET_PREIMAGE request with its SHA-256 hash.
+ */
+void sim_client_add_known_preimage(const uint8_t *preimage, size_t preimage_len);
+
+/**
+ * Adds the Merkle tree of a list of elements, and all the elements (prefixed with 0x00) as known
+ * preimages.
+ *
+ * @param[in] elements
+ *   The elements of the list.
+ * @param[in] element_lens
+ *   The length of each element.
+ * @param[in] n_elements
+ *   The number of elements.
+ * @param[out] root
+ *   The Merkle root of the list.
+ */
+void sim_client_add_known_list(const uint8_t *const elements[],
+                               const size_t element_lens[],
+                               size_t n_elements,
+                               uint8_t root[static 32]);
+
+/**
+ * Adds the Merkle trees of the keys and of the values of a mapping, whose keys must be sorted in
+ * increasing lexicographic order, as for a merkleized PSBT map.
+ *
+ * @param[out] keys_root
+ *   The Merkle root of the list of keys.
+ * @param[out] values_root
+ *   The Merkle root of the list of values.
+ */
+void sim_client_add_known_mapping(const uint8_t *const keys[],
+                                  const size_t key_lens[],
+                                  const uint8_t *const values[],
+                                  const size_t value_lens[],
+                                  size_t n_entries,
+                                  uint8_t keys_root[static 32],
+                                  uint8_t values_root[static 32]);
+
+/**
+ * Executes a client command, as the data of a response with SW_INTERRUPTED_EXECUTION.
+ *
+ * @param[in] request
+ *   The client command, starting with the command code.
+ * @param[in] request_len
+ *   The length of the request.
+ * @param[out] response
+ *   The response, of at most 255 bytes, to send with INS_CONTINUE.
+ *
+ * @return the length of the response, or -1 if the request is invalid or cannot be answered.
+ */
+int sim_client_execute(const uint8_t *request, size_t request_len, uint8_t response[static 255]);
+
+/**
+ * Returns the number of values yielded since the last reset.
+ */
+size_t sim_client_n_yielded(void);
+
+/**
+ * Returns the i-th yielded value, and its length in *len.
+ */
+const uint8_t *sim_client_get_yielded(size_t i, size_t *len);
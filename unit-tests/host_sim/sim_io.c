@@ -0,0 +1,204 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "os.h"
+#include "os_io_seproxyhal.h"
+
+#include "boilerplate/apdu_parser.h"
+#include "boilerplate/constants.h"
+#include "boilerplate/dispatcher.h"
+#include "boilerplate/io.h"
+#include "boilerplate/sw.h"
+#include "common/write.h"
+
+#include "sim_client.h"
+#include "sim_io.h"
+
+unsigned char G_io_apdu_buffer[IO_APDU_BUFFER_SIZE];
+io_seph_app_t G_io_app;
+
+uint16_t G_output_len = 0;
+uint16_t G_ticks;
+
+bool G_was_processing_screen_shown;
+
+dispatcher_context_t G_dispatcher_context;
+
+static struct {
+    sim_stats_t stats;
+
+    bool has_final_response;
+    uint8_t final_response[IO_APDU_BUFFER_SIZE];
+    size_t final_response_len;
+} G_sim_io;
+
+// There is no ticker event in the simulator, so the timeouts never expire
+
+void io_start_interruption_timeout() {
+}
+
+void io_clear_interruption_timeout() {
+}
+
+void io_start_processing_timeout() {
+}
+
+void io_clear_processing_timeout() {
+}
+
+void io_reset_timeouts() {
+    G_was_processing_screen_shown = false;
+}
+
+void io_add_to_response(const void *rdata, size_t rdata_len) {
+    if (G_output_len + rdata_len > IO_APDU_BUFFER_SIZE - 2) {
+        G_output_len = IO_APDU_BUFFER_SIZE;
+        write_u16_be(G_io_apdu_buffer, IO_APDU_BUFFER_SIZE - 2, SW_WRONG_RESPONSE_LENGTH);
+    } else {
+        memmove(G_io_apdu_buffer + G_output_len, rdata, rdata_len);
+        G_output_len += rdata_len;
+    }
+}
+
+void io_finalize_response(uint16_t sw) {
+    if (G_output_len >= IO_APDU_BUFFER_SIZE - 2) {
+        G_output_len = IO_APDU_BUFFER_SIZE;
+        write_u16_be(G_io_apdu_buffer, IO_APDU_BUFFER_SIZE - 2, SW_WRONG_RESPONSE_LENGTH);
+    } else {
+        write_u16_be(G_io_apdu_buffer, G_output_len, sw);
+        G_output_len += 2;
+    }
+}
+
+void io_reset_response() {
+    G_output_len = 0;
+}
+
+void io_set_response(const void *rdata, size_t rdata_len, uint16_t sw) {
+    io_reset_response();
+    if (rdata != NULL) {
+        io_add_to_response(rdata, rdata_len);
+    }
+    io_finalize_response(sw);
+}
+
+int io_confirm_response() {
+    int ret = io_exchange(CHANNEL_APDU | IO_RETURN_AFTER_TX, G_output_len);
+    G_output_len = 0;
+    return ret;
+}
+
+int io_send_response(void *rdata, size_t rdata_len, uint16_t sw) {
+    io_set_response(rdata, rdata_len, sw);
+    return io_confirm_response();
+}
+
+int io_send_sw(uint16_t sw) {
+    return io_send_response(NULL, 0, sw);
+}
+
+// Answers the client command in G_io_apdu_buffer, writing the INS_CONTINUE APDU in its place.
+// Returns the length of the APDU.
+static unsigned short answer_client_command(unsigned short tx_len) {
+    uint8_t response[255];
+    int response_len = -1;
+
+    // only responses with SW_INTERRUPTED_EXECUTION contain a client command
+    if (tx_len > 2 &&
+        G_io_apdu_buffer[tx_len - 2] == (uint8_t) (SW_INTERRUPTED_EXECUTION >> 8) &&
+        G_io_apdu_buffer[tx_len - 1] == (uint8_t) (SW_INTERRUPTED_EXECUTION & 0xFF)) {
+        ++G_sim_io.stats.n_interruptions;
+        ++G_sim_io.stats.ccmd_counts[G_io_apdu_buffer[0]];
+
+        response_len = sim_client_execute(G_io_apdu_buffer, tx_len - 2, response);
+    }
+
+    if (response_len < 0) {
+        // the dispatcher rejects any APDU other than INS_CONTINUE, ending the command
+        G_sim_io.stats.client_error = true;
+        memset(G_io_apdu_buffer, 0, 5);
+        return 5;
+    }
+
+    G_io_apdu_buffer[0] = CLA_FRAMEWORK;
+    G_io_apdu_buffer[1] = INS_CONTINUE;
+    G_io_apdu_buffer[2] = 0;
+    G_io_apdu_buffer[3] = 0;
+    G_io_apdu_buffer[4] = (uint8_t) response_len;
+    memcpy(G_io_apdu_buffer + 5, response, response_len);
+    G_sim_io.stats.bytes_in += 5 + response_len;
+    return 5 + response_len;
+}
+
+unsigned short io_exchange(unsigned char channel_and_flags, unsigned short tx_len) {
+    G_sim_io.stats.bytes_out += tx_len;
+
+    if (channel_and_flags & IO_RETURN_AFTER_TX) {
+        // final response of the command; only the last one is kept
+        memcpy(G_sim_io.final_response, G_io_apdu_buffer, tx_len);
+        G_sim_io.final_response_len = tx_len;
+        G_sim_io.has_final_response = true;
+        return 0;
+    }
+
+    return answer_client_command(tx_len);
+}
+
+uint16_t sim_run_command(const command_descriptor_t descriptors[],
+                         int n_descriptors,
+                         machine_context_t *top_context,
+                         size_t top_context_size,
+                         uint8_t cla,
+                         uint8_t ins,
+                         uint8_t p1,
+                         uint8_t p2,
+                         const uint8_t *data,
+                         size_t data_len,
+                         uint8_t response[static 255],
+                         size_t *response_len,
+                         sim_stats_t *stats) {
+    memset(&G_sim_io, 0, sizeof(G_sim_io));
+    G_output_len = 0;
+
+    // the client implements the protocol version that it announces in P2
+    sim_client_set_protocol_version(p2);
+
+    G_io_apdu_buffer[0] = cla;
+    G_io_apdu_buffer[1] = ins;
+    G_io_apdu_buffer[2] = p1;
+    G_io_apdu_buffer[3] = p2;
+    G_io_apdu_buffer[4] = (uint8_t) data_len;
+    memcpy(G_io_apdu_buffer + 5, data, data_len);
+    G_sim_io.stats.bytes_in = 5 + data_len;
+
+    command_t cmd;
+    uint16_t sw;
+    if (!apdu_parser(&cmd, G_io_apdu_buffer, 5 + data_len)) {
+        sw = SW_WRONG_DATA_LENGTH;
+        *response_len = 0;
+    } else {
+        apdu_dispatcher(descriptors,
+                        n_descriptors,
+                        top_context,
+                        top_context_size,
+                        NULL,
+                        NULL,
+                        &cmd);
+
+        if (!G_sim_io.has_final_response || G_sim_io.final_response_len < 2) {
+            sw = SW_BAD_STATE;
+            *response_len = 0;
+        } else {
+            size_t len = G_sim_io.final_response_len - 2;
+            sw = (uint16_t) (G_sim_io.final_response[len] << 8 | G_sim_io.final_response[len + 1]);
+            *response_len = len < 255 ? len : 255;
+            memcpy(response, G_sim_io.final_response, *response_len);
+        }
+    }
+
+    if (stats != NULL) {
+        *stats = G_sim_io.stats;
+    }
+    return sw;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "boilerplate/dispatcher.h"
+
+/*
+  In-process replacement of the SDK io layer for the host simulator: the responses with
+  SW_INTERRUPTED_EXECUTION are answered by the C client interpreter (sim_client.h) and sent back to
+  the dispatcher as INS_CONTINUE APDUs, without any transport.
+*/
+
+typedef struct {
+    uint32_t n_interruptions;   // number of client commands sent by the app
+    uint32_t ccmd_counts[256];  // number of interruptions per client command code
+    uint32_t bytes_in;          // bytes of APDUs received by the app, including INS_CONTINUE
+    uint32_t bytes_out;         // bytes of the responses sent by the app, including status words
+    bool client_error;          // the client interpreter could not answer a client command
+} sim_stats_t;
+
+/**
+ * Runs a command through the real apdu_dispatcher until its final response, answering all the
+ * client commands in process.
+ *
+ * @param[in] descriptors
+ *   Array of command descriptors, as for apdu_dispatcher.
+ * @param[in] n_descriptors
+ *   Length of the descriptors array.
+ * @param[in] top_context
+ *   Context of the command, as for apdu_dispatcher.
+ * @param[in] top_context_size
+ *   Size of the context.
+ * @param[in] cla, ins, p1, p2
+ *   Header of the APDU. The client interpreter answers as a host of the protocol version p2.
+ * @param[in] data
+ *   Command data of the APDU.
+ * @param[in] data_len
+ *   Length of the command data, at most 255.
+ * @param[out] response
+ *   The data of the final response, without the status word.
+ * @param[out] response_len
+ *   Length of the response data.
+ * @param[out] stats
+ *   The round trip statistics of the command; can be NULL.
+ *
+ * @return the status word of the final response.
+ */
+uint16_t sim_run_command(const command_descriptor_t descriptors[],
+                         int n_descriptors,
+                         machine_context_t *top_context,
+                         size_t top_context_size,
+                         uint8_t cla,
+                         uint8_t ins,
+                         uint8_t p1,
+                         uint8_t p2,
+                         const uint8_t *data,
+                         size_t data_len,
+                         uint8_t response[static 255],
+                         size_t *response_len,
+                         sim_stats_t *stats);
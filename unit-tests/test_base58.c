@@ -27,8 +27,53 @@ static void test_base58(void **state) {
     assert_string_equal((char *) out2, expected_out2);
 }
 
+static void test_base58_implementations(void **state) {
+    (void) state;
+
+    // leading zeros, all zeros, and a full-size input
+    uint8_t in[MAX_ENC_INPUT_SIZE];
+    for (size_t i = 0; i < sizeof(in); i++) {
+        in[i] = i < 3 ? 0 : (uint8_t) (i * 97 + 13);
+    }
+
+    const size_t lengths[] = {0, 1, 2, 3, 4, 5, 21, 25, 82, MAX_ENC_INPUT_SIZE};
+    for (size_t k = 0; k < sizeof(lengths) / sizeof(lengths[0]); k++) {
+        char out_bytewise[200], out_limbs[200];
+        int len_bytewise =
+            base58_encode_bytewise(in, lengths[k], out_bytewise, sizeof(out_bytewise));
+        int len_limbs = base58_encode_limbs(in, lengths[k], out_limbs, sizeof(out_limbs));
+        assert_int_equal(len_bytewise, len_limbs);
+        assert_memory_equal(out_bytewise, out_limbs, len_limbs);
+
+        // output buffer one byte too short
+        if (len_limbs > 0) {
+            assert_int_equal(base58_encode_limbs(in, lengths[k], out_limbs, len_limbs - 1), -1);
+        }
+
+        if (len_limbs >= 2) {
+            uint8_t dec_bytewise[200], dec_limbs[200];
+            int dec_len_bytewise =
+                base58_decode_bytewise(out_limbs, len_limbs, dec_bytewise, sizeof(dec_bytewise));
+            int dec_len_limbs =
+                base58_decode_limbs(out_limbs, len_limbs, dec_limbs, sizeof(dec_limbs));
+            assert_int_equal(dec_len_bytewise, lengths[k]);
+            assert_int_equal(dec_len_limbs, lengths[k]);
+            assert_memory_equal(dec_limbs, in, lengths[k]);
+        }
+    }
+
+    // invalid characters
+    uint8_t out[100];
+    assert_int_equal(base58_decode_limbs("1I", 2, out, sizeof(out)), -1);
+    assert_int_equal(base58_decode_limbs("z0", 2, out, sizeof(out)), -1);
+    assert_int_equal(base58_decode_limbs("ab c", 4, out, sizeof(out)), -1);
+    // too short
+    assert_int_equal(base58_decode_limbs("z", 1, out, sizeof(out)), -1);
+}
+
 int main() {
-    const struct CMUnitTest tests[] = {cmocka_unit_test(test_base58)};
+    const struct CMUnitTest tests[] = {cmocka_unit_test(test_base58),
+                                       cmocka_unit_test(test_base58_implementations)};
 
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
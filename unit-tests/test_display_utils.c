@@ -42,8 +42,26 @@ static void test_format_sats_amount(void **state) {
     }
 }
 
+static void test_format_asset_amount(void **state) {
+    (void) state;
+
+    char out[MAX_ASSET_AMOUNT_LENGTH + 1] = {0};
+
+    // the asset name is not zero-terminated
+    format_asset_amount((const uint8_t *) "TSTX", 3, 150000000LLU, out);
+    assert_string_equal(out, "TST 1.5");
+
+    const char name[] = "ASSET/SUB_ASSET#UNIQUE_TAG_1234";  // longest asset name
+    format_asset_amount((const uint8_t *) name,
+                        MAX_ASSET_NAME_LENGTH,
+                        18446744073709551615LLU,
+                        out);
+    assert_string_equal(out, "ASSET/SUB_ASSET#UNIQUE_TAG_1234 184467440737.09551615");
+}
+
 int main() {
-    const struct CMUnitTest tests[] = {cmocka_unit_test(test_format_sats_amount)};
+    const struct CMUnitTest tests[] = {cmocka_unit_test(test_format_sats_amount),
+                                       cmocka_unit_test(test_format_asset_amount)};
 
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
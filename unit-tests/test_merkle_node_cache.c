@@ -0,0 +1,125 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <cmocka.h>
+
+#include "common/merkle_node_cache.h"
+
+static const uint8_t root_a[32] = {0xaa};
+static const uint8_t root_b[32] = {0xbb};
+
+static void test_merkle_get_subtree(void **state) {
+    (void) state;
+
+    uint32_t start, size;
+
+    assert_true(merkle_get_subtree(5, 3, 0, &start, &size));
+    assert_int_equal(start, 0);
+    assert_int_equal(size, 5);
+
+    assert_true(merkle_get_subtree(5, 3, 1, &start, &size));
+    assert_int_equal(start, 0);
+    assert_int_equal(size, 4);
+
+    assert_true(merkle_get_subtree(5, 3, 2, &start, &size));
+    assert_int_equal(start, 2);
+    assert_int_equal(size, 2);
+
+    assert_true(merkle_get_subtree(5, 3, 3, &start, &size));
+    assert_int_equal(start, 3);
+    assert_int_equal(size, 1);
+
+    assert_true(merkle_get_subtree(5, 4, 1, &start, &size));
+    assert_int_equal(start, 4);
+    assert_int_equal(size, 1);
+
+    // deeper than the leaf
+    assert_false(merkle_get_subtree(5, 3, 4, &start, &size));
+    assert_false(merkle_get_subtree(5, 4, 2, &start, &size));
+
+    // invalid leaf index
+    assert_false(merkle_get_subtree(5, 5, 0, &start, &size));
+}
+
+static void test_merkle_node_cache_find(void **state) {
+    (void) state;
+
+    merkle_node_cache_t cache;
+    merkle_node_cache_init(&cache);
+
+    uint8_t hash[32] = {0x01};
+    int depth = -1;
+
+    assert_int_equal(merkle_node_cache_find(&cache, root_a, 5, 3, &depth), -1);
+
+    merkle_node_cache_add(&cache, root_a, 0, 4, hash);
+    assert_int_equal(merkle_node_cache_find(&cache, root_a, 5, 3, &depth), 0);
+    assert_int_equal(depth, 1);
+
+    // not in the subtree
+    assert_int_equal(merkle_node_cache_find(&cache, root_a, 5, 4, &depth), -1);
+    // different tree
+    assert_int_equal(merkle_node_cache_find(&cache, root_b, 5, 3, &depth), -1);
+    // the whole tree is never returned
+    assert_int_equal(merkle_node_cache_find(&cache, root_a, 4, 3, &depth), -1);
+
+    // the deepest node is returned
+    hash[0] = 0x02;
+    merkle_node_cache_add(&cache, root_a, 2, 2, hash);
+    assert_int_equal(merkle_node_cache_find(&cache, root_a, 5, 3, &depth), 1);
+    assert_int_equal(depth, 2);
+    assert_int_equal(cache.entries[1].hash[0], 0x02);
+
+    assert_int_equal(merkle_node_cache_find(&cache, root_a, 5, 1, &depth), 0);
+    assert_int_equal(depth, 1);
+
+    // nodes that are not on the path for the claimed tree size are not returned
+    merkle_node_cache_init(&cache);
+    merkle_node_cache_add(&cache, root_a, 1, 2, hash);
+    assert_int_equal(merkle_node_cache_find(&cache, root_a, 5, 1, &depth), -1);
+}
+
+static void test_merkle_node_cache_add(void **state) {
+    (void) state;
+
+    merkle_node_cache_t cache;
+    merkle_node_cache_init(&cache);
+
+    uint8_t hash[32] = {0};
+    int depth;
+
+    // adding the same node twice has no effect
+    merkle_node_cache_add(&cache, root_a, 0, 2, hash);
+    merkle_node_cache_add(&cache, root_a, 0, 2, hash);
+    assert_int_equal(cache.n_entries, 1);
+
+    // the same node position in a different tree is a different node
+    merkle_node_cache_add(&cache, root_b, 0, 2, hash);
+    assert_int_equal(cache.n_entries, 2);
+
+    for (uint32_t i = 2; i < MERKLE_NODE_CACHE_SIZE; i++) {
+        merkle_node_cache_add(&cache, root_a, 2 * i, 2, hash);
+    }
+    assert_int_equal(cache.n_entries, MERKLE_NODE_CACHE_SIZE);
+    assert_int_equal(merkle_node_cache_find(&cache, root_a, 64, 1, &depth), 0);
+
+    // once full, the oldest entry is replaced
+    merkle_node_cache_add(&cache, root_a, 62, 2, hash);
+    assert_int_equal(cache.n_entries, MERKLE_NODE_CACHE_SIZE);
+    assert_int_equal(merkle_node_cache_find(&cache, root_a, 64, 1, &depth), -1);
+    assert_int_equal(merkle_node_cache_find(&cache, root_a, 64, 63, &depth), 0);
+    assert_int_equal(depth, 5);
+    assert_int_equal(merkle_node_cache_find(&cache, root_b, 64, 1, &depth), 1);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {cmocka_unit_test(test_merkle_get_subtree),
+                                       cmocka_unit_test(test_merkle_node_cache_find),
+                                       cmocka_unit_test(test_merkle_node_cache_add)};
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -73,8 +73,7 @@ static void test_get_script_type_invalid(void **state) {
                             0x05,   0x06,       0x07,           0x08,        0x09,  0x0a, 0x0b,
                             0x0c,   0x0d,       0x0e,           0x0f,        0x10,  0x11, 0x12,
                             0x13,   0x14,       OP_EQUALVERIFY, OP_CHECKSIG, OP_NOP};  // extra byte
-    //RVN can have more at end
-    //assert_int_equal(get_script_type(p2pkh_long, sizeof(p2pkh_long)), -1);
+    assert_int_equal(get_script_type(p2pkh_long, sizeof(p2pkh_long)), -1);
 
     uint8_t p2sh_short[] = {OP_HASH160, 0x14, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
                             0x07,       0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
@@ -84,8 +83,7 @@ static void test_get_script_type_invalid(void **state) {
     uint8_t p2sh_long[] = {OP_HASH160, 0x14, 0x01, 0x02, 0x03,     0x04,  0x05, 0x06, 0x07,
                            0x08,       0x09, 0x0a, 0x0b, 0x0c,     0x0d,  0x0e, 0x0f, 0x10,
                            0x11,       0x12, 0x13, 0x14, OP_EQUAL, OP_NOP};  // extra byte
-    //RVN can have more at end 
-    //assert_int_equal(get_script_type(p2sh_long, sizeof(p2sh_long)), -1);
+    assert_int_equal(get_script_type(p2sh_long, sizeof(p2sh_long)), -1);
 
     /*
     uint8_t p2wpkh_short[] = {
@@ -816,6 +814,219 @@ uint8_t p2pkh_asset_transfer_big_name[] = {73, OP_DUP, OP_HASH160, 0x14, 0x01, 0
 
 }
 
+// the hash160 of the P2PKH and P2SH scripts, and of the address of tags
+#define HASH160                                                                                 \
+    0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, \
+        0x10, 0x11, 0x12, 0x13, 0x14
+#define P2PKH_PREFIX OP_DUP, OP_HASH160, 0x14, HASH160, OP_EQUALVERIFY, OP_CHECKSIG
+#define P2SH_PREFIX  OP_HASH160, 0x14, HASH160, OP_EQUAL
+#define RVN          'r', 'v', 'n'
+#define NAME_3       'T', 'S', 'T'
+#define NAME_30      NAME_3, NAME_3, NAME_3, NAME_3, NAME_3, NAME_3, NAME_3, NAME_3, NAME_3, NAME_3
+#define NAME_31      NAME_30, 'T'
+#define AMOUNT_1     0x00, 0xe1, 0xf5, 0x05, 0x00, 0x00, 0x00, 0x00  // 100000000
+#define IPFS_HASH                                                                               \
+    0x12, 0x20, 0x84, 0x43, 0xbc, 0xbb, 0x6a, 0x01, 0x18, 0xae, 0xbf, 0xcf, 0xe9, 0x1c, 0x12, \
+        0x5d, 0x6e, 0x58, 0xa8, 0x76, 0x93, 0xb7, 0x3d, 0x08, 0xf7, 0x7d, 0x77, 0xf6, 0xe7,   \
+        0x8f, 0xa2, 0x29, 0x56, 0x3c
+
+#define CHECK_VALID_ASSET(script, type_, base_script_len_, name_, amount_)          \
+    {                                                                               \
+        asset_script_t asset;                                                       \
+        assert_int_equal(parse_asset_script(script, sizeof(script), &asset), type_); \
+        assert_int_equal(asset.type, type_);                                        \
+        assert_int_equal(asset.base_script_len, base_script_len_);                  \
+        assert_int_equal(asset.name_len, strlen(name_));                            \
+        assert_memory_equal(asset.name, name_, strlen(name_));                      \
+        assert_int_equal(asset.amount, amount_);                                    \
+    }
+
+#define CHECK_INVALID_ASSET(script)                                               \
+    {                                                                             \
+        asset_script_t asset;                                                     \
+        assert_int_equal(parse_asset_script(script, sizeof(script), &asset), -1); \
+    }
+
+static void test_parse_asset_script_valid(void **state) {
+    (void) state;
+
+    const char name_31[] = "TSTTSTTSTTSTTSTTSTTSTTSTTSTTSTT";
+
+    uint8_t transfer[] = {P2PKH_PREFIX, OP_RVN_ASSET, 16, RVN, 't', 3, NAME_3, AMOUNT_1, OP_DROP};
+    CHECK_VALID_ASSET(transfer, ASSET_SCRIPT_TRANSFER, 25, "TST", 100000000);
+
+    uint8_t p2sh_transfer[] =
+        {P2SH_PREFIX, OP_RVN_ASSET, 44, RVN, 't', 31, NAME_31, AMOUNT_1, OP_DROP};
+    CHECK_VALID_ASSET(p2sh_transfer, ASSET_SCRIPT_TRANSFER, 23, name_31, 100000000);
+
+    uint8_t transfer_message[] =
+        {P2PKH_PREFIX, OP_RVN_ASSET, 50, RVN, 't', 3, NAME_3, AMOUNT_1, IPFS_HASH, OP_DROP};
+    CHECK_VALID_ASSET(transfer_message, ASSET_SCRIPT_TRANSFER, 25, "TST", 100000000);
+
+    // the longest asset script, with OP_PUSHDATA1
+    uint8_t transfer_message_expire[] = {P2PKH_PREFIX,
+                                         OP_RVN_ASSET,
+                                         OP_PUSHDATA1,
+                                         86,
+                                         RVN,
+                                         't',
+                                         31,
+                                         NAME_31,
+                                         AMOUNT_1,
+                                         IPFS_HASH,
+                                         0x80, 0x8d, 0x5b, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                         OP_DROP};
+    assert_int_equal(sizeof(transfer_message_expire), MAX_ASSET_SCRIPTPUBKEY_LEN);
+    CHECK_VALID_ASSET(transfer_message_expire, ASSET_SCRIPT_TRANSFER, 25, name_31, 100000000);
+
+    uint8_t owner[] = {P2PKH_PREFIX, OP_RVN_ASSET, 9, RVN, 'o', 4, NAME_3, '!', OP_DROP};
+    CHECK_VALID_ASSET(owner, ASSET_SCRIPT_OWNER, 25, "TST!", ASSET_OWNER_AMOUNT);
+
+    uint8_t new[] =
+        {P2PKH_PREFIX, OP_RVN_ASSET, 19, RVN, 'q', 3, NAME_3, AMOUNT_1, 0, 1, 0, OP_DROP};
+    CHECK_VALID_ASSET(new, ASSET_SCRIPT_NEW, 25, "TST", 100000000);
+
+    uint8_t new_ipfs[] = {P2PKH_PREFIX,
+                          OP_RVN_ASSET,
+                          OP_PUSHDATA1,
+                          81,
+                          RVN,
+                          'q',
+                          31,
+                          NAME_31,
+                          AMOUNT_1,
+                          8,
+                          1,
+                          1,
+                          IPFS_HASH,
+                          OP_DROP};
+    CHECK_VALID_ASSET(new_ipfs, ASSET_SCRIPT_NEW, 25, name_31, 100000000);
+
+    uint8_t reissue[] =
+        {P2SH_PREFIX, OP_RVN_ASSET, 18, RVN, 'r', 3, NAME_3, AMOUNT_1, 0xff, 1, OP_DROP};
+    CHECK_VALID_ASSET(reissue, ASSET_SCRIPT_REISSUE, 23, "TST", 100000000);
+
+    uint8_t reissue_ipfs[] =
+        {P2PKH_PREFIX, OP_RVN_ASSET, 52, RVN, 'r', 3, NAME_3, AMOUNT_1, 2, 0, IPFS_HASH, OP_DROP};
+    CHECK_VALID_ASSET(reissue_ipfs, ASSET_SCRIPT_REISSUE, 25, "TST", 100000000);
+
+    asset_script_t asset;
+
+    uint8_t tag[] = {OP_RVN_ASSET, 0x14, HASH160, 6, 4, '#', NAME_3, 1};
+    CHECK_VALID_ASSET(tag, ASSET_SCRIPT_TAG, 0, "#TST", 0);
+    parse_asset_script(tag, sizeof(tag), &asset);
+    assert_memory_equal(asset.tagged_hash160, tag + 2, 20);
+    assert_int_equal(asset.flag, 1);
+
+    uint8_t verifier[] = {OP_RVN_ASSET, OP_RESERVED, 6, 5, '#', NAME_3, '!'};
+    CHECK_VALID_ASSET(verifier, ASSET_SCRIPT_VERIFIER, 0, "#TST!", 0);
+
+    uint8_t unfreeze[] = {OP_RVN_ASSET, OP_RESERVED, OP_RESERVED, 6, 4, '$', NAME_3, 0};
+    CHECK_VALID_ASSET(unfreeze, ASSET_SCRIPT_GLOBAL_RESTRICTION, 0, "$TST", 0);
+    parse_asset_script(unfreeze, sizeof(unfreeze), &asset);
+    assert_int_equal(asset.flag, 0);
+}
+
+static void test_parse_asset_script_invalid(void **state) {
+    (void) state;
+
+    uint8_t empty[] = {0};  // can't declare 0-length array
+    asset_script_t asset;
+    assert_int_equal(parse_asset_script(empty, 0, &asset), -1);
+
+    uint8_t p2pkh[] = {P2PKH_PREFIX};
+    CHECK_INVALID_ASSET(p2pkh);
+
+    uint8_t p2pkh_no_asset[] = {P2PKH_PREFIX, OP_NOP, 16, RVN, 't', 3, NAME_3, AMOUNT_1, OP_DROP};
+    CHECK_INVALID_ASSET(p2pkh_no_asset);
+
+    uint8_t not_rvn[] =
+        {P2PKH_PREFIX, OP_RVN_ASSET, 16, 'r', 'v', 0, 't', 3, NAME_3, AMOUNT_1, OP_DROP};
+    CHECK_INVALID_ASSET(not_rvn);
+
+    uint8_t wrong_type[] = {P2PKH_PREFIX, OP_RVN_ASSET, 16, RVN, 'x', 3, NAME_3, AMOUNT_1, OP_DROP};
+    CHECK_INVALID_ASSET(wrong_type);
+
+    uint8_t no_drop[] = {P2PKH_PREFIX, OP_RVN_ASSET, 16, RVN, 't', 3, NAME_3, AMOUNT_1};
+    CHECK_INVALID_ASSET(no_drop);
+
+    uint8_t short_name[] =
+        {P2PKH_PREFIX, OP_RVN_ASSET, 15, RVN, 't', 2, 'T', 'S', AMOUNT_1, OP_DROP};
+    CHECK_INVALID_ASSET(short_name);
+
+    uint8_t long_name[] =
+        {P2PKH_PREFIX, OP_RVN_ASSET, 45, RVN, 't', 32, NAME_31, 'T', AMOUNT_1, OP_DROP};
+    CHECK_INVALID_ASSET(long_name);
+
+    uint8_t non_ascii_name[] =
+        {P2PKH_PREFIX, OP_RVN_ASSET, 16, RVN, 't', 3, 'T', 0x80, 'T', AMOUNT_1, OP_DROP};
+    CHECK_INVALID_ASSET(non_ascii_name);
+
+    uint8_t name_past_end[] = {P2PKH_PREFIX, OP_RVN_ASSET, 16, RVN, 't', 31, NAME_3, OP_DROP};
+    CHECK_INVALID_ASSET(name_past_end);
+
+    uint8_t short_amount[] =
+        {P2PKH_PREFIX, OP_RVN_ASSET, 15, RVN, 't', 3, NAME_3, 0, 0xe1, 0xf5, 5, 0, 0, 0, OP_DROP};
+    CHECK_INVALID_ASSET(short_amount);
+
+    uint8_t owner_no_exclamation[] =
+        {P2PKH_PREFIX, OP_RVN_ASSET, 9, RVN, 'o', 4, NAME_3, 'T', OP_DROP};
+    CHECK_INVALID_ASSET(owner_no_exclamation);
+
+    uint8_t owner_amount[] =
+        {P2PKH_PREFIX, OP_RVN_ASSET, 17, RVN, 'o', 4, NAME_3, '!', AMOUNT_1, OP_DROP};
+    CHECK_INVALID_ASSET(owner_amount);
+
+    // the expiration time of a transfer is 8 bytes long
+    uint8_t transfer_short_expire[] = {P2PKH_PREFIX,
+                                       OP_RVN_ASSET,
+                                       54,
+                                       RVN,
+                                       't',
+                                       3,
+                                       NAME_3,
+                                       AMOUNT_1,
+                                       IPFS_HASH,
+                                       0x80, 0x8d, 0x5b, 0x00,
+                                       OP_DROP};
+    CHECK_INVALID_ASSET(transfer_short_expire);
+
+    uint8_t transfer_short_message[] =
+        {P2PKH_PREFIX, OP_RVN_ASSET, 38, RVN, 't', 3, NAME_3, AMOUNT_1, 0x12, HASH160, OP_DROP};
+    CHECK_INVALID_ASSET(transfer_short_message);
+
+    uint8_t new_missing_ipfs[] =
+        {P2PKH_PREFIX, OP_RVN_ASSET, 19, RVN, 'q', 3, NAME_3, AMOUNT_1, 0, 1, 1, OP_DROP};
+    CHECK_INVALID_ASSET(new_missing_ipfs);
+
+    uint8_t new_extra_byte[] =
+        {P2PKH_PREFIX, OP_RVN_ASSET, 20, RVN, 'q', 3, NAME_3, AMOUNT_1, 0, 1, 0, 0, OP_DROP};
+    CHECK_INVALID_ASSET(new_extra_byte);
+
+    uint8_t reissue_extra_byte[] =
+        {P2PKH_PREFIX, OP_RVN_ASSET, 19, RVN, 'r', 3, NAME_3, AMOUNT_1, 0xff, 1, 0, OP_DROP};
+    CHECK_INVALID_ASSET(reissue_extra_byte);
+
+    uint8_t tag_bad_flag[] = {OP_RVN_ASSET, 0x14, HASH160, 6, 4, '#', NAME_3, 2};
+    CHECK_INVALID_ASSET(tag_bad_flag);
+
+    uint8_t tag_no_flag[] = {OP_RVN_ASSET, 0x14, HASH160, 5, 4, '#', NAME_3};
+    CHECK_INVALID_ASSET(tag_no_flag);
+
+    uint8_t tag_long_name[] = {OP_RVN_ASSET, 0x14, HASH160, 34, 32, '#', NAME_31, 1};
+    CHECK_INVALID_ASSET(tag_long_name);
+
+    uint8_t verifier_empty[] = {OP_RVN_ASSET, OP_RESERVED, 1, 0};
+    CHECK_INVALID_ASSET(verifier_empty);
+
+    uint8_t verifier_over_80[] = {OP_RVN_ASSET, OP_RESERVED, 82, 81, NAME_31, NAME_31, NAME_3,
+                                  NAME_3,       NAME_3,      NAME_3, NAME_3, NAME_3,  'T'};
+    CHECK_INVALID_ASSET(verifier_over_80);
+
+    uint8_t freeze_extra_byte[] = {OP_RVN_ASSET, OP_RESERVED, OP_RESERVED, 6, 4, '$', NAME_3, 1, 0};
+    CHECK_INVALID_ASSET(freeze_extra_byte);
+}
+
 static void test_format_opscript_script_invalid(void **state) {
     (void) state;
 
@@ -857,6 +1068,8 @@ int main() {
         cmocka_unit_test(test_format_opscript_script_invalid),
         cmocka_unit_test(test_ravencoin_asset_script_valid),
         cmocka_unit_test(test_ravencoin_asset_script_invalid),
+        cmocka_unit_test(test_parse_asset_script_valid),
+        cmocka_unit_test(test_parse_asset_script_invalid),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,507 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <cmocka.h>
+
+#include "common/tx_parser.h"
+
+#define MAX_TX_SIZE 4096
+
+#define ASSET_SCRIPT_MAX_LENGTH 40
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+// Everything the hooks are called with, to compare with the serialized transaction
+static struct {
+    uint8_t hashed[MAX_TX_SIZE];
+    size_t hashed_length;
+    size_t n_hash_calls;
+    uint32_t n_inputs_end;
+    uint32_t output_amounts_index_mask;
+    uint8_t output_amounts[8][8];
+    bool skip_prevouts;  // the prevouts are read without hashing, and hashed separately
+    uint32_t asset_index_mask;
+    uint32_t asset_lengths[8];
+    uint8_t assets[8][ASSET_SCRIPT_MAX_LENGTH];
+} G_record;
+
+static void record_hash(tx_parser_t *parser, const uint8_t *data, size_t length) {
+    (void) parser;
+
+    assert_true(G_record.hashed_length + length <= sizeof(G_record.hashed));
+    memcpy(G_record.hashed + G_record.hashed_length, data, length);
+    G_record.hashed_length += length;
+    ++G_record.n_hash_calls;
+}
+
+static int record_input_header(tx_parser_t *parser, buffer_t *buffers[2]) {
+    if (!G_record.skip_prevouts) {
+        return tx_parser_read_hashed(parser, buffers, NULL, 36);
+    }
+
+    uint8_t prevout[36];
+    if (!tx_parser_read(parser, buffers, prevout, sizeof(prevout))) {
+        return 0;
+    }
+    tx_parser_hash(parser, prevout, sizeof(prevout));
+    return 1;
+}
+
+static int record_inputs_end(tx_parser_t *parser) {
+    (void) parser;
+
+    ++G_record.n_inputs_end;
+    return 0;
+}
+
+static int record_output_amount(tx_parser_t *parser, const uint8_t *amount) {
+    if (parser->item_index < 8) {
+        memcpy(G_record.output_amounts[parser->item_index], amount, 8);
+        G_record.output_amounts_index_mask |= 1 << parser->item_index;
+    }
+    return 0;
+}
+
+static int reject_sequence(tx_parser_t *parser, const uint8_t *sequence) {
+    (void) parser;
+    (void) sequence;
+
+    return -1;
+}
+
+static const tx_parser_hooks_t record_hooks = {
+    .hash = record_hash,
+    .input_header = record_input_header,
+    .inputs_end = record_inputs_end,
+    .output_amount = record_output_amount,
+};
+
+static int record_output_end(tx_parser_t *parser) {
+    tx_asset_sink_t *asset_sink = parser->asset_sink;
+    if (parser->item_index < 8 && asset_sink != NULL && asset_sink->found) {
+        G_record.asset_index_mask |= 1 << parser->item_index;
+        G_record.asset_lengths[parser->item_index] = asset_sink->script_length;
+        memcpy(G_record.assets[parser->item_index],
+               asset_sink->script,
+               MIN(asset_sink->script_length, asset_sink->script_max_length));
+    }
+    return 0;
+}
+
+// The prevouts are read by the parser
+static const tx_parser_hooks_t sink_hooks = {
+    .hash = record_hash,
+    .output_end = record_output_end,
+};
+
+static const tx_parser_hooks_t reject_sequence_hooks = {
+    .hash = record_hash,
+    .input_header = record_input_header,
+    .input_sequence = reject_sequence,
+};
+
+static size_t write_varint(uint8_t *out, uint32_t value) {
+    if (value < 0xfd) {
+        out[0] = (uint8_t) value;
+        return 1;
+    }
+    out[0] = 0xfd;
+    out[1] = value & 0xff;
+    out[2] = value >> 8;
+    return 3;
+}
+
+// Serializes a legacy transaction with n_inputs and n_outputs, with scripts of various sizes
+// (including some whose size takes a 3-byte varint). Returns the offset of the first output in
+// outputs_offset.
+static size_t make_tx(uint8_t *out, uint32_t n_inputs, uint32_t n_outputs, size_t *outputs_offset) {
+    size_t length = 0;
+
+    memcpy(out, "\x02\x00\x00\x00", 4);
+    length += 4;
+    length += write_varint(out + length, n_inputs);
+    for (uint32_t i = 0; i < n_inputs; i++) {
+        memset(out + length, 0x10 + i, 36);  // prevout
+        length += 36;
+        uint32_t script_size = i % 3 == 2 ? 300 : 25 + i;
+        length += write_varint(out + length, script_size);
+        memset(out + length, 0x76, script_size);
+        length += script_size;
+        memcpy(out + length, "\xfd\xff\xff\xff", 4);  // sequence
+        length += 4;
+    }
+    *outputs_offset = length;
+    length += write_varint(out + length, n_outputs);
+    for (uint32_t i = 0; i < n_outputs; i++) {
+        memset(out + length, 0, 8);
+        out[length] = i + 1;  // amount
+        length += 8;
+        uint32_t script_size = i % 2 == 1 ? 260 : 25;
+        length += write_varint(out + length, script_size);
+        memset(out + length, 0xa9, script_size);
+        length += script_size;
+    }
+    memcpy(out + length, "\x00\x00\x00\x00", 4);  // locktime
+    length += 4;
+    return length;
+}
+
+// Serializes a transaction with one input and the given output scripts
+static size_t make_tx_with_outputs(uint8_t *out,
+                                   const uint8_t *const scripts[],
+                                   const size_t script_lengths[],
+                                   size_t n_outputs) {
+    size_t length = 0;
+
+    memcpy(out, "\x02\x00\x00\x00\x01", 5);  // version and input count
+    length += 5;
+    memset(out + length, 0x42, 36);  // prevout
+    length += 36;
+    out[length++] = 0;  // empty scriptSig
+    memcpy(out + length, "\xff\xff\xff\xff", 4);
+    length += 4;
+    length += write_varint(out + length, n_outputs);
+    for (size_t i = 0; i < n_outputs; i++) {
+        memset(out + length, 0, 8);
+        length += 8;
+        length += write_varint(out + length, script_lengths[i]);
+        memcpy(out + length, scripts[i], script_lengths[i]);
+        length += script_lengths[i];
+    }
+    memcpy(out + length, "\x00\x00\x00\x00", 4);
+    length += 4;
+    return length;
+}
+
+// Serializes in out the legacy transaction tx in the BIP144 format, with a witness of two elements
+// for each input; the last element is longer than the size of some chunks
+static size_t make_segwit_tx(uint8_t *out, const uint8_t *tx, size_t tx_length, uint32_t n_inputs) {
+    size_t length = 0;
+
+    memcpy(out, tx, 4);  // version
+    length += 4;
+    out[length++] = 0x00;  // marker
+    out[length++] = 0x01;  // flag
+    memcpy(out + length, tx + 4, tx_length - 8);  // inputs and outputs
+    length += tx_length - 8;
+    for (uint32_t i = 0; i < n_inputs; i++) {
+        out[length++] = 2;
+        out[length++] = 72;
+        memset(out + length, 0x30, 72);
+        length += 72;
+        out[length++] = 33;
+        memset(out + length, 0x02, 33);
+        length += 33;
+    }
+    memcpy(out + length, tx + tx_length - 4, 4);  // locktime
+    length += 4;
+    return length;
+}
+
+static void reset_record(void) {
+    memset(&G_record, 0, sizeof(G_record));
+}
+
+// Parses the data in chunks of chunk_size bytes, as sent in APDUs; returns the last result
+static int parse_in_chunks(tx_parser_t *parser,
+                           const uint8_t *data,
+                           size_t length,
+                           size_t chunk_size) {
+    int result = 0;
+    for (size_t offset = 0; offset < length && result == 0; offset += chunk_size) {
+        size_t n = length - offset < chunk_size ? length - offset : chunk_size;
+        result = tx_parser_process(parser, data + offset, n);
+    }
+    return result;
+}
+
+static void test_tx_parser_single_chunk(void **state) {
+    (void) state;
+
+    uint8_t tx[MAX_TX_SIZE];
+    size_t outputs_offset;
+    size_t tx_length = make_tx(tx, 4, 3, &outputs_offset);
+
+    tx_parser_t parser;
+    reset_record();
+    tx_parser_init(&parser, &record_hooks, NULL, 0);
+
+    assert_int_equal(tx_parser_process(&parser, tx, tx_length), 1);
+
+    // the whole transaction is hashed, in a single run
+    assert_int_equal(G_record.hashed_length, tx_length);
+    assert_memory_equal(G_record.hashed, tx, tx_length);
+    assert_int_equal(G_record.n_hash_calls, 1);
+
+    assert_int_equal(G_record.n_inputs_end, 1);
+    assert_int_equal(G_record.output_amounts_index_mask, 0x7);
+    for (int i = 0; i < 3; i++) {
+        assert_int_equal(G_record.output_amounts[i][0], i + 1);
+    }
+
+    // any data after the transaction is ignored
+    assert_int_equal(tx_parser_process(&parser, tx, 10), 1);
+    assert_int_equal(G_record.hashed_length, tx_length);
+}
+
+static void test_tx_parser_any_chunk_size(void **state) {
+    (void) state;
+
+    uint8_t tx[MAX_TX_SIZE];
+    size_t outputs_offset;
+    size_t tx_length = make_tx(tx, 5, 4, &outputs_offset);
+
+    for (size_t chunk_size = 1; chunk_size <= 300; chunk_size++) {
+        for (int skip_prevouts = 0; skip_prevouts <= 1; skip_prevouts++) {
+            tx_parser_t parser;
+            reset_record();
+            G_record.skip_prevouts = skip_prevouts;
+            tx_parser_init(&parser, &record_hooks, NULL, 0);
+
+            assert_int_equal(parse_in_chunks(&parser, tx, tx_length, chunk_size), 1);
+
+            assert_int_equal(G_record.hashed_length, tx_length);
+            assert_memory_equal(G_record.hashed, tx, tx_length);
+            assert_int_equal(G_record.output_amounts_index_mask, 0xf);
+            assert_int_equal(G_record.output_amounts[3][0], 4);
+        }
+    }
+}
+
+static void test_tx_parser_inputs_only(void **state) {
+    (void) state;
+
+    uint8_t tx[MAX_TX_SIZE];
+    size_t outputs_offset;
+    size_t tx_length = make_tx(tx, 3, 2, &outputs_offset);
+
+    tx_parser_t parser;
+    reset_record();
+    tx_parser_init(&parser, &record_hooks, NULL, TX_PARSER_INPUTS_ONLY);
+
+    assert_int_equal(parse_in_chunks(&parser, tx, tx_length, 50), 1);
+
+    // nothing is hashed after the inputs
+    assert_int_equal(G_record.hashed_length, outputs_offset);
+    assert_memory_equal(G_record.hashed, tx, outputs_offset);
+    assert_int_equal(G_record.n_inputs_end, 1);
+    assert_int_equal(G_record.output_amounts_index_mask, 0);
+}
+
+static void test_tx_parser_extra_data(void **state) {
+    (void) state;
+
+    uint8_t tx[MAX_TX_SIZE];
+    size_t outputs_offset;
+    size_t tx_length = make_tx(tx, 1, 1, &outputs_offset);
+
+    // the size of the extra data is not hashed
+    memcpy(tx + tx_length, "\x03\xaa\xbb\xcc", 4);
+
+    tx_parser_t parser;
+    reset_record();
+    tx_parser_init(&parser, &record_hooks, NULL, TX_PARSER_EXTRA_DATA);
+
+    assert_int_equal(tx_parser_process(&parser, tx, tx_length + 2), 0);
+    assert_int_equal(tx_parser_process(&parser, tx + tx_length + 2, 2), 1);
+
+    assert_int_equal(G_record.hashed_length, tx_length + 3);
+    assert_memory_equal(G_record.hashed, tx, tx_length);
+    assert_memory_equal(G_record.hashed + tx_length, "\xaa\xbb\xcc", 3);
+
+    // without TX_PARSER_EXTRA_DATA, the extra data is ignored
+    reset_record();
+    tx_parser_init(&parser, &record_hooks, NULL, 0);
+
+    assert_int_equal(tx_parser_process(&parser, tx, tx_length + 4), 1);
+    assert_int_equal(G_record.hashed_length, tx_length);
+}
+
+static void test_tx_parser_segwit(void **state) {
+    (void) state;
+
+    uint8_t tx[MAX_TX_SIZE];
+    size_t outputs_offset;
+    size_t tx_length = make_tx(tx, 3, 2, &outputs_offset);
+
+    uint8_t segwit_tx[MAX_TX_SIZE];
+    size_t segwit_tx_length = make_segwit_tx(segwit_tx, tx, tx_length, 3);
+
+    for (size_t chunk_size = 1; chunk_size <= 120; chunk_size++) {
+        tx_parser_t parser;
+        reset_record();
+        tx_parser_init(&parser, &sink_hooks, NULL, TX_PARSER_SEGWIT);
+
+        assert_int_equal(parse_in_chunks(&parser, segwit_tx, segwit_tx_length, chunk_size), 1);
+
+        // the marker, the flag and the witnesses are not hashed
+        assert_true(parser.is_segwit);
+        assert_int_equal(G_record.hashed_length, tx_length);
+        assert_memory_equal(G_record.hashed, tx, tx_length);
+    }
+
+    // the legacy serialization is accepted as well
+    tx_parser_t parser;
+    reset_record();
+    tx_parser_init(&parser, &sink_hooks, NULL, TX_PARSER_SEGWIT);
+    assert_int_equal(tx_parser_process(&parser, tx, tx_length), 1);
+    assert_false(parser.is_segwit);
+    assert_int_equal(G_record.hashed_length, tx_length);
+
+    // the flag must be 0x01
+    segwit_tx[5] = 0x02;
+    reset_record();
+    tx_parser_init(&parser, &sink_hooks, NULL, TX_PARSER_SEGWIT);
+    assert_int_equal(tx_parser_process(&parser, segwit_tx, segwit_tx_length), -1);
+}
+
+static void test_tx_parser_output_sink(void **state) {
+    (void) state;
+
+    uint8_t tx[MAX_TX_SIZE];
+    size_t outputs_offset;
+    size_t tx_length = make_tx(tx, 2, 4, &outputs_offset);
+
+    for (size_t chunk_size = 1; chunk_size <= 120; chunk_size++) {
+        for (uint32_t index = 0; index <= 4; index++) {
+            uint8_t script[34];
+            memset(script, 0, sizeof(script));
+            tx_output_sink_t output_sink = {.index = index,
+                                            .script = script,
+                                            .script_max_length = sizeof(script)};
+
+            tx_parser_t parser;
+            reset_record();
+            tx_parser_init(&parser, &sink_hooks, NULL, 0);
+            parser.output_sink = &output_sink;
+
+            assert_int_equal(parse_in_chunks(&parser, tx, tx_length, chunk_size), 1);
+
+            if (index == 4) {
+                assert_false(output_sink.found);  // there are only 4 outputs
+                continue;
+            }
+            assert_true(output_sink.found);
+            assert_int_equal(output_sink.amount[0], index + 1);
+            // the scripts of the odd outputs are truncated
+            assert_int_equal(output_sink.script_length, index % 2 == 1 ? 260 : 25);
+            for (size_t i = 0; i < MIN(output_sink.script_length, sizeof(script)); i++) {
+                assert_int_equal(script[i], 0xa9);
+            }
+            if (index % 2 == 0) {
+                assert_int_equal(script[25], 0);
+            }
+        }
+    }
+}
+
+static void test_tx_parser_asset_sink(void **state) {
+    (void) state;
+
+    // transfer of 1 RVN_ASSET to a P2PKH, asset data longer than the sink
+    static const uint8_t p2pkh_transfer[] = {
+        0x76, 0xa9, 0x14, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x88, 0xac, 0xc0, 0x27, 0x72,
+        0x76, 0x6e, 0x74, 0x1a, 'R',  'V',  'N',  '_',  'A',  'S',  'S',  'E',  'T',  '_',
+        'W',  'I',  'T',  'H',  '_',  'A',  '_',  'L',  'O',  'N',  'G',  '_',  'N',  'A',
+        'M',  'E',  0x00, 0xe1, 0xf5, 0x05, 0x00, 0x00, 0x00, 0x00, 0x75};
+    // owner token of ASSET to a P2SH
+    static const uint8_t p2sh_owner[] = {
+        0xa9, 0x14, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22,
+        0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x87, 0xc0,
+        0x0b, 0x72, 0x76, 0x6e, 0x6f, 0x06, 'A',  'S',  'S',  'E',  'T',  '!',  0x75};
+    // tag #KYC of an address (null asset)
+    static const uint8_t tag[] = {0xc0, 0x14, 0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x33,
+                                  0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x33,
+                                  0x33, 0x33, 0x06, 0x04, '#',  'K',  'Y',  'C',  0x01};
+    // P2PKH without asset
+    static const uint8_t p2pkh[] = {0x76, 0xa9, 0x14, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44,
+                                    0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44,
+                                    0x44, 0x44, 0x44, 0x44, 0x44, 0x88, 0xac};
+    // OP_RVN_ASSET after something that is not a P2PKH
+    static const uint8_t not_asset[] = {0x76, 0xa9, 0x14, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+                                        0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+                                        0x55, 0x55, 0x55, 0x55, 0x55, 0x88, 0xad, 0xc0, 0x00};
+
+    const uint8_t *const scripts[] = {p2pkh_transfer, p2pkh, p2sh_owner, not_asset, tag};
+    const size_t script_lengths[] = {sizeof(p2pkh_transfer),
+                                     sizeof(p2pkh),
+                                     sizeof(p2sh_owner),
+                                     sizeof(not_asset),
+                                     sizeof(tag)};
+
+    uint8_t tx[MAX_TX_SIZE];
+    size_t tx_length = make_tx_with_outputs(tx, scripts, script_lengths, 5);
+
+    for (size_t chunk_size = 1; chunk_size <= 120; chunk_size++) {
+        uint8_t asset_script[ASSET_SCRIPT_MAX_LENGTH];
+        tx_asset_sink_t asset_sink = {.script = asset_script,
+                                      .script_max_length = sizeof(asset_script)};
+
+        tx_parser_t parser;
+        reset_record();
+        tx_parser_init(&parser, &sink_hooks, NULL, 0);
+        parser.asset_sink = &asset_sink;
+
+        assert_int_equal(parse_in_chunks(&parser, tx, tx_length, chunk_size), 1);
+        assert_int_equal(G_record.hashed_length, tx_length);
+
+        assert_int_equal(G_record.asset_index_mask, (1 << 0) | (1 << 2) | (1 << 4));
+
+        assert_int_equal(G_record.asset_lengths[0], sizeof(p2pkh_transfer) - 25);
+        assert_memory_equal(G_record.assets[0], p2pkh_transfer + 25, ASSET_SCRIPT_MAX_LENGTH);
+
+        assert_int_equal(G_record.asset_lengths[2], sizeof(p2sh_owner) - 23);
+        assert_memory_equal(G_record.assets[2], p2sh_owner + 23, sizeof(p2sh_owner) - 23);
+
+        assert_int_equal(G_record.asset_lengths[4], sizeof(tag));
+        assert_memory_equal(G_record.assets[4], tag, sizeof(tag));
+    }
+}
+
+static void test_tx_parser_errors(void **state) {
+    (void) state;
+
+    uint8_t tx[MAX_TX_SIZE];
+    size_t outputs_offset;
+    size_t tx_length = make_tx(tx, 2, 1, &outputs_offset);
+
+    tx_parser_t parser;
+
+    // errors of the hooks abort the parsing
+    reset_record();
+    tx_parser_init(&parser, &reject_sequence_hooks, NULL, 0);
+    assert_int_equal(tx_parser_process(&parser, tx, tx_length), -1);
+
+    // 8-byte varints are rejected
+    reset_record();
+    tx_parser_init(&parser, &record_hooks, NULL, 0);
+    tx[4] = 0xff;
+    assert_int_equal(tx_parser_process(&parser, tx, tx_length), -1);
+
+    // the version is incomplete, and kept for the next chunk
+    reset_record();
+    tx_parser_init(&parser, &record_hooks, NULL, 0);
+    assert_int_equal(tx_parser_process(&parser, tx, 3), 0);
+    assert_int_equal(parser.store_length, 3);
+    assert_int_equal(G_record.hashed_length, 0);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_tx_parser_single_chunk),
+        cmocka_unit_test(test_tx_parser_any_chunk_size),
+        cmocka_unit_test(test_tx_parser_inputs_only),
+        cmocka_unit_test(test_tx_parser_extra_data),
+        cmocka_unit_test(test_tx_parser_segwit),
+        cmocka_unit_test(test_tx_parser_output_sink),
+        cmocka_unit_test(test_tx_parser_asset_sink),
+        cmocka_unit_test(test_tx_parser_errors),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}